@@ -0,0 +1,41 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_COMMON_HASH_H_
+#define PHYSIS_COMMON_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace physis {
+
+//! Offset basis of the 64-bit FNV-1a hash.
+static const uint64_t kFNVOffsetBasis = 14695981039346656037ULL;
+
+//! Hashes bytes with 64-bit FNV-1a.
+/*!
+  Not cryptographic; used to name cached files and to find identical
+  generated code.
+
+  \param p The bytes.
+  \param size Number of bytes.
+  \param h Hash of the preceding bytes to continue, or an offset basis.
+  \return The hash.
+ */
+inline uint64_t HashFNV1a(const void *p, size_t size,
+                          uint64_t h=kFNVOffsetBasis) {
+  const unsigned char *c = (const unsigned char*)p;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ c[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+inline uint64_t HashFNV1a(const std::string &s,
+                          uint64_t h=kFNVOffsetBasis) {
+  return HashFNV1a(s.data(), s.size(), h);
+}
+
+} // namespace physis
+
+#endif /* PHYSIS_COMMON_HASH_H_ */
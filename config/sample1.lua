@@ -3,3 +3,14 @@ MPI_OVERLAP = true
 MULTISTREAM_BOUNDARY = true
 -- TRACE_KERNEL = false
 -- CUDA_KERNEL_ERROR_CHECK = false
+-- TILE_SCHEDULER = false
+-- REF_GRID_LAYOUT = {PSGrid3DPoint = "soa", PSGrid3DFloat = "redblack"}
+-- REF_GRID_STORAGE_TYPE = {PSGrid3DDouble = "float", PSGrid3DFloat = "bfloat16"}
+-- JIT_SPECIALIZE = false
+-- OPT_STREAMING = true
+-- OPT_GRID_LIVENESS = true
+-- OPT_STENCIL_FACTORING = true
+-- MPI_SPMD = true
+-- REF_FUSE_REDUCTION = true
+-- REF_ACTIVITY_MASK = true
+-- MPI_DEEP_HALO = true
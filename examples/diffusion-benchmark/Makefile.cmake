@@ -134,10 +134,12 @@ physis-cuda: $(PHYSIS_BUILD_DIR) $(PHYSIS_BUILD_DIR)/diffusion3d_physis.cuda.exe
 .PHONY: physis-cuda_at
 physis-cuda_at: physis-cuda
 	$(MAKE) physis-cuda_at_dynamiclinklibraries
+# Number of variants compiled concurrently
+AT_JOBS ?= $(shell nproc 2>/dev/null || echo 1)
 CUDA_DL:= $(patsubst %.cu,%.so,$(wildcard $(PHYSIS_BUILD_DIR)/diffusion3d_physis.*.cuda_dl.cu))
 .PHONY: physis-cuda_at_dynamiclinklibraries
 physis-cuda_at_dynamiclinklibraries:
-	[ "" = "$(CUDA_DL)" ] || $(MAKE) $(CUDA_DL)
+	[ "" = "$(CUDA_DL)" ] || $(MAKE) -j$(AT_JOBS) $(CUDA_DL)
 %.cuda_dl.o: %.cuda_dl.cu 
 	$(NVCC) -c $< $(NVCC_CFLAGS) -I@CMAKE_INSTALL_PREFIX@/include -o $@ -Xcompiler -fPIC
 %.cuda_dl.so: %.cuda_dl.o
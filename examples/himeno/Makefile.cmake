@@ -42,10 +42,12 @@ himenobmtxpa_physis.cuda.exe: himenobmtxpa_physis.cuda.o
 
 cuda_at: cuda
 	$(MAKE) cuda_at_dynamiclinklibraries
+# Number of variants compiled concurrently
+AT_JOBS ?= $(shell nproc 2>/dev/null || echo 1)
 CUDA_DL:= $(patsubst %.cu,%.so,$(wildcard himenobmtxpa_physis.*.cuda_dl.cu))
 .PHONY: cuda_at_dynamiclinklibraries
 cuda_at_dynamiclinklibraries:
-	[ "" = "$(CUDA_DL)" ] || $(MAKE) $(CUDA_DL)
+	[ "" = "$(CUDA_DL)" ] || $(MAKE) -j$(AT_JOBS) $(CUDA_DL)
 %.cuda_dl.o: %.cuda_dl.cu
 	nvcc -c $^ $(NVCC_CFLAGS) -Xcompiler -fPIC
 %.cuda_dl.so: %.cuda_dl.o
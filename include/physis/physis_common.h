@@ -28,6 +28,8 @@
 // translator. Reorganization should be applied.
 
 #define PS_MAX_DIM (3)
+//! Ratio of the sizes of a grid and the grid coarsened from it
+#define PS_COARSEN_FACTOR (2)
 
 //#define PHYSIS_INDEX_INT64
 // Index type is 32-bit int by default
@@ -82,6 +84,121 @@ extern "C" {
 
   extern void PSGridCopyin(void *g, const void *src_array);
   extern void PSGridCopyout(void *g, void *dst_array);
+  //! Copies out a strided view of a grid.
+  /*!
+    Point i of the view is point offset + i * stride of the grid,
+    e.g., a plane at z=k of an NxN grid is given by offset {0, 0, k},
+    size {N, N, 1}, and stride {1, 1, 1}. Only the processes holding
+    points of the view send them, so the cost is proportional to the
+    size of the view. Supported by the reference and MPI runtimes;
+    the others abort.
+
+    \param g The grid to copy out.
+    \param dst_array The destination of the points of the view.
+    \param offset The first point of the view.
+    \param size The number of points of the view along each dimension.
+    \param stride The distance of the points along each dimension.
+   */
+  extern void PSGridCopyoutView(void *g, void *dst_array,
+                                const PSVectorInt offset,
+                                const PSVectorInt size,
+                                const PSVectorInt stride);
+
+  //! Handle of an asynchronous task; 0 refers to no task.
+  typedef int PSTask;
+  //! Copies out a grid asynchronously.
+  /*!
+    The copy runs in the background and is ordered with the stencil
+    runs and other asynchronous tasks accessing the grid, so later
+    runs modifying the grid do not start before the copy is
+    done. Supported by the reference and MPI runtimes. The MPI
+    runtime copies the subgrids into staging buffers before
+    returning, so later runs proceed while they are gathered.
+    Other runtimes abort, and PSWait and PSWaitAll do nothing there.
+
+    Only copyouts and reductions are tasks. Stencil runs and halo
+    exchanges are still executed synchronously by the host thread,
+    which overlaps them with the pending tasks.
+
+    \param g The grid to copy out.
+    \param dst_array The destination, which must not be accessed
+    until the task is waited for with PSWait.
+    \return The handle of the task.
+   */
+  extern PSTask PSGridCopyoutAsync(void *g, void *dst_array);
+  //! Waits for an asynchronous task to complete.
+  extern void PSWait(PSTask t);
+  //! Waits for all asynchronous tasks to complete.
+  extern void PSWaitAll();
+  //! Tracks which tiles of a grid change.
+  /*!
+    Stencils emitting the grid that are run with the activity mask
+    enabled by the translator only compute the tiles within the
+    stencil radius of the tiles of their input grids that have changed
+    since the last run. All the grids of such stencils must be
+    tracked with the same tile size. Supported by the reference
+    runtime for grids stored as is in the AoS layout; a no-op in the
+    other runtimes.
+
+    \param g The grid.
+    \param tile_size Extent of the tiles along each dimension;
+    PHYSIS_ACTIVITY_TILE_SIZE (16 by default) if not positive.
+    \param threshold Points changing by no more than this are
+    considered unchanged; zero gives the same results as computing
+    all the points.
+   */
+  extern void PSGridTrackActivity(void *g, PSIndex tile_size,
+                                  double threshold);
+  //! Marks a region of a tracked grid changed.
+  /*!
+    Needed when the stencils emitting the grid are affected by
+    anything other than the grids and arguments of the stencils.
+
+    \param g The grid.
+    \param offset The first point of the region.
+    \param size The size of the region.
+   */
+  extern void PSGridMarkActive(void *g, PSVectorInt offset,
+                               PSVectorInt size);
+  //! Restricts a grid to the grid coarsened from it.
+  /*!
+    Each point of the coarse grid is set to the average of the points
+    of the fine grid it covers. The coarse grid must be created with
+    PSGrid3DCoarsen or its variants from a grid of the same type.
+    Only primitive point types are supported. Supported by the
+    reference and MPI runtimes; the others abort.
+
+    \param coarse The coarse grid.
+    \param fine The fine grid.
+   */
+  extern void PSGridRestrict(void *coarse, void *fine);
+  //! Prolongs a coarsened grid to the grid it is coarsened from.
+  /*!
+    Each point of the fine grid is set to, or incremented by, the
+    point of the coarse grid covering it. Supported by the same
+    runtimes as PSGridRestrict.
+
+    \param fine The fine grid.
+    \param coarse The coarse grid.
+    \param accumulate Non-zero to add to the fine grid, e.g., to
+    apply a coarse-grid correction.
+   */
+  extern void PSGridProlong(void *fine, void *coarse, int accumulate);
+  //! Widens the halo of a grid to exchange it less often.
+  /*!
+    The halo is allocated depth times wider than the stencils need,
+    so that one exchange serves several stencil runs, which compute
+    the points of the halo redundantly in between. The stencils
+    reading and writing the grid must be translated with
+    MPI_DEEP_HALO, and all the grids they access need a deep halo
+    for the halo to be reused. Supported by the MPI runtime for grids
+    spanning all processes without periodic access; a no-op in the
+    other runtimes.
+
+    \param g The grid.
+    \param depth Number of stencil widths held by the halo.
+   */
+  extern void PSGridSetHaloDepth(void *g, int depth);
   //extern int PSGridDim(void *g, int d);
   extern void PSGridFree(void *p);  
 
@@ -157,13 +274,71 @@ extern "C" {
     int size;
     int rank;
     int dim[PS_GRID_USER_TYPE_MAX_ARRAY_RANK];
+    //! Byte offset of the member in the point type
+    int offset;
   } __PSGridTypeMemberInfo;
+
+  //! Array-of-structures layout, i.e., the point type as is
+#define PS_GRID_LAYOUT_AOS (0)
+  //! Structure-of-arrays layout
+#define PS_GRID_LAYOUT_SOA (-1)
+  //! Checkerboard layout of primitive types for red-black stencils
+  /*!
+    Red points, whose indices sum to an even number, are stored in
+    the first half of the grid and black points in the second half,
+    each compacted along the first dimension.
+   */
+#define PS_GRID_LAYOUT_RED_BLACK (-2)
+
+  //! Grid read at the points computed by a stencil
+#define PS_GRID_ACCESS_READ (1)
+  //! Grid written by a stencil
+#define PS_GRID_ACCESS_WRITE (2)
+  
   typedef struct {
     PSType type;
     int size;
     int num_members;
     __PSGridTypeMemberInfo *members;
+    //! Layout of points
+    /*!
+      PS_GRID_LAYOUT_AOS, PS_GRID_LAYOUT_SOA, or the number of points
+      in each block of the AoSoA layout. PS_GRID_LAYOUT_RED_BLACK is
+      used only with primitive types. Only the reference runtime
+      supports layouts other than AoS.
+     */
+    int layout;
+    //! Size of the storage type of reduced-precision grids
+    /*!
+      Zero if points are stored in the point type itself. Otherwise,
+      float and double grids are stored in storage_type and converted
+      to the point type when read, e.g., a double grid stored as
+      PS_FLOAT or a float grid stored as PS_BFLOAT16. Only the
+      reference runtime supports reduced-precision storage.
+     */
+    int storage_size;
+    PSType storage_type;
   } __PSGridTypeInfo;
+
+  //! Converts a float to bfloat16 with round-to-nearest-even.
+  static inline uint16_t __PSFloatToBFloat16(float v) {
+    uint32_t x;
+    memcpy(&x, &v, sizeof(x));
+    // Keep NaNs quiet instead of rounding them to infinity
+    if ((x & 0x7fffffffu) > 0x7f800000u) {
+      return (uint16_t)((x >> 16) | 0x40u);
+    }
+    x += 0x7fffu + ((x >> 16) & 1u);
+    return (uint16_t)(x >> 16);
+  }
+
+  //! Converts a bfloat16 to float, which is exact.
+  static inline float __PSBFloat16ToFloat(uint16_t v) {
+    uint32_t x = (uint32_t)v << 16;
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+  }
   
 #define INVALID_GRID (NULL)
 
@@ -42,7 +42,27 @@ extern "C" {
   extern PSIndex PSGridDim(void *p, int d);
 #endif
 
+  //! Initializes the runtime in the SPMD mode.
+  /*!
+    Takes the same arguments as PSInit. All processes run the host
+    code and call the runtime directly rather than the root process
+    notifying the others of each call.
+   */
+  extern void __PSInitSPMD(int *argc, char ***argv, int grid_num_dims, ...);
   extern void __PSDomainSetLocalSize(__PSDomain *dom);
+  //! Sets the local size of a domain extended into the halo.
+  /*!
+    Called before running a stencil after its neighbor loads. The
+    local domain is extended on the decomposed sides by as many
+    points as the deep halos of the grids allow to compute
+    redundantly; see PSGridSetHaloDepth.
+
+    \param dom The domain of the stencil.
+    \param num_grids Number of grids accessed by the stencil.
+    \param ... Pairs of a grid and its PS_GRID_ACCESS_READ and
+    PS_GRID_ACCESS_WRITE flags.
+   */
+  extern void __PSDomainExtend(__PSDomain *dom, int num_grids, ...);
   extern __PSGridMPI* __PSGridNewMPI(
       __PSGridTypeInfo *type_info, int dim, const PSVectorInt size, int attr,
       const PSVectorInt global_offset,
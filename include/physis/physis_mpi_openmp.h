@@ -18,6 +18,7 @@
 #endif
 
 #include "physis/physis_common.h"
+#include "physis/physis_tile.h"
 
 #ifdef __cplusplus
 extern "C" {
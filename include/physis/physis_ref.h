@@ -7,8 +7,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdarg.h>
+#include <float.h>
+#include <limits.h>
 
 #include "physis/physis_common.h"
+#include "physis/physis_tile.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,6 +24,22 @@ extern "C" {
     int64_t num_elms;
     PSVectorInt dim;
     void *p;
+    //! Layout of points; see __PSGridTypeInfo
+    int layout;
+    int num_members;
+    __PSGridTypeMemberInfo *members;
+    //! Point type and the type points are stored in; see
+    //! __PSGridTypeInfo
+    PSType type;
+    PSType storage_type;
+    //! Width of the ghost layers for periodic access on each side
+    PSVectorInt ghost;
+    //! Allocated size including the ghost layers
+    PSVectorInt real_dim;
+    //! Start of the allocation; p points to the first interior point
+    void *buf;
+    //! Changed tiles if tracked by PSGridTrackActivity; NULL otherwise
+    void *activity;
   } __PSGrid;
 
 #ifndef PHYSIS_USER
@@ -38,39 +58,153 @@ extern "C" {
 #define DeclareGrid1D(name, type) typedef __PSGrid *PSGrid1D##name;
 #define DeclareGrid2D(name, type) typedef __PSGrid *PSGrid2D##name;
 #define DeclareGrid3D(name, type) typedef __PSGrid *PSGrid3D##name;
+#ifdef PHYSIS_JIT_DIM0
+  // Compiled by the runtime for the size of all grids
+  static const PSIndex __PSJITDim[PS_MAX_DIM] = {
+    PHYSIS_JIT_DIM0, PHYSIS_JIT_DIM1, PHYSIS_JIT_DIM2};
+#define PSGridDim(p, d) (__PSJITDim[(d)])
+  // Not used with grids with ghost layers
+#define __PSGridRealDim(p, d) (__PSJITDim[(d)])
+#else
 #define PSGridDim(p, d) (((__PSGrid *)(p))->dim[(d)])  
+#define __PSGridRealDim(p, d) (((__PSGrid *)(p))->real_dim[(d)])
+#endif
 #endif
   
+  //! Creates a grid.
+  /*!
+    \param type_info Point type of the grid.
+    \param num_dims Number of dimensions.
+    \param dim Size of the grid.
+    \param ghost Width of the ghost layers on each side, which are
+    filled with wrapped-around points by __PSGridUpdateGhost so that
+    periodic accesses within the ghost layers can use plain offsets.
+    \return The new grid.
+   */
   extern __PSGrid* __PSGridNew(__PSGridTypeInfo *type_info,
-                               int num_dims, PSVectorInt dim);
+                               int num_dims, PSVectorInt dim,
+                               PSVectorInt ghost);
   extern int __PSGridGetID(__PSGrid *g);
   extern void __PSGridSet(__PSGrid *g, void *buf, ...);
   extern void __PSGridGet(__PSGrid *g, void *buf, ...);
+  //! Copies wrapped-around points into the ghost layers of a grid.
+  extern void __PSGridFillGhost(__PSGrid *g);
+  //! Returns a run function specialized for the size of all grids.
+  /*!
+    \param source Path of the generated source file.
+    \param name Name of the run function.
+    \param openmp True if the generated code uses OpenMP.
+    \return NULL if the generic run function should be used.
+   */
+  extern void *__PSJITLookupRunFunc(const char *source, const char *name,
+                                    int openmp);
+  //! Specialized code is compiled with OpenMP as the generated code.
+  static inline void *__PSJITGetRunFunc(const char *source,
+                                        const char *name) {
+#ifdef _OPENMP
+    return __PSJITLookupRunFunc(source, name, 1);
+#else
+    return __PSJITLookupRunFunc(source, name, 0);
+#endif
+  }
+
+  //! Cache capacity targeted by streaming run functions by default.
+#define PS_STREAMING_CACHE_SIZE (256 * 1024)
+
+  //! Returns the number of rows streamed together along the slowest dimension.
+  /*!
+    Streaming run functions march along the slowest dimension in
+    blocks of rows, so that the window of planes accessed by the
+    stencil stays in the cache while it moves. The block is sized so
+    that the window fits into PHYSIS_STREAMING_CACHE_SIZE bytes
+    (PS_STREAMING_CACHE_SIZE by default).
+
+    \param row_size Number of points in a row.
+    \param window_size Bytes accessed per point of a row in the
+    window of all grids.
+   */
+  static inline int __PSStreamingBlockSize(PSIndex row_size,
+                                           size_t window_size) {
+    static PSIndex cache_size = -1;
+    PSIndex rows;
+    if (cache_size < 0) {
+      const char *s = getenv("PHYSIS_STREAMING_CACHE_SIZE");
+      PSIndex v = s ? (PSIndex)atol(s) : 0;
+      cache_size = v > 0 ? v : PS_STREAMING_CACHE_SIZE;
+    }
+    if (row_size < 1 || window_size < 1) return 1;
+    rows = cache_size / (row_size * (PSIndex)window_size);
+    return rows > 1 ? (int)rows : 1;
+  }
 
   static inline PSIndex __PSGridGetOffset1D(__PSGrid *g, PSIndex i1) {
     return i1;
   }
   static inline PSIndex __PSGridGetOffset2D(__PSGrid *g, PSIndex i1,
                                      PSIndex i2) {
-    return i1 + i2 * PSGridDim(g, 0);
+    return i1 + i2 * __PSGridRealDim(g, 0);
   }
   static inline PSIndex __PSGridGetOffset3D(__PSGrid *g, PSIndex i1,
                                      PSIndex i2, PSIndex i3) {
-    return i1 + i2 * PSGridDim(g, 0) + i3 * PSGridDim(g, 0) * PSGridDim(g, 1);
+    return i1 + i2 * __PSGridRealDim(g, 0)
+        + i3 * __PSGridRealDim(g, 0) * __PSGridRealDim(g, 1);
   }
 
+  // Periodic gets of grids with ghost layers wide enough are
+  // translated to the plain offset functions above.
   static inline PSIndex __PSGridGetOffsetPeriodic1D(__PSGrid *g, PSIndex i1) {
     return (i1 + PSGridDim(g, 0)) % PSGridDim(g, 0);
   }
   static inline PSIndex __PSGridGetOffsetPeriodic2D(__PSGrid *g, PSIndex i1,
                                                  PSIndex i2) {
     return __PSGridGetOffsetPeriodic1D(g, i1) +
-        (i2 + PSGridDim(g, 1)) % PSGridDim(g, 1) * PSGridDim(g, 0);
+        (i2 + PSGridDim(g, 1)) % PSGridDim(g, 1) * __PSGridRealDim(g, 0);
   }
   static inline PSIndex __PSGridGetOffsetPeriodic3D(__PSGrid *g, PSIndex i1,
                                                  PSIndex i2, PSIndex i3) {
     return __PSGridGetOffsetPeriodic2D(g, i1, i2) +
-        (i3 + PSGridDim(g, 2)) % PSGridDim(g, 2) * PSGridDim(g, 0) * PSGridDim(g, 1);
+        (i3 + PSGridDim(g, 2)) % PSGridDim(g, 2) *
+        __PSGridRealDim(g, 0) * __PSGridRealDim(g, 1);
+  }
+
+  // Offsets in the red-black layout, where the red and black points
+  // of each row are stored at half the index along the first
+  // dimension in the first and second halves of the grid. Grids in
+  // this layout have no ghost layer.
+  static inline PSIndex __PSGridGetOffsetRB1D(__PSGrid *g, PSIndex i1) {
+    return (i1 >> 1) + (i1 & 1) * ((PSGridDim(g, 0) + 1) >> 1);
+  }
+  static inline PSIndex __PSGridGetOffsetRB2D(__PSGrid *g, PSIndex i1,
+                                              PSIndex i2) {
+    PSIndex hx = (PSGridDim(g, 0) + 1) >> 1;
+    return (i1 >> 1) + i2 * hx + ((i1 + i2) & 1) * hx * PSGridDim(g, 1);
+  }
+  static inline PSIndex __PSGridGetOffsetRB3D(__PSGrid *g, PSIndex i1,
+                                              PSIndex i2, PSIndex i3) {
+    PSIndex hx = (PSGridDim(g, 0) + 1) >> 1;
+    return (i1 >> 1) + (i2 + i3 * PSGridDim(g, 1)) * hx +
+        ((i1 + i2 + i3) & 1) * hx * PSGridDim(g, 1) * PSGridDim(g, 2);
+  }
+  static inline PSIndex __PSGridGetOffsetPeriodicRB1D(__PSGrid *g,
+                                                      PSIndex i1) {
+    return __PSGridGetOffsetRB1D(
+        g, (i1 + PSGridDim(g, 0)) % PSGridDim(g, 0));
+  }
+  static inline PSIndex __PSGridGetOffsetPeriodicRB2D(__PSGrid *g,
+                                                      PSIndex i1,
+                                                      PSIndex i2) {
+    return __PSGridGetOffsetRB2D(
+        g, (i1 + PSGridDim(g, 0)) % PSGridDim(g, 0),
+        (i2 + PSGridDim(g, 1)) % PSGridDim(g, 1));
+  }
+  static inline PSIndex __PSGridGetOffsetPeriodicRB3D(__PSGrid *g,
+                                                      PSIndex i1,
+                                                      PSIndex i2,
+                                                      PSIndex i3) {
+    return __PSGridGetOffsetRB3D(
+        g, (i1 + PSGridDim(g, 0)) % PSGridDim(g, 0),
+        (i2 + PSGridDim(g, 1)) % PSGridDim(g, 1),
+        (i3 + PSGridDim(g, 2)) % PSGridDim(g, 2));
   }
 
   typedef void (*ReducerFunc)();
@@ -95,7 +229,218 @@ extern "C" {
                                 __PSGrid *g);
   extern void __PSReduceGridLong(void *buf, enum PSReduceOp op,
                                  __PSGrid *g);
-  
+
+  //! Reduces a grid asynchronously.
+  /*!
+    \return The handle of the reduction task.
+   */
+  extern PSTask __PSReduceGridFloatAsync(void *buf, enum PSReduceOp op,
+                                         __PSGrid *g);
+  extern PSTask __PSReduceGridDoubleAsync(void *buf, enum PSReduceOp op,
+                                          __PSGrid *g);
+  extern PSTask __PSReduceGridIntAsync(void *buf, enum PSReduceOp op,
+                                       __PSGrid *g);
+  extern PSTask __PSReduceGridLongAsync(void *buf, enum PSReduceOp op,
+                                        __PSGrid *g);
+  //! Reduces the points of a grid outside a domain into a partial result.
+  /*!
+    Completes reductions fused into run kernels, which reduce the
+    points of the domain while the stencil is applied. Only grids of
+    the AoS layout stored in the point type are supported.
+
+    \param buf The result of the points inside the domain, which is
+    updated with the points outside.
+    \param op A binary operator to reduce elements.
+    \param g A grid.
+    \param dom The domain reduced by the run kernel.
+   */
+  extern void __PSReduceGridOutsideFloat(void *buf, enum PSReduceOp op,
+                                         __PSGrid *g, const __PSDomain *dom);
+  extern void __PSReduceGridOutsideDouble(void *buf, enum PSReduceOp op,
+                                          __PSGrid *g, const __PSDomain *dom);
+  extern void __PSReduceGridOutsideInt(void *buf, enum PSReduceOp op,
+                                       __PSGrid *g, const __PSDomain *dom);
+  extern void __PSReduceGridOutsideLong(void *buf, enum PSReduceOp op,
+                                        __PSGrid *g, const __PSDomain *dom);
+  //! Returns the identity of a reduction operator.
+  /*!
+    Initial values of the accumulators of fused reductions.
+   */
+  static inline float __PSReduceIdentityFloat(enum PSReduceOp op) {
+    return op == PS_SUM ? 0.0f : op == PS_PROD ? 1.0f :
+        op == PS_MAX ? -FLT_MAX : FLT_MAX;
+  }
+  static inline double __PSReduceIdentityDouble(enum PSReduceOp op) {
+    return op == PS_SUM ? 0.0 : op == PS_PROD ? 1.0 :
+        op == PS_MAX ? -DBL_MAX : DBL_MAX;
+  }
+  static inline int __PSReduceIdentityInt(enum PSReduceOp op) {
+    return op == PS_SUM ? 0 : op == PS_PROD ? 1 :
+        op == PS_MAX ? INT_MIN : INT_MAX;
+  }
+  static inline long __PSReduceIdentityLong(enum PSReduceOp op) {
+    return op == PS_SUM ? 0L : op == PS_PROD ? 1L :
+        op == PS_MAX ? LONG_MIN : LONG_MAX;
+  }
+  //! Waits for the asynchronous tasks reading a grid.
+  /*!
+    Called by run functions before modifying the grid.
+   */
+  extern void __PSGridWait(__PSGrid *g);
+  //! Records that a kernel call modified a grid.
+  /*!
+    Called by run functions after each kernel call that does not go
+    through __PSRunTilesActive, so that the activity mask of the grid,
+    if tracked, does not miss the changes.
+   */
+  extern void __PSGridMarkWritten(__PSGrid *g);
+
+  //! Plans a stencil run over the tiles affected by changed inputs.
+  /*!
+    \param run_tile Callback that runs the stencil.
+    \param stencil Stencil struct whose first member is __PSDomain.
+    \param stencil_size Size of the stencil struct.
+    \param width Stencil radius; negative if unknown.
+    \param read Bit mask of the grids read by the stencil.
+    \param written Bit mask of the grids emitted by the stencil.
+    \param num_grids Number of grids.
+    \param grids The grids of the stencil.
+    \param num_tiles Receives the number of tiles to compute.
+    \param buf_size Receives the size of the buffer needed per tile.
+    \return The plan, or NULL if the whole domain must be computed.
+   */
+  extern void *__PSActivityBegin(__PSRunTileFunc run_tile,
+                                 const void *stencil, size_t stencil_size,
+                                 int width, int read, int written,
+                                 int num_grids, __PSGrid **grids,
+                                 PSIndex *num_tiles, size_t *buf_size);
+  //! Narrows the domain to a planned tile and saves its points.
+  extern void __PSActivityBeginTile(void *plan, PSIndex tile,
+                                    __PSDomain *dom, void *buf);
+  //! Records whether the points of a tile have changed.
+  extern void __PSActivityEndTile(void *plan, PSIndex tile, void *buf);
+  extern void __PSActivityEnd(void *plan);
+
+  //! Runtime functions called by run functions.
+  /*!
+    Run functions specialized by __PSJITGetRunFunc are loaded from a
+    shared object that does not see the symbols of the executable, so
+    they call the runtime through this table, which is filled when
+    the object is loaded.
+   */
+  typedef struct {
+    void (*GridFillGhost)(__PSGrid *g);
+    void (*GridWait)(__PSGrid *g);
+    void (*GridMarkWritten)(__PSGrid *g);
+    void (*ReduceGridOutsideFloat)(void *buf, enum PSReduceOp op,
+                                   __PSGrid *g, const __PSDomain *dom);
+    void (*ReduceGridOutsideDouble)(void *buf, enum PSReduceOp op,
+                                    __PSGrid *g, const __PSDomain *dom);
+    void (*ReduceGridOutsideInt)(void *buf, enum PSReduceOp op,
+                                 __PSGrid *g, const __PSDomain *dom);
+    void (*ReduceGridOutsideLong)(void *buf, enum PSReduceOp op,
+                                  __PSGrid *g, const __PSDomain *dom);
+    void *(*ActivityBegin)(__PSRunTileFunc run_tile,
+                           const void *stencil, size_t stencil_size,
+                           int width, int read, int written,
+                           int num_grids, __PSGrid **grids,
+                           PSIndex *num_tiles, size_t *buf_size);
+    void (*ActivityBeginTile)(void *plan, PSIndex tile,
+                              __PSDomain *dom, void *buf);
+    void (*ActivityEndTile)(void *plan, PSIndex tile, void *buf);
+    void (*ActivityEnd)(void *plan);
+  } __PSJITRuntime;
+#define PS_JIT_RUNTIME_NAME "__PSJITRuntimeTable"
+
+#ifdef PHYSIS_JIT_DIM0
+  __PSJITRuntime __PSJITRuntimeTable;
+#define __PSGridFillGhost (*__PSJITRuntimeTable.GridFillGhost)
+#define __PSGridWait (*__PSJITRuntimeTable.GridWait)
+#define __PSGridMarkWritten (*__PSJITRuntimeTable.GridMarkWritten)
+#define __PSReduceGridOutsideFloat \
+  (*__PSJITRuntimeTable.ReduceGridOutsideFloat)
+#define __PSReduceGridOutsideDouble \
+  (*__PSJITRuntimeTable.ReduceGridOutsideDouble)
+#define __PSReduceGridOutsideInt (*__PSJITRuntimeTable.ReduceGridOutsideInt)
+#define __PSReduceGridOutsideLong \
+  (*__PSJITRuntimeTable.ReduceGridOutsideLong)
+#define __PSActivityBegin (*__PSJITRuntimeTable.ActivityBegin)
+#define __PSActivityBeginTile (*__PSJITRuntimeTable.ActivityBeginTile)
+#define __PSActivityEndTile (*__PSJITRuntimeTable.ActivityEndTile)
+#define __PSActivityEnd (*__PSJITRuntimeTable.ActivityEnd)
+#endif
+
+  //! Fills the ghost layers of a grid if any.
+  static inline void __PSGridUpdateGhost(__PSGrid *g) {
+    if (g->p != g->buf) __PSGridFillGhost(g);
+  }
+
+  //! Runs a stencil only over the tiles affected by changed inputs.
+  /*!
+    Falls back to __PSRunTiles unless the grids of the stencil are
+    tracked by PSGridTrackActivity. Tiles are run in parallel when
+    compiled with OpenMP.
+
+    \param run_tile Callback that runs the stencil over the domain of
+    the stencil struct.
+    \param stencil Stencil struct whose first member is __PSDomain.
+    \param stencil_size Size of the stencil struct.
+    \param rb Red-black color passed to the callback.
+    \param num_dims Number of dimensions of the domain.
+    \param width Stencil radius; negative if unknown.
+    \param read Bit mask of the grids read by the stencil.
+    \param written Bit mask of the grids emitted by the stencil.
+    \param num_grids Number of grids following this parameter.
+   */
+  static inline void __PSRunTilesActive(__PSRunTileFunc run_tile,
+                                        const void *stencil,
+                                        size_t stencil_size,
+                                        int rb, int num_dims, int width,
+                                        int read, int written,
+                                        int num_grids, ...) {
+    __PSGrid *grids[sizeof(int) * 8];
+    PSIndex num_tiles, tile;
+    size_t buf_size;
+    void *plan;
+    va_list vl;
+    int i;
+    PSAssert(num_grids <= (int)(sizeof(grids) / sizeof(grids[0])));
+    va_start(vl, num_grids);
+    for (i = 0; i < num_grids; ++i) {
+      grids[i] = va_arg(vl, __PSGrid *);
+    }
+    va_end(vl);
+    /* Red-black sweeps of the same stencil are not distinguished */
+    plan = __PSActivityBegin(run_tile, stencil, stencil_size,
+                             rb ? -1 : width, read,
+                             written, num_grids, grids, &num_tiles,
+                             &buf_size);
+    if (plan == NULL) {
+      __PSRunTiles(run_tile, stencil, stencil_size, rb, num_dims);
+      return;
+    }
+#ifdef _OPENMP
+#pragma omp parallel private(tile) if (num_tiles > 1 && !omp_in_parallel())
+#endif
+    {
+      void *tile_stencil = malloc(stencil_size);
+      void *buf = malloc(buf_size);
+      PSAssert(tile_stencil && buf);
+      memcpy(tile_stencil, stencil, stencil_size);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (tile = 0; tile < num_tiles; ++tile) {
+        __PSActivityBeginTile(plan, tile, (__PSDomain *)tile_stencil, buf);
+        run_tile(tile_stencil, rb);
+        __PSActivityEndTile(plan, tile, buf);
+      }
+      free(buf);
+      free(tile_stencil);
+    }
+    __PSActivityEnd(plan);
+  }
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,367 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_PHYSIS_TILE_H_
+#define PHYSIS_PHYSIS_TILE_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "physis/physis_common.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Work-stealing tile scheduler for stencil sweeps.
+ *
+ * The iteration space of a stencil is split into tiles along the two
+ * outermost dimensions (j and k in 3-D), and each tile covers the
+ * whole extent of the innermost dimension. Each thread starts with a
+ * contiguous block of tiles in its own deque, runs them from the
+ * head, and steals from the tail of the deques of other threads once
+ * its own deque is empty. Generated code calls __PSRunTiles with a
+ * run-tile callback that executes the stencil over the domain stored
+ * in the first member of the stencil struct; the domain of each tile
+ * is passed by a copy of the stencil struct whose local_min and
+ * local_max are narrowed to the tile.
+ *
+ * The scheduler is header-only so that it is parallelized only when
+ * the generated code is compiled with OpenMP. Otherwise, or when
+ * called within a parallel region, the callback is called once for
+ * the whole domain.
+ *
+ * The MPI-OpenMP runtime calls __PSRunDivisionTiles instead, which
+ * confines stealing to the threads sharing the NUMA divisions of the
+ * domain.
+ *
+ * The tile extent along the second outermost tiled dimension can be
+ * set with the PHYSIS_TILE_SIZE environment variable.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  //! Runs a stencil over the domain of the given stencil struct.
+  typedef void (*__PSRunTileFunc)(const void *stencil, int rb);
+
+  //! Number of tiles each thread gets on average by default.
+#define PS_TILE_PER_THREAD (16)
+
+  typedef struct {
+    //! Next tile to be run by the owner
+    PSIndex head;
+    //! One past the last tile; thieves take tail-1
+    PSIndex tail;
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+    //! Avoids false sharing between adjacent deques
+    char pad[64];
+  } __PSTileDeque;
+
+  typedef struct {
+    //! Dimension tiled with the given tile size; full extent in j
+    //! (2-D and 3-D) or i (1-D)
+    int inner_dim;
+    //! Dimension tiled with size one; -1 unless 3-D
+    int outer_dim;
+    PSIndex inner_min;
+    PSIndex inner_max;
+    PSIndex inner_tile_size;
+    PSIndex num_inner_tiles;
+    PSIndex outer_min;
+    PSIndex num_tiles;
+  } __PSTileSpace;
+
+  static inline PSIndex __PSTileGetDefaultSize(void) {
+    static PSIndex size = -1;
+    if (size < 0) {
+      const char *s = getenv("PHYSIS_TILE_SIZE");
+      PSIndex v = s ? (PSIndex)atol(s) : 0;
+      size = v > 0 ? v : 0;
+    }
+    return size;
+  }
+
+  //! Computes the tiling of a domain.
+  /*!
+    \return Zero if the domain has no point to compute.
+   */
+  static inline int __PSTileSpaceInit(__PSTileSpace *ts,
+                                      const __PSDomain *dom,
+                                      int num_dims, int num_threads) {
+    int d;
+    PSIndex num_outer = 1, inner_ext, tiles_per_outer, size;
+    for (d = 0; d < num_dims; ++d) {
+      if (dom->local_max[d] <= dom->local_min[d]) return 0;
+    }
+    ts->inner_dim = num_dims >= 2 ? 1 : 0;
+    ts->outer_dim = num_dims >= 3 ? 2 : -1;
+    ts->inner_min = dom->local_min[ts->inner_dim];
+    ts->inner_max = dom->local_max[ts->inner_dim];
+    inner_ext = ts->inner_max - ts->inner_min;
+    ts->outer_min = 0;
+    if (ts->outer_dim >= 0) {
+      ts->outer_min = dom->local_min[ts->outer_dim];
+      num_outer = dom->local_max[ts->outer_dim] - ts->outer_min;
+    }
+    size = __PSTileGetDefaultSize();
+    if (size == 0) {
+      tiles_per_outer = ((PSIndex)num_threads * PS_TILE_PER_THREAD
+                         + num_outer - 1) / num_outer;
+      if (tiles_per_outer < 1) tiles_per_outer = 1;
+      size = (inner_ext + tiles_per_outer - 1) / tiles_per_outer;
+      if (size < 1) size = 1;
+    }
+    ts->inner_tile_size = size;
+    ts->num_inner_tiles = (inner_ext + size - 1) / size;
+    ts->num_tiles = ts->num_inner_tiles * num_outer;
+    return 1;
+  }
+
+  //! Narrows the domain to a tile.
+  static inline void __PSTileSetDomain(const __PSTileSpace *ts,
+                                       PSIndex tile, __PSDomain *dom) {
+    PSIndex it = tile % ts->num_inner_tiles;
+    PSIndex ot = tile / ts->num_inner_tiles;
+    PSIndex min = ts->inner_min + it * ts->inner_tile_size;
+    PSIndex max = min + ts->inner_tile_size;
+    dom->local_min[ts->inner_dim] = min;
+    dom->local_max[ts->inner_dim] = max < ts->inner_max ? max : ts->inner_max;
+    if (ts->outer_dim >= 0) {
+      dom->local_min[ts->outer_dim] = ts->outer_min + ot;
+      dom->local_max[ts->outer_dim] = ts->outer_min + ot + 1;
+    }
+  }
+
+#ifdef _OPENMP
+  //! Takes a tile from the head of the own deque.
+  static inline PSIndex __PSTileDequePop(__PSTileDeque *q) {
+    PSIndex t = -1;
+    omp_set_lock(&q->lock);
+    if (q->head < q->tail) t = q->head++;
+    omp_unset_lock(&q->lock);
+    return t;
+  }
+
+  //! Takes a tile from the tail of a victim deque.
+  static inline PSIndex __PSTileDequeSteal(__PSTileDeque *q) {
+    PSIndex t = -1;
+    omp_set_lock(&q->lock);
+    if (q->head < q->tail) t = --q->tail;
+    omp_unset_lock(&q->lock);
+    return t;
+  }
+#endif
+
+  //! Runs a stencil over its domain in tiles with work stealing.
+  /*!
+    \param run_tile Callback that runs the stencil over the domain of
+    the stencil struct.
+    \param stencil Stencil struct whose first member is __PSDomain.
+    \param stencil_size Size of the stencil struct.
+    \param rb Red-black color passed to the callback.
+    \param num_dims Number of dimensions of the domain.
+   */
+  static inline void __PSRunTiles(__PSRunTileFunc run_tile,
+                                  const void *stencil,
+                                  size_t stencil_size,
+                                  int rb, int num_dims) {
+#ifdef _OPENMP
+    __PSTileSpace ts;
+    __PSTileDeque *deques;
+    int num_threads = omp_get_max_threads();
+    int t;
+    if (num_threads == 1 || omp_in_parallel() ||
+        !__PSTileSpaceInit(&ts, (const __PSDomain *)stencil,
+                           num_dims, num_threads) ||
+        ts.num_tiles == 1) {
+      run_tile(stencil, rb);
+      return;
+    }
+    deques = (__PSTileDeque *)malloc(sizeof(__PSTileDeque) * num_threads);
+    PSAssert(deques);
+    for (t = 0; t < num_threads; ++t) {
+      deques[t].head = ts.num_tiles * t / num_threads;
+      deques[t].tail = ts.num_tiles * (t + 1) / num_threads;
+      omp_init_lock(&deques[t].lock);
+    }
+#pragma omp parallel num_threads(num_threads)
+    {
+      int self = omp_get_thread_num();
+      void *tile_stencil = malloc(stencil_size);
+      PSIndex tile;
+      PSAssert(tile_stencil);
+      memcpy(tile_stencil, stencil, stencil_size);
+      while (1) {
+        tile = __PSTileDequePop(&deques[self]);
+        if (tile < 0) {
+          // Steal from the others, starting from the next thread. If
+          // fewer threads than requested are started, their deques
+          // are drained this way too.
+          int i;
+          for (i = 1; i < num_threads && tile < 0; ++i) {
+            tile = __PSTileDequeSteal(&deques[(self + i) % num_threads]);
+          }
+          // No tile is added once started, so all deques are empty
+          if (tile < 0) break;
+        }
+        __PSTileSetDomain(&ts, tile, (__PSDomain *)tile_stencil);
+        run_tile(tile_stencil, rb);
+      }
+      free(tile_stencil);
+    }
+    for (t = 0; t < num_threads; ++t) {
+      omp_destroy_lock(&deques[t].lock);
+    }
+    free(deques);
+#else
+    run_tile(stencil, rb);
+#endif
+  }
+
+  //! Runs a stencil in tiles with work stealing within divisions.
+  /*!
+    The domain is split into divisions in the same way as the buffers
+    of the MPI-OpenMP runtime, whose division u is first touched by
+    thread u % num_threads. Threads and divisions are grouped by
+    their index modulo the smaller of the numbers of threads and
+    divisions. Each group runs the tiles of its own divisions and
+    steals only from the deques of the same group, so tiles stay on
+    the NUMA node holding their points.
+
+    \param run_tile Callback that runs the stencil over the domain of
+    the stencil struct.
+    \param stencil Stencil struct whose first member is __PSDomain.
+    \param stencil_size Size of the stencil struct.
+    \param rb Red-black color passed to the callback.
+    \param num_dims Number of dimensions of the domain.
+    \param div_x Number of divisions along the first dimension.
+    \param div_y Number of divisions along the second dimension.
+    \param div_z Number of divisions along the third dimension.
+   */
+  static inline void __PSRunDivisionTiles(__PSRunTileFunc run_tile,
+                                          const void *stencil,
+                                          size_t stencil_size,
+                                          int rb, int num_dims,
+                                          int div_x, int div_y,
+                                          int div_z) {
+#ifdef _OPENMP
+    const __PSDomain *dom = (const __PSDomain *)stencil;
+    int num_threads = omp_get_max_threads();
+    int num_started = 0, num_groups = 1, num_divs = 1;
+    int div[PS_MAX_DIM] = {div_x, div_y, div_z};
+    __PSDomain *doms;
+    __PSTileSpace *spaces;
+    PSIndex *bases;
+    __PSTileDeque *deques;
+    int d, u, t;
+    if (num_threads == 1 || omp_in_parallel()) {
+      run_tile(stencil, rb);
+      return;
+    }
+    for (d = 0; d < num_dims; ++d) {
+      PSIndex width = dom->local_max[d] - dom->local_min[d];
+      if (width <= 0) return;
+      if (div[d] < 1) div[d] = 1;
+      if (div[d] > width) div[d] = (int)width;
+      num_divs *= div[d];
+    }
+    doms = (__PSDomain *)malloc(sizeof(__PSDomain) * num_divs);
+    spaces = (__PSTileSpace *)malloc(sizeof(__PSTileSpace) * num_divs);
+    bases = (PSIndex *)malloc(sizeof(PSIndex) * num_divs);
+    deques = (__PSTileDeque *)malloc(sizeof(__PSTileDeque) * num_threads);
+    PSAssert(doms && spaces && bases && deques);
+    // The first dimension varies fastest among the divisions
+    for (u = 0; u < num_divs; ++u) {
+      int den = 1;
+      doms[u] = *dom;
+      for (d = 0; d < num_dims; ++d) {
+        PSIndex width = dom->local_max[d] - dom->local_min[d];
+        int idx = (u / den) % div[d];
+        den *= div[d];
+        doms[u].local_min[d] = dom->local_min[d] + idx * width / div[d];
+        if (idx < div[d] - 1) {
+          doms[u].local_max[d] =
+              dom->local_min[d] + (idx + 1) * width / div[d];
+        }
+      }
+    }
+#pragma omp parallel num_threads(num_threads) private(u)
+    {
+      int self = omp_get_thread_num();
+      int group, members, i;
+      void *tile_stencil = malloc(stencil_size);
+      PSIndex tile;
+      PSAssert(tile_stencil);
+      memcpy(tile_stencil, stencil, stencil_size);
+      // Fewer threads than requested may be started
+#pragma omp single
+      {
+        int g, r;
+        num_started = omp_get_num_threads();
+        num_groups = num_started < num_divs ? num_started : num_divs;
+        // Tiles of a group are numbered through its divisions
+        for (u = 0; u < num_divs; ++u) {
+          g = u % num_groups;
+          members = (num_started - g + num_groups - 1) / num_groups;
+          __PSTileSpaceInit(&spaces[u], &doms[u], num_dims, members);
+          bases[u] = u < num_groups ? 0 :
+              bases[u - num_groups] + spaces[u - num_groups].num_tiles;
+        }
+        for (g = 0; g < num_groups; ++g) {
+          PSIndex num_tiles = 0;
+          members = (num_started - g + num_groups - 1) / num_groups;
+          for (u = g; u < num_divs; u += num_groups) {
+            num_tiles += spaces[u].num_tiles;
+          }
+          for (r = 0; r < members; ++r) {
+            __PSTileDeque *q = &deques[g + r * num_groups];
+            q->head = num_tiles * r / members;
+            q->tail = num_tiles * (r + 1) / members;
+            omp_init_lock(&q->lock);
+          }
+        }
+      }
+      group = self % num_groups;
+      members = (num_started - group + num_groups - 1) / num_groups;
+      while (1) {
+        tile = __PSTileDequePop(&deques[self]);
+        if (tile < 0) {
+          // Steal from the next members of the group
+          for (i = 1; i < members && tile < 0; ++i) {
+            tile = __PSTileDequeSteal(
+                &deques[group +
+                        ((self / num_groups + i) % members) * num_groups]);
+          }
+          // No tile is added once started, so the group is done
+          if (tile < 0) break;
+        }
+        for (u = group; tile >= bases[u] + spaces[u].num_tiles;
+             u += num_groups) {}
+        *(__PSDomain *)tile_stencil = doms[u];
+        __PSTileSetDomain(&spaces[u], tile - bases[u],
+                          (__PSDomain *)tile_stencil);
+        run_tile(tile_stencil, rb);
+      }
+      free(tile_stencil);
+    }
+    for (t = 0; t < num_started; ++t) {
+      omp_destroy_lock(&deques[t].lock);
+    }
+    free(doms);
+    free(spaces);
+    free(bases);
+    free(deques);
+#else
+    run_tile(stencil, rb);
+#endif
+  }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PHYSIS_PHYSIS_TILE_H_ */
@@ -74,6 +74,24 @@ extern "C" {
   //#undef DeclareGrid2D  
   //#undef DeclareGrid3D
 
+  /*
+    Coarse grids for multigrid methods. Each dimension is divided by
+    PS_COARSEN_FACTOR, rounding up, and name is the type name of the
+    grid, e.g., Float for PSGrid3DFloat. Since the coarse grid is
+    created with the usual grid new function, it can be used with any
+    stencil; see PSGridRestrict and PSGridProlong for transferring
+    points between the levels.
+  */
+#define PS_COARSEN_DIM(g, d)                                    \
+  ((PSGridDim(g, d) + PS_COARSEN_FACTOR - 1) / PS_COARSEN_FACTOR)
+#define PSGrid1DCoarsen(name, g)                \
+  PSGrid1D##name##New(PS_COARSEN_DIM(g, 0))
+#define PSGrid2DCoarsen(name, g)                                \
+  PSGrid2D##name##New(PS_COARSEN_DIM(g, 0), PS_COARSEN_DIM(g, 1))
+#define PSGrid3DCoarsen(name, g)                                \
+  PSGrid3D##name##New(PS_COARSEN_DIM(g, 0), PS_COARSEN_DIM(g, 1),  \
+                      PS_COARSEN_DIM(g, 2))
+
   extern void *__PSGridEmitUtype(char *s, ...);
   
 #define PSGridGet(g, ...) g->get(__VA_ARGS__)
@@ -106,6 +124,12 @@ extern "C" {
   extern void PSStencilRun(PSStencil, ...);
 
   extern void PSReduce(void *v, ...);
+  //! Reduces a grid asynchronously.
+  /*!
+    Takes the same arguments as PSReduce. The result must not be
+    read until the returned task is waited for with PSWait.
+   */
+  extern PSTask PSReduceAsync(void *v, ...);
 
 #ifdef __cplusplus
 }
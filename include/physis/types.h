@@ -19,7 +19,9 @@ extern "C" {
     PS_LONG = 1,
     PS_FLOAT = 2,
     PS_DOUBLE = 3,
-    PS_USER = 4
+    PS_USER = 4,
+    //! Storage-only type of reduced-precision grids; computed as float
+    PS_BFLOAT16 = 5
   };
 
 #ifdef __cplusplus
@@ -0,0 +1,150 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "runtime/activity.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace physis {
+namespace runtime {
+
+ActivityMask::ActivityMask(int num_dims, const PSIndex *dim,
+                           PSIndex tile_size, double threshold,
+                           uint64_t time):
+    num_dims_(num_dims), tile_size_(tile_size), threshold_(threshold),
+    producer_(NULL), ghost_time_(0) {
+  PSAssert(num_dims > 0 && num_dims <= PS_MAX_DIM);
+  PSAssert(tile_size > 0);
+  int64_t n = 1;
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    dim_[i] = i < num_dims ? dim[i] : 1;
+    num_tiles_[i] = (dim_[i] + tile_size - 1) / tile_size;
+    n *= num_tiles_[i];
+  }
+  changed_.assign(n, time);
+  computed_.assign(n, 0);
+}
+
+bool ActivityMask::IsCompatible(const ActivityMask &m) const {
+  if (num_dims_ != m.num_dims_ || tile_size_ != m.tile_size_) return false;
+  for (int i = 0; i < num_dims_; ++i) {
+    if (dim_[i] != m.dim_[i]) return false;
+  }
+  return true;
+}
+
+void ActivityMask::GetTileRange(int64_t tile, PSIndex *min,
+                                PSIndex *max) const {
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    PSIndex t = tile % num_tiles_[i];
+    tile /= num_tiles_[i];
+    min[i] = t * tile_size_;
+    max[i] = std::min(min[i] + tile_size_, dim_[i]);
+  }
+}
+
+bool ActivityMask::GetTileBounds(const PSIndex *min, const PSIndex *max,
+                                 PSIndex *tmin, PSIndex *tmax) const {
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    PSIndex lo = i < num_dims_ ? std::max(min[i], (PSIndex)0) : 0;
+    PSIndex hi = i < num_dims_ ? std::min(max[i], dim_[i]) : 1;
+    if (lo >= hi) return false;
+    tmin[i] = lo / tile_size_;
+    tmax[i] = (hi - 1) / tile_size_ + 1;
+  }
+  return true;
+}
+
+void ActivityMask::GetTiles(const PSIndex *min, const PSIndex *max,
+                            std::vector<int64_t> &tiles) const {
+  PSIndex tmin[PS_MAX_DIM], tmax[PS_MAX_DIM];
+  if (!GetTileBounds(min, max, tmin, tmax)) return;
+  for (PSIndex k = tmin[2]; k < tmax[2]; ++k) {
+    for (PSIndex j = tmin[1]; j < tmax[1]; ++j) {
+      for (PSIndex i = tmin[0]; i < tmax[0]; ++i) {
+        tiles.push_back(i + num_tiles_[0] * (j + num_tiles_[1] * k));
+      }
+    }
+  }
+}
+
+void ActivityMask::MarkChanged(const PSIndex *min, const PSIndex *max,
+                               uint64_t time) {
+  std::vector<int64_t> tiles;
+  GetTiles(min, max, tiles);
+  FOREACH (it, tiles.begin(), tiles.end()) {
+    changed_[*it] = time;
+  }
+}
+
+void ActivityMask::MarkAllChanged(uint64_t time) {
+  std::fill(changed_.begin(), changed_.end(), time);
+}
+
+bool ActivityMask::IsChangedSince(const PSIndex *min, const PSIndex *max,
+                                  uint64_t time) const {
+  PSIndex tmin[PS_MAX_DIM], tmax[PS_MAX_DIM];
+  if (!GetTileBounds(min, max, tmin, tmax)) return false;
+  for (PSIndex k = tmin[2]; k < tmax[2]; ++k) {
+    for (PSIndex j = tmin[1]; j < tmax[1]; ++j) {
+      for (PSIndex i = tmin[0]; i < tmax[0]; ++i) {
+        if (changed_[i + num_tiles_[0] * (j + num_tiles_[1] * k)] >= time) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+bool ActivityMask::IsProducer(const void *func, const void *stencil,
+                              size_t size) const {
+  return producer_ != NULL && producer_ == func &&
+      producer_stencil_.size() == size &&
+      memcmp(&producer_stencil_[0], stencil, size) == 0;
+}
+
+void ActivityMask::SetProducer(const void *func, const void *stencil,
+                               size_t size) {
+  producer_ = func;
+  const char *p = static_cast<const char*>(stencil);
+  producer_stencil_.assign(p, p + size);
+}
+
+void ActivityMask::ResetProducer() {
+  producer_ = NULL;
+  producer_stencil_.clear();
+}
+
+template <class T>
+static bool IsPointsChanged(const void *x, const void *y,
+                            int64_t num_points, double threshold) {
+  const T *a = static_cast<const T*>(x);
+  const T *b = static_cast<const T*>(y);
+  for (int64_t i = 0; i < num_points; ++i) {
+    if (a[i] == b[i]) continue;
+    // NaNs are always considered changed
+    if (!(fabs((double)a[i] - (double)b[i]) <= threshold)) return true;
+  }
+  return false;
+}
+
+bool IsPointsChanged(PSType type, size_t elm_size, const void *x,
+                     const void *y, int64_t num_points, double threshold) {
+  switch (type) {
+    case PS_FLOAT:
+      return IsPointsChanged<float>(x, y, num_points, threshold);
+    case PS_DOUBLE:
+      return IsPointsChanged<double>(x, y, num_points, threshold);
+    case PS_INT:
+      return IsPointsChanged<int>(x, y, num_points, threshold);
+    case PS_LONG:
+      return IsPointsChanged<long>(x, y, num_points, threshold);
+    default:
+      return memcmp(x, y, elm_size * num_points) != 0;
+  }
+}
+
+} // namespace runtime
+} // namespace physis
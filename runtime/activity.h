@@ -0,0 +1,128 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_RUNTIME_ACTIVITY_H_
+#define PHYSIS_RUNTIME_ACTIVITY_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "runtime/runtime_common.h"
+
+namespace physis {
+namespace runtime {
+
+//! Tracks which tiles of a grid have changed.
+/*!
+  A grid is divided into cubic tiles, and each tile records the time
+  its points last changed and the time they were last brought up to
+  date by a stencil. Times are given by the caller from a clock that
+  increases with each stencil run and each update of a grid by the
+  host.
+
+  A stencil only needs to compute an output tile when a tile of an
+  input grid within the stencil radius of it has changed since the
+  output tile was last computed by the same stencil. Since the
+  outputs are then computed from the same inputs as before, skipping
+  the other tiles gives the same results as long as changes are
+  detected exactly, i.e., with a threshold of zero.
+ */
+class ActivityMask {
+ public:
+  //! Creates a mask with all tiles changed at the given time.
+  /*!
+    \param num_dims Number of dimensions of the grid.
+    \param dim Size of the grid.
+    \param tile_size Extent of the tiles along each dimension.
+    \param threshold Points differing by no more than this are
+    considered unchanged.
+    \param time Current time.
+   */
+  ActivityMask(int num_dims, const PSIndex *dim, PSIndex tile_size,
+               double threshold, uint64_t time);
+  virtual ~ActivityMask() {}
+  int num_dims() const { return num_dims_; }
+  PSIndex tile_size() const { return tile_size_; }
+  double threshold() const { return threshold_; }
+  int64_t num_tiles() const { return changed_.size(); }
+  //! Returns true if the tiles of another mask are the same.
+  bool IsCompatible(const ActivityMask &m) const;
+  //! Returns the points of a tile.
+  /*!
+    \param tile The tile.
+    \param min Receives the first point of the tile.
+    \param max Receives one past the last point of the tile.
+   */
+  void GetTileRange(int64_t tile, PSIndex *min, PSIndex *max) const;
+  //! Returns the tiles overlapping a region in the order of points.
+  /*!
+    \param min The first point of the region.
+    \param max One past the last point of the region.
+    \param tiles Receives the tiles.
+   */
+  void GetTiles(const PSIndex *min, const PSIndex *max,
+                std::vector<int64_t> &tiles) const;
+  //! Marks the tiles overlapping a region changed.
+  void MarkChanged(const PSIndex *min, const PSIndex *max, uint64_t time);
+  //! Marks all tiles changed.
+  void MarkAllChanged(uint64_t time);
+  void MarkChanged(int64_t tile, uint64_t time) { changed_[tile] = time; }
+  //! Time the points of a tile last changed.
+  uint64_t changed(int64_t tile) const { return changed_[tile]; }
+  //! Returns true if any tile overlapping a region changed at or after a time.
+  bool IsChangedSince(const PSIndex *min, const PSIndex *max,
+                      uint64_t time) const;
+  //! Time the points of a tile were last brought up to date.
+  uint64_t &computed(int64_t tile) { return computed_[tile]; }
+  //! Returns true if the grid was last computed by the given stencil.
+  /*!
+    \param func The function running the stencil.
+    \param stencil The stencil struct including the domain and
+    the arguments of the kernel.
+    \param size The size of the stencil struct.
+   */
+  bool IsProducer(const void *func, const void *stencil,
+                  size_t size) const;
+  void SetProducer(const void *func, const void *stencil, size_t size);
+  //! Forgets the producer so that all tiles are computed next time.
+  void ResetProducer();
+  //! Time the ghost layers were last filled.
+  uint64_t &ghost_time() { return ghost_time_; }
+
+ protected:
+  int num_dims_;
+  PSIndex dim_[PS_MAX_DIM];
+  PSIndex tile_size_;
+  double threshold_;
+  //! Number of tiles along each dimension
+  PSIndex num_tiles_[PS_MAX_DIM];
+  std::vector<uint64_t> changed_;
+  std::vector<uint64_t> computed_;
+  const void *producer_;
+  std::vector<char> producer_stencil_;
+  uint64_t ghost_time_;
+  //! Returns the range of tiles overlapping a region.
+  /*!
+    \return False if the region is empty.
+   */
+  bool GetTileBounds(const PSIndex *min, const PSIndex *max,
+                     PSIndex *tmin, PSIndex *tmax) const;
+};
+
+//! Returns true if any point differs by more than a threshold.
+/*!
+  Points of types other than the primitive ones are compared bitwise.
+
+  \param type The point type.
+  \param elm_size The size of each point.
+  \param x The points to compare.
+  \param y The points to compare.
+  \param num_points The number of points.
+  \param threshold The maximum difference of unchanged points.
+ */
+bool IsPointsChanged(PSType type, size_t elm_size, const void *x,
+                     const void *y, int64_t num_points, double threshold);
+
+} // namespace runtime
+} // namespace physis
+
+#endif /* PHYSIS_RUNTIME_ACTIVITY_H_ */
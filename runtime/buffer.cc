@@ -3,6 +3,8 @@
 #include "runtime/buffer.h"
 #include "runtime/grid_util.h"
 
+#include <typeinfo>
+
 namespace physis {
 namespace runtime {
 
@@ -96,5 +98,115 @@ void BufferHost::Copyin(size_t elm_size, int rank,
                 grid_size, subgrid, subgrid_offset, subgrid_size);
 }
 
+//
+// BufferPool
+//
+
+static size_t GetDefaultPoolCapacity() {
+  const char *s = getenv("PHYSIS_BUFFER_POOL_SIZE");
+  if (s == NULL) return PS_BUFFER_POOL_SIZE;
+  return (size_t)strtoull(s, NULL, 10);
+}
+
+BufferPool::BufferPool(size_t capacity):
+    size_(0), capacity_(capacity), num_hits_(0) {
+}
+
+BufferPool::BufferPool():
+    size_(0), capacity_(GetDefaultPoolCapacity()), num_hits_(0) {
+}
+
+BufferPool::~BufferPool() {
+  Clear();
+}
+
+bool BufferPool::Take(EntryMap &map, size_t size, Entry &e) {
+  EntryMap::iterator it = map.find(size);
+  if (it == map.end()) return false;
+  e = *it->second;
+  entries_.erase(it->second);
+  map.erase(it);
+  size_ -= size;
+  ++num_hits_;
+  return true;
+}
+
+BufferHost *BufferPool::GetBuffer(size_t size) {
+  Entry e;
+  if (!Take(buffers_, size, e)) {
+    BufferHost *buf = new BufferHost();
+    buf->Allocate(size);
+    return buf;
+  }
+  // New buffers are zero-filled
+  memset(e.buf->Get(), 0, size);
+  LOG_VERBOSE() << "Recycled buffer of " << size << " bytes\n";
+  return e.buf;
+}
+
+void BufferPool::Release(Buffer *buf) {
+  if (buf == NULL) return;
+  // Derived classes may not be allocated in the host memory
+  if (typeid(*buf) != typeid(BufferHost) || !Reserve(buf->size())) {
+    delete buf;
+    return;
+  }
+  Entry e = {buf->size(), static_cast<BufferHost*>(buf), NULL};
+  buffers_.insert(std::make_pair(e.size,
+                                 entries_.insert(entries_.end(), e)));
+}
+
+void *BufferPool::GetChunk(size_t size) {
+  Entry e;
+  if (!Take(chunks_, size, e)) {
+    void *p = malloc(size);
+    PSAssert(p || size == 0);
+    return p;
+  }
+  return e.chunk;
+}
+
+void BufferPool::ReleaseChunk(void *p, size_t size) {
+  if (p == NULL) return;
+  if (!Reserve(size)) {
+    free(p);
+    return;
+  }
+  Entry e = {size, NULL, p};
+  chunks_.insert(std::make_pair(size, entries_.insert(entries_.end(), e)));
+}
+
+bool BufferPool::Reserve(size_t size) {
+  if (size > capacity_) return false;
+  while (size_ + size > capacity_) Evict();
+  size_ += size;
+  return true;
+}
+
+void BufferPool::Evict() {
+  EntryList::iterator oldest = entries_.begin();
+  EntryMap &map = oldest->buf ? buffers_ : chunks_;
+  std::pair<EntryMap::iterator, EntryMap::iterator> r =
+      map.equal_range(oldest->size);
+  for (EntryMap::iterator it = r.first; it != r.second; ++it) {
+    if (it->second == oldest) {
+      map.erase(it);
+      break;
+    }
+  }
+  LOG_VERBOSE() << "Evicted " << oldest->size << " bytes from pool\n";
+  size_ -= oldest->size;
+  if (oldest->buf) {
+    delete oldest->buf;
+  } else {
+    free(oldest->chunk);
+  }
+  entries_.erase(oldest);
+}
+
+void BufferPool::Clear() {
+  while (!entries_.empty()) Evict();
+}
+
 } // namespace runtime
 } // namespace physis
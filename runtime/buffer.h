@@ -5,6 +5,9 @@
 
 #include "runtime/runtime_common.h"
 
+#include <list>
+#include <map>
+
 namespace physis {
 namespace runtime {
 
@@ -107,6 +110,80 @@ class BufferHost: public Buffer {
   virtual void *GetChunk(size_t size);
 };
 
+//! Default capacity of buffer pools in bytes.
+#define PS_BUFFER_POOL_SIZE (256UL * 1024 * 1024)
+
+//! Pool of host memory recycled between grids of the same size.
+/*!
+  Grids created and deleted repeatedly, such as temporaries in time
+  loops, would otherwise allocate and page in fresh memory every
+  time. Buffers and memory chunks released to the pool are kept
+  until requested again with the same size. When the capacity of the
+  pool would be exceeded, the least recently released ones are freed.
+ */
+class BufferPool {
+ public:
+  //! Create a pool.
+  /*!
+    \param capacity Maximum number of bytes kept in the pool.
+   */
+  explicit BufferPool(size_t capacity);
+  //! Create a pool with the default capacity.
+  /*!
+    The capacity is given in bytes by environment variable
+    PHYSIS_BUFFER_POOL_SIZE, which is PS_BUFFER_POOL_SIZE by
+    default. Zero disables recycling.
+   */
+  BufferPool();
+  ~BufferPool();
+  //! Get a zero-filled host buffer.
+  /*!
+    \param size Size of the buffer in bytes.
+    \return A recycled buffer if any, or a new buffer.
+   */
+  BufferHost *GetBuffer(size_t size);
+  //! Release a buffer to the pool.
+  /*!
+    Buffers other than BufferHost are deleted.
+   */
+  void Release(Buffer *buf);
+  //! Get an uninitialized memory chunk.
+  void *GetChunk(size_t size);
+  //! Release a chunk returned by GetChunk to the pool.
+  void ReleaseChunk(void *p, size_t size);
+  //! Free all buffers and chunks in the pool.
+  void Clear();
+  //! Returns the number of bytes kept in the pool.
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  //! Returns the number of requests served from the pool.
+  size_t num_hits() const { return num_hits_; }
+
+ protected:
+  //! A buffer or a chunk kept in the pool
+  struct Entry {
+    size_t size;
+    //! NULL if a chunk
+    BufferHost *buf;
+    void *chunk;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::multimap<size_t, EntryList::iterator> EntryMap;
+  //! Make room for size bytes by evicting old entries.
+  bool Reserve(size_t size);
+  //! Free the least recently released entry.
+  void Evict();
+  //! Take an entry of a size from a map; returns false if none.
+  bool Take(EntryMap &map, size_t size, Entry &e);
+  //! Entries in the order of release
+  EntryList entries_;
+  EntryMap buffers_;
+  EntryMap chunks_;
+  size_t size_;
+  size_t capacity_;
+  size_t num_hits_;
+};
+
 } // namespace runtime
 } // namespace physis
 
@@ -3,14 +3,17 @@
 #include "runtime/buffer_mpi_openmp.h"
 #undef USE_LINESIZE
 
-#ifdef USE_OPENMP_NUMA
-#include <numaif.h>
-#include <numa.h>
-#endif
-
 namespace physis {
 namespace runtime {
 
+//! Returns true if a region of size is within capacity in all dimensions.
+static bool FitsIn(const IntArray &size, const IntArray &capacity) {
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    if (size[i] > capacity[i]) return false;
+  }
+  return true;
+}
+
 void BufferHostOpenMP::Allocate(
     int num_dims, size_t elm_size, const IntArray &size){
 
@@ -25,7 +28,8 @@ void BufferHostOpenMP::Allocate(
     num_dims_ = num_dims;
     elm_size_ = elm_size;
   }
-  size_  = size;
+  mp_size_ = size;
+  actual_size_ = size_ = GetLinearSize(size);
   const size_t alignment = sysconf(_SC_PAGESIZE);
 
   int status = CreateAlignedMultiBuffer(
@@ -43,14 +47,7 @@ void BufferHostOpenMP::Allocate(
     PSAbort(1);
   }
 
-#ifdef USE_OPENMP_NUMA
-  int maxcpunodes =  0;
-  if (numa_available() != -1){
-    maxcpunodes = numa_max_node() + 1;
-    LOG_DEBUG() << "NUMA reported that " << maxcpunodes << " nodes may be available\n";
-    MoveMultiBuffer(maxcpunodes);
-  }
-#endif
+  FirstTouchMultiBuffer();
   
 }
 
@@ -58,13 +55,22 @@ void BufferHostOpenMP::Allocate(const IntArray &size) {
   Allocate(num_dims_, elm_size_, size);
 }
 
+void BufferHostOpenMP::EnsureCapacity(const IntArray &size) {
+  if (buf_mp_ && FitsIn(size, mp_size_)) return;
+  LOG_DEBUG() << "Expanding capacity from " << mp_size_
+              << " to " << size << "\n";
+  Allocate(size);
+}
+
 
 //
 // BufferHost
 //
 
 BufferHostOpenMP::BufferHostOpenMP(size_t elm_size):
-    BufferHost(elm_size),
+    BufferHost(),
+    num_dims_(0),
+    elm_size_(elm_size),
     buf_mp_(0),
     mp_offset_(0),
     mp_width_(0),
@@ -75,7 +81,9 @@ BufferHostOpenMP::BufferHostOpenMP(size_t elm_size):
 {
 }
 BufferHostOpenMP::BufferHostOpenMP(int num_dims,  size_t elm_size):
-    BufferHost(num_dims, elm_size),
+    BufferHost(),
+    num_dims_(num_dims),
+    elm_size_(elm_size),
     buf_mp_(0),
     mp_offset_(0),
     mp_width_(0),
@@ -89,7 +97,9 @@ BufferHostOpenMP::BufferHostOpenMP(int num_dims,  size_t elm_size):
 }
 
 BufferHostOpenMP::BufferHostOpenMP(int num_dims,  size_t elm_size, IntArray &division_in):
-    BufferHost(num_dims, elm_size),
+    BufferHost(),
+    num_dims_(num_dims),
+    elm_size_(elm_size),
     buf_mp_(0),
     division_(division_in),
     mp_offset_(0),
@@ -107,6 +117,11 @@ BufferHostOpenMP::~BufferHostOpenMP() {
   DeleteOpenMP();
 }
 
+void BufferHostOpenMP::Copyin(const void *src, size_t size) {
+  PSAssert(size <= size_);
+  CopyinMultiBuffer(src, size, 0);
+}
+
 void BufferHostOpenMP::Copyin(
     const void *buf, const IntArray &offset,
     const IntArray &size){
@@ -123,8 +138,13 @@ void BufferHostOpenMP::Copyin(
   EnsureCapacity(offset + size);
   // Offset access is not yet supported.
   PSAssert(offset == 0);
+  CopyinMultiBuffer(buf, GetLinearSize(size), linear_offset);
+}
 
-  size_t size_left = GetLinearSize(size);
+void BufferHostOpenMP::CopyinMultiBuffer(
+    const void *buf, size_t size, size_t linear_offset) {
+  if (size == 0) return;
+  size_t size_left = size;
   size_t offset_left = linear_offset * elm_size_;
 
   intptr_t buf_curpos = (intptr_t)buf;
@@ -189,6 +209,11 @@ void BufferHostOpenMP::Copyin(
 
 }
 
+void BufferHostOpenMP::Copyout(void *dst, size_t size) {
+  PSAssert(size <= size_);
+  CopyoutMultiBuffer(dst, size, 0);
+}
+
 void BufferHostOpenMP::Copyout(
     void *buf, const IntArray &offset,
     const IntArray &size){
@@ -205,8 +230,13 @@ void BufferHostOpenMP::Copyout(
   EnsureCapacity(offset + size);
   // Offset access is not yet supported.
   PSAssert(offset == 0);
+  CopyoutMultiBuffer(buf, GetLinearSize(size), linear_offset);
+}
 
-  size_t size_left = GetLinearSize(size);
+void BufferHostOpenMP::CopyoutMultiBuffer(
+    void *buf, size_t size, size_t linear_offset) {
+  if (size == 0) return;
+  size_t size_left = size;
   size_t offset_left = linear_offset * elm_size_;
 
   intptr_t buf_curpos = (intptr_t)buf;
@@ -286,7 +316,7 @@ void BufferHostOpenMP::MPISendRecvInoI(
   if (recv_p) {
     EnsureCapacity(offset + size);
   } else {
-    PSAssert(offset + size < size_);
+    PSAssert(FitsIn(offset + size, mp_size_));
   }
 
   size_t size_left = GetLinearSize(size);
@@ -468,8 +498,8 @@ void BufferHostOpenMP::DeleteOpenMP()
   DestroyMP3Dinfo(mp_offset_, division_);
   DestroyMP3Dinfo(mp_width_, division_);
 
-  if (mp_cpu_memsize_) delete mp_cpu_memsize_;
-  if (mp_cpu_allocBytes_) delete mp_cpu_allocBytes_;
+  if (mp_cpu_memsize_) delete[] mp_cpu_memsize_;
+  if (mp_cpu_allocBytes_) delete[] mp_cpu_allocBytes_;
   mp_cpu_memsize_ = 0;
   mp_cpu_allocBytes_ = 0;
   
@@ -28,11 +28,13 @@ class BufferHostOpenMP: public BufferHost {
 
  public:
 
+  virtual void Copyin(const void *src, size_t size);
   virtual void Copyin(const void *buf, const IntArray &offset,
                       const IntArray &size);
   virtual void Copyin(const void *buf, const IntArray &offset,
                       const IntArray &size, const size_t linear_offset);
 
+  virtual void Copyout(void *dst, size_t size);
   virtual void Copyout(void *buf, const IntArray &offset,
                        const IntArray &size);
   virtual void Copyout(void *buf, const IntArray &offset,
@@ -49,6 +51,18 @@ class BufferHostOpenMP: public BufferHost {
                                );
   
  protected:
+  //! Reallocate the divisions if size exceeds the current size.
+  void EnsureCapacity(const IntArray &size);
+  //! Returns the number of bytes of a region of size elements.
+  size_t GetLinearSize(const IntArray &size) const {
+    return size.accumulate(num_dims_) * elm_size_;
+  }
+  //! Copy size bytes from buf into the divisions in linear order.
+  void CopyinMultiBuffer(const void *buf, size_t size,
+                         size_t linear_offset);
+  //! Copy size bytes of the divisions in linear order to buf.
+  void CopyoutMultiBuffer(void *buf, size_t size,
+                          size_t linear_offset);
   virtual int CreateAlignedMultiBuffer(
       const IntArray &requested_size, IntArray &division,
       const int elmsize,
@@ -68,6 +82,10 @@ class BufferHostOpenMP: public BufferHost {
                                );
 
  protected:
+  int num_dims_;
+  size_t elm_size_;
+  //! Size of the buffer in elements
+  IntArray mp_size_;
   void **buf_mp_; // release with free
 
  protected:
@@ -89,7 +107,21 @@ class BufferHostOpenMP: public BufferHost {
   size_t *MPcpuallocBytes() { return mp_cpu_allocBytes_; }
 
  public:
+  //! Migrate each division to the NUMA node of its thread.
+  /*!
+    Costly as pages are moved after allocation. FirstTouchMultiBuffer
+    is used for new buffers instead.
+   */
   void MoveMultiBuffer(unsigned int maxcpunodes);
+  //! Touch each division first from the thread that computes it.
+  /*!
+    Uses the same OpenMP schedule as the generated division loop, so
+    each division is placed on the NUMA node of its thread without
+    page migration.
+   */
+  void FirstTouchMultiBuffer();
+  //! Log the NUMA node where each division is located.
+  void ReportPlacement() const;
  private:
   bool mbind_done_p;
 
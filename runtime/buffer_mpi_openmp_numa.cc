@@ -1,6 +1,9 @@
 // Licensed under the BSD license. See LICENSE.txt for more details.
 
 #include "runtime/buffer_mpi_openmp.h"
+#include "runtime/numa_topology.h"
+
+#include <omp.h>
 
 #ifdef USE_OPENMP_NUMA
 #include <numaif.h>
@@ -24,27 +27,18 @@ void BufferHostOpenMP::MoveMultiBuffer(unsigned int maxcpunodes)
   for (unsigned int dim = 0; dim < PS_MAX_DIM; dim++)
       total_num *= division_[dim];
 
-  int tolcpunum = sysconf(_SC_NPROCESSORS_ONLN);
-  if (tolcpunum == -1) {
-    LOG_DEBUG() << "Calling sysconf(_SC_NPROCESSORS_ONLN) failed,";
-    LOG_DEBUG() << "using " << total_num << " as the available cpu number\n";
-    tolcpunum = total_num;
-  }
-  else {
-    LOG_DEBUG() << "sysconf reported that " << tolcpunum << " cpus available\n";
-  }
+  // Division cpuid is computed by thread (cpuid % #threads) with
+  // schedule(static,1)
+  NUMATopology *topology = NUMATopology::GetInstance();
+  int num_threads = omp_get_max_threads();
   for (unsigned int cpuid = 0; cpuid < total_num; cpuid++){
-    int cpuid_to_move = numa_node_of_cpu(cpuid % (unsigned int) tolcpunum);
-    if (cpuid_to_move == -1) {
-      LOG_DEBUG() << "Calling numa_node_of cpu failed for id " << cpuid << "\n";
-      continue;
-    }
+    int cpuid_to_move = topology->GetNodeOfThread(cpuid % num_threads);
     struct bitmask *numa_mask = numa_allocate_nodemask();
     numa_bitmask_setbit(numa_mask, cpuid_to_move);
 
     LOG_DEBUG() << "Moving allocated memory id " << cpuid
       << " to NUMA node " << cpuid_to_move << "\n";
-    int errstatus = 
+    int errstatus =
       mbind(
         buf_mp_[cpuid], mp_cpu_allocBytes_[cpuid],
         MPOL_BIND,
@@ -61,5 +55,61 @@ void BufferHostOpenMP::MoveMultiBuffer(unsigned int maxcpunodes)
 #endif
 }
 
+void BufferHostOpenMP::FirstTouchMultiBuffer()
+{
+  if (buf_mp_ == NULL) return;
+  unsigned int total_num = 1;
+  for (unsigned int dim = 0; dim < PS_MAX_DIM; dim++)
+      total_num *= division_[dim];
+
+  NUMATopology *topology = NUMATopology::GetInstance();
+  // Must match the schedule of the division loop generated by the
+  // translator
+#pragma omp parallel for schedule(static,1)
+  for (int cpuid = 0; cpuid < (int)total_num; cpuid++) {
+    topology->PinCurrentThread();
+    if (buf_mp_[cpuid]) {
+      memset(buf_mp_[cpuid], 0, mp_cpu_allocBytes_[cpuid]);
+    }
+  }
+  mbind_done_p = true; // No migration needed
+  ReportPlacement();
+}
+
+void BufferHostOpenMP::ReportPlacement() const
+{
+  unsigned int total_num = 1;
+  for (unsigned int dim = 0; dim < PS_MAX_DIM; dim++)
+      total_num *= division_[dim];
+
+  NUMATopology *topology = NUMATopology::GetInstance();
+  int num_threads = omp_get_max_threads();
+  unsigned int num_misplaced = 0;
+  unsigned int num_unknown = 0;
+  for (unsigned int cpuid = 0; cpuid < total_num; cpuid++) {
+    if (buf_mp_[cpuid] == NULL) continue;
+    int expected = topology->GetNodeOfThread(cpuid % num_threads);
+    int node = GetNUMANodeOfAddress(buf_mp_[cpuid]);
+    LOG_VERBOSE() << "Division " << cpuid << ": thread "
+                  << (cpuid % num_threads) << ", node " << node
+                  << " (expected " << expected << ")\n";
+    if (node == -1) {
+      ++num_unknown;
+    } else if (node != expected) {
+      ++num_misplaced;
+    }
+  }
+  if (num_unknown == total_num) {
+    LOG_DEBUG() << "Placement of " << total_num
+                << " divisions not available\n";
+  } else if (num_misplaced) {
+    LOG_WARNING() << num_misplaced << " of " << total_num
+                  << " divisions are not on the node of their thread\n";
+  } else {
+    LOG_DEBUG() << "All of " << total_num
+                << " divisions are on the node of their thread\n";
+  }
+}
+
 } // namespace runtime
 } // namespace physis
@@ -0,0 +1,60 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "runtime/buffer_mpi_shared.h"
+#include "runtime/mpi_util.h"
+
+namespace physis {
+namespace runtime {
+
+// The window is freed explicitly rather than by a deleter function
+// since MPI_Win_free needs the window handle, not the pointer.
+BufferHostMPIShared::BufferHostMPIShared(MPI_Comm comm):
+    BufferHost(NULL), comm_(comm), win_(MPI_WIN_NULL) {
+}
+
+BufferHostMPIShared::~BufferHostMPIShared() {
+  FreeWindow();
+}
+
+void *BufferHostMPIShared::GetChunk(size_t size) {
+  // Buffer::EnsureCapacity calls Free and then Allocate, so any
+  // previous window is released here.
+  FreeWindow();
+  MPI_Info info;
+  CHECK_MPI(MPI_Info_create(&info));
+  // Let each process place its chunk in its local memory
+  CHECK_MPI(MPI_Info_set(info, (char*)"alloc_shared_noncontig",
+                         (char*)"true"));
+  void *p = NULL;
+  CHECK_MPI(MPI_Win_allocate_shared(size, 1, info, comm_, &p, &win_));
+  CHECK_MPI(MPI_Info_free(&info));
+  // Passive-target epoch for the whole lifetime of the window, which
+  // allows for MPI_Win_sync
+  CHECK_MPI(MPI_Win_lock_all(MPI_MODE_NOCHECK, win_));
+  if (size == 0) return NULL;
+  PSAssert(p);
+  memset(p, 0, size);
+  return p;
+}
+
+void BufferHostMPIShared::FreeWindow() {
+  if (win_ == MPI_WIN_NULL) return;
+  CHECK_MPI(MPI_Win_unlock_all(win_));
+  CHECK_MPI(MPI_Win_free(&win_));
+  win_ = MPI_WIN_NULL;
+}
+
+void *BufferHostMPIShared::GetPeer(int peer) const {
+  MPI_Aint size;
+  int disp_unit;
+  void *p = NULL;
+  CHECK_MPI(MPI_Win_shared_query(win_, peer, &size, &disp_unit, &p));
+  return size > 0 ? p : NULL;
+}
+
+void BufferHostMPIShared::Sync() {
+  CHECK_MPI(MPI_Win_sync(win_));
+}
+
+} // namespace runtime
+} // namespace physis
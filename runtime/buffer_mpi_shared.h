@@ -0,0 +1,49 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_RUNTIME_BUFFER_MPI_SHARED_H_
+#define PHYSIS_RUNTIME_BUFFER_MPI_SHARED_H_
+
+#include "mpi.h"
+
+#include "runtime/runtime_common.h"
+#include "runtime/buffer.h"
+
+namespace physis {
+namespace runtime {
+
+//! Host buffer allocated in an MPI-3 shared-memory window.
+/*!
+  The memory of the buffer is directly addressable by the other
+  processes of the communicator, which must be created with
+  MPI_Comm_split_type(MPI_COMM_TYPE_SHARED). Allocation and
+  deallocation are collective over the communicator, so all
+  processes must allocate and free their buffers in the same order,
+  possibly with zero size.
+ */
+class BufferHostMPIShared: public BufferHost {
+ public:
+  explicit BufferHostMPIShared(MPI_Comm comm);
+  virtual ~BufferHostMPIShared();
+  //! Returns the pointer to the buffer of a peer process.
+  /*!
+    \param peer Rank of the peer in the shared communicator.
+    \return Pointer to the memory chunk of the peer.
+   */
+  void *GetPeer(int peer) const;
+  //! Synchronizes the public and private copies of the window.
+  void Sync();
+  MPI_Comm comm() const { return comm_; }
+
+ protected:
+  virtual void *GetChunk(size_t size);
+  void FreeWindow();
+
+  MPI_Comm comm_;
+  MPI_Win win_;
+};
+
+} // namespace runtime
+} // namespace physis
+
+
+#endif /* PHYSIS_RUNTIME_BUFFER_MPI_SHARED_H_ */
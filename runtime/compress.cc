@@ -0,0 +1,417 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "runtime/compress.h"
+#include "runtime/timing.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace physis {
+namespace runtime {
+
+//! Raw size of the blocks coded independently; a multiple of words
+static const size_t kBlockSize = 64 * 1024;
+//! Flag of the block sizes marking blocks stored as they are
+static const uint32_t kRawBlock = 0x80000000U;
+//! Longest run or literal of the run-length encoding
+static const size_t kMaxRun = 128;
+
+enum PACK_METHOD {PACK_RAW, PACK_SHUFFLE_RLE};
+
+struct PackHeader {
+  uint32_t method;
+  uint32_t num_blocks;
+};
+
+static size_t GetNumBlocks(size_t size) {
+  return (size + kBlockSize - 1) / kBlockSize;
+}
+
+//! XORs each word with the previous one and shuffles the bytes into planes.
+static void ShuffleResiduals(const uint8_t *src, size_t n, int w,
+                             uint8_t *dst) {
+  size_t nw = n / w;
+  for (int p = 0; p < w; ++p) {
+    uint8_t prev = 0;
+    uint8_t *plane = dst + p * nw;
+    for (size_t i = 0; i < nw; ++i) {
+      uint8_t b = src[i * w + p];
+      plane[i] = b ^ prev;
+      prev = b;
+    }
+  }
+  memcpy(dst + nw * w, src + nw * w, n - nw * w);
+}
+
+static void UnshuffleResiduals(const uint8_t *src, size_t n, int w,
+                               uint8_t *dst) {
+  size_t nw = n / w;
+  for (int p = 0; p < w; ++p) {
+    uint8_t prev = 0;
+    const uint8_t *plane = src + p * nw;
+    for (size_t i = 0; i < nw; ++i) {
+      prev ^= plane[i];
+      dst[i * w + p] = prev;
+    }
+  }
+  memcpy(dst + nw * w, src + nw * w, n - nw * w);
+}
+
+//! Run-length encodes zeros.
+/*!
+  A token byte with the high bit set stands for a run of up to
+  kMaxRun zeros, and otherwise is followed by up to kMaxRun literal
+  bytes.
+
+  \return Zero if the encoded bytes exceed the capacity.
+ */
+static size_t EncodeRuns(const uint8_t *src, size_t n, uint8_t *dst,
+                         size_t cap) {
+  size_t o = 0;
+  size_t token = 0;
+  size_t num_literals = 0;
+  size_t k = 0;
+  while (k < n) {
+    if (src[k] == 0 && k + 1 < n && src[k + 1] == 0) {
+      size_t run = 0;
+      while (k < n && run < kMaxRun && src[k] == 0) {
+        ++run;
+        ++k;
+      }
+      if (o >= cap) return 0;
+      dst[o++] = 0x80 | (run - 1);
+      num_literals = 0;
+      continue;
+    }
+    if (num_literals == 0 || num_literals == kMaxRun) {
+      if (o >= cap) return 0;
+      token = o++;
+      num_literals = 0;
+    }
+    if (o >= cap) return 0;
+    dst[o++] = src[k++];
+    dst[token] = num_literals++;
+  }
+  return o;
+}
+
+//! Returns false if the encoded bytes do not decode to n bytes.
+static bool DecodeRuns(const uint8_t *src, size_t len, uint8_t *dst,
+                       size_t n) {
+  size_t o = 0;
+  size_t k = 0;
+  while (k < len) {
+    uint8_t t = src[k++];
+    size_t run = (t & 0x7f) + 1;
+    if (o + run > n) return false;
+    if (t & 0x80) {
+      memset(dst + o, 0, run);
+    } else {
+      if (k + run > len) return false;
+      memcpy(dst + o, src + k, run);
+      k += run;
+    }
+    o += run;
+  }
+  return o == n;
+}
+
+struct BlockCoding {
+  int word_size;
+  const uint8_t *src;
+  size_t size;
+  uint8_t *dst;
+  //! Size of each block; offsets of decoded blocks in src
+  uint32_t *block_sizes;
+  size_t *block_offsets;
+  size_t num_blocks;
+  bool failed;
+};
+
+static void EncodeBlock(BlockCoding *c, size_t j, uint8_t *scratch) {
+  size_t n = std::min(kBlockSize, c->size - j * kBlockSize);
+  const uint8_t *src = c->src + j * kBlockSize;
+  // Coded in place of the raw block and compacted later
+  uint8_t *dst = c->dst + j * kBlockSize;
+  ShuffleResiduals(src, n, c->word_size, scratch);
+  size_t len = EncodeRuns(scratch, n, dst, n - 1);
+  if (len == 0) {
+    memcpy(dst, src, n);
+    c->block_sizes[j] = n | kRawBlock;
+  } else {
+    c->block_sizes[j] = len;
+  }
+}
+
+static void DecodeBlock(BlockCoding *c, size_t j, uint8_t *scratch) {
+  size_t n = std::min(kBlockSize, c->size - j * kBlockSize);
+  const uint8_t *src = c->src + c->block_offsets[j];
+  uint8_t *dst = c->dst + j * kBlockSize;
+  uint32_t len = c->block_sizes[j] & ~kRawBlock;
+  if (c->block_sizes[j] & kRawBlock) {
+    if (len != n) {
+      c->failed = true;
+      return;
+    }
+    memcpy(dst, src, n);
+    return;
+  }
+  if (!DecodeRuns(src, len, scratch, n)) {
+    c->failed = true;
+    return;
+  }
+  UnshuffleResiduals(scratch, n, c->word_size, dst);
+}
+
+struct BlockWorker {
+  BlockCoding *coding;
+  void (*code)(BlockCoding *c, size_t j, uint8_t *scratch);
+  int index;
+  int num_workers;
+};
+
+static void *RunBlockWorker(void *arg) {
+  BlockWorker *w = static_cast<BlockWorker*>(arg);
+  std::vector<uint8_t> scratch(kBlockSize);
+  for (size_t j = w->index; j < w->coding->num_blocks;
+       j += w->num_workers) {
+    w->code(w->coding, j, &scratch[0]);
+  }
+  return NULL;
+}
+
+//! Codes the blocks with threads; the calling thread is one of them.
+static void RunBlocks(BlockCoding *c,
+                      void (*code)(BlockCoding *c, size_t j,
+                                   uint8_t *scratch),
+                      int num_threads) {
+  if (c->num_blocks == 0) return;
+  int n = (int)std::min((size_t)std::max(num_threads, 1), c->num_blocks);
+  std::vector<BlockWorker> workers(n);
+  std::vector<pthread_t> threads;
+  for (int i = 0; i < n; ++i) {
+    BlockWorker w = {c, code, i, n};
+    workers[i] = w;
+  }
+  for (int i = 1; i < n; ++i) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, RunBlockWorker, &workers[i]) != 0) {
+      // Leaves the blocks of the remaining workers to this thread
+      for (int k = i; k < n; ++k) {
+        for (size_t j = k; j < c->num_blocks; j += n) {
+          std::vector<uint8_t> scratch(kBlockSize);
+          code(c, j, &scratch[0]);
+        }
+      }
+      break;
+    }
+    threads.push_back(t);
+  }
+  RunBlockWorker(&workers[0]);
+  FOREACH (it, threads.begin(), threads.end()) {
+    pthread_join(*it, NULL);
+  }
+}
+
+static size_t StoreRaw(const void *src, size_t size, void *dst) {
+  PackHeader h = {PACK_RAW, 0};
+  memcpy(dst, &h, sizeof(h));
+  memcpy((char*)dst + sizeof(h), src, size);
+  return sizeof(h) + size;
+}
+
+int GetCompressionWordSize(PSType type) {
+  switch (type) {
+    case PS_FLOAT:
+      return sizeof(float);
+    case PS_DOUBLE:
+      return sizeof(double);
+    case PS_INT:
+      return sizeof(int);
+    case PS_LONG:
+      return sizeof(long);
+    default:
+      return 0;
+  }
+}
+
+size_t GetMaxCompressedSize(size_t size) {
+  return sizeof(PackHeader) + GetNumBlocks(size) * sizeof(uint32_t) + size;
+}
+
+size_t CompressPoints(PSType type, const void *src, size_t size,
+                      void *dst, int num_threads) {
+  int w = GetCompressionWordSize(type);
+  PSAssert(w > 0);
+  size_t nb = GetNumBlocks(size);
+  uint8_t *out = static_cast<uint8_t*>(dst);
+  uint32_t *block_sizes = reinterpret_cast<uint32_t*>(
+      out + sizeof(PackHeader));
+  uint8_t *payload = out + sizeof(PackHeader) + nb * sizeof(uint32_t);
+  BlockCoding c = {w, static_cast<const uint8_t*>(src), size,
+                   payload, block_sizes, NULL, nb, false};
+  RunBlocks(&c, EncodeBlock, num_threads);
+  // Compact the blocks coded at their raw offsets
+  size_t len = 0;
+  for (size_t j = 0; j < nb; ++j) {
+    size_t bs = block_sizes[j] & ~kRawBlock;
+    memmove(payload + len, payload + j * kBlockSize, bs);
+    len += bs;
+  }
+  len += sizeof(PackHeader) + nb * sizeof(uint32_t);
+  if (len >= sizeof(PackHeader) + size) {
+    return StoreRaw(src, size, dst);
+  }
+  PackHeader h = {PACK_SHUFFLE_RLE, (uint32_t)nb};
+  memcpy(dst, &h, sizeof(h));
+  return len;
+}
+
+bool DecompressPoints(PSType type, const void *src, size_t src_size,
+                      void *dst, size_t size, int num_threads) {
+  const uint8_t *in = static_cast<const uint8_t*>(src);
+  PackHeader h;
+  if (src_size < sizeof(h)) return false;
+  memcpy(&h, in, sizeof(h));
+  if (h.method == PACK_RAW) {
+    if (src_size < sizeof(h) + size) return false;
+    memcpy(dst, in + sizeof(h), size);
+    return true;
+  }
+  int w = GetCompressionWordSize(type);
+  size_t nb = GetNumBlocks(size);
+  if (h.method != PACK_SHUFFLE_RLE || w == 0 || h.num_blocks != nb ||
+      src_size < sizeof(h) + nb * sizeof(uint32_t)) {
+    return false;
+  }
+  std::vector<uint32_t> block_sizes(nb);
+  memcpy(&block_sizes[0], in + sizeof(h), nb * sizeof(uint32_t));
+  std::vector<size_t> block_offsets(nb);
+  size_t offset = sizeof(h) + nb * sizeof(uint32_t);
+  for (size_t j = 0; j < nb; ++j) {
+    block_offsets[j] = offset;
+    offset += block_sizes[j] & ~kRawBlock;
+  }
+  if (offset > src_size) return false;
+  BlockCoding c = {w, in, size, static_cast<uint8_t*>(dst),
+                   &block_sizes[0], &block_offsets[0], nb, false};
+  RunBlocks(&c, DecodeBlock, num_threads);
+  return !c.failed;
+}
+
+//
+// MessageCompressor
+//
+
+//! Number of messages of a stream measured for each decision
+static const int kNumProbes = 4;
+//! Number of messages sent uncompressed after compression does not pay
+static const int kNumSuspended = 64;
+//! Maximum ratio of compressed streams
+static const double kMaxRatio = 0.9;
+
+MessageCompressor::MessageCompressor():
+    threshold_(0), num_threads_(1), bandwidth_(1250.0 * 1000 * 1000),
+    raw_bytes_(0), packed_bytes_(0) {
+  const char *s = getenv("PHYSIS_COMPRESS_THRESHOLD");
+  if (s) threshold_ = (size_t)strtoull(s, NULL, 10);
+  s = getenv("PHYSIS_COMPRESS_THREADS");
+  if (s) num_threads_ = std::max(atoi(s), 1);
+  s = getenv("PHYSIS_COMPRESS_BANDWIDTH");
+  if (s && atof(s) > 0) bandwidth_ = atof(s) * 1000 * 1000;
+  LOG_DEBUG() << "Compression threshold: " << threshold_ << "\n";
+}
+
+MessageCompressor::MessageCompressor(size_t threshold, int num_threads,
+                                     double bandwidth):
+    threshold_(threshold), num_threads_(std::max(num_threads, 1)),
+    bandwidth_(bandwidth), raw_bytes_(0), packed_bytes_(0) {
+}
+
+size_t MessageCompressor::Pack(const MessageStream &stream, PSType type,
+                               const void *src, size_t size, void *dst) {
+  StreamStats &s = streams_[stream];
+  size_t len;
+  if (s.suspended > 0) {
+    --s.suspended;
+    len = StoreRaw(src, size, dst);
+  } else {
+    Stopwatch st;
+    st.Start();
+    len = CompressPoints(type, src, size, dst, num_threads_);
+    s.time += st.Stop() * 1.0e-3;
+    s.raw += size;
+    s.packed += len;
+    if (++s.count == kNumProbes) {
+      double saved = s.packed < s.raw ?
+          (s.raw - s.packed) / bandwidth_ : 0.0;
+      // Decoding takes about as long as encoding
+      if (s.packed > s.raw * kMaxRatio || s.time * 2 > saved) {
+        LOG_DEBUG() << "Suspending compression of ratio "
+                    << (double)s.packed / s.raw << " and time "
+                    << s.time << " s\n";
+        s.suspended = kNumSuspended;
+      }
+      s.raw = s.packed = s.count = 0;
+      s.time = 0.0;
+    }
+  }
+  raw_bytes_ += size;
+  packed_bytes_ += len;
+  return len;
+}
+
+void MessageCompressor::Unpack(PSType type, const void *src,
+                               size_t src_size, void *dst, size_t size) {
+  if (!DecompressPoints(type, src, src_size, dst, size, num_threads_)) {
+    LOG_ERROR() << "Malformed compressed message\n";
+    PSAbort(1);
+  }
+}
+
+bool MessageCompressor::IsSuspended(const MessageStream &stream) const {
+  std::map<MessageStream, StreamStats>::const_iterator it =
+      streams_.find(stream);
+  return it != streams_.end() && it->second.suspended > 0;
+}
+
+void SendPacked(InterProcComm *ipc, MessageCompressor *c, int grid_id,
+                PSType type, void *buf, size_t size, int dst) {
+  if (!c->IsCompressed(type, size)) {
+    ipc->Send(buf, size, dst);
+    return;
+  }
+  size_t cap = c->GetPackedSize(size);
+  void *packed = c->staging_pool().GetChunk(cap);
+  uint64_t len = c->Pack(MessageStream(grid_id, dst, MessageStream::kCopy),
+                         type, buf, size, packed);
+  ipc->Send(&len, sizeof(len), dst);
+  ipc->Send(packed, len, dst);
+  c->staging_pool().ReleaseChunk(packed, cap);
+}
+
+void RecvPacked(InterProcComm *ipc, MessageCompressor *c, PSType type,
+                void *buf, size_t size, int src) {
+  if (!c->IsCompressed(type, size)) {
+    ipc->Recv(buf, size, src);
+    return;
+  }
+  uint64_t len;
+  ipc->Recv(&len, sizeof(len), src);
+  if (len > c->GetPackedSize(size)) {
+    LOG_ERROR() << "Compressed message too large: " << len << "\n";
+    PSAbort(1);
+  }
+  // Sized for the largest message so that chunks are reused
+  size_t cap = c->GetPackedSize(size);
+  void *packed = c->staging_pool().GetChunk(cap);
+  ipc->Recv(packed, len, src);
+  c->Unpack(type, packed, len, buf, size);
+  c->staging_pool().ReleaseChunk(packed, cap);
+}
+
+} // namespace runtime
+} // namespace physis
@@ -0,0 +1,178 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_RUNTIME_COMPRESS_H_
+#define PHYSIS_RUNTIME_COMPRESS_H_
+
+#include <stdint.h>
+#include <map>
+
+#include "runtime/runtime_common.h"
+#include "runtime/buffer.h"
+#include "runtime/ipc.h"
+
+namespace physis {
+namespace runtime {
+
+//! Returns the size of the words predicted by the codec for a type.
+/*!
+  \return Zero if points of the type are not compressed.
+ */
+int GetCompressionWordSize(PSType type);
+
+//! Returns the maximum size of compressed points.
+size_t GetMaxCompressedSize(size_t size);
+
+//! Compresses points losslessly.
+/*!
+  Each word is predicted by the previous one and replaced by their
+  XOR, which clears the sign, exponent and leading mantissa bits of
+  smooth fields. The bytes of the residuals are then shuffled into
+  planes so that the cleared bytes form long runs, which are
+  run-length encoded. Points are coded in independent blocks, which
+  are distributed over threads; blocks and whole messages that do not
+  shrink are stored as they are.
+
+  \param type The point type; must have a non-zero word size.
+  \param src The points.
+  \param size The size of the points in bytes.
+  \param dst Receives at most GetMaxCompressedSize(size) bytes.
+  \param num_threads Number of threads coding the blocks.
+  \return The size of the compressed points.
+ */
+size_t CompressPoints(PSType type, const void *src, size_t size,
+                      void *dst, int num_threads);
+
+//! Decompresses points compressed by CompressPoints.
+/*!
+  \param type The point type.
+  \param src The compressed points.
+  \param src_size The maximum size of the compressed points.
+  \param dst Receives the points.
+  \param size The size of the points in bytes.
+  \param num_threads Number of threads decoding the blocks.
+  \return False if the compressed points are malformed.
+ */
+bool DecompressPoints(PSType type, const void *src, size_t src_size,
+                      void *dst, size_t size, int num_threads);
+
+//! Identifies a stream of similar messages.
+/*!
+  Messages of the same grid exchanged with the same peer for the same
+  purpose, such as the halo in one direction, are expected to
+  compress alike.
+ */
+struct MessageStream {
+  //! Tag of the copies of whole sub grids
+  static const int kCopy = -1;
+  int grid;
+  int peer;
+  //! Distinguishes the messages of a grid to a peer, e.g., the
+  //! direction of a halo
+  int tag;
+  MessageStream(int grid, int peer, int tag):
+      grid(grid), peer(peer), tag(tag) {}
+  bool operator<(const MessageStream &s) const {
+    if (grid != s.grid) return grid < s.grid;
+    if (peer != s.peer) return peer < s.peer;
+    return tag < s.tag;
+  }
+};
+
+//! Optional compression of messages carrying grid points.
+/*!
+  Messages of primitive types no smaller than a threshold are
+  compressed. Since the receiver must allocate for the compressed
+  format, whether a message is compressed only depends on its type
+  and size, and the threshold must be the same on all processes.
+
+  Compression is adaptive for each stream of similar messages, such
+  as the halo of a grid in one direction. After a few messages, a
+  stream whose ratio or coding time does not pay off for the
+  bandwidth of the network is sent uncompressed for a while, after
+  which compression is probed again.
+
+  The default settings are read from the environment:
+  PHYSIS_COMPRESS_THRESHOLD gives the threshold in bytes (no message
+  is compressed when not set), PHYSIS_COMPRESS_THREADS the number of
+  coding threads (1 by default) and PHYSIS_COMPRESS_BANDWIDTH the
+  network bandwidth in MB/s (1250 by default).
+ */
+class MessageCompressor {
+ public:
+  //! Creates a compressor with the default settings.
+  MessageCompressor();
+  /*!
+    \param threshold Minimum size of compressed messages; zero
+    disables compression.
+    \param num_threads Number of coding threads.
+    \param bandwidth Network bandwidth in bytes per second.
+   */
+  MessageCompressor(size_t threshold, int num_threads, double bandwidth);
+  virtual ~MessageCompressor() {}
+  size_t threshold() const { return threshold_; }
+  //! Returns true if messages of a type and size are compressed.
+  bool IsCompressed(PSType type, size_t size) const {
+    return threshold_ > 0 && size >= threshold_ &&
+        GetCompressionWordSize(type) > 0;
+  }
+  //! Returns the size of the buffer of a compressed message.
+  size_t GetPackedSize(size_t size) const {
+    return GetMaxCompressedSize(size);
+  }
+  //! Encodes a message.
+  /*!
+    \param stream The stream of the message.
+    \param type The point type.
+    \param src The message.
+    \param size The size of the message.
+    \param dst Receives at most GetPackedSize(size) bytes.
+    \return The size of the encoded message.
+   */
+  size_t Pack(const MessageStream &stream, PSType type, const void *src,
+              size_t size, void *dst);
+  //! Decodes a message encoded by Pack.
+  void Unpack(PSType type, const void *src, size_t src_size,
+              void *dst, size_t size);
+  //! Returns true if a stream is currently sent uncompressed.
+  bool IsSuspended(const MessageStream &stream) const;
+  //! Total size of the messages given to Pack.
+  size_t raw_bytes() const { return raw_bytes_; }
+  //! Total size of the messages returned by Pack.
+  size_t packed_bytes() const { return packed_bytes_; }
+  //! Pool of staging buffers for encoded messages.
+  BufferPool &staging_pool() { return staging_pool_; }
+
+ protected:
+  //! Statistics of the messages of a stream since the last decision
+  struct StreamStats {
+    size_t raw;
+    size_t packed;
+    double time;
+    int count;
+    //! Number of messages left to send uncompressed
+    int suspended;
+    StreamStats(): raw(0), packed(0), time(0.0), count(0), suspended(0) {}
+  };
+  size_t threshold_;
+  int num_threads_;
+  double bandwidth_;
+  std::map<MessageStream, StreamStats> streams_;
+  size_t raw_bytes_;
+  size_t packed_bytes_;
+  BufferPool staging_pool_;
+};
+
+//! Sends a copy of a sub grid compressed if the compressor accepts it.
+/*!
+  \param grid_id The grid whose points are sent.
+ */
+void SendPacked(InterProcComm *ipc, MessageCompressor *c, int grid_id,
+                PSType type, void *buf, size_t size, int dst);
+//! Receives a message sent by SendPacked.
+void RecvPacked(InterProcComm *ipc, MessageCompressor *c, PSType type,
+                void *buf, size_t size, int src);
+
+} // namespace runtime
+} // namespace physis
+
+#endif /* PHYSIS_RUNTIME_COMPRESS_H_ */
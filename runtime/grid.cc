@@ -28,7 +28,7 @@ Grid::Grid(const __PSGridTypeInfo *type_info,
            int num_dims, const IndexArray &size, int attr):
     type_(type_info->type), num_dims_(num_dims),
     num_elms_(size.accumulate(num_dims)),
-    size_(size), data_buffer_(NULL), attr_(attr) {
+    size_(size), data_buffer_(NULL), buffer_pool_(NULL), attr_(attr) {
   CopyTypeInfo(type_info_, *type_info);
 }
 
@@ -43,7 +43,11 @@ void Grid::InitBuffer() {
 
 void Grid::DeleteBuffers() {
   if (data_buffer_) {
-    delete data_buffer_;
+    if (buffer_pool_) {
+      buffer_pool_->Release(data_buffer_);
+    } else {
+      delete data_buffer_;
+    }
     data_buffer_ = NULL;
   }
 }
@@ -119,6 +123,13 @@ int Grid::Reduce(PSReduceOp op, void *out) {
   return rv;
 }
 
+GridSpace::~GridSpace() {
+  // Grids not deleted yet release their buffers on their own
+  FOREACH (it, grids_.begin(), grids_.end()) {
+    it->second->buffer_pool() = NULL;
+  }
+}
+
 bool GridSpace::RegisterGrid(Grid *g) {
   g->id() = grid_counter_.next();
   grids_.insert(std::make_pair(g->id(), g));
@@ -56,6 +56,8 @@ class Grid {
   }
   Buffer *buffer() { return data_buffer_; }
   const Buffer *buffer() const { return data_buffer_; }  
+  //! Pool where buffers are recycled; NULL if not pooled.
+  BufferPool *&buffer_pool() { return buffer_pool_; }
   virtual void *GetAddress(const IndexArray &indices);    
   virtual void Set(const IndexArray &indices, const void *buf);
   virtual void Get(const IndexArray &indices, void *buf); 
@@ -82,6 +84,7 @@ class Grid {
   IndexArray size_;
   int id_;
   Buffer *data_buffer_;
+  BufferPool *buffer_pool_;
   //char *data_;
   int attr_;
 
@@ -98,11 +101,13 @@ class Grid {
 class GridSpace {
  public:
   GridSpace() {}
-  virtual ~GridSpace() {}
+  virtual ~GridSpace();
   Grid *FindGrid(int id) const;
   void DeleteGrid(Grid *g);
   void DeleteGrid(int id);
   //void ReduceGrid(Grid *g, void *buf);
+  //! Pool of host buffers recycled between grids.
+  BufferPool &buffer_pool() { return buffer_pool_; }
 
   virtual std::ostream &Print(std::ostream &os) const;
 
@@ -116,6 +121,7 @@ class GridSpace {
   bool DeregisterGrid(Grid *g);
   std::map<int, Grid*> grids_;
   physis::Counter grid_counter_;  
+  BufferPool buffer_pool_;
 };
 
 } // namespace runtime
@@ -4,6 +4,7 @@
 
 #include <limits.h>
 #include <algorithm>
+#include <vector>
 
 #include "runtime/grid_util.h"
 
@@ -32,19 +33,10 @@ GridMPI::GridMPI(const __PSGridTypeInfo *type_info,
     Grid(type_info, num_dims, size, attr),
     global_offset_(global_offset),  
     local_offset_(local_offset), local_size_(local_size),
-    halo_(halo), halo_member_(NULL), halo_self_fw_(NULL), halo_self_bw_(NULL),
+    halo_(halo), halo_member_(NULL), halo_depth_(1), halo_valid_(0),
+    halo_self_fw_(NULL), halo_self_bw_(NULL),
   halo_peer_fw_(NULL), halo_peer_bw_(NULL) {
 
-  empty_ = local_size_.accumulate(num_dims_) == 0;
-  if (empty_) return;
-  
-  local_real_size_ = local_size_;
-  local_real_offset_ = local_offset_;
-  for (int i = 0; i < num_dims_; ++i) {
-    local_real_size_[i] += halo.fw[i] + halo.bw[i];
-    local_real_offset_[i] -= halo.bw[i];
-  }
-
   if (type_info->num_members > 0) {
     halo_member_ = new Width2[type_info->num_members];
     for (int i = 0; i < type_info->num_members; ++i) {
@@ -70,7 +62,18 @@ GridMPI::GridMPI(const __PSGridTypeInfo *type_info,
     type_info_.members[0].type = PS_USER;
     halo_member_[0] = halo_;
   }
+
+  // Member info above is set even without local points since the
+  // sizes of the whole grid are computed from it
+  empty_ = local_size_.accumulate(num_dims_) == 0;
+  if (empty_) return;
   
+  local_real_size_ = local_size_;
+  local_real_offset_ = local_offset_;
+  for (int i = 0; i < num_dims_; ++i) {
+    local_real_size_[i] += halo.fw[i] + halo.bw[i];
+    local_real_offset_[i] -= halo.bw[i];
+  }
 }
 
 GridMPI *GridMPI::Create(PSType type, int elm_size,
@@ -92,10 +95,12 @@ GridMPI* GridMPI::Create(const __PSGridTypeInfo *type_info,
                          const IndexArray &local_size,
                          const Width2 &halo,
                          const Width2 *halo_member,                         
-                         int attr) {
+                         int attr,
+                         BufferPool *buffer_pool) {
   GridMPI *g = new GridMPI(type_info, num_dims, size,
                            global_offset, local_offset,
                            local_size, halo, halo_member, attr);
+  g->buffer_pool_ = buffer_pool;
   g->InitBuffers();
   return g;
 }
@@ -103,8 +108,12 @@ GridMPI* GridMPI::Create(const __PSGridTypeInfo *type_info,
 
 void GridMPI::InitBuffers() {
   if (empty_) return;  
-  data_buffer_ = new BufferHost();
-  data_buffer_->Allocate(GetLocalBufferRealSize());
+  if (buffer_pool_) {
+    data_buffer_ = buffer_pool_->GetBuffer(GetLocalBufferRealSize());
+  } else {
+    data_buffer_ = new BufferHost();
+    data_buffer_->Allocate(GetLocalBufferRealSize());
+  }
   //data_ = (char*)data_buffer_->Get();
   //LOG_DEBUG() << "buffer addr: " << (void*)data_ << "\n";
   InitHaloBuffers();
@@ -124,24 +133,35 @@ void GridMPI::InitHaloBuffers() {
     halo_self_fw_[i] = halo_self_bw_[i] = NULL;
     halo_peer_fw_[i] = halo_peer_bw_[i] = NULL;
     if (halo_.fw[i]) {
-      halo_self_fw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.fw[i], true) * elm_size());
-      assert(halo_self_fw_[i]);
-      halo_peer_fw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.fw[i], true) * elm_size());
-      assert(halo_peer_fw_[i]);      
+      size_t halo_size = CalcHaloSize(i, halo_.fw[i], true) * elm_size();
+      halo_self_fw_[i] = AllocateHaloBuffer(halo_size);
+      halo_peer_fw_[i] = AllocateHaloBuffer(halo_size);
     } 
     if (halo_.bw[i]) {
-      halo_self_bw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.bw[i], true) * elm_size());
-      assert(halo_self_bw_[i]);
-      halo_peer_bw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.bw[i], true) * elm_size());
-      assert(halo_peer_bw_[i]);      
+      size_t halo_size = CalcHaloSize(i, halo_.bw[i], true) * elm_size();
+      halo_self_bw_[i] = AllocateHaloBuffer(halo_size);
+      halo_peer_bw_[i] = AllocateHaloBuffer(halo_size);
     } 
   }
 }
 
+char *GridMPI::AllocateHaloBuffer(size_t size) {
+  char *p = (char*)(buffer_pool_ ? buffer_pool_->GetChunk(size) :
+                    malloc(size));
+  assert(p);
+  return p;
+}
+
+void GridMPI::FreeHaloBuffer(char *&p, size_t size) {
+  if (p == NULL) return;
+  if (buffer_pool_) {
+    buffer_pool_->ReleaseChunk(p, size);
+  } else {
+    free(p);
+  }
+  p = NULL;
+}
+
 GridMPI::~GridMPI() {
   delete[] halo_member_;
   DeleteBuffers();
@@ -157,10 +177,12 @@ void GridMPI::DeleteHaloBuffers() {
   if (empty_) return;
   
   for (int i = 0; i < num_dims_ - 1; ++i) {
-    if (halo_self_fw_) PS_XFREE(halo_self_fw_[i]);
-    if (halo_self_bw_) PS_XFREE(halo_self_bw_[i]);
-    if (halo_peer_fw_) PS_XFREE(halo_peer_fw_[i]);
-    if (halo_peer_bw_) PS_XFREE(halo_peer_bw_[i]);
+    size_t fw_size = CalcHaloSize(i, halo_.fw[i], true) * elm_size();
+    size_t bw_size = CalcHaloSize(i, halo_.bw[i], true) * elm_size();
+    if (halo_self_fw_) FreeHaloBuffer(halo_self_fw_[i], fw_size);
+    if (halo_self_bw_) FreeHaloBuffer(halo_self_bw_[i], bw_size);
+    if (halo_peer_fw_) FreeHaloBuffer(halo_peer_fw_[i], fw_size);
+    if (halo_peer_bw_) FreeHaloBuffer(halo_peer_bw_[i], bw_size);
   }
   PS_XDELETEA(halo_self_fw_);
   PS_XDELETEA(halo_self_bw_);
@@ -168,6 +190,35 @@ void GridMPI::DeleteHaloBuffers() {
   PS_XDELETEA(halo_peer_bw_);
 }
 
+void GridMPI::SetHaloDepth(int depth, const Width2 &halo) {
+  halo_depth_ = depth;
+  halo_valid_ = 0;
+  if (empty_) {
+    halo_ = halo;
+    halo_member_[0] = halo_;
+    return;
+  }
+  std::vector<char> points(GetLocalBufferSize());
+  Copyout(&points[0]);
+  DeleteBuffers();
+  halo_ = halo;
+  halo_member_[0] = halo_;
+  local_real_size_ = local_size_;
+  local_real_offset_ = local_offset_;
+  for (int i = 0; i < num_dims_; ++i) {
+    local_real_size_[i] += halo_.fw[i] + halo_.bw[i];
+    local_real_offset_[i] -= halo_.bw[i];
+  }
+  InitBuffers();
+  Copyin(&points[0]);
+}
+
+void GridMPI::SetBuffer(Buffer *buf) {
+  PSAssert(buf->size() >= GetLocalBufferRealSize());
+  Grid::DeleteBuffers();
+  data_buffer_ = buf;
+}
+
 char *GridMPI::GetHaloPeerBuf(int dim, bool fw, unsigned width) {
   if (dim == num_dims_ - 1) {
     IndexArray offset(0);
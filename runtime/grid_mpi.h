@@ -33,6 +33,23 @@ class GridMPI: public Grid {
           int attr);
   //! Flag to indicate whether this sub grid is empty
   bool empty_;
+  //! Wraps an index into [0, n).
+  /*!
+    Indices at most n away from [0, n) are wrapped without division;
+    farther ones, such as with stencil offsets larger than the grid,
+    fall back to the modulo.
+   */
+  static PSIndex WrapIndex(PSIndex i, PSIndex n) {
+    if (i < 0) {
+      i += n;
+    } else if (i >= n) {
+      i -= n;
+    }
+    if (i < 0 || i >= n) {
+      i = ((i % n) + n) % n;
+    }
+    return i;
+  }
   //! Offset of the whole grid within the global domain.
   /*!
     This is usually 0. If non-zero, the grid is located within the
@@ -60,6 +77,14 @@ class GridMPI: public Grid {
   IndexArray local_real_offset_;    
   //! Length of the actual buffer with halo
   IndexArray local_real_size_;
+  //! Number of stencil widths held by the halo
+  int halo_depth_;
+  //! Width of the halo whose points are up to date
+  /*!
+    Only tracked for grids with deep halos; see
+    GridSpaceMPI::SetHaloDepth.
+   */
+  int halo_valid_;
 
   // REFACTORING: Use Buffer abstraction
   //! Buffer for sending halo for forward accesses
@@ -81,6 +106,19 @@ class GridMPI: public Grid {
   virtual void DeleteBuffers();
   //! Deletes halo buffers.
   virtual void DeleteHaloBuffers();
+  //! Allocates a halo buffer, recycled from the buffer pool if any.
+  char *AllocateHaloBuffer(size_t size);
+  //! Frees a halo buffer allocated by AllocateHaloBuffer.
+  void FreeHaloBuffer(char *&p, size_t size);
+  //! Replaces the data buffer.
+  /*!
+    The current buffer is deleted, and the grid takes the ownership
+    of the new buffer, which must be large enough to hold the sub grid
+    including the halo.
+
+    \param buf The new data buffer.
+   */
+  virtual void SetBuffer(Buffer *buf);
 
   virtual char *&GetHaloSelf(int dim, bool fw) {
     return fw ? halo_self_fw_[dim] : halo_self_bw_[dim];
@@ -134,7 +172,8 @@ class GridMPI: public Grid {
                          const IndexArray &local_size,
                          const Width2 &halo,
                          const Width2 *halo_member,
-                         int attr);
+                         int attr,
+                         BufferPool *buffer_pool=NULL);
   
   virtual ~GridMPI();
   virtual std::ostream &Print(std::ostream &os) const;
@@ -150,6 +189,20 @@ class GridMPI: public Grid {
   }  
   const Width2 &halo() const { return halo_; }
   bool HasHalo() const { return ! (halo_.fw == 0 && halo_.bw == 0); }
+  int halo_depth() const { return halo_depth_; }
+  int halo_valid() const { return halo_valid_; }
+  void set_halo_valid(int width) { halo_valid_ = width; }
+  //! Marks all the points of the halo stale.
+  void InvalidateHalo() { halo_valid_ = 0; }
+  //! Widens the halo for a halo depth.
+  /*!
+    The buffers are reallocated with the new halo, keeping the points
+    of the sub grid. The halo is invalidated.
+
+    \param depth The new halo depth.
+    \param halo The new halo width.
+   */
+  virtual void SetHaloDepth(int depth, const Width2 &halo);
 
   Width2 &halo(int member_id) {
     return halo_member_[member_id];
@@ -205,7 +258,9 @@ class GridMPI: public Grid {
   //! Get the offset of an grid element with periodic access.
   /*!
     The indices may be outside the grid logical domain. In that case,
-    the access is wrapped around.
+    the access is wrapped around. Dimensions that are decomposed
+    read wrapped-around points from the halo, and the others wrap
+    the index.
     
     \param indices Position of the element.
     \return Offset of the element in length.
@@ -214,18 +269,18 @@ class GridMPI: public Grid {
   PSIndex CalcOffsetPeriodic(const IndexArray &indices) {
     PSIndex off =
         local_size_[0] == size_[0] ? 
-        (indices[0] + size_[0]) % size_[0] :
+        WrapIndex(indices[0], size_[0]) :
         indices[0] - local_real_offset_[0];
     if (dim > 1)
       off +=
           (local_size_[1] == size_[1] ? 
-           (indices[1] + size_[1]) % size_[1] :
+           WrapIndex(indices[1], size_[1]) :
            indices[1] - local_real_offset_[1])
           * local_real_size_[0];
     if (dim > 2)
       off +=
           (local_size_[2] == size_[2] ? 
-           (indices[2] + size_[2]) % size_[2] :
+           WrapIndex(indices[2], size_[2]) :
            indices[2] - local_real_offset_[2])
           * local_real_size_[0] * local_real_size_[1];
     return off;
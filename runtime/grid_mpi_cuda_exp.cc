@@ -71,7 +71,9 @@ GridMPICUDAExp *GridMPICUDAExp::Create(
       const IndexArray &global_offset, const IndexArray &local_offset,
       const IndexArray &local_size, const Width2 &halo,
       const Width2 *halo_member,
-      int attr) {
+      int attr,
+      BufferPool *buffer_pool) {
+  // Device buffers are not pooled
   GridMPICUDAExp *g = new GridMPICUDAExp(
       type_info, num_dims, size, global_offset, local_offset,
       local_size, halo, halo_member, attr);
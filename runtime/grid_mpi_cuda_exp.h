@@ -66,7 +66,8 @@ class GridMPICUDAExp: public GridMPI {
       const IndexArray &global_offset, const IndexArray &local_offset,
       const IndexArray &local_size, const Width2 &halo,
       const Width2 *halo_member,      
-      int attr);
+      int attr,
+      BufferPool *buffer_pool=NULL);
   
   
   virtual ~GridMPICUDAExp();
@@ -11,10 +11,15 @@
 #include "runtime/mpi_util.h"
 #include "runtime/mpi_wrapper.h"
 #include "runtime/grid_mpi.h"
+#include "runtime/grid_util.h"
+#include "runtime/buffer_mpi_shared.h"
 #include "runtime/timing.h"
 #include "runtime/ipc.h"
+#include "runtime/compress.h"
 
+#include <limits.h>
 #include <utility>
+#include <vector>
 
 namespace physis {
 namespace runtime {
@@ -25,6 +30,35 @@ struct FetchInfo {
   IndexArray peer_size;
 };
 
+//! Sub grid geometry of a process on the same node.
+struct SharedHaloGeometry {
+  PSIndex real_size[PS_MAX_DIM];
+  PSIndex halo_bw[PS_MAX_DIM];
+  PSIndex halo_fw[PS_MAX_DIM];
+};
+
+//! Per-grid state of the shared-memory halo exchange.
+struct SharedHalo {
+  //! Shared data buffer; owned by the grid unless the grid is empty.
+  BufferHostMPIShared *buffer;
+  bool owned;
+  //! Geometry of each process in the shared communicator
+  std::vector<SharedHaloGeometry> geometry;
+};
+
+//! Compressed halo message in flight.
+struct PackedHalo {
+  //! Staging buffer of the compressed message
+  void *buf;
+  size_t buf_size;
+  //! Halo buffer receiving the message; NULL when sending
+  void *dst;
+  size_t size;
+  PSType type;
+  //! Request of the send
+  MPI_Request req;
+};
+
 enum GRID_REQUEST_KIND {INVALID, DONE, FETCH_REQUEST, FETCH_REPLY};
 
 struct GridRequest {
@@ -34,6 +68,30 @@ struct GridRequest {
   GridRequest(int rank, GRID_REQUEST_KIND k): my_rank(rank), kind(k) {}
 };
 
+//! MPI tag of the points transferred between grid levels.
+/*!
+  Distinct from the tag of the other messages, which may be in
+  flight between the same processes, such as asynchronous copyouts.
+ */
+#define PS_MPI_LEVEL_TRANSFER_TAG (1000)
+
+//! Returns how many times a dimension of a grid is coarsened.
+/*!
+  \param global_size Size of the domain along the dimension.
+  \param size Size of the grid along the dimension.
+  \return The coarsest level that still has size points or more.
+ */
+inline int GetCoarsenLevel(PSIndex global_size, PSIndex size) {
+  int level = 0;
+  PSIndex factor = PS_COARSEN_FACTOR;
+  while (size > 0 && factor <= global_size &&
+         (global_size + factor - 1) / factor >= size) {
+    ++level;
+    factor *= PS_COARSEN_FACTOR;
+  }
+  return level;
+}
+
 void SendGridRequest(int my_rank, int peer_rank, MPI_Comm comm,
                      GRID_REQUEST_KIND kind);
 GridRequest RecvGridRequest(MPI_Comm comm);
@@ -158,7 +216,71 @@ class GridSpaceMPI: public GridSpace {
   
   
 
+  //! Widen the halo of a grid to exchange it every few stencils.
+  /*!
+    The halo becomes depth times the widest stencil access of the
+    grid (at least one point) on both sides of every decomposed
+    dimension. Neighbor loads of the grid then exchange the whole
+    halo, and skip the exchange while enough of the halo is still up
+    to date. This requires the stencils to compute the points of the
+    halo redundantly, which GetDomainExtension accounts for, so the
+    halo is only reused once a stencil has been extended.
+
+    The depth is reduced to fit the smallest sub grid, and kept at
+    one for grids not spanning all processes or exchanged through
+    shared memory. Collective over all processes.
+
+    \param g The grid.
+    \param depth Number of stencil widths held by the halo.
+   */
+  virtual void SetHaloDepth(GT *g, int depth);
+  //! Width of the halo on all decomposed sides of a grid.
+  /*!
+    \return INT_MAX if no dimension is decomposed.
+   */
+  int GetHaloExtent(GT *g) const;
+  //! Compute how far to extend the local domain of a stencil.
+  /*!
+    Called after the neighbor loads of a stencil, which record how
+    far the loaded halos allow to compute redundantly. The
+    extension is further limited by the valid halo of the grids read
+    at the computed points and the halo of the written grids, and is
+    zero unless all the grids have deep halos. The halos of the
+    written grids are marked stale beyond the extension.
+
+    \param num_grids Number of grids accessed by the stencil.
+    \param grids The grids.
+    \param modes PS_GRID_ACCESS_READ and PS_GRID_ACCESS_WRITE flags
+    of each grid.
+    \return Number of points to extend on each side.
+   */
+  virtual int GetDomainExtension(int num_grids, GT **grids,
+                                 const int *modes);
+
   virtual int FindOwnerProcess(GT *g, const IndexArray &index);
+
+  //! Enable halo exchange through shared memory within each node.
+  /*!
+    Grids created afterwards are allocated in MPI-3 shared-memory
+    windows spanning the processes on the same node. Halos of
+    neighbors on the same node are then directly copied from their
+    grid buffers without packing and message passing. Halos of
+    off-node neighbors are still exchanged with MPI messages.
+
+    Must be called collectively before creating any grid.
+    
+    \return True if enabled.
+   */
+  virtual bool EnableSharedMemoryHalo();
+  bool shared_memory_halo() const { return shm_comm_ != MPI_COMM_NULL; }
+  //! Delete a grid.
+  /*!
+    Hides GridSpace::DeleteGrid to release the shared-memory window
+    of the grid. Must be called collectively when the shared-memory
+    halo exchange is enabled.
+   */
+  void DeleteGrid(GT *g);
+  void DeleteGrid(int id);
   
   virtual std::ostream &Print(std::ostream &os) const;
   
@@ -173,6 +295,8 @@ class GridSpaceMPI: public GridSpace {
   const IndexArray &my_size() { return my_size_; }
   const IndexArray &my_offset() { return my_offset_; }  
   const std::vector<IntArray> &proc_indices() const { return proc_indices_; }
+  //! Compressor of halo and copy messages.
+  MessageCompressor *compressor() const { return compressor_; }
   int GetProcessRank(const IntArray &proc_index) const;
   //! Reduce a grid with binary operator op.
   /*
@@ -182,6 +306,40 @@ class GridSpaceMPI: public GridSpace {
    * \return The number of reduced elements.
    */
   virtual int ReduceGrid(void *out, PSReduceOp op, GT *g);
+  //! Restrict a grid to the grid coarsened from it.
+  /*!
+    Collective over all processes. Coarse grids are partitioned on
+    boundaries aligned with those of the finer levels, so the points
+    are mostly restricted within each process and otherwise received
+    from the neighbors only.
+    
+    \param coarse The destination coarse grid.
+    \param fine The source fine grid.
+    \see RestrictSubgrid
+   */
+  virtual void RestrictGrid(GT *coarse, GT *fine);
+  //! Prolong a coarsened grid to the grid it is coarsened from.
+  /*!
+    Collective over all processes.
+    
+    \param fine The destination fine grid.
+    \param coarse The source coarse grid.
+    \param accumulate True to add to the fine grid.
+    \see ProlongSubgrid
+   */
+  virtual void ProlongGrid(GT *fine, GT *coarse, bool accumulate);
+
+  //! Level from which coarse grids are agglomerated.
+  /*!
+    Grids coarsened this many times or more from the domain are
+    held entirely by the first process instead of being partitioned
+    over all processes. Set by environment variable
+    PHYSIS_AGGLOMERATE_LEVEL; 0, the default, disables
+    agglomeration. Must be the same on all processes and must not be
+    changed while coarse grids exist.
+   */
+  int agglomeration_level() const { return agglomeration_level_; }
+  void set_agglomeration_level(int level) { agglomeration_level_ = level; }
 
   //virtual void Save() const;
   //virtual void Restore();
@@ -207,6 +365,45 @@ class GridSpaceMPI: public GridSpace {
   MPI_Comm comm_;
   // Timing profile for halo exchange
   std::map<int, DataCopyProfile*> load_neighbor_prof_;
+  //! Communicator of the processes on the same node
+  MPI_Comm shm_comm_;
+  //! Rank in shm_comm_ of each process; MPI_UNDEFINED if off node
+  std::vector<int> shm_ranks_;
+  //! Shared-memory halo state of each grid
+  std::map<int, SharedHalo*> shm_halo_;
+  MessageCompressor *compressor_;
+  //! Compressed halo messages of the ongoing exchange
+  mutable std::vector<PackedHalo> packed_halos_;
+  //! Extension allowed by the neighbor loads since the last stencil
+  int pending_extension_;
+  //! True once a stencil has been extended
+  bool domain_extension_;
+  int agglomeration_level_;
+
+  //! Move the buffer of a new grid into a shared-memory window.
+  virtual void InitSharedHalo(GT *g);
+  const SharedHalo *FindSharedHalo(GT *g) const;
+  //! True if the halo from peer is directly read from shared memory.
+  bool IsSharedPeer(GT *g, int peer) const;
+  //! Copy the halo of one dimension from peers on the same node.
+  virtual void CopyinSharedHalo(GT *g, int dim,
+                                const Width2 &halo_width,
+                                bool periodic) const;
+  //! Receive a halo, compressed if the compressor accepts it.
+  void IrecvHalo(GT *g, void *buf, size_t size, int peer,
+                 std::vector<MPI_Request> &requests) const;
+  //! Send a halo, compressed if the compressor accepts it.
+  /*!
+    \param tag Direction of the halo, which identifies the stream of
+    compressed messages with the grid and the peer.
+   */
+  void IsendHalo(GT *g, void *buf, size_t size, int peer,
+                 int tag) const;
+  //! Wait for compressed sends and decompress received halos.
+  /*!
+    Must be called after the receive requests complete.
+   */
+  void CompletePackedHalos() const;
   
   // To support fetching of subgrids from distributed processes. Used
   // by LoadSubgrid
@@ -223,19 +420,77 @@ class GridSpaceMPI: public GridSpace {
   void *buf;
   size_t cur_buf_size;
 
+  //! Gather regions of a distributed grid.
+  /*!
+    Collective over the processes exchanging points of the
+    regions. Points are only sent to the processes whose region
+    intersects the local subgrid, so the regions must be known to
+    all processes.
+
+    \param g The grid.
+    \param offsets The offset of the region of each process.
+    \param sizes The size of the region of each process.
+    \param region_buf Receives the points of the region of this
+    process.
+   */
+  virtual void GatherRegion(GT *g, const std::vector<IndexArray> &offsets,
+                            const std::vector<IndexArray> &sizes,
+                            void *region_buf);
+  //! Abort unless coarse is coarsened from fine.
+  void CheckCoarsened(GT *coarse, GT *fine) const;
+
   //! Calculate paritioning of a grid into sub grids.
+  /*!
+    \see GetSubgrid
+   */
   virtual void PartitionGrid(int num_dims, const IndexArray &size,
                              const IndexArray &global_offset,
                              IndexArray &local_offset, IndexArray &local_size) {
-    for (int i = 0; i < num_dims; ++i) {
-      local_offset[i] =
-          std::max(my_offset_[i] - global_offset[i], (PSIndex)0);
-      PSIndex first = std::max(my_offset_[i], global_offset[i]);
-      PSIndex last = std::min(global_offset[i] + size[i],
-                              my_offset_[i] + my_size_[i]);
-      local_size[i] = std::max(last - first, (PSIndex)0);
+    if (GetLevel(num_dims, size, global_offset) > 0 &&
+        !IsAgglomerated(num_dims, size) &&
+        !IsLevelPartitionable(num_dims, size)) {
+      LOG_WARNING() << "Grid of " << size << " points is too small to be "
+                    << "partitioned over " << proc_size_
+                    << " processes; agglomerated on the first process\n";
     }
-    return;
+    GetSubgrid(num_dims, size, global_offset, my_idx_,
+               local_offset, local_size);
+  }
+  //! Calculate the sub grid of a grid on a process.
+  /*!
+    Grids at the origin smaller than the domain, such as coarsened
+    grids, are partitioned on the process boundaries coarsened as
+    many times as the grid, so that each coarse point is on the
+    process of the first fine point it covers. Such a grid is
+    agglomerated on the first process if enabled for its level or if
+    some process in the middle would have no point. Other grids are
+    aligned with domains and only have subgrids on the processes
+    covering them.
+   */
+  void GetSubgrid(int num_dims, const IndexArray &size,
+                  const IndexArray &global_offset,
+                  const IntArray &proc_index,
+                  IndexArray &local_offset, IndexArray &local_size) const;
+  //! Returns the level of a coarse grid; 0 for other grids.
+  int GetLevel(int num_dims, const IndexArray &size,
+               const IndexArray &global_offset) const;
+  //! True if agglomeration is enabled for the level of a coarse grid.
+  bool IsAgglomerated(int num_dims, const IndexArray &size) const;
+  //! True unless some process in the middle would have no point.
+  bool IsLevelPartitionable(int num_dims, const IndexArray &size) const;
+  //! Returns a process boundary coarsened as many times as a grid.
+  /*!
+    \param dim The dimension.
+    \param proc Index of the process along the dimension; the
+    number of processes for the end of the last process.
+    \param size The size of the grid along the dimension.
+   */
+  PSIndex GetLevelBoundary(int dim, int proc, PSIndex size) const {
+    if (proc >= proc_size_[dim]) return size;
+    int level = GetCoarsenLevel(global_size_[dim], size);
+    PSIndex factor = 1;
+    for (int i = 0; i < level; ++i) factor *= PS_COARSEN_FACTOR;
+    return std::min((offsets_[dim][proc] + factor - 1) / factor, size);
   }
   
 }; // class GridSpaceMPI
@@ -247,8 +502,13 @@ GridSpaceMPI<GridType>::GridSpaceMPI(
     InterProcComm &ipc):
     num_dims_(num_dims), global_size_(global_size),
     proc_num_dims_(proc_num_dims), proc_size_(proc_size),
-    ipc_(ipc), my_rank_(ipc.GetRank()), buf(NULL), cur_buf_size(0) {
+    ipc_(ipc), my_rank_(ipc.GetRank()), shm_comm_(MPI_COMM_NULL),
+    compressor_(new MessageCompressor()),
+    pending_extension_(INT_MAX), domain_extension_(false),
+    agglomeration_level_(0), buf(NULL), cur_buf_size(0) {
   assert(num_dims_ == proc_num_dims_);
+  const char *s = getenv("PHYSIS_AGGLOMERATE_LEVEL");
+  if (s) agglomeration_level_ = atoi(s);
   
   num_procs_ = proc_size_.accumulate(proc_num_dims_); // For example 6
 
@@ -287,6 +547,100 @@ GridSpaceMPI<GridType>::~GridSpaceMPI() {
   FOREACH (it, load_neighbor_prof_.begin(), load_neighbor_prof_.end()) {
     delete[] it->second;
   }
+  FOREACH (it, shm_halo_.begin(), shm_halo_.end()) {
+    if (it->second->owned) delete it->second->buffer;
+    delete it->second;
+  }
+  delete compressor_;
+  int finalized;
+  MPI_Finalized(&finalized);
+  if (shm_comm_ != MPI_COMM_NULL && !finalized) {
+    MPI_Comm_free(&shm_comm_);
+  }
+}
+
+template <class GridType>
+bool GridSpaceMPI<GridType>::EnableSharedMemoryHalo() {
+  if (shared_memory_halo()) return true;
+  PSAssert(grids_.empty());
+  CHECK_MPI(MPI_Comm_split_type(comm_, MPI_COMM_TYPE_SHARED, my_rank_,
+                                MPI_INFO_NULL, &shm_comm_));
+  MPI_Group group, shm_group;
+  CHECK_MPI(MPI_Comm_group(comm_, &group));
+  CHECK_MPI(MPI_Comm_group(shm_comm_, &shm_group));
+  std::vector<int> ranks(num_procs_);
+  for (int i = 0; i < num_procs_; ++i) ranks[i] = i;
+  shm_ranks_.resize(num_procs_);
+  CHECK_MPI(MPI_Group_translate_ranks(group, num_procs_, &ranks[0],
+                                      shm_group, &shm_ranks_[0]));
+  MPI_Group_free(&group);
+  MPI_Group_free(&shm_group);
+  int shm_size;
+  CHECK_MPI(MPI_Comm_size(shm_comm_, &shm_size));
+  LOG_INFO() << "Shared-memory halo exchange enabled with "
+             << shm_size << " processes on this node\n";
+  return true;
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::InitSharedHalo(GridType *g) {
+  SharedHalo *sh = new SharedHalo();
+  // Allocation is collective, so empty sub grids allocate an empty
+  // chunk.
+  sh->buffer = new BufferHostMPIShared(shm_comm_);
+  sh->buffer->Allocate(g->empty() ? 0 : g->GetLocalBufferRealSize());
+  sh->owned = g->empty();
+  if (!g->empty()) g->SetBuffer(sh->buffer);
+  SharedHaloGeometry my_geom;
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    my_geom.real_size[i] = g->local_real_size()[i];
+    my_geom.halo_bw[i] = g->halo().bw[i];
+    my_geom.halo_fw[i] = g->halo().fw[i];
+  }
+  int shm_size;
+  CHECK_MPI(MPI_Comm_size(shm_comm_, &shm_size));
+  sh->geometry.resize(shm_size);
+  CHECK_MPI(MPI_Allgather(&my_geom, sizeof(SharedHaloGeometry), MPI_BYTE,
+                          &sh->geometry[0], sizeof(SharedHaloGeometry),
+                          MPI_BYTE, shm_comm_));
+  shm_halo_.insert(std::make_pair(g->id(), sh));
+}
+
+template <class GridType>
+const SharedHalo *GridSpaceMPI<GridType>::FindSharedHalo(
+    GridType *g) const {
+  typename std::map<int, SharedHalo*>::const_iterator it =
+      shm_halo_.find(g->id());
+  return it == shm_halo_.end() ? NULL : it->second;
+}
+
+template <class GridType>
+bool GridSpaceMPI<GridType>::IsSharedPeer(GridType *g, int peer) const {
+  return FindSharedHalo(g) && shm_ranks_[peer] != MPI_UNDEFINED;
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::DeleteGrid(GridType *g) {
+  typename std::map<int, SharedHalo*>::iterator it =
+      shm_halo_.find(g->id());
+  SharedHalo *sh = NULL;
+  if (it != shm_halo_.end()) {
+    sh = it->second;
+    shm_halo_.erase(it);
+  }
+  // Frees the shared window when the buffer is owned by the grid
+  GridSpace::DeleteGrid(g);
+  if (sh) {
+    if (sh->owned) delete sh->buffer;
+    delete sh;
+  }
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::DeleteGrid(int id) {
+  GridType *g = static_cast<GridType*>(FindGrid(id));
+  assert(g);
+  DeleteGrid(g);
 }
 
 template <class GridType>
@@ -352,13 +706,18 @@ GridType *GridSpaceMPI<GridType>::CreateGrid(
     }
   }
   
+  // Buffers of grids in shared-memory windows are not recycled
   GridType *g = GridType::Create(
       type_info, num_dims, grid_size,
       grid_global_offset, local_offset, local_size,
-      halo, halo_member, attr);
+      halo, halo_member, attr,
+      shared_memory_halo() ? NULL : &buffer_pool_);
   LOG_DEBUG() << "grid created\n";
   RegisterGrid(g);
   LOG_DEBUG() << "grid registered\n";
+  if (shared_memory_halo()) {
+    InitSharedHalo(g);
+  }
   DataCopyProfile *profs =
       new DataCopyProfile[num_dims*2];
   load_neighbor_prof_.insert(std::make_pair(g->id(), profs));
@@ -393,7 +752,6 @@ void GridSpaceMPI<GridType>::ExchangeBoundariesAsync(
 
   int fw_peer = fw_neighbors_[dim];
   int bw_peer = bw_neighbors_[dim];
-  int tag = 0;
   const unsigned halo_fw_width = halo_width.fw[dim];
   const unsigned halo_bw_width = halo_width.bw[dim];  
   size_t fw_size = grid->CalcHaloSize(dim, halo_fw_width, diagonal)
@@ -414,34 +772,31 @@ void GridSpaceMPI<GridType>::ExchangeBoundariesAsync(
   if (halo_fw_width > 0 &&
       (grid->local_offset()[dim] + grid->local_size()[dim]
        < grid->size_[dim] ||
-       (periodic && proc_size_[dim] > 1))) {
+       (periodic && proc_size_[dim] > 1)) &&
+      !IsSharedPeer(grid, fw_peer)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Receiving halo of " << fw_size
                 << " bytes for fw access from " << fw_peer << "\n";
-    MPI_Request req;
-    CHECK_MPI(MPI_Irecv(
-        grid->GetHaloPeerBuf(dim, true, halo_fw_width),
-        fw_size, MPI_BYTE, fw_peer, tag, comm_, &req));
-    requests.push_back(req);
+    IrecvHalo(grid, grid->GetHaloPeerBuf(dim, true, halo_fw_width),
+              fw_size, fw_peer, requests);
   }
 
   if (halo_bw_width > 0 &&
       (grid->local_offset()[dim] > 0 ||
-       (periodic && proc_size_[dim] > 1))) {
+       (periodic && proc_size_[dim] > 1)) &&
+      !IsSharedPeer(grid, bw_peer)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Receiving halo of " << bw_size
                 << " bytes for bw access from " << bw_peer << "\n";
-    MPI_Request req;
-    CHECK_MPI(MPI_Irecv(
-        grid->GetHaloPeerBuf(dim, false, halo_bw_width),
-        bw_size, MPI_BYTE, bw_peer, tag, comm_, &req));
-    requests.push_back(req);
+    IrecvHalo(grid, grid->GetHaloPeerBuf(dim, false, halo_bw_width),
+              bw_size, bw_peer, requests);
   }
 
   // Sends out the halo for forward access
   if (halo_fw_width > 0 &&
       (grid->local_offset()[dim] > 0 ||
-       (periodic && proc_size_[dim] > 1))) {
+       (periodic && proc_size_[dim] > 1)) &&
+      !IsSharedPeer(grid, bw_peer)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Sending halo of " << fw_size << " bytes"
                 << " for fw access to " << bw_peer << "\n";
@@ -449,26 +804,24 @@ void GridSpaceMPI<GridType>::ExchangeBoundariesAsync(
     grid->CopyoutHalo(dim, halo_width, true, diagonal);
     LOG_DEBUG() << "grid2: " << grid->data() << "\n";
     LOG_DEBUG() << "dim: " << dim << "\n";        
-    MPI_Request req;
     LOG_DEBUG() << "send buf: " <<
         (void*)(grid->halo_self_fw_[dim])
                 << "\n";        
-    CHECK_MPI(PS_MPI_Isend(grid->halo_self_fw_[dim], fw_size, MPI_BYTE,
-                           bw_peer, tag, comm_, &req));
+    IsendHalo(grid, grid->halo_self_fw_[dim], fw_size, bw_peer, dim * 2);
   }
 
    // Sends out the halo for backward access
   if (halo_bw_width > 0 &&
       (grid->local_offset()[dim] + grid->local_size()[dim]
        < grid->size_[dim] ||
-       (periodic && proc_size_[dim] > 1))) {
+       (periodic && proc_size_[dim] > 1)) &&
+      !IsSharedPeer(grid, fw_peer)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Sending halo of " << bw_size << " bytes"
                 << " for bw access to " << fw_peer << "\n";
     grid->CopyoutHalo(dim, halo_width, false, diagonal);
-    MPI_Request req;
-    CHECK_MPI(PS_MPI_Isend(grid->halo_self_bw_[dim], bw_size, MPI_BYTE,
-                           fw_peer, tag, comm_, &req));
+    IsendHalo(grid, grid->halo_self_bw_[dim], bw_size, fw_peer,
+              dim * 2 + 1);
   }
 
   return;
@@ -478,18 +831,141 @@ template <class GridType>
 void GridSpaceMPI<GridType>::ExchangeBoundaries(
     GridType *grid, int member, int dim, const Width2 &halo_width,
     bool diagonal, bool periodic) const {
+  const SharedHalo *sh = FindSharedHalo(grid);
+  // Make sure the peers on the same node have finished updating
+  // their sub grids
+  if (sh) {
+    sh->buffer->Sync();
+    CHECK_MPI(MPI_Barrier(shm_comm_));
+    sh->buffer->Sync();
+  }
   std::vector<MPI_Request> requests;
   ExchangeBoundariesAsync(grid, member, dim, halo_width, diagonal,
                           periodic, requests);
   FOREACH (it, requests.begin(), requests.end()) {
     MPI_Request *req = &(*it);
     CHECK_MPI(MPI_Wait(req, MPI_STATUS_IGNORE));
+  }
+  CompletePackedHalos();
+  if (!requests.empty()) {
     grid->CopyinHalo(dim, halo_width, false, diagonal);
     grid->CopyinHalo(dim, halo_width, true, diagonal);
   }
+  if (sh) {
+    // Done after CopyinHalo as it copies in both directions
+    // regardless of where the halo came from.
+    CopyinSharedHalo(grid, dim, halo_width, periodic);
+    // The peers must not modify their sub grids until all processes
+    // finish reading them
+    CHECK_MPI(MPI_Barrier(shm_comm_));
+  }
   return;
 }
 
+template <class GridType>
+void GridSpaceMPI<GridType>::IrecvHalo(
+    GridType *g, void *buf, size_t size, int peer,
+    std::vector<MPI_Request> &requests) const {
+  MPI_Request req;
+  if (!compressor_->IsCompressed(g->type(), size)) {
+    CHECK_MPI(MPI_Irecv(buf, size, MPI_BYTE, peer, 0, comm_, &req));
+    requests.push_back(req);
+    return;
+  }
+  PackedHalo h;
+  h.buf_size = compressor_->GetPackedSize(size);
+  h.buf = compressor_->staging_pool().GetChunk(h.buf_size);
+  h.dst = buf;
+  h.size = size;
+  h.type = g->type();
+  h.req = MPI_REQUEST_NULL;
+  // The message may be shorter than the staging buffer
+  CHECK_MPI(MPI_Irecv(h.buf, h.buf_size, MPI_BYTE, peer, 0, comm_, &req));
+  requests.push_back(req);
+  packed_halos_.push_back(h);
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::IsendHalo(
+    GridType *g, void *buf, size_t size, int peer, int tag) const {
+  if (!compressor_->IsCompressed(g->type(), size)) {
+    MPI_Request req;
+    CHECK_MPI(PS_MPI_Isend(buf, size, MPI_BYTE, peer, 0, comm_, &req));
+    return;
+  }
+  PackedHalo h;
+  h.buf_size = compressor_->GetPackedSize(size);
+  h.buf = compressor_->staging_pool().GetChunk(h.buf_size);
+  h.dst = NULL;
+  h.size = compressor_->Pack(MessageStream(g->id(), peer, tag), g->type(),
+                             buf, size, h.buf);
+  h.type = g->type();
+  LOG_DEBUG() << "[" << my_rank_ << "] "
+              << "Halo compressed to " << h.size << " bytes\n";
+  CHECK_MPI(PS_MPI_Isend(h.buf, h.size, MPI_BYTE, peer, 0, comm_,
+                         &h.req));
+  packed_halos_.push_back(h);
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::CompletePackedHalos() const {
+  FOREACH (it, packed_halos_.begin(), packed_halos_.end()) {
+    if (it->dst) {
+      compressor_->Unpack(it->type, it->buf, it->buf_size, it->dst,
+                          it->size);
+    } else {
+      CHECK_MPI(MPI_Wait(&it->req, MPI_STATUS_IGNORE));
+    }
+    compressor_->staging_pool().ReleaseChunk(it->buf, it->buf_size);
+  }
+  packed_halos_.clear();
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::CopyinSharedHalo(
+    GridType *grid, int dim, const Width2 &halo_width,
+    bool periodic) const {
+  if (grid->empty()) return;
+  const SharedHalo *sh = FindSharedHalo(grid);
+  int fw_peer = fw_neighbors_[dim];
+  int bw_peer = bw_neighbors_[dim];
+  // Same conditions as receiving halo in ExchangeBoundariesAsync
+  if (halo_width.fw[dim] > 0 &&
+      (grid->local_offset()[dim] + grid->local_size()[dim]
+       < grid->size_[dim] ||
+       (periodic && proc_size_[dim] > 1)) &&
+      IsSharedPeer(grid, fw_peer)) {
+    int peer = shm_ranks_[fw_peer];
+    const SharedHaloGeometry &geom = sh->geometry[peer];
+    IndexArray src_offset(0), dst_offset(0);
+    src_offset[dim] = geom.halo_bw[dim];
+    dst_offset[dim] = grid->local_real_size()[dim] - grid->halo().fw[dim];
+    IndexArray halo_size = grid->local_real_size();
+    halo_size[dim] = halo_width.fw[dim];
+    CopySubgridToGrid(grid->elm_size(), grid->num_dims(),
+                      grid->data(), grid->local_real_size(), dst_offset,
+                      sh->buffer->GetPeer(peer), IndexArray(geom.real_size),
+                      src_offset, halo_size);
+  }
+  if (halo_width.bw[dim] > 0 &&
+      (grid->local_offset()[dim] > 0 ||
+       (periodic && proc_size_[dim] > 1)) &&
+      IsSharedPeer(grid, bw_peer)) {
+    int peer = shm_ranks_[bw_peer];
+    const SharedHaloGeometry &geom = sh->geometry[peer];
+    IndexArray src_offset(0), dst_offset(0);
+    src_offset[dim] = geom.real_size[dim] - geom.halo_fw[dim]
+        - halo_width.bw[dim];
+    dst_offset[dim] = grid->halo().bw[dim] - halo_width.bw[dim];
+    IndexArray halo_size = grid->local_real_size();
+    halo_size[dim] = halo_width.bw[dim];
+    CopySubgridToGrid(grid->elm_size(), grid->num_dims(),
+                      grid->data(), grid->local_real_size(), dst_offset,
+                      sh->buffer->GetPeer(peer), IndexArray(geom.real_size),
+                      src_offset, halo_size);
+  }
+}
+
 #if 0
 template <class GridType>
 void GridSpaceMPI<GridType>::ExchangeBoundariesAsync(
@@ -689,14 +1165,129 @@ GridType *GridSpaceMPI<GridType>::LoadNeighbor(
     const IndexArray &offset_max,
     bool diagonal, bool reuse, bool periodic) {
   Width2 hw;
+  unsigned width = 0;
   for (int i = 0; i < PS_MAX_DIM; ++i) {
     hw.bw[i] = (offset_min[i] <= 0) ? (unsigned)(abs(offset_min[i])) : 0;
     hw.fw[i] = (offset_max[i] >= 0) ? (unsigned)(offset_max[i]) : 0;
+    width = std::max(width, std::max(hw.bw[i], hw.fw[i]));
   }
-  ExchangeBoundaries(g, member, hw, diagonal, periodic, reuse);
+  if (g->halo_depth() == 1 || periodic || !domain_extension_) {
+    ExchangeBoundaries(g, member, hw, diagonal, periodic, reuse);
+    g->InvalidateHalo();
+    pending_extension_ = 0;
+    return NULL;
+  }
+  // Exchange the whole halo only when the valid part is too narrow
+  // for the stencil
+  if (g->halo_valid() < (int)width) {
+    LOG_DEBUG() << "Exchanging deep halo of grid " << g->id() << "\n";
+    ExchangeBoundaries(g, member, g->halo(), true, false, reuse);
+    g->set_halo_valid(GetHaloExtent(g));
+  }
+  pending_extension_ = std::min(pending_extension_,
+                                g->halo_valid() - (int)width);
   return NULL;
 }
 
+template <class GridType>
+void GridSpaceMPI<GridType>::SetHaloDepth(GridType *g, int depth) {
+  PSAssert(depth >= 1);
+  // No halo without decomposition
+  if (proc_size_.accumulate(num_dims_) == 1) depth = 1;
+  if (depth > 1 && FindSharedHalo(g)) {
+    LOG_WARNING() << "Deep halo not supported with shared-memory halo "
+                  << "exchange\n";
+    depth = 1;
+  }
+  bool spanning = !g->empty();
+  for (int i = 0; i < num_dims_; ++i) {
+    if (g->size()[i] != global_size_[i] || g->global_offset()[i] != 0) {
+      spanning = false;
+    }
+  }
+  if (depth > 1 && !spanning) {
+    LOG_WARNING() << "Deep halo only supported for grids spanning all "
+                  << "processes\n";
+    depth = 1;
+  }
+  // Halo width per stencil width; the same on all processes since
+  // the grid spans them
+  Width2 halo = g->halo();
+  PSIndex radius = 1;
+  for (int i = 0; i < num_dims_; ++i) {
+    if (proc_size_[i] == 1) continue;
+    radius = std::max(radius, (PSIndex)std::max(halo.bw[i], halo.fw[i]));
+  }
+  radius /= g->halo_depth();
+  for (int i = 0; i < num_dims_; ++i) {
+    if (proc_size_[i] == 1) continue;
+    // Halos are sent from the points of the neighbors
+    int max_depth = std::max(min_partition_[i] / radius, (PSIndex)1);
+    if (depth > max_depth) {
+      LOG_WARNING() << "Halo depth reduced to " << max_depth
+                    << " for sub grids of " << min_partition_[i]
+                    << " points\n";
+      depth = max_depth;
+    }
+  }
+  if (depth == g->halo_depth()) return;
+  for (int i = 0; i < num_dims_; ++i) {
+    if (proc_size_[i] == 1) continue;
+    halo.bw[i] = halo.fw[i] = radius * depth;
+  }
+  LOG_DEBUG() << "Halo of grid " << g->id() << " set to " << halo << "\n";
+  g->SetHaloDepth(depth, halo);
+}
+
+template <class GridType>
+int GridSpaceMPI<GridType>::GetHaloExtent(GridType *g) const {
+  int extent = INT_MAX;
+  for (int i = 0; i < num_dims_; ++i) {
+    if (proc_size_[i] == 1) continue;
+    extent = std::min(extent, (int)std::min(g->halo().bw[i],
+                                            g->halo().fw[i]));
+  }
+  return extent;
+}
+
+template <class GridType>
+int GridSpaceMPI<GridType>::GetDomainExtension(
+    int num_grids, GridType **grids, const int *modes) {
+  domain_extension_ = true;
+  int extension = pending_extension_;
+  pending_extension_ = INT_MAX;
+  // Nothing to compute redundantly without decomposition
+  if (proc_size_.accumulate(num_dims_) == 1) return 0;
+  for (int i = 0; i < num_grids; ++i) {
+    GridType *g = grids[i];
+    if (g->halo_depth() == 1) {
+      extension = 0;
+    } else if (modes[i] & PS_GRID_ACCESS_WRITE) {
+      extension = std::min(extension, GetHaloExtent(g));
+    }
+  }
+  // Grids read only at the computed points are exchanged here, once
+  // for their whole halo unless they are written
+  for (int i = 0; i < num_grids && extension > 0; ++i) {
+    GridType *g = grids[i];
+    if (!(modes[i] & PS_GRID_ACCESS_READ)) continue;
+    if (g->halo_valid() == 0 && !(modes[i] & PS_GRID_ACCESS_WRITE)) {
+      ExchangeBoundaries(g, 0, g->halo(), true, false);
+      g->set_halo_valid(GetHaloExtent(g));
+    }
+    extension = std::min(extension, g->halo_valid());
+  }
+  if (extension == INT_MAX) extension = 0;
+  extension = std::max(extension, 0);
+  for (int i = 0; i < num_grids; ++i) {
+    if (modes[i] & PS_GRID_ACCESS_WRITE) {
+      grids[i]->set_halo_valid(std::min(grids[i]->halo_valid(),
+                                        extension));
+    }
+  }
+  return extension;
+}
+
 
 template <class GridType>
 int GridSpaceMPI<GridType>::FindOwnerProcess(GridType *g, const IndexArray &index) {
@@ -738,6 +1329,249 @@ int GridSpaceMPI<GridType>::ReduceGrid(void *out, PSReduceOp op,
   return g->num_elms();
 }
 
+// Returns false if the intersection of two regions is empty
+static inline bool IntersectRegion(int num_dims,
+                                   const IndexArray &offset1,
+                                   const IndexArray &size1,
+                                   const IndexArray &offset2,
+                                   const IndexArray &size2,
+                                   IndexArray &offset, IndexArray &size) {
+  for (int i = 0; i < num_dims; ++i) {
+    offset[i] = std::max(offset1[i], offset2[i]);
+    PSIndex last = std::min(offset1[i] + size1[i], offset2[i] + size2[i]);
+    if (last <= offset[i]) return false;
+    size[i] = last - offset[i];
+  }
+  return true;
+}
+
+template <class GridType>
+int GridSpaceMPI<GridType>::GetLevel(
+    int num_dims, const IndexArray &size,
+    const IndexArray &global_offset) const {
+  int level = 0;
+  for (int i = 0; i < num_dims; ++i) {
+    if (global_offset[i] != 0 || size[i] > global_size_[i]) return 0;
+    level = std::max(level, GetCoarsenLevel(global_size_[i], size[i]));
+  }
+  return level;
+}
+
+template <class GridType>
+bool GridSpaceMPI<GridType>::IsAgglomerated(
+    int num_dims, const IndexArray &size) const {
+  return agglomeration_level_ > 0 &&
+      GetLevel(num_dims, size, IndexArray()) >= agglomeration_level_;
+}
+
+template <class GridType>
+bool GridSpaceMPI<GridType>::IsLevelPartitionable(
+    int num_dims, const IndexArray &size) const {
+  for (int i = 0; i < num_dims; ++i) {
+    // Processes without points are only allowed at the end, so that
+    // halos are exchanged between neighbors
+    bool empty = false;
+    for (int j = 0; j < proc_size_[i]; ++j) {
+      if (GetLevelBoundary(i, j + 1, size[i]) ==
+          GetLevelBoundary(i, j, size[i])) {
+        empty = true;
+      } else if (empty) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::GetSubgrid(
+    int num_dims, const IndexArray &size, const IndexArray &global_offset,
+    const IntArray &proc_index,
+    IndexArray &local_offset, IndexArray &local_size) const {
+  if (GetLevel(num_dims, size, global_offset) == 0) {
+    for (int i = 0; i < num_dims; ++i) {
+      PSIndex offset = offsets_[i][proc_index[i]];
+      PSIndex end = offset + partitions_[i][proc_index[i]];
+      local_offset[i] = std::max(offset - global_offset[i], (PSIndex)0);
+      PSIndex first = std::max(offset, global_offset[i]);
+      PSIndex last = std::min(global_offset[i] + size[i], end);
+      local_size[i] = std::max(last - first, (PSIndex)0);
+    }
+    return;
+  }
+  if (IsAgglomerated(num_dims, size) ||
+      !IsLevelPartitionable(num_dims, size)) {
+    bool first = true;
+    for (int i = 0; i < num_dims; ++i) {
+      if (proc_index[i] != 0) first = false;
+    }
+    for (int i = 0; i < num_dims; ++i) {
+      local_offset[i] = 0;
+      local_size[i] = first ? size[i] : 0;
+    }
+    return;
+  }
+  for (int i = 0; i < num_dims; ++i) {
+    local_offset[i] = GetLevelBoundary(i, proc_index[i], size[i]);
+    local_size[i] =
+        GetLevelBoundary(i, proc_index[i] + 1, size[i]) - local_offset[i];
+  }
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::GatherRegion(
+    GridType *g, const std::vector<IndexArray> &offsets,
+    const std::vector<IndexArray> &sizes, void *region_buf) {
+  int nd = g->num_dims();
+  size_t elm_size = g->elm_size();
+  const IndexArray &offset = offsets[my_rank_];
+  const IndexArray &size = sizes[my_rank_];
+  const char *local = NULL;
+  std::vector<char> tmp;
+  if (!g->empty()) {
+    if (g->HasHalo()) {
+      tmp.resize(g->GetLocalBufferSize());
+      g->Copyout(&tmp[0]);
+      local = &tmp[0];
+    } else {
+      local = (const char*)g->buffer()->Get();
+    }
+  }
+  std::vector<std::vector<char> > send_bufs(num_procs_);
+  std::vector<std::vector<char> > recv_bufs(num_procs_);
+  std::vector<IndexArray> recv_offsets(num_procs_), recv_sizes(num_procs_);
+  std::vector<MPI_Request> requests;
+  // Points of the other processes within the region of this process
+  for (int i = 0; i < num_procs_; ++i) {
+    if (i == my_rank_) continue;
+    IndexArray po, ps;
+    GetSubgrid(nd, g->size(), g->global_offset(), proc_indices_[i],
+               po, ps);
+    if (!IntersectRegion(nd, po, ps, offset, size,
+                         recv_offsets[i], recv_sizes[i])) {
+      continue;
+    }
+    recv_bufs[i].resize(recv_sizes[i].accumulate(nd) * elm_size);
+    MPI_Request req;
+    CHECK_MPI(MPI_Irecv(&recv_bufs[i][0], recv_bufs[i].size(), MPI_BYTE,
+                        i, PS_MPI_LEVEL_TRANSFER_TAG, comm_, &req));
+    requests.push_back(req);
+  }
+  // Local points within the region of each process
+  IndexArray io, is;
+  for (int i = 0; i < num_procs_; ++i) {
+    if (!IntersectRegion(nd, g->local_offset(), g->local_size(),
+                         offsets[i], sizes[i], io, is)) {
+      continue;
+    }
+    send_bufs[i].resize(is.accumulate(nd) * elm_size);
+    CopyoutSubgrid(elm_size, nd, local, g->local_size(),
+                   &send_bufs[i][0], io - g->local_offset(), is);
+    if (i == my_rank_) {
+      CopyinSubgrid(elm_size, nd, region_buf, size,
+                    &send_bufs[i][0], io - offset, is);
+      continue;
+    }
+    MPI_Request req;
+    CHECK_MPI(PS_MPI_Isend(&send_bufs[i][0], send_bufs[i].size(), MPI_BYTE,
+                           i, PS_MPI_LEVEL_TRANSFER_TAG, comm_, &req));
+    requests.push_back(req);
+  }
+  if (!requests.empty()) {
+    CHECK_MPI(MPI_Waitall(requests.size(), &requests[0],
+                          MPI_STATUSES_IGNORE));
+  }
+  for (int i = 0; i < num_procs_; ++i) {
+    if (recv_bufs[i].empty()) continue;
+    CopyinSubgrid(elm_size, nd, region_buf, size, &recv_bufs[i][0],
+                  recv_offsets[i] - offset, recv_sizes[i]);
+  }
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::CheckCoarsened(GridType *coarse,
+                                            GridType *fine) const {
+  bool ok = coarse->type() == fine->type() &&
+      coarse->num_dims() == fine->num_dims() &&
+      fine->type() != PS_USER;
+  for (int i = 0; i < fine->num_dims() && ok; ++i) {
+    ok = coarse->size()[i] ==
+        (fine->size()[i] + PS_COARSEN_FACTOR - 1) / PS_COARSEN_FACTOR;
+  }
+  if (!ok) {
+    LOG_ERROR() << "Grid not coarsened from the given grid\n";
+    PSAbort(1);
+  }
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::RestrictGrid(GridType *coarse,
+                                          GridType *fine) {
+  CheckCoarsened(coarse, fine);
+  coarse->InvalidateHalo();
+  int nd = fine->num_dims();
+  // Fine points covered by the coarse subgrid of each process
+  std::vector<IndexArray> fos(num_procs_), fss(num_procs_);
+  for (int i = 0; i < num_procs_; ++i) {
+    IndexArray co, cs;
+    GetSubgrid(nd, coarse->size(), coarse->global_offset(),
+               proc_indices_[i], co, cs);
+    GetFineRegion(nd, co, cs, fine->size(), fos[i], fss[i]);
+  }
+  const IndexArray &fo = fos[my_rank_];
+  const IndexArray &fs = fss[my_rank_];
+  std::vector<char> fine_points(fs.accumulate(nd) * fine->elm_size() + 1);
+  GatherRegion(fine, fos, fss, &fine_points[0]);
+  if (coarse->empty()) return;
+  std::vector<char> coarse_points(coarse->GetLocalBufferSize());
+  RestrictSubgrid(fine->type(), nd, &fine_points[0], fo, fs,
+                  &coarse_points[0], coarse->local_offset(),
+                  coarse->local_size());
+  if (coarse->HasHalo()) {
+    coarse->Copyin(&coarse_points[0]);
+  } else {
+    memcpy(coarse->buffer()->Get(), &coarse_points[0],
+           coarse_points.size());
+  }
+}
+
+template <class GridType>
+void GridSpaceMPI<GridType>::ProlongGrid(GridType *fine, GridType *coarse,
+                                         bool accumulate) {
+  CheckCoarsened(coarse, fine);
+  fine->InvalidateHalo();
+  int nd = fine->num_dims();
+  // Coarse points covering the fine subgrid of each process
+  std::vector<IndexArray> cos(num_procs_), css(num_procs_);
+  for (int i = 0; i < num_procs_; ++i) {
+    IndexArray fo, fs;
+    GetSubgrid(nd, fine->size(), fine->global_offset(),
+               proc_indices_[i], fo, fs);
+    GetCoarseRegion(nd, fo, fs, cos[i], css[i]);
+  }
+  const IndexArray &co = cos[my_rank_];
+  const IndexArray &cs = css[my_rank_];
+  std::vector<char> coarse_points(cs.accumulate(nd) * coarse->elm_size() + 1);
+  GatherRegion(coarse, cos, css, &coarse_points[0]);
+  if (fine->empty()) return;
+  std::vector<char> fine_points(fine->GetLocalBufferSize());
+  if (accumulate) {
+    if (fine->HasHalo()) {
+      fine->Copyout(&fine_points[0]);
+    } else {
+      memcpy(&fine_points[0], fine->buffer()->Get(), fine_points.size());
+    }
+  }
+  ProlongSubgrid(fine->type(), nd, &coarse_points[0], co, cs,
+                 &fine_points[0], fine->local_offset(), fine->local_size(),
+                 accumulate);
+  if (fine->HasHalo()) {
+    fine->Copyin(&fine_points[0]);
+  } else {
+    memcpy(fine->buffer()->Get(), &fine_points[0], fine_points.size());
+  }
+}
+
 template <class GridType>
 void GridSpaceMPI<GridType>::Partition(
     int num_dims, int num_procs,
@@ -2,6 +2,8 @@
 
 #include "runtime/grid_util.h"
 
+#include <algorithm>
+
 using namespace physis::runtime;
 using physis::IntArray;
 using physis::IndexArray;
@@ -202,5 +204,517 @@ void CopyinSubgrid(size_t elm_size, int num_dims,
   return;
 }
 
+void CopySubgridToGrid(size_t elm_size, int num_dims,
+                       void *dst, const IndexArray &dst_size,
+                       const IndexArray &dst_offset,
+                       const void *src, const IndexArray &src_size,
+                       const IndexArray &src_offset,
+                       const IndexArray &subgrid_size) {
+  size_t num_lines = 1;
+  for (int i = 1; i < num_dims; ++i) {
+    num_lines *= subgrid_size[i];
+  }
+  size_t line_size = subgrid_size[0] * elm_size;
+  if (num_lines == 0 || line_size == 0) return;
+
+  // Copy each 1-D continuous line of the sub grid
+  for (size_t l = 0; l < num_lines; ++l) {
+    IndexArray d = dst_offset;
+    IndexArray s = src_offset;
+    size_t r = l;
+    for (int i = 1; i < num_dims; ++i) {
+      PSIndex x = r % subgrid_size[i];
+      r /= subgrid_size[i];
+      d[i] += x;
+      s[i] += x;
+    }
+    memcpy((void*)((intptr_t)dst +
+                   get1DOffset(d, dst_size, num_dims) * elm_size),
+           (const void*)((intptr_t)src +
+                         get1DOffset(s, src_size, num_dims) * elm_size),
+           line_size);
+  }
+  return;
+}
+
+size_t GetMemberSize(const __PSGridTypeMemberInfo &member) {
+  size_t size = member.size;
+  for (int i = 0; i < member.rank; ++i) {
+    size *= member.dim[i];
+  }
+  return size;
+}
+
+size_t GetLayoutBlockSize(int layout, size_t num_elms) {
+  if (layout == PS_GRID_LAYOUT_SOA) {
+    return num_elms;
+  }
+  PSAssert(layout > 0);
+  return layout;
+}
+
+size_t GetLayoutBufferSize(int layout, size_t elm_size,
+                           size_t num_elms) {
+  if (layout == PS_GRID_LAYOUT_AOS || num_elms == 0) {
+    return elm_size * num_elms;
+  }
+  size_t block = GetLayoutBlockSize(layout, num_elms);
+  return (num_elms + block - 1) / block * block * elm_size;
+}
+
+// Copy points between the AoS layout and a blocked layout.
+/*
+ * \param is_copyin Flag to indicate copyin or copyout.
+ */
+static void CopyPointsWithLayout(int layout, size_t elm_size,
+                                 int num_members,
+                                 const __PSGridTypeMemberInfo *members,
+                                 size_t num_elms, char *grid,
+                                 char *points,
+                                 size_t begin, size_t end,
+                                 bool is_copyin) {
+  if (layout == PS_GRID_LAYOUT_AOS) {
+    char *p = grid + begin * elm_size;
+    size_t size = (end - begin) * elm_size;
+    if (is_copyin) {
+      memcpy(p, points, size);
+    } else {
+      memcpy(points, p, size);
+    }
+    return;
+  }
+  size_t block = GetLayoutBlockSize(layout, num_elms);
+  // Member-major order to stream through each member array
+  for (int m = 0; m < num_members; ++m) {
+    size_t offset = members[m].offset;
+    size_t size = GetMemberSize(members[m]);
+    char *point = points + offset;
+    for (size_t i = begin; i < end; ++i) {
+      char *p = grid + (i / block) * block * elm_size
+          + offset * block + (i % block) * size;
+      if (is_copyin) {
+        memcpy(p, point, size);
+      } else {
+        memcpy(point, p, size);
+      }
+      point += elm_size;
+    }
+  }
+  return;
+}
+
+void CopyinPointsToLayout(int layout, size_t elm_size,
+                          int num_members,
+                          const __PSGridTypeMemberInfo *members,
+                          size_t num_elms, void *grid,
+                          const void *points,
+                          size_t begin, size_t end) {
+  CopyPointsWithLayout(layout, elm_size, num_members, members,
+                       num_elms, (char*)grid, (char*)points,
+                       begin, end, true);
+}
+
+void CopyoutPointsFromLayout(int layout, size_t elm_size,
+                             int num_members,
+                             const __PSGridTypeMemberInfo *members,
+                             size_t num_elms, const void *grid,
+                             void *points,
+                             size_t begin, size_t end) {
+  CopyPointsWithLayout(layout, elm_size, num_members, members,
+                       num_elms, (char*)grid, (char*)points,
+                       begin, end, false);
+}
+
+// Number of rows along the first dimension and the size of each
+// half of a red-black grid
+static PSIndex GetRedBlackHalfRow(const IndexArray &dim) {
+  return (dim[0] + 1) / 2;
+}
+
+static int64_t GetNumRows(int num_dims, const IndexArray &dim) {
+  int64_t num_rows = 1;
+  for (int i = 1; i < num_dims; ++i) num_rows *= dim[i];
+  return num_rows;
+}
+
+size_t GetRedBlackBufferSize(int num_dims, const IndexArray &dim) {
+  return 2 * GetRedBlackHalfRow(dim) * GetNumRows(num_dims, dim);
+}
+
+int64_t GetRedBlackOffset(int num_dims, const IndexArray &dim,
+                          const IndexArray &index) {
+  int64_t hx = GetRedBlackHalfRow(dim);
+  int64_t row = 0;
+  int64_t stride = 1;
+  PSIndex sum = index[0];
+  for (int i = 1; i < num_dims; ++i) {
+    row += index[i] * stride;
+    stride *= dim[i];
+    sum += index[i];
+  }
+  return index[0] / 2 + row * hx + (sum & 1) * hx * stride;
+}
+
+// Copy points between the natural order and the red-black layout.
+/*
+ * \param is_copyin Flag to indicate copyin or copyout.
+ */
+static void CopyPointsWithRedBlack(size_t elm_size, int num_dims,
+                                   const IndexArray &dim, char *grid,
+                                   char *points, bool is_copyin) {
+  int64_t hx = GetRedBlackHalfRow(dim);
+  int64_t num_rows = GetNumRows(num_dims, dim);
+  char *half[2] = {grid, grid + hx * num_rows * elm_size};
+  IndexArray index;
+  for (int64_t r = 0; r < num_rows; ++r) {
+    // Color of the first point of the row
+    int parity = 0;
+    for (int i = 1; i < num_dims; ++i) parity += index[i];
+    for (PSIndex x = 0; x < dim[0]; ++x) {
+      char *p = half[(x + parity) & 1] + (r * hx + x / 2) * elm_size;
+      if (is_copyin) {
+        memcpy(p, points, elm_size);
+      } else {
+        memcpy(points, p, elm_size);
+      }
+      points += elm_size;
+    }
+    for (int i = 1; i < num_dims; ++i) {
+      if (++index[i] < dim[i]) break;
+      index[i] = 0;
+    }
+  }
+}
+
+void CopyinPointsToRedBlack(size_t elm_size, int num_dims,
+                            const IndexArray &dim, void *grid,
+                            const void *points) {
+  CopyPointsWithRedBlack(elm_size, num_dims, dim, (char*)grid,
+                         (char*)points, true);
+}
+
+void CopyoutPointsFromRedBlack(size_t elm_size, int num_dims,
+                               const IndexArray &dim, const void *grid,
+                               void *points) {
+  CopyPointsWithRedBlack(elm_size, num_dims, dim, (char*)grid,
+                         (char*)points, false);
+}
+
+size_t GetPrimitiveTypeSize(PSType type) {
+  switch (type) {
+    case PS_INT: return sizeof(int);
+    case PS_LONG: return sizeof(long);
+    case PS_FLOAT: return sizeof(float);
+    case PS_DOUBLE: return sizeof(double);
+    case PS_BFLOAT16: return sizeof(uint16_t);
+    default:
+      LOG_ERROR() << "Not a primitive type: " << type << "\n";
+      PSAbort(1);
+  }
+  return 0;
+}
+
+template <class T>
+static void ConvertToStorage(PSType storage_type, const T *src,
+                             void *dst, size_t num_elms) {
+  if (storage_type == PS_FLOAT) {
+    float *d = (float*)dst;
+    for (size_t i = 0; i < num_elms; ++i) d[i] = (float)src[i];
+  } else if (storage_type == PS_BFLOAT16) {
+    uint16_t *d = (uint16_t*)dst;
+    for (size_t i = 0; i < num_elms; ++i) {
+      d[i] = __PSFloatToBFloat16((float)src[i]);
+    }
+  } else {
+    LOG_ERROR() << "Unsupported storage type: " << storage_type << "\n";
+    PSAbort(1);
+  }
+}
+
+template <class T>
+static void ConvertFromStorage(PSType storage_type, const void *src,
+                               T *dst, size_t num_elms) {
+  if (storage_type == PS_FLOAT) {
+    const float *s = (const float*)src;
+    for (size_t i = 0; i < num_elms; ++i) dst[i] = (T)s[i];
+  } else if (storage_type == PS_BFLOAT16) {
+    const uint16_t *s = (const uint16_t*)src;
+    for (size_t i = 0; i < num_elms; ++i) {
+      dst[i] = (T)__PSBFloat16ToFloat(s[i]);
+    }
+  } else {
+    LOG_ERROR() << "Unsupported storage type: " << storage_type << "\n";
+    PSAbort(1);
+  }
+}
+
+void ConvertPointsToStorage(PSType type, PSType storage_type,
+                            const void *src, void *dst,
+                            size_t num_elms) {
+  if (type == PS_DOUBLE) {
+    ConvertToStorage(storage_type, (const double*)src, dst, num_elms);
+  } else if (type == PS_FLOAT) {
+    ConvertToStorage(storage_type, (const float*)src, dst, num_elms);
+  } else {
+    LOG_ERROR() << "Reduced precision not supported for type "
+                << type << "\n";
+    PSAbort(1);
+  }
+}
+
+void ConvertPointsFromStorage(PSType type, PSType storage_type,
+                              const void *src, void *dst,
+                              size_t num_elms) {
+  if (type == PS_DOUBLE) {
+    ConvertFromStorage(storage_type, src, (double*)dst, num_elms);
+  } else if (type == PS_FLOAT) {
+    ConvertFromStorage(storage_type, src, (float*)dst, num_elms);
+  } else {
+    LOG_ERROR() << "Reduced precision not supported for type "
+                << type << "\n";
+    PSAbort(1);
+  }
+}
+
+// Returns the region of size n at offset along each dimension,
+// treating dimensions beyond num_dims as one point.
+static void GetRegionBounds(int num_dims, const IndexArray &offset,
+                            const IndexArray &size,
+                            IndexArray &min, IndexArray &max) {
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    min[i] = i < num_dims ? offset[i] : 0;
+    max[i] = i < num_dims ? offset[i] + size[i] : 1;
+  }
+}
+
+template <class T>
+static void RestrictSubgrid(int num_dims, const T *fine,
+                            const IndexArray &fine_offset,
+                            const IndexArray &fine_size,
+                            T *coarse, const IndexArray &coarse_offset,
+                            const IndexArray &coarse_size) {
+  IndexArray fmin, fmax, cmin, cmax;
+  GetRegionBounds(num_dims, fine_offset, fine_size, fmin, fmax);
+  GetRegionBounds(num_dims, coarse_offset, coarse_size, cmin, cmax);
+  IndexArray fsize = fmax - fmin;
+  IndexArray c, f;
+  for (c[2] = cmin[2]; c[2] < cmax[2]; ++c[2]) {
+    for (c[1] = cmin[1]; c[1] < cmax[1]; ++c[1]) {
+      for (c[0] = cmin[0]; c[0] < cmax[0]; ++c[0]) {
+        IndexArray lo, hi;
+        for (int i = 0; i < PS_MAX_DIM; ++i) {
+          lo[i] = i < num_dims ? c[i] * PS_COARSEN_FACTOR : 0;
+          hi[i] = std::min(lo[i] + (i < num_dims ? PS_COARSEN_FACTOR : 1),
+                           fmax[i]);
+          PSAssert(lo[i] >= fmin[i] && lo[i] < hi[i]);
+        }
+        double sum = 0;
+        int n = 0;
+        for (f[2] = lo[2]; f[2] < hi[2]; ++f[2]) {
+          for (f[1] = lo[1]; f[1] < hi[1]; ++f[1]) {
+            for (f[0] = lo[0]; f[0] < hi[0]; ++f[0]) {
+              sum += fine[GridCalcOffset3D(f - fmin, fsize)];
+              ++n;
+            }
+          }
+        }
+        *(coarse++) = (T)(sum / n);
+      }
+    }
+  }
+}
+
+void RestrictSubgrid(PSType type, int num_dims, const void *fine,
+                     const IndexArray &fine_offset,
+                     const IndexArray &fine_size,
+                     void *coarse, const IndexArray &coarse_offset,
+                     const IndexArray &coarse_size) {
+  switch (type) {
+    case PS_INT:
+      RestrictSubgrid(num_dims, (const int*)fine, fine_offset, fine_size,
+                      (int*)coarse, coarse_offset, coarse_size);
+      break;
+    case PS_LONG:
+      RestrictSubgrid(num_dims, (const long*)fine, fine_offset, fine_size,
+                      (long*)coarse, coarse_offset, coarse_size);
+      break;
+    case PS_FLOAT:
+      RestrictSubgrid(num_dims, (const float*)fine, fine_offset,
+                      fine_size, (float*)coarse, coarse_offset,
+                      coarse_size);
+      break;
+    case PS_DOUBLE:
+      RestrictSubgrid(num_dims, (const double*)fine, fine_offset,
+                      fine_size, (double*)coarse, coarse_offset,
+                      coarse_size);
+      break;
+    default:
+      LOG_ERROR() << "Restriction not supported for type " << type << "\n";
+      PSAbort(1);
+  }
+}
+
+template <class T>
+static void ProlongSubgrid(int num_dims, const T *coarse,
+                           const IndexArray &coarse_offset,
+                           const IndexArray &coarse_size,
+                           T *fine, const IndexArray &fine_offset,
+                           const IndexArray &fine_size, bool accumulate) {
+  IndexArray fmin, fmax, cmin, cmax;
+  GetRegionBounds(num_dims, fine_offset, fine_size, fmin, fmax);
+  GetRegionBounds(num_dims, coarse_offset, coarse_size, cmin, cmax);
+  IndexArray csize = cmax - cmin;
+  IndexArray f, c;
+  for (f[2] = fmin[2]; f[2] < fmax[2]; ++f[2]) {
+    for (f[1] = fmin[1]; f[1] < fmax[1]; ++f[1]) {
+      for (f[0] = fmin[0]; f[0] < fmax[0]; ++f[0]) {
+        for (int i = 0; i < PS_MAX_DIM; ++i) {
+          c[i] = i < num_dims ? f[i] / PS_COARSEN_FACTOR : 0;
+          PSAssert(c[i] >= cmin[i] && c[i] < cmax[i]);
+        }
+        T v = coarse[GridCalcOffset3D(c - cmin, csize)];
+        if (accumulate) {
+          *(fine++) += v;
+        } else {
+          *(fine++) = v;
+        }
+      }
+    }
+  }
+}
+
+void ProlongSubgrid(PSType type, int num_dims, const void *coarse,
+                    const IndexArray &coarse_offset,
+                    const IndexArray &coarse_size,
+                    void *fine, const IndexArray &fine_offset,
+                    const IndexArray &fine_size, bool accumulate) {
+  switch (type) {
+    case PS_INT:
+      ProlongSubgrid(num_dims, (const int*)coarse, coarse_offset,
+                     coarse_size, (int*)fine, fine_offset, fine_size,
+                     accumulate);
+      break;
+    case PS_LONG:
+      ProlongSubgrid(num_dims, (const long*)coarse, coarse_offset,
+                     coarse_size, (long*)fine, fine_offset, fine_size,
+                     accumulate);
+      break;
+    case PS_FLOAT:
+      ProlongSubgrid(num_dims, (const float*)coarse, coarse_offset,
+                     coarse_size, (float*)fine, fine_offset, fine_size,
+                     accumulate);
+      break;
+    case PS_DOUBLE:
+      ProlongSubgrid(num_dims, (const double*)coarse, coarse_offset,
+                     coarse_size, (double*)fine, fine_offset, fine_size,
+                     accumulate);
+      break;
+    default:
+      LOG_ERROR() << "Prolongation not supported for type " << type << "\n";
+      PSAbort(1);
+  }
+}
+
+void GetCoarseRegion(int num_dims, const IndexArray &fine_offset,
+                     const IndexArray &fine_size,
+                     IndexArray &coarse_offset, IndexArray &coarse_size) {
+  coarse_offset = IndexArray();
+  coarse_size = IndexArray();
+  for (int i = 0; i < num_dims; ++i) {
+    if (fine_size[i] == 0) continue;
+    coarse_offset[i] = fine_offset[i] / PS_COARSEN_FACTOR;
+    coarse_size[i] = (fine_offset[i] + fine_size[i] - 1) /
+        PS_COARSEN_FACTOR + 1 - coarse_offset[i];
+  }
+}
+
+void GetFineRegion(int num_dims, const IndexArray &coarse_offset,
+                   const IndexArray &coarse_size,
+                   const IndexArray &fine_dim,
+                   IndexArray &fine_offset, IndexArray &fine_size) {
+  fine_offset = IndexArray();
+  fine_size = IndexArray();
+  for (int i = 0; i < num_dims; ++i) {
+    if (coarse_size[i] == 0) continue;
+    fine_offset[i] = coarse_offset[i] * PS_COARSEN_FACTOR;
+    fine_size[i] = std::min(
+        (coarse_offset[i] + coarse_size[i]) * PS_COARSEN_FACTOR,
+        fine_dim[i]) - fine_offset[i];
+  }
+}
+
+void CopyoutStridedSubgrid(size_t elm_size, int num_dims,
+                           const void *grid, const IndexArray &grid_size,
+                           void *subgrid,
+                           const IndexArray &subgrid_offset,
+                           const IndexArray &subgrid_size,
+                           const IndexArray &stride) {
+  IndexArray gsize, offset, size, step;
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    gsize[i] = i < num_dims ? grid_size[i] : 1;
+    offset[i] = i < num_dims ? subgrid_offset[i] : 0;
+    size[i] = i < num_dims ? subgrid_size[i] : 1;
+    step[i] = i < num_dims ? stride[i] : 1;
+  }
+  const char *src = static_cast<const char*>(grid);
+  char *dst = static_cast<char*>(subgrid);
+  IndexArray p;
+  for (PSIndex k = 0; k < size[2]; ++k) {
+    for (PSIndex j = 0; j < size[1]; ++j) {
+      p[0] = offset[0];
+      p[1] = offset[1] + j * step[1];
+      p[2] = offset[2] + k * step[2];
+      const char *row = src + GridCalcOffset3D(p, gsize) * elm_size;
+      if (step[0] == 1) {
+        memcpy(dst, row, size[0] * elm_size);
+        dst += size[0] * elm_size;
+        continue;
+      }
+      for (PSIndex i = 0; i < size[0]; ++i) {
+        memcpy(dst, row + i * step[0] * elm_size, elm_size);
+        dst += elm_size;
+      }
+    }
+  }
+}
+
+void CheckGridView(int num_dims, const IndexArray &grid_size,
+                   const IndexArray &offset, const IndexArray &size,
+                   const IndexArray &stride) {
+  for (int i = 0; i < num_dims; ++i) {
+    if (stride[i] < 1 || size[i] < 0 || offset[i] < 0 ||
+        (size[i] > 0 &&
+         offset[i] + (size[i] - 1) * stride[i] >= grid_size[i])) {
+      LOG_ERROR() << "Invalid view (offset: " << offset
+                  << ", size: " << size << ", stride: " << stride
+                  << ") of grid of size " << grid_size << "\n";
+      PSAbort(1);
+    }
+  }
+}
+
+bool IntersectGridView(int num_dims, const IndexArray &offset,
+                       const IndexArray &size, const IndexArray &stride,
+                       const IndexArray &region_offset,
+                       const IndexArray &region_size,
+                       IndexArray &view_offset, IndexArray &view_size) {
+  view_offset = IndexArray();
+  view_size = IndexArray();
+  for (int i = 0; i < num_dims; ++i) {
+    // Indices of the first points at or after the region boundaries
+    PSIndex first = std::max(
+        region_offset[i] - offset[i] + stride[i] - 1, (PSIndex)0)
+        / stride[i];
+    PSIndex last = std::max(
+        region_offset[i] + region_size[i] - offset[i] + stride[i] - 1,
+        (PSIndex)0) / stride[i];
+    last = std::min(last, size[i]);
+    if (last <= first) return false;
+    view_offset[i] = first;
+    view_size[i] = last - first;
+  }
+  return true;
+}
+
 } // namespace runtime
 } // namespace physis
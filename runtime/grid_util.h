@@ -42,6 +42,264 @@ void CopyinSubgrid(size_t elm_size, int num_dims,
                    const IndexArray &subgrid_offset,
                    const IndexArray &subgrid_size);
 
+//! Copy a multi-dimensional sub grid into another grid.
+/*
+  Unlike CopyoutSubgrid and CopyinSubgrid, no intermediate continuous
+  buffer is used, and the source and destination grids may have
+  different sizes.
+  
+  \param elm_size The size of each element.
+  \param num_dims The number of dimensions of the grids.
+  \param dst The destination grid.
+  \param dst_size The size of each dimension of the destination grid.
+  \param dst_offset The offset of the sub grid in the destination.
+  \param src The source grid.
+  \param src_size The size of each dimension of the source grid.
+  \param src_offset The offset of the sub grid in the source.
+  \param subgrid_size The size of the sub grid to copy.
+ */
+void CopySubgridToGrid(size_t elm_size, int num_dims,
+                       void *dst, const IndexArray &dst_size,
+                       const IndexArray &dst_offset,
+                       const void *src, const IndexArray &src_size,
+                       const IndexArray &src_offset,
+                       const IndexArray &subgrid_size);
+
+//! Copy every stride-th point of a sub grid into a continuous buffer.
+/*
+  Point i of the copied points is point subgrid_offset + i * stride
+  of the grid.
+  
+  \param elm_size The size of each element.
+  \param num_dims The number of dimensions of the grid.
+  \param grid The source grid.
+  \param grid_size The size of each dimension of the grid.
+  \param subgrid The destination buffer.
+  \param subgrid_offset The first point to copy.
+  \param subgrid_size The number of points to copy along each dimension.
+  \param stride The distance of the copied points along each dimension.
+ */
+void CopyoutStridedSubgrid(size_t elm_size, int num_dims,
+                           const void *grid, const IndexArray &grid_size,
+                           void *subgrid,
+                           const IndexArray &subgrid_offset,
+                           const IndexArray &subgrid_size,
+                           const IndexArray &stride);
+
+//! Abort unless a strided view lies within a grid.
+/*
+  \param num_dims The number of dimensions of the grid.
+  \param grid_size The size of each dimension of the grid.
+  \param offset The first point of the view.
+  \param size The number of points of the view along each dimension.
+  \param stride The distance of the points along each dimension.
+ */
+void CheckGridView(int num_dims, const IndexArray &grid_size,
+                   const IndexArray &offset, const IndexArray &size,
+                   const IndexArray &stride);
+
+//! Returns the points of a strided view within a region of a grid.
+/*
+  \param num_dims The number of dimensions of the grid.
+  \param offset The first point of the view.
+  \param size The number of points of the view along each dimension.
+  \param stride The distance of the points along each dimension.
+  \param region_offset The offset of the region.
+  \param region_size The size of the region.
+  \param view_offset Receives the index of the first point within
+  the region in the view.
+  \param view_size Receives the number of points within the region.
+  \return False if no point is within the region.
+ */
+bool IntersectGridView(int num_dims, const IndexArray &offset,
+                       const IndexArray &size, const IndexArray &stride,
+                       const IndexArray &region_offset,
+                       const IndexArray &region_size,
+                       IndexArray &view_offset, IndexArray &view_size);
+
+//! Returns the byte size of a member of a user-defined point type.
+size_t GetMemberSize(const __PSGridTypeMemberInfo &member);
+
+//! Returns the number of points in each block of a layout.
+/*!
+  \param layout PS_GRID_LAYOUT_SOA or an AoSoA block size.
+  \param num_elms The number of points in the grid.
+ */
+size_t GetLayoutBlockSize(int layout, size_t num_elms);
+
+//! Returns the buffer size needed for a grid in a layout.
+/*!
+  The last AoSoA block is always allocated as a whole.
+  
+  \param layout The grid layout.
+  \param elm_size The size of the point type.
+  \param num_elms The number of points in the grid.
+ */
+size_t GetLayoutBufferSize(int layout, size_t elm_size,
+                           size_t num_elms);
+
+//! Copy points in the AoS layout into a grid in another layout.
+/*!
+  Member m of point i is located at
+  (i / B) * B * elm_size + offset_m * B + (i % B) * size_m, where B
+  is the block size of the layout. Each member array of a block is
+  thus located at the offset of the member in the point type
+  multiplied by the block size, so no member array overlaps the
+  others.
+
+  \param layout The layout of the destination grid.
+  \param elm_size The size of the point type.
+  \param num_members The number of members of the point type.
+  \param members The members of the point type.
+  \param num_elms The number of points in the destination grid.
+  \param grid The destination grid.
+  \param points The source points.
+  \param begin The index of the first point to copy.
+  \param end The index past the last point to copy.
+ */
+void CopyinPointsToLayout(int layout, size_t elm_size,
+                          int num_members,
+                          const __PSGridTypeMemberInfo *members,
+                          size_t num_elms, void *grid,
+                          const void *points,
+                          size_t begin, size_t end);
+
+//! Copy points of a grid in a layout out to the AoS layout.
+/*!
+  \see CopyinPointsToLayout
+ */
+void CopyoutPointsFromLayout(int layout, size_t elm_size,
+                             int num_members,
+                             const __PSGridTypeMemberInfo *members,
+                             size_t num_elms, const void *grid,
+                             void *points,
+                             size_t begin, size_t end);
+
+//! Returns the number of points allocated in the red-black layout.
+/*!
+  Each row along the first dimension is given (dim[0] + 1) / 2
+  points in both the red and black halves.
+ */
+size_t GetRedBlackBufferSize(int num_dims, const IndexArray &dim);
+
+//! Returns the offset of a point in the red-black layout.
+/*!
+  Point (i, j, k) is located at (i / 2) + (j + k * dim[1]) * H +
+  ((i + j + k) % 2) * H * dim[1] * dim[2], where H = (dim[0] + 1) / 2.
+  Red points, whose indices sum to an even number, are thus in the
+  first half, and black points in the second half.
+
+  \param num_dims The number of dimensions of the grid.
+  \param dim The size of each dimension of the grid.
+  \param index The index of the point.
+ */
+int64_t GetRedBlackOffset(int num_dims, const IndexArray &dim,
+                          const IndexArray &index);
+
+//! Copy points in the natural order into a red-black grid.
+/*!
+  \param elm_size The size of the point type.
+  \param num_dims The number of dimensions of the grid.
+  \param dim The size of each dimension of the grid.
+  \param grid The destination grid.
+  \param points The source points.
+ */
+void CopyinPointsToRedBlack(size_t elm_size, int num_dims,
+                            const IndexArray &dim, void *grid,
+                            const void *points);
+
+//! Copy points of a red-black grid out in the natural order.
+/*!
+  \see CopyinPointsToRedBlack
+ */
+void CopyoutPointsFromRedBlack(size_t elm_size, int num_dims,
+                               const IndexArray &dim, const void *grid,
+                               void *points);
+
+//! Returns the size of a primitive type.
+size_t GetPrimitiveTypeSize(PSType type);
+
+//! Convert points to the storage type of a reduced-precision grid.
+/*!
+  \param type The point type, PS_FLOAT or PS_DOUBLE.
+  \param storage_type The storage type, PS_FLOAT or PS_BFLOAT16.
+  \param src Points in the point type.
+  \param dst Points in the storage type.
+  \param num_elms The number of points to convert.
+ */
+void ConvertPointsToStorage(PSType type, PSType storage_type,
+                            const void *src, void *dst,
+                            size_t num_elms);
+
+//! Convert points of a reduced-precision grid to the point type.
+/*!
+  \see ConvertPointsToStorage
+ */
+void ConvertPointsFromStorage(PSType type, PSType storage_type,
+                              const void *src, void *dst,
+                              size_t num_elms);
+
+//! Restrict a region of a grid to the grid coarsened from it.
+/*!
+  Each coarse point is the average of the fine points it covers,
+  i.e., fine points PS_COARSEN_FACTOR * i through PS_COARSEN_FACTOR *
+  (i + 1) - 1 along each dimension. Fine points beyond the fine
+  region are ignored, which is the case at the upper boundaries of
+  odd-sized grids.
+
+  \param type The point type.
+  \param num_dims The number of dimensions of the grids.
+  \param fine Points of the fine region.
+  \param fine_offset The offset of the fine region.
+  \param fine_size The size of the fine region.
+  \param coarse Receives the points of the coarse region.
+  \param coarse_offset The offset of the coarse region.
+  \param coarse_size The size of the coarse region.
+  \see GetFineRegion
+ */
+void RestrictSubgrid(PSType type, int num_dims, const void *fine,
+                     const IndexArray &fine_offset,
+                     const IndexArray &fine_size,
+                     void *coarse, const IndexArray &coarse_offset,
+                     const IndexArray &coarse_size);
+
+//! Prolong a region of a coarsened grid to the grid it is coarsened from.
+/*!
+  Each fine point takes the value of the coarse point covering it,
+  which makes the prolongation the transpose of the restriction up
+  to scaling.
+
+  \param type The point type.
+  \param num_dims The number of dimensions of the grids.
+  \param coarse Points of the coarse region.
+  \param coarse_offset The offset of the coarse region.
+  \param coarse_size The size of the coarse region.
+  \param fine Points of the fine region.
+  \param fine_offset The offset of the fine region.
+  \param fine_size The size of the fine region.
+  \param accumulate True to add to the fine points instead of
+  overwriting them.
+  \see GetCoarseRegion
+ */
+void ProlongSubgrid(PSType type, int num_dims, const void *coarse,
+                    const IndexArray &coarse_offset,
+                    const IndexArray &coarse_size,
+                    void *fine, const IndexArray &fine_offset,
+                    const IndexArray &fine_size, bool accumulate);
+
+//! Returns the coarse points covering a fine region.
+void GetCoarseRegion(int num_dims, const IndexArray &fine_offset,
+                     const IndexArray &fine_size,
+                     IndexArray &coarse_offset, IndexArray &coarse_size);
+
+//! Returns the fine points covered by a coarse region.
+/*!
+  \param fine_dim The size of the fine grid.
+ */
+void GetFineRegion(int num_dims, const IndexArray &coarse_offset,
+                   const IndexArray &coarse_size,
+                   const IndexArray &fine_dim,
+                   IndexArray &fine_offset, IndexArray &fine_size);
 
 // TODO (Index range): Create two distinctive types: offset_type and
 //index_type.
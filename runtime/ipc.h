@@ -16,6 +16,8 @@ class InterProcComm {
  public:
   typedef enum {IPC_SUCCESS = 0, IPC_FAILURE = 1} IPC_ERROR_T;
   virtual void *CreateRequest() const = 0;
+  //! Frees a request created by CreateRequest.
+  virtual void DestroyRequest(void *req) const = 0;
   virtual IPC_ERROR_T Init(int *argc, char ***argv) = 0;
   virtual IPC_ERROR_T Finalize() = 0;
   virtual int GetRank() const = 0;
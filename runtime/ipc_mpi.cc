@@ -56,6 +56,10 @@ void *InterProcCommMPI::CreateRequest() const {
   return (void*)r;
 }
 
+void InterProcCommMPI::DestroyRequest(void *req) const {
+  delete static_cast<MPI_Request*>(req);
+}
+
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Send(
     void *buf, size_t len, int dest) {
   int tag = 0;
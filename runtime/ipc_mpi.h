@@ -18,6 +18,7 @@ class InterProcCommMPI: public InterProcComm {
  public:
   static InterProcCommMPI* GetInstance();
   virtual void *CreateRequest() const;
+  virtual void DestroyRequest(void *req) const;
   virtual IPC_ERROR_T Init(int *argc, char ***argv);
   virtual IPC_ERROR_T Finalize();
   virtual int GetRank() const;
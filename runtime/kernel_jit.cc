@@ -0,0 +1,200 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "runtime/kernel_jit.h"
+#include "common/hash.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#ifndef PHYSIS_JIT_INCLUDE_DIR
+#define PHYSIS_JIT_INCLUDE_DIR "."
+#endif
+#ifndef PHYSIS_JIT_OPENMP_FLAGS
+#define PHYSIS_JIT_OPENMP_FLAGS "-fopenmp"
+#endif
+
+namespace physis {
+namespace runtime {
+
+static string GetEnv(const char *name, const string &default_value) {
+  const char *v = getenv(name);
+  return (v && *v) ? string(v) : default_value;
+}
+
+KernelJIT::KernelJIT(): table_(NULL), table_size_(0) {
+  Init();
+}
+
+KernelJIT::KernelJIT(const string &table_name, const void *table,
+                     size_t table_size):
+    table_name_(table_name), table_(table), table_size_(table_size) {
+  Init();
+}
+
+void KernelJIT::Init() {
+  pthread_mutex_init(&mutex_, NULL);
+  cache_dir_ = GetEnv("PHYSIS_JIT_CACHE_DIR",
+                      "/tmp/physis-jit-" + toString(getuid()));
+  if (mkdir(cache_dir_.c_str(), 0700) != 0 && errno != EEXIST) {
+    LOG_WARNING() << "Cannot create JIT cache directory "
+                  << cache_dir_ << "\n";
+  }
+  wait_ = getenv("PHYSIS_JIT_WAIT") != NULL;
+}
+
+KernelJIT::~KernelJIT() {
+  FOREACH (it, modules_.begin(), modules_.end()) {
+    Module *m = it->second;
+    // Do not leave partially written objects behind
+    if (!m->joined) pthread_join(m->thread, NULL);
+    if (m->handle) dlclose(m->handle);
+    delete m;
+  }
+  pthread_mutex_destroy(&mutex_);
+}
+
+KernelJIT::Module *KernelJIT::CreateModule(const string &source,
+                                           int num_dims,
+                                           const IndexArray &size,
+                                           bool openmp) {
+  Module *m = new Module();
+  m->source = source;
+  m->status = FAILED;
+  m->joined = true;
+  m->handle = NULL;
+  std::ifstream ifs(source.c_str());
+  if (!ifs) {
+    LOG_WARNING() << "JIT source not found: " << source << "\n";
+    return m;
+  }
+  std::stringstream contents;
+  contents << ifs.rdbuf();
+
+  bool is_c = endswith(source, ".c");
+  std::stringstream cmd;
+  cmd << (is_c ? GetEnv("PHYSIS_JIT_CC", "cc") :
+          GetEnv("PHYSIS_JIT_CXX", "c++"))
+      << " " << GetEnv("PHYSIS_JIT_CFLAGS", "-O3")
+      << " -fPIC -shared";
+  if (openmp) cmd << " " << PHYSIS_JIT_OPENMP_FLAGS;
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    cmd << " -DPHYSIS_JIT_DIM" << i << "="
+        << (i < num_dims ? size[i] : 1);
+  }
+  cmd << " -I" << PHYSIS_JIT_INCLUDE_DIR << " " << source;
+  m->command = cmd.str();
+
+  std::stringstream so_path;
+  so_path << cache_dir_ << "/"
+          << source.substr(source.find_last_of('/') + 1) << "."
+          << std::hex << HashFNV1a(m->command, HashFNV1a(contents.str()))
+          << ".so";
+  m->so_path = so_path.str();
+
+  if (access(m->so_path.c_str(), R_OK) == 0) {
+    LOG_DEBUG() << "JIT cache hit: " << m->so_path << "\n";
+    m->status = COMPILED;
+    return m;
+  }
+  LOG_INFO() << "JIT compiling " << m->so_path << "\n";
+  m->status = COMPILING;
+  if (pthread_create(&m->thread, NULL, Compile, m) != 0) {
+    LOG_WARNING() << "Cannot start JIT compilation\n";
+    m->status = FAILED;
+    return m;
+  }
+  m->joined = false;
+  return m;
+}
+
+void *KernelJIT::Compile(void *arg) {
+  Module *m = (Module*)arg;
+  // Written to a temporary file and renamed so that concurrent
+  // processes never load a partial object
+  string tmp = m->so_path + "." + toString(getpid()) + ".tmp";
+  string cmd = m->command + " -o " + tmp + " && mv -f " + tmp + " " +
+      m->so_path;
+  int ret = system(cmd.c_str());
+  Status s = ret == 0 ? COMPILED : FAILED;
+  if (s == FAILED) {
+    LOG_WARNING() << "JIT compilation failed: " << cmd << "\n";
+    unlink(tmp.c_str());
+  }
+  // Read by GetFunc without waiting for this thread
+  __atomic_store_n(&m->status, s, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+void KernelJIT::Load(Module *m) {
+  if (!m->joined) {
+    pthread_join(m->thread, NULL);
+    m->joined = true;
+  }
+  m->handle = dlopen(m->so_path.c_str(), RTLD_LAZY | RTLD_LOCAL);
+  if (m->handle == NULL) {
+    LOG_WARNING() << "JIT load failed: " << dlerror() << "\n";
+    m->status = FAILED;
+    return;
+  }
+  if (table_) {
+    void *t = dlsym(m->handle, table_name_.c_str());
+    if (t == NULL) {
+      LOG_WARNING() << "JIT runtime table not found: " << table_name_
+                    << "\n";
+      dlclose(m->handle);
+      m->handle = NULL;
+      m->status = FAILED;
+      return;
+    }
+    memcpy(t, table_, table_size_);
+  }
+  LOG_INFO() << "JIT loaded " << m->so_path << "\n";
+  m->status = LOADED;
+}
+
+void *KernelJIT::GetFunc(const string &source, const string &name,
+                         int num_dims, const IndexArray &size,
+                         bool openmp) {
+  std::stringstream key;
+  key << source << ":" << size << ":" << openmp;
+  pthread_mutex_lock(&mutex_);
+  Module *&m = modules_[key.str()];
+  if (m == NULL) m = CreateModule(source, num_dims, size, openmp);
+  if (wait_ && !m->joined) {
+    pthread_join(m->thread, NULL);
+    m->joined = true;
+  }
+  Status status = __atomic_load_n(&m->status, __ATOMIC_ACQUIRE);
+  if (status == COMPILED) {
+    // The compilation thread is joined before loading
+    Load(m);
+    status = m->status;
+  }
+  void *f = NULL;
+  if (status == LOADED) {
+    std::map<string, void*>::iterator it = m->funcs.find(name);
+    if (it == m->funcs.end()) {
+      f = dlsym(m->handle, name.c_str());
+      if (f == NULL) {
+        LOG_WARNING() << "JIT function not found: " << name << "\n";
+      }
+      m->funcs[name] = f;
+    } else {
+      f = it->second;
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+  return f;
+}
+
+} // namespace runtime
+} // namespace physis
@@ -0,0 +1,93 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_RUNTIME_KERNEL_JIT_H_
+#define PHYSIS_RUNTIME_KERNEL_JIT_H_
+
+#include <pthread.h>
+#include <map>
+
+#include "runtime/runtime_common.h"
+
+namespace physis {
+namespace runtime {
+
+//! Specializes generated code for grid sizes known at startup.
+/*!
+  The generated source file is compiled again into a shared object
+  with the grid size given as the PHYSIS_JIT_DIM0-2 macros, so that
+  PSGridDim and the offset computation are folded by the C
+  compiler. Compilation runs in a background thread; until it is done,
+  NULL is returned, and the caller is expected to run the generic
+  code.
+
+  Shared objects are cached in PHYSIS_JIT_CACHE_DIR
+  (/tmp/physis-jit-<uid> by default) with a name derived from the
+  source contents, the size and the compiler command, so later runs
+  with the same configuration load them without compiling. The
+  compiler and flags can be changed with PHYSIS_JIT_CC,
+  PHYSIS_JIT_CXX and PHYSIS_JIT_CFLAGS. The OpenMP flag found when
+  building the runtime is added if the generated code is compiled with
+  OpenMP. Setting PHYSIS_JIT_WAIT makes the first lookup wait for the
+  compilation.
+
+  Shared objects are loaded locally and cannot resolve the runtime
+  functions of the executable, which is usually not linked to export
+  them. Instead, the runtime can give a table of function pointers
+  that is copied into a variable of each object when it is loaded.
+ */
+class KernelJIT {
+ public:
+  KernelJIT();
+  /*!
+    \param table_name Name of the variable receiving the table.
+    \param table Runtime functions called by the generated code.
+    \param table_size Size of the table.
+   */
+  KernelJIT(const string &table_name, const void *table,
+            size_t table_size);
+  virtual ~KernelJIT();
+  //! Returns a function specialized for a grid size.
+  /*!
+    \param source Path of the generated source file.
+    \param name Name of the function.
+    \param num_dims Number of dimensions of the grids.
+    \param size Size of all grids.
+    \param openmp True to compile with OpenMP, as the host code.
+    \return The function, or NULL if not available yet or if
+    compilation failed.
+   */
+  void *GetFunc(const string &source, const string &name,
+                int num_dims, const IndexArray &size, bool openmp);
+
+ protected:
+  enum Status {COMPILING, COMPILED, LOADED, FAILED};
+  struct Module {
+    string source;
+    string command;
+    string so_path;
+    //! Set by the compilation thread; accessed atomically
+    Status status;
+    bool joined;
+    pthread_t thread;
+    void *handle;
+    std::map<string, void*> funcs;
+  };
+  //! Modules indexed by the source path, the size and OpenMP
+  std::map<string, Module*> modules_;
+  pthread_mutex_t mutex_;
+  string cache_dir_;
+  bool wait_;
+  string table_name_;
+  const void *table_;
+  size_t table_size_;
+  void Init();
+  Module *CreateModule(const string &source, int num_dims,
+                       const IndexArray &size, bool openmp);
+  void Load(Module *m);
+  static void *Compile(void *arg);
+};
+
+} // namespace runtime
+} // namespace physis
+
+#endif /* PHYSIS_RUNTIME_KERNEL_JIT_H_ */
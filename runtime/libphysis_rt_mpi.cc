@@ -4,6 +4,7 @@
 #include <stdarg.h>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "mpi.h"
 
@@ -60,16 +61,22 @@ static T *__PSGridGetAddr(void *g, PSIndex x, PSIndex y,
 extern "C" {
 #endif
   
-  // Assumes extra arguments. The first argument is the number of
-  // dimensions, and each of the remaining ones is the size of
-  // respective dimension.
-  void PSInit(int *argc, char ***argv, int grid_num_dims, ...) {
+  static void InitRuntime(int *argc, char ***argv, int grid_num_dims,
+                          bool spmd, va_list vl) {
+    // Exchange halos between processes on the same node through
+    // shared memory if physis-shm-halo option is given
+    std::vector<string> opts;
+    bool shm_halo = ParseOption(argc, argv, "physis-shm-halo", 0, opts);
+    // Run the host code in all processes if physis-spmd option is
+    // given
+    spmd |= ParseOption(argc, argv, "physis-spmd", 0, opts);
     RuntimeMPI<GridSpaceMPIType> *rt = new RuntimeMPI<GridSpaceMPIType>();
-    va_list vl;
-    va_start(vl, grid_num_dims);
+    if (spmd) rt->EnableSPMD();
     rt->Init(argc, argv, grid_num_dims, vl);
-    va_end(vl);    
     gs = rt->gs();
+    if (shm_halo) {
+      gs->EnableSharedMemoryHalo();
+    }
     if (rt->IsMaster()) {
       master = static_cast<MasterType*>(rt->proc());
     } else {
@@ -78,6 +85,23 @@ extern "C" {
     }
   }
 
+  // Assumes extra arguments. The first argument is the number of
+  // dimensions, and each of the remaining ones is the size of
+  // respective dimension.
+  void PSInit(int *argc, char ***argv, int grid_num_dims, ...) {
+    va_list vl;
+    va_start(vl, grid_num_dims);
+    InitRuntime(argc, argv, grid_num_dims, false, vl);
+    va_end(vl);    
+  }
+
+  void __PSInitSPMD(int *argc, char ***argv, int grid_num_dims, ...) {
+    va_list vl;
+    va_start(vl, grid_num_dims);
+    InitRuntime(argc, argv, grid_num_dims, true, vl);
+    va_end(vl);    
+  }
+
   void PSFinalize() {
     master->Finalize();
   }
@@ -156,6 +180,35 @@ extern "C" {
     local_min.CopyTo(dom->local_min);
     local_max.CopyTo(dom->local_max);
   }
+
+  void __PSDomainExtend(__PSDomain *dom, int num_grids, ...) {
+    std::vector<GridMPI*> grids(num_grids);
+    std::vector<int> modes(num_grids);
+    va_list args;
+    va_start(args, num_grids);
+    for (int i = 0; i < num_grids; ++i) {
+      grids[i] = (GridMPI*)va_arg(args, __PSGridMPI*);
+      modes[i] = va_arg(args, int);
+    }
+    va_end(args);
+    PSIndex ext = num_grids > 0 ?
+        gs->GetDomainExtension(num_grids, &grids[0], &modes[0]) : 0;
+    IndexArray local_min = gs->my_offset();
+    IndexArray local_max = gs->my_offset() + gs->my_size();
+    for (int i = 0; i < gs->num_dims(); ++i) {
+      if (gs->proc_size()[i] == 1) continue;
+      local_min[i] -= ext;
+      local_max[i] += ext;
+    }
+    local_min.SetNoLessThan(IndexArray(dom->min));
+    local_max.SetNoMoreThan(IndexArray(dom->max));
+    if (!(local_min.LessThan(local_max, gs->num_dims()))) {
+      local_min.Set(0);
+      local_max.Set(0);
+    }
+    local_min.CopyTo(dom->local_min);
+    local_max.CopyTo(dom->local_max);
+  }
   
   void PSPrintInternalInfo(FILE *out) {
     std::ostringstream ss;
@@ -187,6 +240,24 @@ extern "C" {
     return;
   }
 
+  void PSGridCopyoutView(void *g, void *buf, const PSVectorInt offset,
+                         const PSVectorInt size, const PSVectorInt stride) {
+    master->GridCopyoutView((GridMPI*)g, buf, IndexArray(offset),
+                            IndexArray(size), IndexArray(stride));
+  }
+
+  PSTask PSGridCopyoutAsync(void *g, void *buf) {
+    return master->GridCopyoutAsync((GridMPI*)g, buf);
+  }
+
+  void PSWait(PSTask t) {
+    master->Wait(t);
+  }
+
+  void PSWaitAll() {
+    master->WaitAll();
+  }
+
   PSIndex PSGridDim(void *p, int d) {
     Grid *g = (Grid *)p;    
     return g->size()[d];
@@ -319,6 +390,25 @@ extern "C" {
     __PSReduceGrid(buf, op, g);            
   }
 
+  void PSGridRestrict(void *coarse, void *fine) {
+    master->GridRestrict((GridMPI*)coarse, (GridMPI*)fine);
+  }
+
+  void PSGridProlong(void *fine, void *coarse, int accumulate) {
+    master->GridProlong((GridMPI*)fine, (GridMPI*)coarse, accumulate);
+  }
+
+  void PSGridSetHaloDepth(void *g, int depth) {
+    master->GridSetHaloDepth((GridMPI*)g, depth);
+  }
+
+  // Activity of grids is only tracked by the reference runtime
+  void PSGridTrackActivity(void *g, PSIndex tile_size, double threshold) {
+  }
+
+  void PSGridMarkActive(void *g, PSVectorInt offset, PSVectorInt size) {
+  }
+
 #if 0
   float __PSGridGetFloat(__PSGridMPI *g, ...) {
     va_list args;
@@ -661,6 +661,46 @@ extern "C" {
   }
   
 
+  // Activity of grids is only tracked by the reference runtime
+  void PSGridTrackActivity(void *g, PSIndex tile_size, double threshold) {
+  }
+
+  void PSGridMarkActive(void *g, PSVectorInt offset, PSVectorInt size) {
+  }
+
+  // Restriction needs the subgrids in a single host buffer
+  void PSGridRestrict(void *coarse, void *fine) {
+    LOG_ERROR() << "Grid restriction not supported by this runtime\n";
+    PSAbort(1);
+  }
+
+  void PSGridProlong(void *fine, void *coarse, int accumulate) {
+    LOG_ERROR() << "Grid prolongation not supported by this runtime\n";
+    PSAbort(1);
+  }
+
+  void PSGridCopyoutView(void *g, void *dst_array, const PSVectorInt offset,
+                         const PSVectorInt size, const PSVectorInt stride) {
+    LOG_ERROR() << "Grid view copyouts not supported by this runtime\n";
+    PSAbort(1);
+  }
+
+  PSTask PSGridCopyoutAsync(void *g, void *dst_array) {
+    LOG_ERROR() << "Asynchronous copyouts not supported by this runtime\n";
+    PSAbort(1);
+    return 0;
+  }
+
+  // No task is ever pending
+  void PSWait(PSTask t) {}
+
+  void PSWaitAll() {}
+
+  // Halos are exchanged for every stencil run
+  void PSGridSetHaloDepth(void *g, int depth) {
+    PSAssert(depth >= 1);
+  }
+
 #ifdef __cplusplus
 }
 #endif
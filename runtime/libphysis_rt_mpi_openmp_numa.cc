@@ -5,15 +5,7 @@
 #endif
 
 #include "runtime/mpi_openmp_runtime.h"
-
-#ifdef USE_OPENMP_NUMA
-#if 0
-#include <numa.h>
-#endif
-#endif
-
-#include <omp.h>
-#include <sched.h>
+#include "runtime/numa_topology.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,18 +15,10 @@ extern "C" {
 #ifndef USE_OPENMP_NUMA
     return;
 #else
-#if 1
-    cpu_set_t mask;
-    CPU_ZERO(&mask);
-    int thread_idx = omp_get_thread_num();
-    CPU_SET(thread_idx, &mask);
-    //LOG_DEBUG() << "Resetting using CPU ID to " << thread_idx << "\n";
-    if (sched_setaffinity(0, sizeof(mask), &mask) == -1){
-      perror("sched_setaffinity ");
-      LOG_DEBUG() << "Calling sched_setaffinity failed for OpenMP thread "
-                  << thread_idx << "\n";
-    }
-#endif
+    // Pins the thread to the CPU in the process affinity mask, not
+    // to the CPU of the same index, so that processes sharing a node
+    // do not collide.
+    physis::runtime::NUMATopology::GetInstance()->PinCurrentThread();
 #endif /* ifndef USE_OPENMP_NUMA */
   } // __PSInitLoop_NUMA
 
@@ -5,30 +5,308 @@
 #include "runtime/reduce.h"
 #include "runtime/runtime_ref.h"
 #include "runtime/grid.h"
+#include "runtime/grid_util.h"
+#include "runtime/kernel_jit.h"
+#include "runtime/task_graph.h"
+#include "runtime/activity.h"
 
 #include <stdarg.h>
+#include <algorithm>
 #include <functional>
 #include <boost/function.hpp>
+#include <boost/bind.hpp>
 
 using namespace physis::runtime;
 
 namespace {
 
 RuntimeRef<GridSpace> *rt;
+KernelJIT *jit = NULL;
+// Recycles the buffers of freed grids
+BufferPool *buffer_pool = NULL;
+// Runs asynchronous copies and reductions
+TaskGraph *task_graph = NULL;
+// Size of the first grid, which JIT-compiled code is specialized for
+int jit_num_dims = 0;
+PSVectorInt jit_dim;
+// Number of live grids of other sizes
+int num_jit_nonconforming_grids = 0;
+// Time of changes of tracked grids
+uint64_t activity_clock = 0;
+// Tile size of tracked grids by default
+const PSIndex DEFAULT_ACTIVITY_TILE_SIZE = 16;
+
+// A stencil run over the tiles affected by changed inputs
+struct ActivityPlan {
+  __PSGrid *grid;
+  ActivityMask *mask;
+  __PSDomain dom;
+  std::vector<int64_t> tiles;
+  uint64_t time;
+};
+
+bool HasGhost(const __PSGrid *g) {
+  for (int i = 0; i < g->num_dims; ++i) {
+    if (g->ghost[i]) return true;
+  }
+  return false;
+}
+
+// Specialized code assumes no ghost layer
+bool IsJITConforming(__PSGrid *g) {
+  if (g->num_dims != jit_num_dims || HasGhost(g)) return false;
+  for (int i = 0; i < g->num_dims; ++i) {
+    if (g->dim[i] != jit_dim[i]) return false;
+  }
+  return true;
+}
+
+// Offset of the r-th row along the first dimension
+int64_t GetRowOffset(const __PSGrid *g, int64_t r) {
+  int64_t offset = 0;
+  int64_t stride = g->real_dim[0];
+  for (int i = 1; i < g->num_dims; ++i) {
+    offset += (r % g->dim[i]) * stride;
+    r /= g->dim[i];
+    stride *= g->real_dim[i];
+  }
+  return offset;
+}
+
+PSIndex WrapIndex(PSIndex i, PSIndex n) {
+  i %= n;
+  return i < 0 ? i + n : i;
+}
+
+char *GetPointAddress(const __PSGrid *g, const PSIndex *idx) {
+  int64_t offset = 0;
+  int64_t stride = 1;
+  for (int i = 0; i < g->num_dims; ++i) {
+    offset += idx[i] * stride;
+    stride *= g->real_dim[i];
+  }
+  return (char*)g->p + offset * g->elm_size;
+}
+
+bool IsRedBlack(const __PSGrid *g) {
+  return g->layout == PS_GRID_LAYOUT_RED_BLACK;
+}
+
+ActivityMask *GetActivity(const __PSGrid *g) {
+  return static_cast<ActivityMask*>(g->activity);
+}
+
+// Range of the points of a planned tile within the stencil domain
+void GetPlannedTileRange(const ActivityPlan *plan, PSIndex tile,
+                         PSIndex *min, PSIndex *max) {
+  plan->mask->GetTileRange(plan->tiles[tile], min, max);
+  for (int i = 0; i < plan->grid->num_dims; ++i) {
+    min[i] = std::max(min[i], plan->dom.local_min[i]);
+    max[i] = std::min(max[i], plan->dom.local_max[i]);
+  }
+}
+
+// Copies the points of a region into a continuous buffer
+void CopyoutRegion(const __PSGrid *g, const PSIndex *min,
+                   const PSIndex *max, void *buf) {
+  physis::IndexArray offset(min), size;
+  for (int i = 0; i < g->num_dims; ++i) {
+    offset[i] += g->ghost[i];
+    size[i] = max[i] - min[i];
+  }
+  CopyoutSubgrid(g->elm_size, g->num_dims, g->buf,
+                 physis::IndexArray(g->real_dim), buf, offset, size);
+}
+
+// Size of the buffer including the ghost layers
+size_t GetBufferSize(const __PSGrid *g) {
+  if (IsRedBlack(g)) {
+    return GetRedBlackBufferSize(g->num_dims, physis::IndexArray(g->dim)) *
+        g->elm_size;
+  }
+  int64_t num_real_elms = 1;
+  for (int i = 0; i < g->num_dims; ++i) {
+    num_real_elms *= g->real_dim[i];
+  }
+  return GetLayoutBufferSize(g->layout, g->elm_size, num_real_elms);
+}
+
+// Number of points converted at a time when reducing
+// reduced-precision grids
+const int64_t REDUCE_CHUNK_SIZE = 4096;
 
 template <class T>
 void PSReduceGridTemplate(void *buf, PSReduceOp op,
                           __PSGrid *g) {
   boost::function<T (T, T)> func = GetReducer<T>(op);
-  T *d = (T *)g->p;
-  T v = d[0];
-  for (int64_t i = 1; i < g->num_elms; ++i) {
-    v = func(v, d[i]);
+  if (IsRedBlack(g)) {
+    // Each row consists of a red and a black segment, and the
+    // unused point at the end of either is skipped
+    physis::IndexArray dim(g->dim);
+    PSIndex hx = (g->dim[0] + 1) / 2;
+    int64_t num_rows = g->num_elms / g->dim[0];
+    T *half[2] = {(T *)g->p, (T *)g->p + hx * num_rows};
+    physis::IndexArray index;
+    T v = *((T *)g->p);
+    for (int64_t r = 0; r < num_rows; ++r) {
+      int parity = 0;
+      for (int i = 1; i < g->num_dims; ++i) parity += index[i];
+      for (int c = 0; c < 2; ++c) {
+        // Number of points of color c in this row
+        PSIndex n = (g->dim[0] + 1 - ((c + parity) & 1)) / 2;
+        T *d = half[c] + r * hx;
+        for (PSIndex i = (r == 0 && c == 0) ? 1 : 0; i < n; ++i) {
+          v = func(v, d[i]);
+        }
+      }
+      for (int i = 1; i < g->num_dims; ++i) {
+        if (++index[i] < dim[i]) break;
+        index[i] = 0;
+      }
+    }
+    *((T*)buf) = v;
+    return;
+  }
+  if (g->storage_type == g->type && !HasGhost(g)) {
+    T *d = (T *)g->p;
+    T v = d[0];
+    for (int64_t i = 1; i < g->num_elms; ++i) {
+      v = func(v, d[i]);
+    }
+    *((T*)buf) = v;
+    return;
+  }
+  if (HasGhost(g)) {
+    // Skip the ghost layers row by row
+    int64_t num_rows = g->num_elms / g->dim[0];
+    T v = *((T *)g->p);
+    for (int64_t r = 0; r < num_rows; ++r) {
+      T *d = (T *)g->p + GetRowOffset(g, r);
+      for (int64_t i = r == 0 ? 1 : 0; i < g->dim[0]; ++i) {
+        v = func(v, d[i]);
+      }
+    }
+    *((T*)buf) = v;
+    return;
+  }
+  // Accumulate in the point type
+  T chunk[REDUCE_CHUNK_SIZE];
+  T v = 0;
+  for (int64_t i = 0; i < g->num_elms; i += REDUCE_CHUNK_SIZE) {
+    int64_t n = std::min(REDUCE_CHUNK_SIZE, g->num_elms - i);
+    ConvertPointsFromStorage(g->type, g->storage_type,
+                             (char*)g->p + i * g->elm_size, chunk, n);
+    int64_t j = 0;
+    if (i == 0) v = chunk[j++];
+    for (; j < n; ++j) {
+      v = func(v, chunk[j]);
+    }
   }
   *((T*)buf) = v;
   return;
 }
 
+template <class T>
+void PSReduceGridOutsideTemplate(void *buf, PSReduceOp op, __PSGrid *g,
+                                 const __PSDomain *dom) {
+  if (IsRedBlack(g) || g->storage_type != g->type) {
+    LOG_ERROR() << "Fused reduction not supported for this grid layout\n";
+    PSAbort(1);
+  }
+  boost::function<T (T, T)> func = GetReducer<T>(op);
+  T v = *((T*)buf);
+  // Points of each row outside the domain along the first dimension
+  PSIndex nx = g->dim[0];
+  PSIndex lo = std::max((PSIndex)0, std::min(dom->local_min[0], nx));
+  PSIndex hi = std::max(lo, std::min(dom->local_max[0], nx));
+  int64_t num_rows = g->num_elms / nx;
+  physis::IndexArray index;
+  for (int64_t r = 0; r < num_rows; ++r) {
+    bool inside = true;
+    for (int i = 1; i < g->num_dims; ++i) {
+      if (index[i] < dom->local_min[i] || index[i] >= dom->local_max[i]) {
+        inside = false;
+      }
+    }
+    T *d = (T *)g->p + GetRowOffset(g, r);
+    for (PSIndex i = 0; i < (inside ? lo : nx); ++i) {
+      v = func(v, d[i]);
+    }
+    if (inside) {
+      for (PSIndex i = hi; i < nx; ++i) {
+        v = func(v, d[i]);
+      }
+    }
+    for (int i = 1; i < g->num_dims; ++i) {
+      if (++index[i] < g->dim[i]) break;
+      index[i] = 0;
+    }
+  }
+  *((T*)buf) = v;
+}
+
+void CopyoutGrid(__PSGrid *g, void *dst_array) {
+  if (g->storage_type != g->type) {
+    ConvertPointsFromStorage(g->type, g->storage_type, g->p,
+                             dst_array, g->num_elms);
+    return;
+  }
+  if (IsRedBlack(g)) {
+    CopyoutPointsFromRedBlack(g->elm_size, g->num_dims,
+                              physis::IndexArray(g->dim), g->p,
+                              dst_array);
+    return;
+  }
+  if (HasGhost(g)) {
+    CopyoutSubgrid(g->elm_size, g->num_dims, g->buf,
+                   physis::IndexArray(g->real_dim), dst_array,
+                   physis::IndexArray(g->ghost),
+                   physis::IndexArray(g->dim));
+    return;
+  }
+  CopyoutPointsFromLayout(g->layout, g->elm_size, g->num_members,
+                          g->members, g->num_elms, g->p, dst_array,
+                          0, g->num_elms);
+}
+
+// Checks that coarse is coarsened from fine
+void CheckCoarsened(const __PSGrid *coarse, const __PSGrid *fine) {
+  bool ok = coarse->type == fine->type &&
+      coarse->num_dims == fine->num_dims && fine->type != PS_USER;
+  for (int i = 0; i < fine->num_dims && ok; ++i) {
+    ok = coarse->dim[i] ==
+        (fine->dim[i] + PS_COARSEN_FACTOR - 1) / PS_COARSEN_FACTOR;
+  }
+  if (!ok) {
+    LOG_ERROR() << "Grid not coarsened from the given grid\n";
+    PSAbort(1);
+  }
+}
+
+// Waits for the asynchronous tasks accessing an object before the
+// host accesses it.
+void WaitTasks(const void *obj, bool write) {
+  if (task_graph) task_graph->WaitObject(obj, write);
+}
+
+// Submits a task reading src and writing dst.
+PSTask SubmitTask(const TaskGraph::TaskFunc &func, const void *src,
+                  const void *dst) {
+  if (task_graph == NULL) {
+    func();
+    return 0;
+  }
+  return task_graph->Submit(func, std::vector<const void*>(1, src),
+                            std::vector<const void*>(1, dst));
+}
+
+template <class T>
+PSTask PSReduceGridAsyncTemplate(void *buf, PSReduceOp op,
+                                 __PSGrid *g) {
+  return SubmitTask(boost::bind(PSReduceGridTemplate<T>, buf, op, g),
+                    g, buf);
+}
+
 }
 
 #ifdef __cplusplus
@@ -37,11 +315,20 @@ extern "C" {
 
   void PSInit(int *argc, char ***argv, int grid_num_dims, ...) {
     rt = new RuntimeRef<GridSpace>();
+    buffer_pool = new BufferPool();
+    task_graph = new TaskGraph();
     va_list vl;
     va_start(vl, grid_num_dims);
     rt->Init(argc, argv, grid_num_dims, vl);
   }
   void PSFinalize() {
+    // Pending tasks are completed
+    delete task_graph;
+    task_graph = NULL;
+    delete jit;
+    jit = NULL;
+    delete buffer_pool;
+    buffer_pool = NULL;
     delete rt;
   }
 
@@ -51,41 +338,350 @@ extern "C" {
   }
 
   __PSGrid* __PSGridNew(__PSGridTypeInfo *type_info,
-                        int num_dims, PSVectorInt dim) {
+                        int num_dims, PSVectorInt dim,
+                        PSVectorInt ghost) {
     __PSGrid *g = (__PSGrid*)malloc(sizeof(__PSGrid));
+    g->type = type_info->type;
+    g->storage_type = type_info->type;
     g->elm_size = type_info->size;
+    if (type_info->storage_size) {
+      g->storage_type = type_info->storage_type;
+      g->elm_size = type_info->storage_size;
+    }
     g->num_dims = num_dims;
     PSVectorIntCopy(g->dim, dim);
+    PSVectorIntInit(g->ghost, 0);
+    PSVectorIntCopy(g->real_dim, dim);
     g->num_elms = 1;
     int i;
     for (i = 0; i < num_dims; i++) {
+      g->ghost[i] = ghost[i];
+      g->real_dim[i] = dim[i] + ghost[i] * 2;
       g->num_elms *= dim[i];
     }
 
-    g->p = calloc(g->num_elms, g->elm_size);
-    if (!g->p) {
+    g->layout = PS_GRID_LAYOUT_AOS;
+    g->activity = NULL;
+    g->num_members = 0;
+    g->members = NULL;
+    if (type_info->layout == PS_GRID_LAYOUT_RED_BLACK) {
+      // Points are converted as a whole
+      PSAssert(g->storage_type == g->type);
+      g->layout = type_info->layout;
+    } else if (type_info->layout != PS_GRID_LAYOUT_AOS) {
+      PSAssert(type_info->num_members > 0);
+      g->layout = type_info->layout;
+      g->num_members = type_info->num_members;
+      g->members = (__PSGridTypeMemberInfo*)malloc(
+          sizeof(__PSGridTypeMemberInfo) * g->num_members);
+      memcpy(g->members, type_info->members,
+             sizeof(__PSGridTypeMemberInfo) * g->num_members);
+    }
+
+    // Ghost layers are only given to AoS grids stored as is
+    PSAssert(!HasGhost(g) || (g->layout == PS_GRID_LAYOUT_AOS &&
+                              g->storage_type == g->type));
+
+    size_t buf_size = GetBufferSize(g);
+    if (buffer_pool) {
+      g->buf = buffer_pool->GetChunk(buf_size);
+      if (g->buf) memset(g->buf, 0, buf_size);
+    } else {
+      g->buf = calloc(buf_size, 1);
+    }
+    if (!g->buf) {
       return INVALID_GRID;
     }
+    g->p = (char*)g->buf +
+        GridCalcOffset3D(physis::IndexArray(g->ghost),
+                         physis::IndexArray(g->real_dim)) * g->elm_size;
+
+    if (jit_num_dims == 0) {
+      jit_num_dims = num_dims;
+      PSVectorIntCopy(jit_dim, dim);
+    }
+    if (!IsJITConforming(g)) {
+      ++num_jit_nonconforming_grids;
+    }
 
     return g;
   }
 
   void PSGridFree(void *p) {
     __PSGrid *g = (__PSGrid *)p;        
-    if (g->p) {
-      free(g->p);
+    WaitTasks(g, true);
+    if (g->buf) {
+      if (buffer_pool) {
+        buffer_pool->ReleaseChunk(g->buf, GetBufferSize(g));
+      } else {
+        free(g->buf);
+      }
+      if (!IsJITConforming(g)) --num_jit_nonconforming_grids;
     }
+    g->buf = NULL;
     g->p = NULL;
+    PS_XFREE(g->members);
+    delete GetActivity(g);
+    g->activity = NULL;
   }
 
   void PSGridCopyin(void *p, const void *src_array) {
     __PSGrid *g = (__PSGrid *)p;
-    memcpy(g->p, src_array, g->elm_size * g->num_elms);
+    WaitTasks(g, true);
+    if (GetActivity(g)) GetActivity(g)->MarkAllChanged(++activity_clock);
+    if (g->storage_type != g->type) {
+      ConvertPointsToStorage(g->type, g->storage_type, src_array,
+                             g->p, g->num_elms);
+      return;
+    }
+    if (IsRedBlack(g)) {
+      CopyinPointsToRedBlack(g->elm_size, g->num_dims,
+                             physis::IndexArray(g->dim), g->p, src_array);
+      return;
+    }
+    if (HasGhost(g)) {
+      CopyinSubgrid(g->elm_size, g->num_dims, g->buf,
+                    physis::IndexArray(g->real_dim), src_array,
+                    physis::IndexArray(g->ghost),
+                    physis::IndexArray(g->dim));
+      return;
+    }
+    CopyinPointsToLayout(g->layout, g->elm_size, g->num_members,
+                         g->members, g->num_elms, g->p, src_array,
+                         0, g->num_elms);
   }
 
   void PSGridCopyout(void *p, void *dst_array) {
+    WaitTasks(dst_array, true);
+    CopyoutGrid((__PSGrid *)p, dst_array);
+  }
+
+  void PSGridCopyoutView(void *p, void *dst_array,
+                         const PSVectorInt offset, const PSVectorInt size,
+                         const PSVectorInt stride) {
     __PSGrid *g = (__PSGrid *)p;
-    memcpy(dst_array, g->p, g->elm_size * g->num_elms);
+    physis::IndexArray dim(g->dim);
+    CheckGridView(g->num_dims, dim, physis::IndexArray(offset),
+                  physis::IndexArray(size), physis::IndexArray(stride));
+    WaitTasks(dst_array, true);
+    if (g->storage_type == g->type && g->layout == PS_GRID_LAYOUT_AOS) {
+      CopyoutStridedSubgrid(g->elm_size, g->num_dims, g->buf,
+                            physis::IndexArray(g->real_dim), dst_array,
+                            physis::IndexArray(offset) +
+                            physis::IndexArray(g->ghost),
+                            physis::IndexArray(size),
+                            physis::IndexArray(stride));
+      return;
+    }
+    // Other layouts are first converted to the natural order
+    size_t point_size = g->type == PS_USER ?
+        g->elm_size : GetPrimitiveTypeSize(g->type);
+    std::vector<char> points(g->num_elms * point_size);
+    CopyoutGrid(g, &points[0]);
+    CopyoutStridedSubgrid(point_size, g->num_dims,
+                          &points[0], dim, dst_array,
+                          physis::IndexArray(offset),
+                          physis::IndexArray(size),
+                          physis::IndexArray(stride));
+  }
+
+  // Points are transferred in the natural order to support any
+  // layout and storage type
+  void PSGridRestrict(void *c, void *f) {
+    __PSGrid *coarse = (__PSGrid *)c;
+    __PSGrid *fine = (__PSGrid *)f;
+    CheckCoarsened(coarse, fine);
+    size_t point_size = GetPrimitiveTypeSize(fine->type);
+    std::vector<char> fine_points(fine->num_elms * point_size);
+    std::vector<char> coarse_points(coarse->num_elms * point_size);
+    CopyoutGrid(fine, &fine_points[0]);
+    RestrictSubgrid(fine->type, fine->num_dims, &fine_points[0],
+                    physis::IndexArray(), physis::IndexArray(fine->dim),
+                    &coarse_points[0], physis::IndexArray(),
+                    physis::IndexArray(coarse->dim));
+    PSGridCopyin(coarse, &coarse_points[0]);
+  }
+
+  void PSGridProlong(void *f, void *c, int accumulate) {
+    __PSGrid *fine = (__PSGrid *)f;
+    __PSGrid *coarse = (__PSGrid *)c;
+    CheckCoarsened(coarse, fine);
+    size_t point_size = GetPrimitiveTypeSize(fine->type);
+    std::vector<char> fine_points(fine->num_elms * point_size);
+    std::vector<char> coarse_points(coarse->num_elms * point_size);
+    CopyoutGrid(coarse, &coarse_points[0]);
+    if (accumulate) CopyoutGrid(fine, &fine_points[0]);
+    ProlongSubgrid(fine->type, fine->num_dims, &coarse_points[0],
+                   physis::IndexArray(), physis::IndexArray(coarse->dim),
+                   &fine_points[0], physis::IndexArray(),
+                   physis::IndexArray(fine->dim), accumulate);
+    PSGridCopyin(fine, &fine_points[0]);
+  }
+
+  // Grids are not decomposed, so there is no halo to exchange
+  void PSGridSetHaloDepth(void *g, int depth) {
+    PSAssert(depth >= 1);
+  }
+
+  PSTask PSGridCopyoutAsync(void *p, void *dst_array) {
+    return SubmitTask(boost::bind(CopyoutGrid, (__PSGrid *)p, dst_array),
+                      p, dst_array);
+  }
+
+  void PSWait(PSTask t) {
+    if (task_graph) task_graph->Wait(t);
+  }
+
+  void PSWaitAll() {
+    if (task_graph) task_graph->WaitAll();
+  }
+
+  void __PSGridWait(__PSGrid *g) {
+    WaitTasks(g, true);
+  }
+
+  void __PSGridMarkWritten(__PSGrid *g) {
+    ActivityMask *m = GetActivity(g);
+    if (m == NULL) return;
+    // Any point may have changed
+    m->MarkAllChanged(++activity_clock);
+    m->ResetProducer();
+  }
+
+  void PSGridTrackActivity(void *p, PSIndex tile_size, double threshold) {
+    __PSGrid *g = (__PSGrid *)p;
+    if (g->layout != PS_GRID_LAYOUT_AOS || g->storage_type != g->type) {
+      LOG_WARNING() << "Activity not tracked for grids not stored as is "
+                    << "in the AoS layout\n";
+      return;
+    }
+    if (tile_size <= 0) {
+      const char *s = getenv("PHYSIS_ACTIVITY_TILE_SIZE");
+      tile_size = s ? atol(s) : 0;
+      if (tile_size <= 0) tile_size = DEFAULT_ACTIVITY_TILE_SIZE;
+    }
+    physis::IndexArray dim(g->dim);
+    delete GetActivity(g);
+    g->activity = new ActivityMask(g->num_dims, &dim[0], tile_size,
+                                   threshold, ++activity_clock);
+  }
+
+  void PSGridMarkActive(void *p, PSVectorInt offset, PSVectorInt size) {
+    __PSGrid *g = (__PSGrid *)p;
+    if (GetActivity(g) == NULL) return;
+    physis::IndexArray min(offset);
+    physis::IndexArray max = min + physis::IndexArray(size);
+    GetActivity(g)->MarkChanged(&min[0], &max[0], ++activity_clock);
+  }
+
+  void *__PSActivityBegin(__PSRunTileFunc run_tile,
+                          const void *stencil, size_t stencil_size,
+                          int width, int read, int written,
+                          int num_grids, __PSGrid **grids,
+                          PSIndex *num_tiles, size_t *buf_size) {
+    const __PSDomain *dom = (const __PSDomain *)stencil;
+    std::vector<__PSGrid*> outputs;
+    for (int i = 0; i < num_grids; ++i) {
+      if ((written & (1 << i)) &&
+          std::find(outputs.begin(), outputs.end(), grids[i]) ==
+          outputs.end()) {
+        outputs.push_back(grids[i]);
+      }
+    }
+    ActivityMask *mask = outputs.size() == 1 ? GetActivity(outputs[0]) : NULL;
+    bool tracked = mask != NULL && width >= 0;
+    for (int i = 0; i < num_grids && tracked; ++i) {
+      if (!(read & (1 << i))) continue;
+      ActivityMask *m = GetActivity(grids[i]);
+      if (m == NULL || !m->IsCompatible(*mask)) tracked = false;
+    }
+    uint64_t now = ++activity_clock;
+    if (!tracked) {
+      // Any emitted point may change
+      FOREACH (it, outputs.begin(), outputs.end()) {
+        ActivityMask *m = GetActivity(*it);
+        if (m == NULL) continue;
+        m->MarkChanged(dom->local_min, dom->local_max, now);
+        m->ResetProducer();
+      }
+      return NULL;
+    }
+
+    ActivityPlan *plan = new ActivityPlan();
+    plan->grid = outputs[0];
+    plan->mask = mask;
+    plan->dom = *dom;
+    plan->time = now;
+    std::vector<int64_t> tiles;
+    mask->GetTiles(dom->local_min, dom->local_max, tiles);
+    // Tiles computed by another stencil are not known to be up to date
+    bool produced = mask->IsProducer(
+        reinterpret_cast<const void*>(run_tile), stencil, stencil_size);
+    FOREACH (it, tiles.begin(), tiles.end()) {
+      // Also recompute tiles overwritten since computed
+      bool active = !produced || mask->changed(*it) > mask->computed(*it);
+      if (!active) {
+        PSIndex min[PS_MAX_DIM], max[PS_MAX_DIM];
+        mask->GetTileRange(*it, min, max);
+        for (int i = 0; i < PS_MAX_DIM; ++i) {
+          min[i] -= width;
+          max[i] += width;
+        }
+        for (int i = 0; i < num_grids && !active; ++i) {
+          if (!(read & (1 << i))) continue;
+          active = GetActivity(grids[i])->IsChangedSince(
+              min, max, mask->computed(*it));
+        }
+      }
+      if (active) plan->tiles.push_back(*it);
+      mask->computed(*it) = now;
+    }
+    mask->SetProducer(reinterpret_cast<const void*>(run_tile), stencil,
+                      stencil_size);
+    LOG_VERBOSE() << "Active tiles: " << plan->tiles.size() << "/"
+                  << tiles.size() << "\n";
+    *num_tiles = plan->tiles.size();
+    // The points of a tile before and after running the stencil
+    size_t tile_points = 1;
+    for (int i = 0; i < plan->grid->num_dims; ++i) {
+      tile_points *= mask->tile_size();
+    }
+    *buf_size = tile_points * plan->grid->elm_size * 2;
+    return plan;
+  }
+
+  void __PSActivityBeginTile(void *p, PSIndex tile, __PSDomain *dom,
+                             void *buf) {
+    ActivityPlan *plan = static_cast<ActivityPlan*>(p);
+    PSIndex min[PS_MAX_DIM], max[PS_MAX_DIM];
+    GetPlannedTileRange(plan, tile, min, max);
+    for (int i = 0; i < plan->grid->num_dims; ++i) {
+      dom->local_min[i] = min[i];
+      dom->local_max[i] = max[i];
+    }
+    CopyoutRegion(plan->grid, min, max, buf);
+  }
+
+  void __PSActivityEndTile(void *p, PSIndex tile, void *buf) {
+    ActivityPlan *plan = static_cast<ActivityPlan*>(p);
+    const __PSGrid *g = plan->grid;
+    PSIndex min[PS_MAX_DIM], max[PS_MAX_DIM];
+    GetPlannedTileRange(plan, tile, min, max);
+    int64_t num_points = 1;
+    for (int i = 0; i < g->num_dims; ++i) {
+      num_points *= max[i] - min[i];
+    }
+    char *cur = (char*)buf + num_points * g->elm_size;
+    CopyoutRegion(g, min, max, cur);
+    if (IsPointsChanged(g->type, g->elm_size, buf, cur, num_points,
+                        plan->mask->threshold())) {
+      // Each tile is run by a single thread
+      plan->mask->MarkChanged(plan->tiles[tile], plan->time);
+    }
+  }
+
+  void __PSActivityEnd(void *plan) {
+    delete static_cast<ActivityPlan*>(plan);
   }
 
   PSDomain1D PSDomain1DNew(PSIndex minx, PSIndex maxx) {
@@ -109,22 +705,112 @@ extern "C" {
   }
 
   void __PSGridSet(__PSGrid *g, void *buf, ...) {
+    WaitTasks(g, true);
     int nd = g->num_dims;
     va_list vl;
     va_start(vl, buf);
+    physis::IndexArray index;
     PSIndex offset = 0;
     PSIndex base_offset = 1;
     for (int i = 0; i < nd; ++i) {
-      PSIndex idx = va_arg(vl, PSIndex);
-      offset += idx * base_offset;
-      base_offset *= g->dim[i];
+      index[i] = va_arg(vl, PSIndex);
+      offset += index[i] * base_offset;
+      base_offset *= g->real_dim[i];
     }
     va_end(vl);
-    offset *= g->elm_size;
-    memcpy(((char *)g->p) + offset, buf, g->elm_size);
+    if (GetActivity(g)) {
+      physis::IndexArray next = index + 1;
+      GetActivity(g)->MarkChanged(&index[0], &next[0], ++activity_clock);
+    }
+    if (IsRedBlack(g)) {
+      offset = GetRedBlackOffset(nd, physis::IndexArray(g->dim), index);
+      memcpy((char*)g->p + offset * g->elm_size, buf, g->elm_size);
+      return;
+    }
+    if (g->storage_type != g->type) {
+      ConvertPointsToStorage(g->type, g->storage_type, buf,
+                             (char*)g->p + offset * g->elm_size, 1);
+      return;
+    }
+    CopyinPointsToLayout(g->layout, g->elm_size, g->num_members,
+                         g->members, g->num_elms, g->p, buf,
+                         offset, offset + 1);
+  }
+
+  void __PSGridFillGhost(__PSGrid *g) {
+    if (!HasGhost(g)) return;
+    int nd = g->num_dims;
+    ActivityMask *activity = GetActivity(g);
+    // Dimensions are filled in order, each over the ghost layers
+    // of the preceding dimensions, so that corners are filled too
+    for (int d = 0; d < nd; ++d) {
+      if (g->ghost[d] == 0) continue;
+      PSIndex min[PS_MAX_DIM], max[PS_MAX_DIM];
+      for (int i = 0; i < PS_MAX_DIM; ++i) {
+        min[i] = 0;
+        max[i] = i < nd ? g->dim[i] : 1;
+        if (i < d) {
+          min[i] -= g->ghost[i];
+          max[i] += g->ghost[i];
+        }
+      }
+      for (int fw = 0; fw < 2; ++fw) {
+        if (activity) {
+          // Skip the face if the interior points wrapped into it,
+          // including those of the corners, have not changed
+          PSIndex src_min[PS_MAX_DIM], src_max[PS_MAX_DIM];
+          for (int i = 0; i < PS_MAX_DIM; ++i) {
+            src_min[i] = 0;
+            src_max[i] = g->dim[i];
+          }
+          src_min[d] = fw ? 0 : g->dim[d] - g->ghost[d];
+          src_max[d] = fw ? g->ghost[d] : g->dim[d];
+          if (!activity->IsChangedSince(src_min, src_max,
+                                        activity->ghost_time())) {
+            continue;
+          }
+        }
+        min[d] = fw ? g->dim[d] : -g->ghost[d];
+        max[d] = fw ? g->dim[d] + g->ghost[d] : 0;
+        // Rows along the first dimension are copied at once unless
+        // the first dimension is being filled
+        PSIndex row = d == 0 ? 1 : max[0] - min[0];
+        PSIndex idx[PS_MAX_DIM], src[PS_MAX_DIM];
+        for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+          for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+            for (idx[0] = min[0]; idx[0] < max[0]; idx[0] += row) {
+              memcpy(src, idx, sizeof(idx));
+              src[d] = WrapIndex(idx[d], g->dim[d]);
+              memcpy(GetPointAddress(g, idx), GetPointAddress(g, src),
+                     g->elm_size * row);
+            }
+          }
+        }
+      }
+    }
+    if (activity) activity->ghost_time() = ++activity_clock;
+  }
+
+  void *__PSJITLookupRunFunc(const char *source, const char *name,
+                             int openmp) {
+    // Specialized code is valid only when all grids are of the same
+    // size
+    if (jit_num_dims == 0 || num_jit_nonconforming_grids > 0) {
+      return NULL;
+    }
+    if (jit == NULL) {
+      static const __PSJITRuntime table = {
+        __PSGridFillGhost, __PSGridWait, __PSGridMarkWritten,
+        __PSReduceGridOutsideFloat, __PSReduceGridOutsideDouble,
+        __PSReduceGridOutsideInt, __PSReduceGridOutsideLong,
+        __PSActivityBegin, __PSActivityBeginTile,
+        __PSActivityEndTile, __PSActivityEnd};
+      jit = new KernelJIT(PS_JIT_RUNTIME_NAME, &table, sizeof(table));
+    }
+    return jit->GetFunc(source, name, jit_num_dims,
+                        physis::IndexArray(jit_dim), openmp);
   }
 
-  
   void __PSReduceGridFloat(void *buf, PSReduceOp op,
                            __PSGrid *g) {
     PSReduceGridTemplate<float>(buf, op, g);
@@ -145,6 +831,46 @@ extern "C" {
     PSReduceGridTemplate<long>(buf, op, g);
   }
 
+  void __PSReduceGridOutsideFloat(void *buf, PSReduceOp op,
+                                  __PSGrid *g, const __PSDomain *dom) {
+    PSReduceGridOutsideTemplate<float>(buf, op, g, dom);
+  }
+
+  void __PSReduceGridOutsideDouble(void *buf, PSReduceOp op,
+                                   __PSGrid *g, const __PSDomain *dom) {
+    PSReduceGridOutsideTemplate<double>(buf, op, g, dom);
+  }
+
+  void __PSReduceGridOutsideInt(void *buf, PSReduceOp op,
+                                __PSGrid *g, const __PSDomain *dom) {
+    PSReduceGridOutsideTemplate<int>(buf, op, g, dom);
+  }
+
+  void __PSReduceGridOutsideLong(void *buf, PSReduceOp op,
+                                 __PSGrid *g, const __PSDomain *dom) {
+    PSReduceGridOutsideTemplate<long>(buf, op, g, dom);
+  }
+
+  PSTask __PSReduceGridFloatAsync(void *buf, PSReduceOp op,
+                                  __PSGrid *g) {
+    return PSReduceGridAsyncTemplate<float>(buf, op, g);
+  }
+
+  PSTask __PSReduceGridDoubleAsync(void *buf, PSReduceOp op,
+                                   __PSGrid *g) {
+    return PSReduceGridAsyncTemplate<double>(buf, op, g);
+  }
+
+  PSTask __PSReduceGridIntAsync(void *buf, PSReduceOp op,
+                                __PSGrid *g) {
+    return PSReduceGridAsyncTemplate<int>(buf, op, g);
+  }
+
+  PSTask __PSReduceGridLongAsync(void *buf, PSReduceOp op,
+                                 __PSGrid *g) {
+    return PSReduceGridAsyncTemplate<long>(buf, op, g);
+  }
+
 #ifdef __cplusplus
 }
 #endif
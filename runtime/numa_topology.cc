@@ -0,0 +1,159 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#if ! defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "runtime/numa_topology.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include <set>
+
+#ifdef USE_OPENMP_NUMA
+#include <numaif.h>
+#include <numa.h>
+#endif
+
+namespace physis {
+namespace runtime {
+
+NUMATopology *NUMATopology::GetInstance() {
+  static NUMATopology *topology = NULL;
+  // Make sure the topology is created before entering parallel
+  // regions; otherwise only one thread must create it.
+#pragma omp critical (physis_numa_topology)
+  {
+    if (topology == NULL) {
+      topology = new NUMATopology();
+    }
+  }
+  return topology;
+}
+
+NUMATopology::NUMATopology(): num_nodes_(1) {
+  Discover();
+  pinned_cpu_.resize(omp_get_max_threads(), -1);
+  LOG_INFO() << *this << "\n";
+}
+
+// Returns the node of a CPU by looking for the nodeN entry in
+// /sys/devices/system/cpu/cpuM.
+static int GetNodeOfCPUFromSysfs(int cpu) {
+  char path[256];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR *dir = opendir(path);
+  if (dir == NULL) return -1;
+  int node = -1;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, "node", 4) == 0 &&
+        ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+      node = atoi(ent->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+void NUMATopology::Discover() {
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for (int i = 0; i < CPU_SETSIZE; ++i) {
+      if (CPU_ISSET(i, &mask)) cpus_.push_back(i);
+    }
+  } else {
+    perror("sched_getaffinity ");
+  }
+  if (cpus_.size() == 0) {
+    LOG_WARNING() << "Could not get the CPU affinity; "
+                  << "assuming all online CPUs are available\n";
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long i = 0; i < std::max(n, 1L); ++i) {
+      cpus_.push_back(i);
+    }
+  }
+
+  std::set<int> nodes;
+  cpu_node_.resize(cpus_.back() + 1, 0);
+  FOREACH (it, cpus_.begin(), cpus_.end()) {
+    int node;
+#ifdef USE_OPENMP_NUMA
+    node = numa_available() == -1 ? -1 : numa_node_of_cpu(*it);
+#else
+    node = GetNodeOfCPUFromSysfs(*it);
+#endif
+    if (node == -1) {
+      LOG_DEBUG() << "Node of CPU " << *it << " unknown\n";
+      node = 0;
+    }
+    cpu_node_[*it] = node;
+    nodes.insert(node);
+  }
+  num_nodes_ = nodes.size();
+}
+
+int NUMATopology::GetNodeOfCPU(int cpu) const {
+  if (cpu < 0 || cpu >= (int)cpu_node_.size()) return 0;
+  return cpu_node_[cpu];
+}
+
+void NUMATopology::PinCurrentThread() {
+#ifdef USE_OPENMP_NUMA
+  int thread_idx = omp_get_thread_num();
+  if (thread_idx >= (int)pinned_cpu_.size()) {
+    LOG_DEBUG() << "Thread " << thread_idx
+                << " started after the topology is discovered\n";
+    return;
+  }
+  int cpu = GetCPUOfThread(thread_idx);
+  if (pinned_cpu_[thread_idx] == cpu) return;
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  if (sched_setaffinity(0, sizeof(mask), &mask) == -1) {
+    perror("sched_setaffinity ");
+    LOG_DEBUG() << "Calling sched_setaffinity failed for OpenMP thread "
+                << thread_idx << "\n";
+  }
+  // Do not try again even if failed
+  pinned_cpu_[thread_idx] = cpu;
+#endif
+}
+
+std::ostream &NUMATopology::Print(std::ostream &os) const {
+  StringJoin sj;
+  FOREACH (it, cpus_.begin(), cpus_.end()) {
+    sj << (toString(*it) + ":" + toString(GetNodeOfCPU(*it)));
+  }
+  os << "NUMATopology {"
+     << "#nodes: " << num_nodes_
+     << ", #cpus: " << cpus_.size()
+     << ", cpu:node: {" << sj.str() << "}"
+     << "}";
+  return os;
+}
+
+int GetNUMANodeOfAddress(void *p) {
+#ifdef USE_OPENMP_NUMA
+  if (p == NULL || numa_available() == -1) return -1;
+  void *page = (void*)((intptr_t)p & ~((intptr_t)sysconf(_SC_PAGESIZE) - 1));
+  int status = -1;
+  // Query only; no page is moved when the nodes argument is NULL
+  if (move_pages(0, 1, &page, NULL, &status, 0) != 0) return -1;
+  return status < 0 ? -1 : status;
+#else
+  return -1;
+#endif
+}
+
+} // namespace runtime
+} // namespace physis
@@ -0,0 +1,76 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_RUNTIME_NUMA_TOPOLOGY_H_
+#define PHYSIS_RUNTIME_NUMA_TOPOLOGY_H_
+
+#include <iostream>
+#include <vector>
+
+#include "runtime/runtime_common.h"
+
+namespace physis {
+namespace runtime {
+
+//! NUMA topology of the CPUs available to this process.
+/*!
+  The topology is discovered with libnuma when USE_OPENMP_NUMA is
+  defined, and from sysfs otherwise. OpenMP threads are mapped
+  round-robin onto the CPUs in the affinity mask of the process, so
+  MPI processes bound to disjoint CPU sets by the launcher do not
+  place their threads on the same CPUs.
+ */
+class NUMATopology {
+ public:
+  static NUMATopology *GetInstance();
+  virtual ~NUMATopology() {}
+  //! Number of NUMA nodes spanned by the available CPUs.
+  int num_nodes() const { return num_nodes_; }
+  //! Number of CPUs available to this process.
+  int num_cpus() const { return cpus_.size(); }
+  //! CPU the given OpenMP thread is pinned to.
+  int GetCPUOfThread(int thread) const {
+    return cpus_[thread % cpus_.size()];
+  }
+  //! NUMA node of a CPU; 0 if unknown.
+  int GetNodeOfCPU(int cpu) const;
+  //! NUMA node the given OpenMP thread runs on.
+  int GetNodeOfThread(int thread) const {
+    return GetNodeOfCPU(GetCPUOfThread(thread));
+  }
+  //! Pin the calling OpenMP thread to its CPU.
+  /*!
+    Only effective with USE_OPENMP_NUMA. The affinity is set only
+    once for each thread, so this is cheap to call at the beginning
+    of every parallel loop.
+   */
+  void PinCurrentThread();
+  std::ostream &Print(std::ostream &os) const;
+
+ protected:
+  NUMATopology();
+  void Discover();
+  //! CPUs available to this process, in ascending order
+  std::vector<int> cpus_;
+  //! NUMA node of each CPU indexed by CPU id
+  std::vector<int> cpu_node_;
+  int num_nodes_;
+  //! CPU each OpenMP thread is pinned to; -1 if not yet pinned
+  std::vector<int> pinned_cpu_;
+};
+
+//! Returns the NUMA node where a page is located.
+/*!
+  \param p Address within the page.
+  \return The node id, or -1 if unknown.
+ */
+int GetNUMANodeOfAddress(void *p);
+
+} // namespace runtime
+} // namespace physis
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const physis::runtime::NUMATopology &t) {
+  return t.Print(os);
+}
+
+#endif /* PHYSIS_RUNTIME_NUMA_TOPOLOGY_H_ */
@@ -8,6 +8,9 @@
 #include "runtime/proc.h"
 #include "runtime/grid_util.h"
 
+#include <list>
+#include <map>
+
 namespace physis {
 namespace runtime {
 
@@ -18,7 +21,8 @@ enum RT_FUNC_KIND {
   FUNC_COPYIN, FUNC_COPYOUT,
   FUNC_GET, FUNC_SET,
   FUNC_RUN, FUNC_FINALIZE, FUNC_BARRIER,
-  FUNC_GRID_REDUCE
+  FUNC_GRID_REDUCE, FUNC_GRID_RESTRICT, FUNC_GRID_PROLONG,
+  FUNC_COPYOUT_ASYNC, FUNC_COPYOUT_VIEW, FUNC_GRID_HALO_DEPTH
 };
 
 struct Request {
@@ -39,6 +43,106 @@ struct RequestNEW {
   int attr;
 };
 
+//! Arguments of restriction and prolongation.
+struct RequestTRANSFER {
+  int coarse_id;
+  int fine_id;
+  int accumulate;
+};
+
+//! Strided view of a grid to copy out.
+struct RequestVIEW {
+  IndexArray offset;
+  IndexArray size;
+  IndexArray stride;
+};
+
+//! Subgrid staged for an asynchronous copyout.
+struct StagedSubgrid {
+  IndexArray offset;
+  IndexArray size;
+  //! Staging chunk taken from the buffer pool
+  void *buf;
+  size_t bytes;
+  //! Transfer request; NULL if already local.
+  void *req;
+};
+
+//! Asynchronous copyout waited for by the master.
+struct AsyncCopyout {
+  void *dst;
+  int num_dims;
+  IndexArray grid_size;
+  size_t elm_size;
+  std::vector<StagedSubgrid> subgrids;
+};
+
+//! Copy the local subgrid of a grid into a pooled staging chunk.
+template <class GridType>
+void StageSubgrid(GridType *g, BufferPool &pool, StagedSubgrid &s) {
+  s.offset = g->local_offset();
+  s.size = g->local_size();
+  s.bytes = g->GetLocalBufferSize();
+  s.buf = pool.GetChunk(s.bytes);
+  s.req = NULL;
+  if (g->HasHalo()) {
+    g->Copyout(s.buf);
+  } else {
+    memcpy(s.buf, g->buffer()->Get(), s.bytes);
+  }
+}
+
+//! Copy the local points of a view into a pooled staging chunk.
+/*!
+  The offset and size of the staged subgrid are given in the
+  indices of the view.
+
+  \return False if no point of the view is local, in which case
+  no chunk is taken.
+ */
+template <class GridType>
+bool StageGridView(GridType *g, const RequestVIEW &v, BufferPool &pool,
+                   StagedSubgrid &s) {
+  int nd = g->num_dims();
+  s.buf = NULL;
+  s.bytes = 0;
+  s.req = NULL;
+  if (g->empty() ||
+      !IntersectGridView(nd, v.offset, v.size, v.stride,
+                         g->local_offset(), g->local_size(),
+                         s.offset, s.size)) {
+    s.size = IndexArray();
+    return false;
+  }
+  s.bytes = s.size.accumulate(nd) * g->elm_size();
+  s.buf = pool.GetChunk(s.bytes);
+  IndexArray first = s.offset;
+  first *= v.stride;
+  first += v.offset;
+  first -= g->local_real_offset();
+  CopyoutStridedSubgrid(g->elm_size(), nd, g->buffer()->Get(),
+                        g->local_real_size(), s.buf, first, s.size,
+                        v.stride);
+  return true;
+}
+
+//! Send the local points of a view to the root process.
+/*!
+  The offset and size of the local points in the view are sent
+  first, followed by the points if any.
+ */
+template <class GridType>
+void SendGridView(InterProcComm *ipc, GridType *g, const RequestVIEW &v,
+                  BufferPool &pool, int root) {
+  StagedSubgrid s;
+  bool staged = StageGridView(g, v, pool, s);
+  ipc->Send(&s.offset, sizeof(IndexArray), root);
+  ipc->Send(&s.size, sizeof(IndexArray), root);
+  if (!staged) return;
+  ipc->Send(s.buf, s.bytes, root);
+  pool.ReleaseChunk(s.buf, s.bytes);
+}
+
 template <class GridSpaceType>
 class Client: public Proc {
  protected:
@@ -49,6 +153,10 @@ class Client: public Proc {
          __PSStencilRunClientFunction *stencil_runs,
          GridSpaceType *gs);
   virtual ~Client() {}
+  //! Serve the requests of the master.
+  /*!
+    Returns after the master finalizes, leaving MPI to the caller.
+   */
   virtual void Listen();  
   virtual void Finalize();
   virtual void Barrier();
@@ -60,13 +168,26 @@ class Client: public Proc {
   virtual void GridCopyout(int id);
   virtual void GridCopyoutStage2(
       typename GridSpaceType::GridType *g);
+  virtual void GridCopyoutAsync(int id);
+  virtual void GridCopyoutView(int id);
   virtual void GridSet(int id);
   virtual void GridGet(int id);  
   virtual void StencilRun(int id);
   virtual void GridReduce(int id);
+  virtual void GridRestrict();
+  virtual void GridProlong();
+  virtual void GridSetHaloDepth(int id);
   static int GetMasterRank() {
     return Proc::GetRootRank();
   }
+ protected:
+  //! Subgrids being sent by asynchronous copyouts
+  std::list<StagedSubgrid> staged_sends_;
+  //! Release the staging chunks of completed sends.
+  /*!
+    \param wait True to wait for all sends to complete.
+   */
+  void ReleaseStagedSends(bool wait);
 };
 
 template <class GridSpaceType>
@@ -75,6 +196,22 @@ class Master: public Proc {
   Counter gridCounter;
   GridSpaceType *gs_;  
   void NotifyCall(enum RT_FUNC_KIND fkind, int opt=0);
+  //! Constructs a master on any rank.
+  /*!
+    \param spmd True if every rank runs the host code redundantly.
+   */
+  Master(InterProcComm *ipc,
+         __PSStencilRunClientFunction *stencil_runs,
+         GridSpaceType *gs, bool spmd);
+  //! Receives the subgrids of the other processes into buf.
+  virtual void GridCopyoutRemote(typename GridSpaceType::GridType *g,
+                                 void *buf);
+  //! Receives the points of a view held by the other processes.
+  virtual void GridCopyoutViewRemote(typename GridSpaceType::GridType *g,
+                                     void *buf, const RequestVIEW &v);
+  //! Asynchronous copyouts not yet waited for
+  std::map<int, AsyncCopyout> async_copyouts_;
+  int last_task_;
  public:
   Master(InterProcComm *ipc,
          __PSStencilRunClientFunction *stencil_runs,
@@ -95,17 +232,103 @@ class Master: public Proc {
   virtual void GridCopyinLocal(typename GridSpaceType::GridType *g, const void *buf);  
   virtual void GridCopyout(typename GridSpaceType::GridType *g, void *buf);
   virtual void GridCopyoutLocal(typename GridSpaceType::GridType *g, void *buf);  
+  //! Copy out a grid asynchronously.
+  /*!
+    The subgrids of all processes are copied into staging buffers
+    before returning, so later stencil runs can modify the grid while
+    the subgrids are sent to the master.
+
+    \param g The grid.
+    \param buf The destination, which is written by Wait.
+    \return The task to wait for.
+   */
+  virtual int GridCopyoutAsync(typename GridSpaceType::GridType *g,
+                               void *buf);
+  //! Copy out a strided view of a grid.
+  /*!
+    \param g The grid.
+    \param buf The destination of the points of the view.
+    \param offset The first point of the view.
+    \param size The number of points of the view.
+    \param stride The distance of the points of the view.
+   */
+  virtual void GridCopyoutView(typename GridSpaceType::GridType *g,
+                               void *buf, const IndexArray &offset,
+                               const IndexArray &size,
+                               const IndexArray &stride);
+  //! Wait for an asynchronous copyout to complete.
+  virtual void Wait(int task);
+  //! Wait for all asynchronous copyouts to complete.
+  virtual void WaitAll();
   virtual void GridSet(typename GridSpaceType::GridType *g, const void *buf, const IndexArray &index);
   virtual void GridGet(typename GridSpaceType::GridType *g, void *buf, const IndexArray &index);  
   virtual void StencilRun(int id, int iter, int num_stencils,
                           void **stencils, unsigned *stencil_sizes);
   virtual void GridReduce(void *buf, PSReduceOp op, typename GridSpaceType::GridType *g);
+  virtual void GridRestrict(typename GridSpaceType::GridType *coarse,
+                            typename GridSpaceType::GridType *fine);
+  virtual void GridProlong(typename GridSpaceType::GridType *fine,
+                           typename GridSpaceType::GridType *coarse,
+                           bool accumulate);
+  //! Widen the halo of a grid.
+  /*!
+    \see GridSpaceMPI::SetHaloDepth
+   */
+  virtual void GridSetHaloDepth(typename GridSpaceType::GridType *g,
+                                int depth);
   static int GetMasterRank() {
     return Proc::GetRootRank();
   }
   
 };
 
+//! Master run by every process in the SPMD mode.
+/*!
+  All processes run the host code redundantly, so the arguments of
+  each runtime call are already known to every process. Calls are
+  executed locally without notifying clients, and collectives are
+  used only when data must move between processes.
+ */
+template <class GridSpaceType>
+class MasterSPMD: public Master<GridSpaceType> {
+ public:
+  MasterSPMD(InterProcComm *ipc,
+             __PSStencilRunClientFunction *stencil_runs,
+             GridSpaceType *gs);
+  virtual ~MasterSPMD() {}
+  virtual void Finalize();
+  virtual void Barrier();
+  virtual typename GridSpaceType::GridType *GridNew(
+      __PSGridTypeInfo *type_info,
+      int num_dims, const IndexArray &size,
+      const IndexArray &global_offset, const IndexArray &stencil_offset_min,
+      const IndexArray &stencil_offset_max,
+      const int *stencil_offset_min_member,
+      const int *stencil_offset_max_member,
+      int attr);
+  virtual void GridDelete(typename GridSpaceType::GridType *g);
+  virtual void GridCopyin(typename GridSpaceType::GridType *g, const void *buf);
+  virtual void GridCopyout(typename GridSpaceType::GridType *g, void *buf);
+  virtual int GridCopyoutAsync(typename GridSpaceType::GridType *g,
+                               void *buf);
+  virtual void GridCopyoutView(typename GridSpaceType::GridType *g,
+                               void *buf, const IndexArray &offset,
+                               const IndexArray &size,
+                               const IndexArray &stride);
+  virtual void GridSet(typename GridSpaceType::GridType *g, const void *buf, const IndexArray &index);
+  virtual void GridGet(typename GridSpaceType::GridType *g, void *buf, const IndexArray &index);  
+  virtual void StencilRun(int id, int iter, int num_stencils,
+                          void **stencils, unsigned *stencil_sizes);
+  virtual void GridReduce(void *buf, PSReduceOp op, typename GridSpaceType::GridType *g);
+  virtual void GridRestrict(typename GridSpaceType::GridType *coarse,
+                            typename GridSpaceType::GridType *fine);
+  virtual void GridProlong(typename GridSpaceType::GridType *fine,
+                           typename GridSpaceType::GridType *coarse,
+                           bool accumulate);
+  virtual void GridSetHaloDepth(typename GridSpaceType::GridType *g,
+                                int depth);
+};
+
 template <class GridSpaceType>
 Client<GridSpaceType>::Client(InterProcComm *ipc,
                               __PSStencilRunClientFunction *stencil_runs,
@@ -116,6 +339,7 @@ Client<GridSpaceType>::Client(InterProcComm *ipc,
 template <class GridSpaceType>
 void Client<GridSpaceType>::Listen() {
   while (!done_) {
+    ReleaseStagedSends(false);
     LOG_INFO() << "Client: listening\n";
     Request req;
     ipc_->Bcast(&req, sizeof(Request), GetMasterRank());
@@ -172,6 +396,29 @@ void Client<GridSpaceType>::Listen() {
         GridReduce(req.opt);
         LOG_DEBUG() << "Client: grid reduce done\n";
         break;
+      case FUNC_COPYOUT_ASYNC:
+        LOG_DEBUG() << "Client: async copyout requested ("
+                    << req.opt << ")\n";
+        GridCopyoutAsync(req.opt);
+        break;
+      case FUNC_COPYOUT_VIEW:
+        LOG_DEBUG() << "Client: view copyout requested ("
+                    << req.opt << ")\n";
+        GridCopyoutView(req.opt);
+        break;
+      case FUNC_GRID_RESTRICT:
+        LOG_DEBUG() << "Client: grid restrict requested\n";
+        GridRestrict();
+        break;
+      case FUNC_GRID_PROLONG:
+        LOG_DEBUG() << "Client: grid prolong requested\n";
+        GridProlong();
+        break;
+      case FUNC_GRID_HALO_DEPTH:
+        LOG_DEBUG() << "Client: grid halo depth requested ("
+                    << req.opt << ")\n";
+        GridSetHaloDepth(req.opt);
+        break;
       case FUNC_INVALID:
         LOG_INFO() << "Client: invaid request\n";
         PSAbort(1);
@@ -181,8 +428,6 @@ void Client<GridSpaceType>::Listen() {
     }
   }
   LOG_INFO() << "Client listening terminated.\n";
-  MPI_Finalize();
-  exit(EXIT_SUCCESS);
   return;
 }
 
@@ -190,10 +435,18 @@ template <class GridSpaceType>
 Master<GridSpaceType>::Master(InterProcComm *ipc,
                               __PSStencilRunClientFunction *stencil_runs,
                               GridSpaceType *gs):
-    Proc(ipc, stencil_runs), gs_(gs) {
+    Proc(ipc, stencil_runs), gs_(gs), last_task_(0) {
   assert(rank_ == 0);
 }
 
+template <class GridSpaceType>
+Master<GridSpaceType>::Master(InterProcComm *ipc,
+                              __PSStencilRunClientFunction *stencil_runs,
+                              GridSpaceType *gs, bool spmd):
+    Proc(ipc, stencil_runs), gs_(gs), last_task_(0) {
+  assert(spmd || rank_ == 0);
+}
+
 template <class GridSpaceType>
 void Master<GridSpaceType>::NotifyCall(enum RT_FUNC_KIND fkind, int opt) {
   Request r(fkind, opt);
@@ -204,6 +457,7 @@ void Master<GridSpaceType>::NotifyCall(enum RT_FUNC_KIND fkind, int opt) {
 template <class GridSpaceType>
 void Master<GridSpaceType>::Finalize() {
   LOG_DEBUG() << "[" << rank() << "] Finalize\n";
+  WaitAll();
   NotifyCall(FUNC_FINALIZE);
   MPI_Finalize();
 }
@@ -211,6 +465,7 @@ void Master<GridSpaceType>::Finalize() {
 template <class GridSpaceType>
 void Client<GridSpaceType>::Finalize() {
   LOG_DEBUG() << "[" << rank() << "] Finalize\n";
+  ReleaseStagedSends(true);
   done_ = true;
 }
 
@@ -324,6 +579,7 @@ void Client<GridSpaceType>::GridDelete(int id) {
 
 template <class GridSpaceType>
 void Master<GridSpaceType>::GridCopyinLocal(typename GridSpaceType::GridType *g, const void *buf) {
+  g->InvalidateHalo();
   if (g->empty()) return;
 
   void *tmp_buf = NULL;
@@ -378,7 +634,8 @@ void Master<GridSpaceType>::GridCopyin(typename GridSpaceType::GridType *g, cons
                             subgrid_size.accumulate(g->num_dims()) * g->elm_size(j));      
     }
     LOG_DEBUG() << "Send packed subgrid to process " << i << "\n";
-    ipc_->Send(send_buf.Get(), gsize, i);
+    SendPacked(ipc_, gs_->compressor(), g->id(), g->type(), send_buf.Get(),
+               gsize, i);
   }
   return;
 }
@@ -391,8 +648,8 @@ void Client<GridSpaceType>::GridCopyinStage2(typename GridSpaceType::GridType *g
     dst_buf = new BufferHost();
     dst_buf->EnsureCapacity(g->GetLocalBufferSize());
   }
-  ipc_->Recv(dst_buf->Get(), g->GetLocalBufferSize(),
-             GetMasterRank());  
+  RecvPacked(ipc_, gs_->compressor(), g->type(), dst_buf->Get(),
+             g->GetLocalBufferSize(), GetMasterRank());
   if (g->HasHalo()) {
     g->Copyin(dst_buf->Get());
     delete dst_buf;
@@ -404,6 +661,7 @@ void Client<GridSpaceType>::GridCopyin(int id) {
   LOG_DEBUG() << "Copyin\n";
 
   typename GridSpaceType::GridType *g = static_cast<typename GridSpaceType::GridType*>(gs_->FindGrid(id));
+  g->InvalidateHalo();
   // notify the local offset
   IndexArray ia = g->local_offset();
   ipc_->Send(&ia, sizeof(IndexArray), GetMasterRank());  
@@ -427,8 +685,7 @@ void Master<GridSpaceType>::GridCopyoutLocal(typename GridSpaceType::GridType *g
   void *tmp_buf = NULL;
   
   if (g->HasHalo()) {
-    tmp_buf = malloc(g->GetLocalBufferSize());
-    assert(tmp_buf);
+    tmp_buf = gs_->buffer_pool().GetChunk(g->GetLocalBufferSize());
     g->Copyout(tmp_buf);
     grid_src = tmp_buf;
   }
@@ -437,7 +694,9 @@ void Master<GridSpaceType>::GridCopyoutLocal(typename GridSpaceType::GridType *g
                 g->size(), grid_src, g->local_offset(),
                 g->local_size());
   
-  if (g->HasHalo()) free(tmp_buf);
+  if (g->HasHalo()) {
+    gs_->buffer_pool().ReleaseChunk(tmp_buf, g->GetLocalBufferSize());
+  }
   
   return;
 }
@@ -452,6 +711,12 @@ void Master<GridSpaceType>::GridCopyout(typename GridSpaceType::GridType *g, voi
   
   // Copyout from remote grids
   NotifyCall(FUNC_COPYOUT, g->id());
+  GridCopyoutRemote(g, buf);
+}
+
+template <class GridSpaceType>
+void Master<GridSpaceType>::GridCopyoutRemote(
+    typename GridSpaceType::GridType *g, void *buf) {
   BufferHost recv_buf;
   // Assumes the master rank is 0
   for (int i = 1; i < gs_->num_procs(); ++i) {
@@ -466,7 +731,8 @@ void Master<GridSpaceType>::GridCopyout(typename GridSpaceType::GridType *g, voi
     if (gsize == 0) continue;
     LOG_DEBUG() << "Elm TOTAL SIZE: " << g->elm_total_size()<< "\n";
     recv_buf.EnsureCapacity(gsize);
-    ipc_->Recv(recv_buf.Get(), gsize, i);
+    RecvPacked(ipc_, gs_->compressor(), g->type(), recv_buf.Get(),
+               gsize, i);
     LOG_DEBUG() << "Copyout subgrid received from " << i << "\n";
     void *recv_buf_p = recv_buf.Get();
     void *buf_p = buf;
@@ -484,16 +750,15 @@ void Master<GridSpaceType>::GridCopyout(typename GridSpaceType::GridType *g, voi
 template <class GridSpaceType>
 void Client<GridSpaceType>::GridCopyoutStage2(
     typename GridSpaceType::GridType *g) {
-  Buffer *sbuf = g->buffer();
+  void *sbuf = g->buffer()->Get();
   if (g->HasHalo()) {
-    sbuf = new BufferHost();
-    sbuf->EnsureCapacity(g->GetLocalBufferSize());
-    g->Copyout(sbuf->Get());
+    sbuf = gs_->buffer_pool().GetChunk(g->GetLocalBufferSize());
+    g->Copyout(sbuf);
   } 
-  ipc_->Send(sbuf->Get(),  g->GetLocalBufferSize(),
-             GetMasterRank());
+  SendPacked(ipc_, gs_->compressor(), g->id(), g->type(), sbuf,
+             g->GetLocalBufferSize(), GetMasterRank());
   if (g->HasHalo()) {
-    free(sbuf);
+    gs_->buffer_pool().ReleaseChunk(sbuf, g->GetLocalBufferSize());
   }
 }
 
@@ -515,6 +780,150 @@ void Client<GridSpaceType>::GridCopyout(int id) {
   return;
 }
 
+template <class GridSpaceType>
+void Client<GridSpaceType>::GridCopyoutAsync(int id) {
+  LOG_DEBUG() << "[" << rank() << "] CopyoutAsync\n";
+  typename GridSpaceType::GridType *g =
+      static_cast<typename GridSpaceType::GridType*>(gs_->FindGrid(id));
+  IndexArray ia = g->local_offset();
+  ipc_->Send(&ia, sizeof(IndexArray), GetMasterRank());  
+  ia = g->local_size();
+  ipc_->Send(&ia, sizeof(IndexArray), GetMasterRank());  
+  if (g->empty()) return;
+  StagedSubgrid s;
+  StageSubgrid(g, gs_->buffer_pool(), s);
+  s.req = ipc_->CreateRequest();
+  ipc_->Isend(s.buf, s.bytes, GetMasterRank(), s.req);
+  staged_sends_.push_back(s);
+}
+
+template <class GridSpaceType>
+void Client<GridSpaceType>::GridCopyoutView(int id) {
+  LOG_DEBUG() << "[" << rank() << "] CopyoutView\n";
+  typename GridSpaceType::GridType *g =
+      static_cast<typename GridSpaceType::GridType*>(gs_->FindGrid(id));
+  RequestVIEW v;
+  ipc_->Bcast(&v, sizeof(RequestVIEW), GetMasterRank());
+  SendGridView(ipc_, g, v, gs_->buffer_pool(), GetMasterRank());
+}
+
+template <class GridSpaceType>
+void Client<GridSpaceType>::ReleaseStagedSends(bool wait) {
+  std::list<StagedSubgrid>::iterator it = staged_sends_.begin();
+  while (it != staged_sends_.end()) {
+    bool done = true;
+    if (wait) {
+      ipc_->Wait(it->req);
+    } else {
+      ipc_->Test(it->req, &done);
+    }
+    if (!done) {
+      ++it;
+      continue;
+    }
+    ipc_->DestroyRequest(it->req);
+    gs_->buffer_pool().ReleaseChunk(it->buf, it->bytes);
+    it = staged_sends_.erase(it);
+  }
+}
+
+// Subgrids are received in the background with nonblocking
+// transfers, which are ordered with the later messages from the same
+// process.
+template <class GridSpaceType>
+int Master<GridSpaceType>::GridCopyoutAsync(
+    typename GridSpaceType::GridType *g, void *buf) {
+  LOG_DEBUG() << "[" << rank() << "] CopyoutAsync\n";
+  NotifyCall(FUNC_COPYOUT_ASYNC, g->id());
+  int task = ++last_task_;
+  AsyncCopyout &c = async_copyouts_[task];
+  c.dst = buf;
+  c.num_dims = g->num_dims();
+  c.grid_size = g->size();
+  c.elm_size = g->elm_size();
+  if (!g->empty()) {
+    StagedSubgrid s;
+    StageSubgrid(g, gs_->buffer_pool(), s);
+    c.subgrids.push_back(s);
+  }
+  for (int i = 1; i < gs_->num_procs(); ++i) {
+    StagedSubgrid s;
+    ipc_->Recv(&s.offset, sizeof(IndexArray), i);
+    ipc_->Recv(&s.size, sizeof(IndexArray), i);
+    s.bytes = s.size.accumulate(g->num_dims()) * g->elm_size();
+    if (s.bytes == 0) continue;
+    s.buf = gs_->buffer_pool().GetChunk(s.bytes);
+    s.req = ipc_->CreateRequest();
+    ipc_->Irecv(s.buf, s.bytes, i, s.req);
+    c.subgrids.push_back(s);
+  }
+  return task;
+}
+
+// Only the processes holding points of the view send them.
+template <class GridSpaceType>
+void Master<GridSpaceType>::GridCopyoutView(
+    typename GridSpaceType::GridType *g, void *buf,
+    const IndexArray &offset, const IndexArray &size,
+    const IndexArray &stride) {
+  LOG_DEBUG() << "[" << rank() << "] CopyoutView\n";
+  CheckGridView(g->num_dims(), g->size(), offset, size, stride);
+  NotifyCall(FUNC_COPYOUT_VIEW, g->id());
+  RequestVIEW v = {offset, size, stride};
+  ipc_->Bcast(&v, sizeof(RequestVIEW), rank());
+  GridCopyoutViewRemote(g, buf, v);
+}
+
+template <class GridSpaceType>
+void Master<GridSpaceType>::GridCopyoutViewRemote(
+    typename GridSpaceType::GridType *g, void *buf, const RequestVIEW &v) {
+  int nd = g->num_dims();
+  StagedSubgrid s;
+  if (StageGridView(g, v, gs_->buffer_pool(), s)) {
+    CopyinSubgrid(g->elm_size(), nd, buf, v.size, s.buf, s.offset,
+                  s.size);
+    gs_->buffer_pool().ReleaseChunk(s.buf, s.bytes);
+  }
+  // Assumes the master rank is 0
+  for (int i = 1; i < gs_->num_procs(); ++i) {
+    ipc_->Recv(&s.offset, sizeof(IndexArray), i);
+    ipc_->Recv(&s.size, sizeof(IndexArray), i);
+    s.bytes = s.size.accumulate(nd) * g->elm_size();
+    if (s.bytes == 0) continue;
+    s.buf = gs_->buffer_pool().GetChunk(s.bytes);
+    ipc_->Recv(s.buf, s.bytes, i);
+    CopyinSubgrid(g->elm_size(), nd, buf, v.size, s.buf, s.offset,
+                  s.size);
+    gs_->buffer_pool().ReleaseChunk(s.buf, s.bytes);
+  }
+}
+
+template <class GridSpaceType>
+void Master<GridSpaceType>::Wait(int task) {
+  typename std::map<int, AsyncCopyout>::iterator it =
+      async_copyouts_.find(task);
+  // Already waited for
+  if (it == async_copyouts_.end()) return;
+  AsyncCopyout &c = it->second;
+  FOREACH (sit, c.subgrids.begin(), c.subgrids.end()) {
+    if (sit->req) {
+      ipc_->Wait(sit->req);
+      ipc_->DestroyRequest(sit->req);
+    }
+    CopyinSubgrid(c.elm_size, c.num_dims, c.dst, c.grid_size,
+                  sit->buf, sit->offset, sit->size);
+    gs_->buffer_pool().ReleaseChunk(sit->buf, sit->bytes);
+  }
+  async_copyouts_.erase(it);
+}
+
+template <class GridSpaceType>
+void Master<GridSpaceType>::WaitAll() {
+  while (!async_copyouts_.empty()) {
+    Wait(async_copyouts_.begin()->first);
+  }
+}
+
 template <class GridSpaceType>
 void Master<GridSpaceType>::StencilRun(int id, int iter, int num_stencils,
                         void **stencils,
@@ -612,15 +1021,16 @@ void Master<GridSpaceType>::GridGet(typename GridSpaceType::GridType *g, void *b
 template <class GridSpaceType>
 void Client<GridSpaceType>::GridSet(int id) {
   LOG_DEBUG() << "Client GridSet(" << id << ")\n";
+  int gid;
+  ipc_->Bcast(&gid, sizeof(int), GetMasterRank());
+  typename GridSpaceType::GridType *g = static_cast<typename GridSpaceType::GridType*>(gs_->FindGrid(gid));
+  g->InvalidateHalo();
   if (id != rank()) {
     // this is not a request to me
     LOG_DEBUG() << "Client GridSet done\n";
     return;
   }
 
-  int gid;
-  ipc_->Recv(&gid, sizeof(int), GetMasterRank());
-  typename GridSpaceType::GridType *g = static_cast<typename GridSpaceType::GridType*>(gs_->FindGrid(gid));
   IndexArray index;
   ipc_->Recv(&index, sizeof(IndexArray), GetMasterRank());
   LOG_DEBUG() << "Set index: " << index << "\n";
@@ -636,16 +1046,22 @@ void Client<GridSpaceType>::GridSet(int id) {
 template <class GridSpaceType>
 void Master<GridSpaceType>::GridSet(typename GridSpaceType::GridType *g, const void *buf, const IndexArray &index) {
   LOG_DEBUG() << "Master GridSet\n";
+  g->InvalidateHalo();
 
   int peer_rank = gs_->FindOwnerProcess(g, index);
   LOG_DEBUG() << "Owner: " << peer_rank << "\n";
 
-  if (peer_rank != rank()) {
+  // Deep halos are invalidated on all processes so that they agree
+  // on when halos are exchanged
+  if (peer_rank != rank() || g->halo_depth() > 1) {
     // NOTE: We don't need to notify all processes but clients are
     // waiting on MPI_Bcast, so P2P methods are not allowed.
     NotifyCall(FUNC_SET, peer_rank);
     int gid = g->id();
-    ipc_->Send(&gid, sizeof(int), peer_rank);
+    ipc_->Bcast(&gid, sizeof(int), rank());
+  }
+
+  if (peer_rank != rank()) {
     // MPI_Send does not accept const buffer pointer    
     IndexArray t = index;    
     ipc_->Send(&t, sizeof(IndexArray), peer_rank);
@@ -675,6 +1091,254 @@ void Master<GridSpaceType>::GridReduce(void *buf, PSReduceOp op, typename GridSp
   LOG_DEBUG() << "Master GridReduce done\n";
 }
 
+template <class GridSpaceType>
+void Client<GridSpaceType>::GridRestrict() {
+  RequestTRANSFER req;
+  ipc_->Bcast(&req, sizeof(RequestTRANSFER), GetMasterRank());
+  gs_->RestrictGrid(
+      static_cast<typename GridSpaceType::GridType*>(
+          gs_->FindGrid(req.coarse_id)),
+      static_cast<typename GridSpaceType::GridType*>(
+          gs_->FindGrid(req.fine_id)));
+}
+
+template <class GridSpaceType>
+void Client<GridSpaceType>::GridProlong() {
+  RequestTRANSFER req;
+  ipc_->Bcast(&req, sizeof(RequestTRANSFER), GetMasterRank());
+  gs_->ProlongGrid(
+      static_cast<typename GridSpaceType::GridType*>(
+          gs_->FindGrid(req.fine_id)),
+      static_cast<typename GridSpaceType::GridType*>(
+          gs_->FindGrid(req.coarse_id)),
+      req.accumulate);
+}
+
+template <class GridSpaceType>
+void Master<GridSpaceType>::GridRestrict(
+    typename GridSpaceType::GridType *coarse,
+    typename GridSpaceType::GridType *fine) {
+  LOG_DEBUG() << "Master GridRestrict\n";
+  NotifyCall(FUNC_GRID_RESTRICT);
+  RequestTRANSFER req = {coarse->id(), fine->id(), 0};
+  ipc_->Bcast(&req, sizeof(RequestTRANSFER), rank());
+  gs_->RestrictGrid(coarse, fine);
+}
+
+template <class GridSpaceType>
+void Master<GridSpaceType>::GridProlong(
+    typename GridSpaceType::GridType *fine,
+    typename GridSpaceType::GridType *coarse,
+    bool accumulate) {
+  LOG_DEBUG() << "Master GridProlong\n";
+  NotifyCall(FUNC_GRID_PROLONG);
+  RequestTRANSFER req = {coarse->id(), fine->id(), accumulate};
+  ipc_->Bcast(&req, sizeof(RequestTRANSFER), rank());
+  gs_->ProlongGrid(fine, coarse, accumulate);
+}
+
+template <class GridSpaceType>
+void Client<GridSpaceType>::GridSetHaloDepth(int id) {
+  int depth;
+  ipc_->Bcast(&depth, sizeof(int), GetMasterRank());
+  gs_->SetHaloDepth(
+      static_cast<typename GridSpaceType::GridType*>(gs_->FindGrid(id)),
+      depth);
+}
+
+template <class GridSpaceType>
+void Master<GridSpaceType>::GridSetHaloDepth(
+    typename GridSpaceType::GridType *g, int depth) {
+  LOG_DEBUG() << "Master GridSetHaloDepth\n";
+  NotifyCall(FUNC_GRID_HALO_DEPTH, g->id());
+  ipc_->Bcast(&depth, sizeof(int), rank());
+  gs_->SetHaloDepth(g, depth);
+}
+
+template <class GridSpaceType>
+MasterSPMD<GridSpaceType>::MasterSPMD(
+    InterProcComm *ipc, __PSStencilRunClientFunction *stencil_runs,
+    GridSpaceType *gs): Master<GridSpaceType>(ipc, stencil_runs, gs, true) {
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::Finalize() {
+  LOG_DEBUG() << "[" << this->rank() << "] Finalize\n";
+  MPI_Finalize();
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::Barrier() {
+  LOG_DEBUG() << "[" << this->rank() << "] Barrier\n";
+  this->ipc_->Barrier();
+}
+
+template <class GridSpaceType>
+typename GridSpaceType::GridType *MasterSPMD<GridSpaceType>::GridNew(
+    __PSGridTypeInfo *type_info,
+    int num_dims, const IndexArray &size,
+    const IndexArray &global_offset,
+    const IndexArray &stencil_offset_min,
+    const IndexArray &stencil_offset_max,
+    const int *stencil_offset_min_member,
+    const int *stencil_offset_max_member,
+    int attr) {
+  LOG_DEBUG() << "[" << this->rank() << "] New\n";
+  // Grids are created in the same order by all processes, so they
+  // get the same IDs without any communication.
+  return this->gs_->CreateGrid(
+      type_info, num_dims, size, global_offset,
+      stencil_offset_min, stencil_offset_max,
+      stencil_offset_min_member, stencil_offset_max_member,
+      attr);
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridDelete(
+    typename GridSpaceType::GridType *g) {
+  LOG_DEBUG() << "[" << this->rank() << "] Delete\n";
+  this->gs_->DeleteGrid(g);
+}
+
+// Every process has the whole input buffer, so it only needs to copy
+// its own subgrid.
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridCopyin(
+    typename GridSpaceType::GridType *g, const void *buf) {
+  LOG_DEBUG() << "[" << this->rank() << "] Copyin\n";
+  this->GridCopyinLocal(g, buf);
+}
+
+// Subgrids are gathered to the root process and the whole grid is
+// broadcast since the host code of every process may read it.
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridCopyout(
+    typename GridSpaceType::GridType *g, void *buf) {
+  LOG_DEBUG() << "[" << this->rank() << "] Copyout\n";
+  int root = Proc::GetRootRank();
+  if (this->IsRoot()) {
+    this->GridCopyoutLocal(g, buf);
+    this->GridCopyoutRemote(g, buf);
+  } else {
+    IndexArray ia = g->local_offset();
+    this->ipc_->Send(&ia, sizeof(IndexArray), root);
+    ia = g->local_size();
+    this->ipc_->Send(&ia, sizeof(IndexArray), root);
+    if (!g->empty()) {
+      BufferHost sbuf;
+      const void *p = g->buffer()->Get();
+      if (g->HasHalo()) {
+        sbuf.EnsureCapacity(g->GetLocalBufferSize());
+        g->Copyout(sbuf.Get());
+        p = sbuf.Get();
+      }
+      SendPacked(this->ipc_, this->gs_->compressor(), g->id(),
+                 g->type(), const_cast<void*>(p),
+                 g->GetLocalBufferSize(), root);
+    }
+  }
+  this->ipc_->Bcast(buf, g->num_elms() * g->elm_total_size(), root);
+}
+
+// The whole grid is broadcast to all processes by a collective
+// operation, which is not overlapped.
+template <class GridSpaceType>
+int MasterSPMD<GridSpaceType>::GridCopyoutAsync(
+    typename GridSpaceType::GridType *g, void *buf) {
+  GridCopyout(g, buf);
+  return ++this->last_task_;
+}
+
+// Points of the view are gathered to the root process and broadcast
+// like GridCopyout.
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridCopyoutView(
+    typename GridSpaceType::GridType *g, void *buf,
+    const IndexArray &offset, const IndexArray &size,
+    const IndexArray &stride) {
+  LOG_DEBUG() << "[" << this->rank() << "] CopyoutView\n";
+  CheckGridView(g->num_dims(), g->size(), offset, size, stride);
+  RequestVIEW v = {offset, size, stride};
+  if (this->IsRoot()) {
+    this->GridCopyoutViewRemote(g, buf, v);
+  } else {
+    SendGridView(this->ipc_, g, v, this->gs_->buffer_pool(),
+                 Proc::GetRootRank());
+  }
+  this->ipc_->Bcast(buf, size.accumulate(g->num_dims()) * g->elm_size(),
+                    Proc::GetRootRank());
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridSet(
+    typename GridSpaceType::GridType *g, const void *buf,
+    const IndexArray &index) {
+  LOG_DEBUG() << "[" << this->rank() << "] GridSet\n";
+  g->InvalidateHalo();
+  // Only the owner updates the point; the others already have the
+  // value in the host code.
+  if (this->gs_->FindOwnerProcess(g, index) == this->rank()) {
+    g->Set(index, buf);
+  }
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridGet(
+    typename GridSpaceType::GridType *g, void *buf,
+    const IndexArray &index) {
+  LOG_DEBUG() << "[" << this->rank() << "] GridGet\n";
+  int owner = this->gs_->FindOwnerProcess(g, index);
+  if (owner == this->rank()) {
+    g->Get(index, buf);
+  }
+  this->ipc_->Bcast(buf, g->elm_size(), owner);
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::StencilRun(int id, int iter,
+                                           int num_stencils,
+                                           void **stencils,
+                                           unsigned *stencil_sizes) {
+  LOG_DEBUG() << "[" << this->rank() << "] StencilRun(" << id << ")\n";
+  // Stencil objects refer to grids by IDs, which are the same in all
+  // processes.
+  this->stencil_runs_[id](iter, stencils);
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridReduce(
+    void *buf, PSReduceOp op, typename GridSpaceType::GridType *g) {
+  LOG_DEBUG() << "[" << this->rank() << "] GridReduce\n";
+  // The reduced value is only valid at the root; the result is
+  // broadcast since every process continues with it.
+  this->gs_->ReduceGrid(buf, op, g);
+  this->ipc_->Bcast(buf, g->elm_size(), Proc::GetRootRank());
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridRestrict(
+    typename GridSpaceType::GridType *coarse,
+    typename GridSpaceType::GridType *fine) {
+  LOG_DEBUG() << "[" << this->rank() << "] GridRestrict\n";
+  this->gs_->RestrictGrid(coarse, fine);
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridProlong(
+    typename GridSpaceType::GridType *fine,
+    typename GridSpaceType::GridType *coarse,
+    bool accumulate) {
+  LOG_DEBUG() << "[" << this->rank() << "] GridProlong\n";
+  this->gs_->ProlongGrid(fine, coarse, accumulate);
+}
+
+template <class GridSpaceType>
+void MasterSPMD<GridSpaceType>::GridSetHaloDepth(
+    typename GridSpaceType::GridType *g, int depth) {
+  LOG_DEBUG() << "[" << this->rank() << "] GridSetHaloDepth\n";
+  this->gs_->SetHaloDepth(g, depth);
+}
+
 } // namespace runtime
 } // namespace physis
 
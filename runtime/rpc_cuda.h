@@ -116,8 +116,9 @@ void ClientCUDA<GridSpaceType>::GridCopyinStage2(typename GridSpaceType::GridTyp
   // receive the subregion for this process
   Buffer *dst_buf = new BufferCUDAHost();
   dst_buf->EnsureCapacity(g->GetLocalBufferSize());
-  this->ipc_->Recv(dst_buf->Get(), g->GetLocalBufferSize(),
-                   this->GetMasterRank());
+  RecvPacked(this->ipc_, this->gs_->compressor(), g->type(),
+             dst_buf->Get(), g->GetLocalBufferSize(),
+             this->GetMasterRank());
   LOG_DEBUG() << "dst_buf[0]: " << ((float*)dst_buf->Get())[0] << "\n";
   g->Copyin(dst_buf->Get());
   delete dst_buf;
@@ -129,8 +130,9 @@ void ClientCUDA<GridSpaceType>::GridCopyoutStage2(typename GridSpaceType::GridTy
   sbuf->EnsureCapacity(g->GetLocalBufferSize());
   g->Copyout(sbuf->Get());
   LOG_DEBUG() << "dst_buf[0]: " << ((float*)sbuf->Get())[0] << "\n";
-  this->ipc_->Send(sbuf->Get(), g->GetLocalBufferSize(),
-                   this->GetMasterRank());
+  SendPacked(this->ipc_, this->gs_->compressor(), g->id(),
+             g->type(), sbuf->Get(), g->GetLocalBufferSize(),
+             this->GetMasterRank());
   delete sbuf;
 }
 
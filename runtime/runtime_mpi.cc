@@ -118,6 +118,8 @@ void RuntimeMPI::InitRPC(InterProcComm *ipc) {
 void RuntimeMPI::Listen() {
   assert(!IsMaster());
   static_cast<Client<GridMPI>*>(proc_)->Listen();
+  MPI_Finalize();
+  exit(EXIT_SUCCESS);
 }
 
 } // namespace runtime
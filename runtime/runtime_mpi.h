@@ -28,14 +28,24 @@ class RuntimeMPI: public Runtime<GridSpaceType> {
   virtual Proc *proc() {
     return proc_;
   }
+  //! Returns true if the process runs the host code.
+  /*!
+    All processes run the host code in the SPMD mode.
+   */
   virtual int IsMaster() {
-    return proc_->rank() == Proc::GetRootRank();
+    return spmd_ || proc_->rank() == Proc::GetRootRank();
   }
+  //! Serves the master and terminates the process when it finalizes.
   void Listen();
+  //! Lets all processes run the host code instead of listening to
+  //! the root process. Must be called before Init.
+  void EnableSPMD() { spmd_ = true; }
+  bool spmd() const { return spmd_; }
   
  protected:
   __PSStencilRunClientFunction *client_funcs_;
   Proc *proc_;
+  bool spmd_;
 
   virtual void InitDomainSize(int domain_rank, va_list vl,
                               IndexArray &domain_size);
@@ -54,7 +64,8 @@ class RuntimeMPI: public Runtime<GridSpaceType> {
 };
 
 template <class GridSpaceType>
-RuntimeMPI<GridSpaceType>::RuntimeMPI(): Runtime<GridSpaceType>() {
+RuntimeMPI<GridSpaceType>::RuntimeMPI(): Runtime<GridSpaceType>(),
+                                          spmd_(false) {
 }
 
 template <class GridSpaceType>
@@ -155,7 +166,11 @@ void RuntimeMPI<GridSpaceType>::InitStencilFuncs(va_list vl) {
 
 template <class GridSpaceType>
 void RuntimeMPI<GridSpaceType>::InitRPC(InterProcComm *ipc) {
-  if (ipc->GetRank() == Proc::GetRootRank()) {
+  if (spmd_) {
+    LOG_DEBUG() << "Running in the SPMD mode.\n";
+    proc_ = new MasterSPMD<GridSpaceType>(ipc, client_funcs_, this->gs_);
+    LOG_INFO() << *proc_ << "\n";
+  } else if (ipc->GetRank() == Proc::GetRootRank()) {
     LOG_DEBUG() << "I'm the master.\n";
     proc_ = new Master<GridSpaceType>(ipc, client_funcs_, this->gs_);
     LOG_INFO() << *proc_ << "\n";
@@ -170,6 +185,8 @@ template <class GridSpaceType>
 void RuntimeMPI<GridSpaceType>::Listen() {
   assert(!IsMaster());
   static_cast<Client<GridSpaceType>*>(proc_)->Listen();
+  MPI_Finalize();
+  exit(EXIT_SUCCESS);
 }
 
 } // namespace runtime
@@ -0,0 +1,198 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "runtime/task_graph.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+namespace physis {
+namespace runtime {
+
+TaskGraph::TaskGraph() {
+  const char *s = getenv("PHYSIS_NUM_TASK_THREADS");
+  Init(s ? atoi(s) : 1);
+}
+
+TaskGraph::TaskGraph(int num_threads) {
+  Init(num_threads);
+}
+
+void TaskGraph::Init(int num_threads) {
+  last_id_ = 0;
+  done_ = false;
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&ready_cond_, NULL);
+  pthread_cond_init(&complete_cond_, NULL);
+  for (int i = 0; i < num_threads; ++i) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, Work, this) != 0) {
+      LOG_WARNING() << "Cannot create task threads\n";
+      break;
+    }
+    threads_.push_back(t);
+  }
+  LOG_DEBUG() << "Task threads: " << threads_.size() << "\n";
+}
+
+TaskGraph::~TaskGraph() {
+  WaitAll();
+  pthread_mutex_lock(&mutex_);
+  done_ = true;
+  pthread_cond_broadcast(&ready_cond_);
+  pthread_mutex_unlock(&mutex_);
+  FOREACH (it, threads_.begin(), threads_.end()) {
+    pthread_join(*it, NULL);
+  }
+  pthread_cond_destroy(&complete_cond_);
+  pthread_cond_destroy(&ready_cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+void TaskGraph::AddDependency(Task *task, TaskID pred) {
+  std::map<TaskID, Task*>::iterator it = tasks_.find(pred);
+  if (it == tasks_.end()) return;
+  std::vector<Task*> &successors = it->second->successors;
+  if (std::find(successors.begin(), successors.end(), task) !=
+      successors.end()) return;
+  successors.push_back(task);
+  ++task->num_deps;
+}
+
+TaskGraph::TaskID TaskGraph::Submit(const TaskFunc &func,
+                                    const std::vector<const void*> &reads,
+                                    const std::vector<const void*> &writes) {
+  if (threads_.empty()) {
+    func();
+    return 0;
+  }
+  Task *task = new Task();
+  task->func = func;
+  task->num_deps = 0;
+  task->reads = reads;
+  task->writes = writes;
+  pthread_mutex_lock(&mutex_);
+  task->id = ++last_id_;
+  FOREACH (it, reads.begin(), reads.end()) {
+    AddDependency(task, accesses_[*it].writer);
+  }
+  FOREACH (it, writes.begin(), writes.end()) {
+    Access &a = accesses_[*it];
+    AddDependency(task, a.writer);
+    FOREACH (rit, a.readers.begin(), a.readers.end()) {
+      AddDependency(task, *rit);
+    }
+  }
+  // Readers of written objects are only needed until this task is
+  // done, which is implied by waiting for this task
+  FOREACH (it, writes.begin(), writes.end()) {
+    Access &a = accesses_[*it];
+    a.writer = task->id;
+    a.readers.clear();
+  }
+  FOREACH (it, reads.begin(), reads.end()) {
+    accesses_[*it].readers.push_back(task->id);
+  }
+  tasks_[task->id] = task;
+  if (task->num_deps == 0) {
+    ready_.push_back(task);
+    pthread_cond_signal(&ready_cond_);
+  }
+  TaskID id = task->id;
+  pthread_mutex_unlock(&mutex_);
+  return id;
+}
+
+void TaskGraph::ReleaseAccess(const void *obj, TaskID id) {
+  std::map<const void*, Access>::iterator it = accesses_.find(obj);
+  if (it == accesses_.end()) return;
+  Access &a = it->second;
+  if (a.writer == id) a.writer = 0;
+  a.readers.erase(std::remove(a.readers.begin(), a.readers.end(), id),
+                  a.readers.end());
+  if (a.writer == 0 && a.readers.empty()) accesses_.erase(it);
+}
+
+// Called with the mutex locked
+void TaskGraph::Complete(Task *task) {
+  FOREACH (it, task->successors.begin(), task->successors.end()) {
+    if (--(*it)->num_deps == 0) {
+      ready_.push_back(*it);
+      pthread_cond_signal(&ready_cond_);
+    }
+  }
+  FOREACH (it, task->reads.begin(), task->reads.end()) {
+    ReleaseAccess(*it, task->id);
+  }
+  FOREACH (it, task->writes.begin(), task->writes.end()) {
+    ReleaseAccess(*it, task->id);
+  }
+  tasks_.erase(task->id);
+  delete task;
+  pthread_cond_broadcast(&complete_cond_);
+}
+
+void *TaskGraph::Work(void *arg) {
+  TaskGraph *tg = static_cast<TaskGraph*>(arg);
+  pthread_mutex_lock(&tg->mutex_);
+  while (true) {
+    while (tg->ready_.empty() && !tg->done_) {
+      pthread_cond_wait(&tg->ready_cond_, &tg->mutex_);
+    }
+    if (tg->ready_.empty()) break;
+    Task *task = tg->ready_.front();
+    tg->ready_.pop_front();
+    pthread_mutex_unlock(&tg->mutex_);
+    task->func();
+    pthread_mutex_lock(&tg->mutex_);
+    tg->Complete(task);
+  }
+  pthread_mutex_unlock(&tg->mutex_);
+  return NULL;
+}
+
+void TaskGraph::WaitLocked(TaskID id) {
+  while (tasks_.count(id)) {
+    pthread_cond_wait(&complete_cond_, &mutex_);
+  }
+}
+
+void TaskGraph::Wait(TaskID id) {
+  if (id == 0) return;
+  pthread_mutex_lock(&mutex_);
+  WaitLocked(id);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void TaskGraph::WaitAll() {
+  pthread_mutex_lock(&mutex_);
+  while (!tasks_.empty()) {
+    pthread_cond_wait(&complete_cond_, &mutex_);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+void TaskGraph::WaitObject(const void *obj, bool write) {
+  pthread_mutex_lock(&mutex_);
+  std::map<const void*, Access>::iterator it = accesses_.find(obj);
+  if (it != accesses_.end()) {
+    // Copied since the access is updated while waiting
+    Access a = it->second;
+    WaitLocked(a.writer);
+    if (write) {
+      FOREACH (rit, a.readers.begin(), a.readers.end()) {
+        WaitLocked(*rit);
+      }
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+bool TaskGraph::IsPending(TaskID id) {
+  pthread_mutex_lock(&mutex_);
+  bool pending = tasks_.count(id) > 0;
+  pthread_mutex_unlock(&mutex_);
+  return pending;
+}
+
+} // namespace runtime
+} // namespace physis
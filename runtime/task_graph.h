@@ -0,0 +1,108 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_RUNTIME_TASK_GRAPH_H_
+#define PHYSIS_RUNTIME_TASK_GRAPH_H_
+
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <vector>
+#include <boost/function.hpp>
+
+#include "runtime/runtime_common.h"
+
+namespace physis {
+namespace runtime {
+
+//! Executes tasks asynchronously in the order of their data dependencies.
+/*!
+  Each task declares the objects, such as grids and host buffers, it
+  reads and writes. A task waits for the preceding tasks writing the
+  objects it reads or writes, and for the preceding tasks reading the
+  objects it writes. Tasks whose dependencies are satisfied are run
+  by a pool of worker threads, so independent tasks may complete out
+  of order.
+
+  The host thread accessing an object must wait for the pending tasks
+  accessing it with WaitObject. The number of worker threads is given
+  by PHYSIS_NUM_TASK_THREADS (1 by default); with no thread, tasks
+  are run synchronously when submitted.
+ */
+class TaskGraph {
+ public:
+  //! Identifies a submitted task; 0 refers to no task.
+  typedef int TaskID;
+  typedef boost::function<void ()> TaskFunc;
+  //! Creates a task graph with threads given by PHYSIS_NUM_TASK_THREADS.
+  TaskGraph();
+  explicit TaskGraph(int num_threads);
+  //! Waits for all tasks and stops the threads.
+  virtual ~TaskGraph();
+  //! Submits a task.
+  /*!
+    \param func The function to run.
+    \param reads Objects read by the task.
+    \param writes Objects written by the task.
+    \return The ID of the task, or 0 if it is already completed.
+   */
+  TaskID Submit(const TaskFunc &func,
+                const std::vector<const void*> &reads,
+                const std::vector<const void*> &writes);
+  //! Waits for a task to complete.
+  void Wait(TaskID id);
+  //! Waits for all submitted tasks to complete.
+  void WaitAll();
+  //! Waits for the pending tasks accessing an object.
+  /*!
+    \param obj The object.
+    \param write True if the caller writes the object, in which case
+    the tasks reading it are waited for as well as those writing it.
+   */
+  void WaitObject(const void *obj, bool write);
+  int num_threads() const { return threads_.size(); }
+  //! Returns true if a task is not completed yet.
+  bool IsPending(TaskID id);
+
+ protected:
+  struct Task {
+    TaskID id;
+    TaskFunc func;
+    //! Number of pending tasks this task depends on
+    int num_deps;
+    //! Tasks depending on this task
+    std::vector<Task*> successors;
+    std::vector<const void*> reads;
+    std::vector<const void*> writes;
+  };
+  //! Pending tasks accessing an object
+  struct Access {
+    TaskID writer;
+    std::vector<TaskID> readers;
+    Access(): writer(0) {}
+  };
+  TaskID last_id_;
+  std::map<TaskID, Task*> tasks_;
+  std::map<const void*, Access> accesses_;
+  std::deque<Task*> ready_;
+  std::vector<pthread_t> threads_;
+  bool done_;
+  pthread_mutex_t mutex_;
+  //! Signaled when a task becomes ready or the graph is destroyed
+  pthread_cond_t ready_cond_;
+  //! Signaled when a task completes
+  pthread_cond_t complete_cond_;
+
+  void Init(int num_threads);
+  //! Makes task depend on a pending task.
+  void AddDependency(Task *task, TaskID pred);
+  void Complete(Task *task);
+  //! Removes a completed task from the accesses of an object.
+  void ReleaseAccess(const void *obj, TaskID id);
+  void WaitLocked(TaskID id);
+  static void *Work(void *arg);
+};
+
+} // namespace runtime
+} // namespace physis
+
+#endif /* PHYSIS_RUNTIME_TASK_GRAPH_H_ */
@@ -0,0 +1,106 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/activity.h"
+
+#include <math.h>
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+TEST(ActivityMask, Tiles) {
+  PSIndex dim[] = {10, 8, 1};
+  ActivityMask m(2, dim, 4, 0.0, 1);
+  // 3x2 tiles
+  EXPECT_EQ(6, m.num_tiles());
+  PSIndex min[PS_MAX_DIM], max[PS_MAX_DIM];
+  m.GetTileRange(2, min, max);
+  EXPECT_EQ(8, min[0]);
+  EXPECT_EQ(10, max[0]);
+  EXPECT_EQ(0, min[1]);
+  EXPECT_EQ(4, max[1]);
+  m.GetTileRange(4, min, max);
+  EXPECT_EQ(4, min[0]);
+  EXPECT_EQ(8, max[0]);
+  EXPECT_EQ(4, min[1]);
+  EXPECT_EQ(8, max[1]);
+  PSIndex rmin[] = {3, 5, 0}, rmax[] = {5, 8, 1};
+  vector<int64_t> tiles;
+  m.GetTiles(rmin, rmax, tiles);
+  ASSERT_EQ(2U, tiles.size());
+  EXPECT_EQ(3, tiles[0]);
+  EXPECT_EQ(4, tiles[1]);
+}
+
+TEST(ActivityMask, ChangedSince) {
+  PSIndex dim[] = {16, 16, 16};
+  ActivityMask m(3, dim, 8, 0.0, 1);
+  PSIndex all_min[] = {0, 0, 0}, all_max[] = {16, 16, 16};
+  EXPECT_TRUE(m.IsChangedSince(all_min, all_max, 1));
+  EXPECT_FALSE(m.IsChangedSince(all_min, all_max, 2));
+  PSIndex p[] = {9, 2, 15}, q[] = {10, 3, 16};
+  m.MarkChanged(p, q, 3);
+  EXPECT_TRUE(m.IsChangedSince(all_min, all_max, 2));
+  // Regions beyond the grid are clipped
+  PSIndex n_min[] = {-2, -2, 6}, n_max[] = {8, 4, 18};
+  EXPECT_FALSE(m.IsChangedSince(n_min, n_max, 2));
+  n_max[0] = 9;
+  EXPECT_TRUE(m.IsChangedSince(n_min, n_max, 2));
+  m.MarkAllChanged(4);
+  // Empty regions never change
+  EXPECT_FALSE(m.IsChangedSince(p, p, 0));
+  EXPECT_TRUE(m.IsChangedSince(p, q, 4));
+  EXPECT_EQ(4U, m.changed(0));
+}
+
+TEST(ActivityMask, Producer) {
+  PSIndex dim[] = {16, 1, 1};
+  ActivityMask m(1, dim, 4, 0.0, 1);
+  int func;
+  int s1[] = {1, 2, 3}, s2[] = {1, 2, 4};
+  EXPECT_FALSE(m.IsProducer(&func, s1, sizeof(s1)));
+  m.SetProducer(&func, s1, sizeof(s1));
+  EXPECT_TRUE(m.IsProducer(&func, s1, sizeof(s1)));
+  EXPECT_FALSE(m.IsProducer(&func, s2, sizeof(s2)));
+  EXPECT_FALSE(m.IsProducer(s1, s1, sizeof(s1)));
+  m.ResetProducer();
+  EXPECT_FALSE(m.IsProducer(&func, s1, sizeof(s1)));
+}
+
+TEST(ActivityMask, Compatible) {
+  PSIndex d1[] = {16, 16, 1}, d2[] = {16, 8, 1};
+  ActivityMask m1(2, d1, 4, 0.0, 1), m2(2, d1, 4, 0.5, 1);
+  ActivityMask m3(2, d2, 4, 0.0, 1), m4(2, d1, 8, 0.0, 1);
+  EXPECT_TRUE(m1.IsCompatible(m2));
+  EXPECT_FALSE(m1.IsCompatible(m3));
+  EXPECT_FALSE(m1.IsCompatible(m4));
+}
+
+TEST(IsPointsChanged, Threshold) {
+  float x[] = {1.0f, 2.0f, 3.0f};
+  float y[] = {1.0f, 2.0f, 3.25f};
+  EXPECT_FALSE(IsPointsChanged(PS_FLOAT, sizeof(float), x, x, 3, 0.0));
+  EXPECT_TRUE(IsPointsChanged(PS_FLOAT, sizeof(float), x, y, 3, 0.0));
+  EXPECT_FALSE(IsPointsChanged(PS_FLOAT, sizeof(float), x, y, 3, 0.5));
+  double z[] = {NAN};
+  EXPECT_TRUE(IsPointsChanged(PS_DOUBLE, sizeof(double), z, z, 1, 1.0));
+  int a[] = {1, 2}, b[] = {1, 3};
+  EXPECT_TRUE(IsPointsChanged(PS_INT, sizeof(int), a, b, 2, 0.0));
+  // Compared bitwise
+  EXPECT_TRUE(IsPointsChanged(PS_USER, sizeof(a), a, b, 1, 10.0));
+  EXPECT_FALSE(IsPointsChanged(PS_USER, sizeof(a), a, a, 1, 0.0));
+}
+
+} // namespace runtime
+} // namespace physis
+
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
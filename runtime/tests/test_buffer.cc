@@ -180,6 +180,72 @@ TEST(BufferHost, Copyin3D) {
   }
 }
 
+TEST(BufferPool, RecycleBuffer) {
+  BufferPool pool;
+  size_t s = 16 * sizeof(int);
+  BufferHost *buf = pool.GetBuffer(s);
+  EXPECT_EQ(s, buf->size());
+  int *p = (int*)buf->Get();
+  for (int i = 0; i < 16; ++i) {
+    p[i] = i + 1;
+  }
+  pool.Release(buf);
+  EXPECT_EQ(s, pool.size());
+  // Buffers of different sizes are not recycled
+  BufferHost *other = pool.GetBuffer(s * 2);
+  EXPECT_EQ(0U, pool.num_hits());
+  BufferHost *recycled = pool.GetBuffer(s);
+  EXPECT_EQ(buf, recycled);
+  EXPECT_EQ(1U, pool.num_hits());
+  EXPECT_EQ(0U, pool.size());
+  // Recycled buffers are zero-filled as new ones
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_EQ(0, ((int*)recycled->Get())[i]);
+  }
+  pool.Release(recycled);
+  pool.Release(other);
+  EXPECT_EQ(s * 3, pool.size());
+  pool.Clear();
+  EXPECT_EQ(0U, pool.size());
+}
+
+TEST(BufferPool, RecycleChunk) {
+  BufferPool pool;
+  void *p = pool.GetChunk(100);
+  pool.ReleaseChunk(p, 100);
+  EXPECT_EQ(p, pool.GetChunk(100));
+  EXPECT_EQ(1U, pool.num_hits());
+  pool.ReleaseChunk(p, 100);
+}
+
+TEST(BufferPool, Capacity) {
+  BufferPool pool(150);
+  void *p = pool.GetChunk(100);
+  void *q = pool.GetChunk(100);
+  pool.ReleaseChunk(p, 100);
+  // The oldest chunk is freed as the pool is full
+  pool.ReleaseChunk(q, 100);
+  EXPECT_EQ(100U, pool.size());
+  EXPECT_EQ(q, pool.GetChunk(100));
+  EXPECT_EQ(0U, pool.size());
+  BufferHost *buf = pool.GetBuffer(40);
+  void *r = pool.GetChunk(60);
+  pool.ReleaseChunk(q, 100);
+  pool.Release(buf);
+  // Evicted in the order of release across buffers and chunks
+  pool.ReleaseChunk(r, 60);
+  EXPECT_EQ(100U, pool.size());
+  EXPECT_EQ(r, pool.GetChunk(60));
+  EXPECT_EQ(40U, pool.size());
+  pool.ReleaseChunk(r, 60);
+  // Larger than the pool
+  pool.ReleaseChunk(pool.GetChunk(200), 200);
+  EXPECT_EQ(100U, pool.size());
+  BufferPool disabled(0);
+  disabled.Release(disabled.GetBuffer(100));
+  EXPECT_EQ(0U, disabled.size());
+}
+
 } // namespace runtime
 } // namespace physis
 
@@ -0,0 +1,85 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/buffer_mpi_openmp.h"
+#include "runtime/numa_topology.h"
+
+#include <omp.h>
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+TEST(NUMATopology, Discover) {
+  NUMATopology *t = NUMATopology::GetInstance();
+  ASSERT_GT(t->num_cpus(), 0);
+  ASSERT_GT(t->num_nodes(), 0);
+  for (int i = 0; i < omp_get_max_threads(); ++i) {
+    EXPECT_GE(t->GetNodeOfThread(i), 0);
+    EXPECT_LT(t->GetNodeOfThread(i), t->num_nodes());
+  }
+}
+
+TEST(BufferHostOpenMP, Allocate) {
+  IntArray division(2, 2, 2);
+  BufferHostOpenMP buf(3, sizeof(int), division);
+  buf.Allocate(IntArray(4, 5, 6));
+  EXPECT_EQ(4*5*6*sizeof(int), buf.size());
+  EXPECT_EQ(division, buf.MPdivision());
+  size_t total = 0;
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(buf.Get_MP()[i] != NULL);
+    // First touched with zero
+    int *p = (int*)buf.Get_MP()[i];
+    for (size_t j = 0; j < buf.MPcpumemsize()[i]; ++j) {
+      EXPECT_EQ(0, p[j]);
+    }
+    total += buf.MPcpumemsize()[i];
+  }
+  EXPECT_EQ(4U*5*6, total);
+}
+
+TEST(BufferHostOpenMP, Copy) {
+  IntArray division(2, 1, 3);
+  BufferHostOpenMP buf(3, sizeof(int), division);
+  IntArray size(5, 4, 7);
+  int s = 5*4*7;
+  int p[s];
+  int q[s];
+  for (int i = 0; i < s; ++i) {
+    p[i] = i;
+    q[i] = 0;
+  }
+  // Allocated on demand
+  buf.Copyin(p, IntArray(), size);
+  EXPECT_EQ(s*sizeof(int), buf.size());
+  buf.Copyout(q, IntArray(), size);
+  for (int i = 0; i < s; ++i) {
+    EXPECT_EQ(i, q[i]);
+  }
+  // Linear copies with offset
+  buf.Copyout(q, IntArray(), IntArray(3, 1, 1), 10);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(10 + i, q[i]);
+  }
+  for (int i = 0; i < s; ++i) {
+    q[i] = 0;
+  }
+  buf.CopyinAll(q);
+  buf.Copyout(p, s*sizeof(int));
+  for (int i = 0; i < s; ++i) {
+    EXPECT_EQ(0, p[i]);
+  }
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,106 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/compress.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+template <class T>
+static size_t RoundTrip(PSType type, const vector<T> &x, int num_threads) {
+  size_t size = sizeof(T) * x.size();
+  vector<char> packed(GetMaxCompressedSize(size));
+  size_t len = CompressPoints(type, &x[0], size, &packed[0], num_threads);
+  EXPECT_LE(len, packed.size());
+  vector<T> y(x.size());
+  EXPECT_TRUE(DecompressPoints(type, &packed[0], len, &y[0], size,
+                               num_threads));
+  EXPECT_EQ(0, memcmp(&x[0], &y[0], size));
+  return len;
+}
+
+TEST(CompressPoints, Smooth) {
+  // Spans multiple blocks with a partial last block
+  vector<float> f(50001);
+  for (size_t i = 0; i < f.size(); ++i) f[i] = 1.0f + i * 1.0e-6f;
+  EXPECT_LT(RoundTrip(PS_FLOAT, f, 1), f.size() * sizeof(float) / 2);
+  EXPECT_LT(RoundTrip(PS_FLOAT, f, 4), f.size() * sizeof(float) / 2);
+  vector<double> d(30000, 0.0);
+  for (size_t i = 0; i < d.size(); ++i) d[i] = sin(i * 1.0e-4);
+  EXPECT_LT(RoundTrip(PS_DOUBLE, d, 3), d.size() * sizeof(double));
+  vector<int> n(20000);
+  for (size_t i = 0; i < n.size(); ++i) n[i] = i / 7;
+  EXPECT_LT(RoundTrip(PS_INT, n, 2), n.size() * sizeof(int) / 2);
+}
+
+TEST(CompressPoints, Incompressible) {
+  vector<int> x(10000);
+  srand(1);
+  for (size_t i = 0; i < x.size(); ++i) x[i] = rand();
+  // Stored as is with a small header
+  size_t len = RoundTrip(PS_INT, x, 2);
+  EXPECT_LE(len, x.size() * sizeof(int) + 16);
+  vector<float> y(3);
+  y[0] = 1.0f;
+  y[1] = NAN;
+  y[2] = -0.0f;
+  RoundTrip(PS_FLOAT, y, 1);
+}
+
+TEST(CompressPoints, Malformed) {
+  vector<float> x(1000, 2.0f);
+  size_t size = sizeof(float) * x.size();
+  vector<char> packed(GetMaxCompressedSize(size));
+  size_t len = CompressPoints(PS_FLOAT, &x[0], size, &packed[0], 1);
+  vector<float> y(x.size());
+  EXPECT_FALSE(DecompressPoints(PS_FLOAT, &packed[0], len - 1, &y[0],
+                                size, 1));
+  EXPECT_FALSE(DecompressPoints(PS_FLOAT, &packed[0], len, &y[0],
+                                size / 2, 1));
+}
+
+TEST(MessageCompressor, Adaptive) {
+  MessageCompressor c(1024, 1, 1.0e9);
+  EXPECT_TRUE(c.IsCompressed(PS_DOUBLE, 1024));
+  EXPECT_FALSE(c.IsCompressed(PS_DOUBLE, 1023));
+  EXPECT_FALSE(c.IsCompressed(PS_USER, 4096));
+  EXPECT_FALSE(MessageCompressor(0, 1, 1.0e9).IsCompressed(PS_FLOAT, 4096));
+  vector<int> noise(4096);
+  srand(2);
+  for (size_t i = 0; i < noise.size(); ++i) noise[i] = rand();
+  size_t size = sizeof(int) * noise.size();
+  vector<char> packed(c.GetPackedSize(size));
+  MessageStream stream(0, 1, 2);
+  for (int i = 0; i < 4; ++i) {
+    // Streams do not depend on the buffers of the messages
+    vector<int> copy(noise);
+    c.Pack(stream, PS_INT, &copy[0], size, &packed[0]);
+  }
+  // Suspended after the probes do not pay off
+  EXPECT_TRUE(c.IsSuspended(stream));
+  EXPECT_FALSE(c.IsSuspended(MessageStream(0, 1, 3)));
+  EXPECT_FALSE(c.IsSuspended(MessageStream(0, 2, 2)));
+  size_t len = c.Pack(stream, PS_INT, &noise[0], size, &packed[0]);
+  vector<int> y(noise.size());
+  c.Unpack(PS_INT, &packed[0], len, &y[0], size);
+  EXPECT_TRUE(y == noise);
+  EXPECT_EQ(5 * size, c.raw_bytes());
+}
+
+} // namespace runtime
+} // namespace physis
+
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
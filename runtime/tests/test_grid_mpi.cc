@@ -3,6 +3,7 @@
 #include "runtime/grid_space_mpi.h"
 #include "runtime/ipc_mpi.h"
 #include "runtime/grid_mpi_debug_util.h"
+#include "runtime/rpc.h"
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -94,6 +95,9 @@ class Grid3DFloatTestBase: public T {
     }
     gs_ = new GridSpaceMPIType(
         3, global_size, 3, proc_size, *ipc);
+    if (UseSharedHalo()) {
+      gs_->EnableSharedMemoryHalo();
+    }
     stencil_min_ = std::tr1::get<0>(this->GetParam());
     stencil_max_ = std::tr1::get<1>(this->GetParam());
     width_.fw = stencil_max_;
@@ -106,10 +110,12 @@ class Grid3DFloatTestBase: public T {
   }
   
   virtual void TearDown() {
-    delete g_;
+    gs_->DeleteGrid(g_);
     delete gs_;
   }
 
+  virtual bool UseSharedHalo() const { return false; }
+
   float Get(const IndexArray &idx) const {
     return *(float*)(g_->GetAddress(idx));
   }
@@ -248,9 +254,16 @@ INSTANTIATE_TEST_CASE_P(
 
 class Grid3DFloatExchangeBoundariesTest:
     public Grid3DFloatTestBase< ::testing::TestWithParam<
-    tr1::tuple<IndexArray, IndexArray, bool, bool> > > {};
+    tr1::tuple<IndexArray, IndexArray, bool, bool> > > {
+ protected:
+  void ExchangeAndVerify();
+};
 
 TEST_P(Grid3DFloatExchangeBoundariesTest, ExchangeBoundaries) {
+  ExchangeAndVerify();
+}
+
+void Grid3DFloatExchangeBoundariesTest::ExchangeAndVerify() {
   bool diag = std::tr1::get<2>(GetParam());
   bool periodic = std::tr1::get<3>(GetParam());
   gs_->ExchangeBoundaries(g_, 0, 2, width_, diag, periodic);
@@ -344,6 +357,387 @@ INSTANTIATE_TEST_CASE_P(
         ::testing::Values(IndexArray(1, 1, 2)),
         ::testing::Bool(), ::testing::Bool()));
 
+class Grid3DFloatSharedHaloExchangeBoundariesTest:
+    public Grid3DFloatExchangeBoundariesTest {
+ protected:
+  virtual bool UseSharedHalo() const { return true; }
+};
+
+TEST_P(Grid3DFloatSharedHaloExchangeBoundariesTest, ExchangeBoundaries) {
+  ExchangeAndVerify();
+}
+
+INSTANTIATE_TEST_CASE_P(
+    DiagonalPeriodic13pt, Grid3DFloatSharedHaloExchangeBoundariesTest,
+    ::testing::Combine(
+        ::testing::Values(IndexArray(-2, -2, -2)),
+        ::testing::Values(IndexArray(2, 2, 2)),
+        ::testing::Bool(), ::testing::Bool()));
+
+INSTANTIATE_TEST_CASE_P(
+    DiagonalPeriodicAsymmetry, Grid3DFloatSharedHaloExchangeBoundariesTest,
+    ::testing::Combine(
+        ::testing::Values(IndexArray(-2, -2, -1)),
+        ::testing::Values(IndexArray(1, 1, 2)),
+        ::testing::Bool(), ::testing::Bool()));
+
+TEST(GridSpaceMPI, RecycleBuffers) {
+  IndexArray global_size(N, N, N);
+  GridSpaceMPIType *gs = new GridSpaceMPIType(
+      3, global_size, 3, proc_size, *ipc);
+  IndexArray stencil_min(-1, -1, -1), stencil_max(1, 1, 1);
+  GridMPI *g = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, global_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  InitGrid<float>(g);
+  Buffer *buf = g->buffer();
+  // The data buffer and the send and receive buffers of the halo
+  size_t num_buffers = 1;
+  for (int i = 0; i < 2; ++i) {
+    if (g->halo().fw[i]) num_buffers += 2;
+    if (g->halo().bw[i]) num_buffers += 2;
+  }
+  gs->DeleteGrid(g);
+  EXPECT_LT(0U, gs->buffer_pool().size());
+  g = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, global_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  EXPECT_EQ(buf, g->buffer());
+  EXPECT_EQ(0U, gs->buffer_pool().size());
+  EXPECT_EQ(num_buffers, gs->buffer_pool().num_hits());
+  for (PSIndex i = 0; i < g->local_size().accumulate(3); ++i) {
+    EXPECT_EQ(0.0f, ((float*)g->data())[i]);
+  }
+  gs->DeleteGrid(g);
+  delete gs;
+}
+
+// Counts the points of the buffer of a grid within a distance from
+// the sub grid that differ from the values set by InitGrid
+static int CountStalePoints(GridMPI *g, int distance) {
+  int stale = 0;
+  IndexArray begin = g->local_real_offset();
+  IndexArray end = g->local_real_offset() + g->local_real_size();
+  for (int k = begin[2]; k < end[2]; ++k) {
+    for (int j = begin[1]; j < end[1]; ++j) {
+      for (int i = begin[0]; i < end[0]; ++i) {
+        IndexArray p(i, j, k);
+        bool inside = true;
+        for (int d = 0; d < 3; ++d) {
+          if (p[d] < 0 || p[d] >= g->size()[d] ||
+              p[d] < g->local_offset()[d] - distance ||
+              p[d] >= g->local_offset()[d] + g->local_size()[d] + distance) {
+            inside = false;
+          }
+        }
+        if (!inside) continue;
+        if (*(float*)(g->GetAddress(p)) != i + j * N + k * N * N) ++stale;
+      }
+    }
+  }
+  return stale;
+}
+
+TEST(GridSpaceMPI, DeepHalo) {
+  IndexArray global_size(N, N, N);
+  GridSpaceMPIType *gs = new GridSpaceMPIType(
+      3, global_size, 3, proc_size, *ipc);
+  IndexArray stencil_min(-1, -1, -1), stencil_max(1, 1, 1);
+  GridMPI *g = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, global_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  GridMPI *h = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, global_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  InitGrid<float>(g);
+  // Deeper than the smallest sub grid
+  gs->SetHaloDepth(g, N);
+  int depth = g->halo_depth();
+  EXPECT_EQ(0, CountStalePoints(g, 0));
+  // Reduced to fit the sub grids of the decomposed dimensions
+  if (proc_size.accumulate(3) > 1) {
+    EXPECT_GE(N / 2, depth);
+  }
+  if (depth > 1) {
+    EXPECT_EQ(depth, gs->GetHaloExtent(g));
+    GridMPI *grids[] = {g, h};
+    int modes[] = {PS_GRID_ACCESS_READ, PS_GRID_ACCESS_WRITE};
+    // Exchanged as usual until a domain is extended
+    gs->LoadNeighbor(g, stencil_min, stencil_max, false, false, false);
+    EXPECT_EQ(0, g->halo_valid());
+    EXPECT_EQ(0, gs->GetDomainExtension(1, grids, modes));
+    gs->LoadNeighbor(g, stencil_min, stencil_max, false, false, false);
+    EXPECT_EQ(depth, g->halo_valid());
+    EXPECT_EQ(0, CountStalePoints(g, depth));
+    EXPECT_EQ(depth - 1, gs->GetDomainExtension(1, grids, modes));
+    // Not exchanged while valid
+    float *p = (float*)g->GetAddress(g->local_offset());
+    *p += 1.0f;
+    gs->LoadNeighbor(g, stencil_min, stencil_max, false, false, false);
+    EXPECT_EQ(1, CountStalePoints(g, depth));
+    // No extension with a grid without deep halo
+    EXPECT_EQ(0, gs->GetDomainExtension(2, grids, modes));
+    g->InvalidateHalo();
+    *p -= 1.0f;
+    gs->LoadNeighbor(g, stencil_min, stencil_max, false, false, false);
+    modes[0] = PS_GRID_ACCESS_READ | PS_GRID_ACCESS_WRITE;
+    EXPECT_EQ(depth - 1, gs->GetDomainExtension(1, grids, modes));
+    EXPECT_EQ(depth - 1, g->halo_valid());
+    gs->SetHaloDepth(g, 1);
+    EXPECT_EQ(1, g->halo_depth());
+    EXPECT_EQ(0, CountStalePoints(g, 0));
+  }
+  gs->DeleteGrid(g);
+  gs->DeleteGrid(h);
+  delete gs;
+}
+
+TEST(MasterSPMD, CopyinCopyout) {
+  IndexArray global_size(N, N, N);
+  GridSpaceMPIType *gs = new GridSpaceMPIType(
+      3, global_size, 3, proc_size, *ipc);
+  MasterSPMD<GridSpaceMPIType> master(ipc, NULL, gs);
+  IndexArray stencil_min(-1, -1, -1), stencil_max(1, 1, 1);
+  GridMPI *g = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, global_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  size_t num_elms = global_size.accumulate(3);
+  float *in = new float[num_elms];
+  float *out = new float[num_elms];
+  for (size_t i = 0; i < num_elms; ++i) {
+    in[i] = i;
+    out[i] = -1;
+  }
+  master.GridCopyin(g, in);
+  master.GridCopyout(g, out);
+  for (size_t i = 0; i < num_elms; ++i) {
+    EXPECT_EQ(in[i], out[i]);
+  }
+  float v = -1;
+  master.GridGet(g, &v, IndexArray(N-1, N/2, 1));
+  EXPECT_EQ(in[N-1 + N/2*N + N*N], v);
+  float sum = 0;
+  master.GridReduce(&sum, PS_SUM, g);
+  EXPECT_EQ((float)(num_elms * (num_elms - 1) / 2), sum);
+  delete[] in;
+  delete[] out;
+  gs->DeleteGrid(g);
+  delete gs;
+}
+
+TEST(MasterSPMD, CopyoutAsync) {
+  IndexArray global_size(N, N, N);
+  GridSpaceMPIType *gs = new GridSpaceMPIType(
+      3, global_size, 3, proc_size, *ipc);
+  MasterSPMD<GridSpaceMPIType> master(ipc, NULL, gs);
+  IndexArray stencil_min(-1, -1, -1), stencil_max(1, 1, 1);
+  GridMPI *g = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, global_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  size_t num_elms = global_size.accumulate(3);
+  vector<float> in(num_elms), out(num_elms, -1), out2(num_elms, -1);
+  for (size_t i = 0; i < num_elms; ++i) in[i] = i;
+  master.GridCopyin(g, &in[0]);
+  int t1 = master.GridCopyoutAsync(g, &out[0]);
+  // Later updates are not seen by the pending copyout
+  for (size_t i = 0; i < num_elms; ++i) in[i] = -(float)i;
+  master.GridCopyin(g, &in[0]);
+  int t2 = master.GridCopyoutAsync(g, &out2[0]);
+  EXPECT_NE(t1, t2);
+  master.Wait(t1);
+  master.WaitAll();
+  for (size_t i = 0; i < num_elms; ++i) {
+    EXPECT_EQ((float)i, out[i]);
+    EXPECT_EQ(in[i], out2[i]);
+  }
+  gs->DeleteGrid(g);
+  delete gs;
+}
+
+//! Master finalizing the clients without finalizing MPI
+class TestMaster: public Master<GridSpaceMPIType> {
+ public:
+  TestMaster(InterProcComm *ipc, GridSpaceMPIType *gs):
+      Master<GridSpaceMPIType>(ipc, NULL, gs) {}
+  virtual void Finalize() {
+    WaitAll();
+    NotifyCall(FUNC_FINALIZE);
+  }
+};
+
+// The clients keep serving requests, which modify their subgrids,
+// while their staged subgrids are sent.
+TEST(MasterClient, CopyoutAsync) {
+  IndexArray global_size(N, N, N);
+  GridSpaceMPIType *gs = new GridSpaceMPIType(
+      3, global_size, 3, proc_size, *ipc);
+  if (ipc->GetRank() != Proc::GetRootRank()) {
+    Client<GridSpaceMPIType> client(ipc, NULL, gs);
+    client.Listen();
+    delete gs;
+    return;
+  }
+  TestMaster master(ipc, gs);
+  __PSGridTypeInfo type_info = {PS_FLOAT, sizeof(float), 0, NULL};
+  IndexArray stencil_min(-1, -1, -1), stencil_max(1, 1, 1);
+  GridMPI *g = master.GridNew(
+      &type_info, 3, global_size, IndexArray(0),
+      stencil_min, stencil_max, NULL, NULL, 0);
+  size_t num_elms = global_size.accumulate(3);
+  vector<float> in(num_elms), out(num_elms, -1), out2(num_elms, -1),
+      out3(num_elms, -1);
+  for (size_t i = 0; i < num_elms; ++i) in[i] = i;
+  master.GridCopyin(g, &in[0]);
+  int t1 = master.GridCopyoutAsync(g, &out[0]);
+  // Later updates are not seen by the pending copyout
+  for (size_t i = 0; i < num_elms; ++i) in[i] = -(float)i;
+  master.GridCopyin(g, &in[0]);
+  int t2 = master.GridCopyoutAsync(g, &out2[0]);
+  for (size_t i = 0; i < num_elms; ++i) in[i] = 2 * (float)i;
+  master.GridCopyin(g, &in[0]);
+  int t3 = master.GridCopyoutAsync(g, &out3[0]);
+  EXPECT_NE(t1, t2);
+  EXPECT_NE(t2, t3);
+  master.Wait(t2);
+  // Waiting again has no effect
+  master.Wait(t2);
+  master.WaitAll();
+  for (size_t i = 0; i < num_elms; ++i) {
+    EXPECT_EQ((float)i, out[i]);
+    EXPECT_EQ(-(float)i, out2[i]);
+    EXPECT_EQ(in[i], out3[i]);
+  }
+  // Pending copyouts are completed by finalization
+  master.GridCopyoutAsync(g, &out[0]);
+  master.GridDelete(g);
+  master.Finalize();
+  for (size_t i = 0; i < num_elms; ++i) {
+    EXPECT_EQ(in[i], out[i]);
+  }
+  delete gs;
+}
+
+TEST(MasterSPMD, CopyoutView) {
+  IndexArray global_size(N, N, N);
+  GridSpaceMPIType *gs = new GridSpaceMPIType(
+      3, global_size, 3, proc_size, *ipc);
+  MasterSPMD<GridSpaceMPIType> master(ipc, NULL, gs);
+  IndexArray stencil_min(-1, -1, -1), stencil_max(1, 1, 1);
+  GridMPI *g = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, global_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  size_t num_elms = global_size.accumulate(3);
+  vector<float> in(num_elms);
+  for (size_t i = 0; i < num_elms; ++i) in[i] = i;
+  master.GridCopyin(g, &in[0]);
+  // The plane at z=N-3
+  vector<float> plane(N * N, -1);
+  master.GridCopyoutView(g, &plane[0], IndexArray(0, 0, N-3),
+                         IndexArray(N, N, 1), IndexArray(1, 1, 1));
+  for (int i = 0; i < N * N; ++i) {
+    EXPECT_EQ(in[i + (N-3)*N*N], plane[i]);
+  }
+  // Every third point from (1, 0, 2)
+  IndexArray vs(3, 3, 2);
+  vector<float> v(vs.accumulate(3), -1);
+  master.GridCopyoutView(g, &v[0], IndexArray(1, 0, 2), vs,
+                         IndexArray(3, 3, 3));
+  for (int k = 0; k < vs[2]; ++k) {
+    for (int j = 0; j < vs[1]; ++j) {
+      for (int i = 0; i < vs[0]; ++i) {
+        EXPECT_EQ(in[(1+3*i) + 3*j*N + (2+3*k)*N*N],
+                  v[i + j*vs[0] + k*vs[0]*vs[1]]);
+      }
+    }
+  }
+  gs->DeleteGrid(g);
+  delete gs;
+}
+
+static void CheckRestrictProlong(int agglomeration_level) {
+  IndexArray global_size(N, N, N);
+  GridSpaceMPIType *gs = new GridSpaceMPIType(
+      3, global_size, 3, proc_size, *ipc);
+  gs->set_agglomeration_level(agglomeration_level);
+  MasterSPMD<GridSpaceMPIType> master(ipc, NULL, gs);
+  IndexArray stencil_min(-1, -1, -1), stencil_max(1, 1, 1);
+  // Odd along the last dimension
+  IndexArray fine_size(N, N, N-1), coarse_size(N/2, N/2, N/2);
+  GridMPI *fine = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, fine_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  GridMPI *coarse = gs->CreateGrid(
+      PS_FLOAT, sizeof(float), 3, coarse_size,
+      IndexArray(0), stencil_min, stencil_max, 0);
+  // Each coarse subgrid has a point unless the fine ones are smaller
+  // than the coarsening factor
+  bool partitionable = true;
+  for (int i = 0; i < 3; ++i) {
+    if (N / proc_size[i] < 2) partitionable = false;
+  }
+  if (agglomeration_level == 0 && partitionable) {
+    // Partitioned on the fine boundaries coarsened
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ((gs->my_offset()[i] + 1) / 2, coarse->local_offset()[i]);
+    }
+    EXPECT_FALSE(coarse->empty());
+  } else {
+    EXPECT_EQ(gs->my_rank() != 0, coarse->empty());
+  }
+  size_t num_fine = fine_size.accumulate(3);
+  size_t num_coarse = coarse_size.accumulate(3);
+  float *in = new float[num_fine];
+  float *out = new float[num_fine];
+  float *c = new float[num_coarse];
+  for (size_t i = 0; i < num_fine; ++i) {
+    in[i] = i;
+  }
+  master.GridCopyin(fine, in);
+  master.GridRestrict(coarse, fine);
+  master.GridCopyout(coarse, c);
+  for (int k = 0; k < N/2; ++k) {
+    for (int j = 0; j < N/2; ++j) {
+      for (int i = 0; i < N/2; ++i) {
+        float sum = 0;
+        int n = 0;
+        for (int z = 2*k; z < std::min(2*k+2, N-1); ++z) {
+          for (int y = 2*j; y < 2*j+2; ++y) {
+            for (int x = 2*i; x < 2*i+2; ++x) {
+              sum += in[x + y*N + z*N*N];
+              ++n;
+            }
+          }
+        }
+        EXPECT_EQ(sum / n, c[i + j*N/2 + k*N*N/4]);
+      }
+    }
+  }
+  master.GridProlong(fine, coarse, true);
+  master.GridCopyout(fine, out);
+  for (int z = 0; z < N-1; ++z) {
+    for (int y = 0; y < N; ++y) {
+      for (int x = 0; x < N; ++x) {
+        int f = x + y*N + z*N*N;
+        EXPECT_EQ(in[f] + c[x/2 + y/2*N/2 + z/2*N*N/4], out[f]);
+      }
+    }
+  }
+  delete[] in;
+  delete[] out;
+  delete[] c;
+  gs->DeleteGrid(fine);
+  gs->DeleteGrid(coarse);
+  delete gs;
+}
+
+TEST(MasterSPMD, RestrictProlong) {
+  CheckRestrictProlong(0);
+}
+
+TEST(MasterSPMD, RestrictProlongAgglomerated) {
+  CheckRestrictProlong(1);
+}
+
 int main(int argc, char *argv[]) {
   ::testing::InitGoogleMock(&argc, argv);
   ipc = InterProcCommMPI::GetInstance();
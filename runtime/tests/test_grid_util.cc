@@ -0,0 +1,258 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/grid_util.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#include <cmath>
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+struct Point {
+  float x;
+  double y;
+  int z[3];
+};
+
+class GridLayoutTest: public ::testing::TestWithParam<int> {
+ protected:
+  virtual void SetUp() {
+    __PSGridTypeMemberInfo x = {PS_FLOAT, sizeof(float), 0, {0},
+                                offsetof(Point, x)};
+    __PSGridTypeMemberInfo y = {PS_DOUBLE, sizeof(double), 0, {0},
+                                offsetof(Point, y)};
+    __PSGridTypeMemberInfo z = {PS_INT, sizeof(int), 1, {3},
+                                offsetof(Point, z)};
+    members_[0] = x;
+    members_[1] = y;
+    members_[2] = z;
+    for (int i = 0; i < N; ++i) {
+      points_[i].x = i;
+      points_[i].y = i * 2;
+      for (int j = 0; j < 3; ++j) {
+        points_[i].z[j] = i * 3 + j;
+      }
+    }
+  }
+  static const int N = 37;
+  __PSGridTypeMemberInfo members_[3];
+  Point points_[N];
+};
+
+TEST_P(GridLayoutTest, RoundTrip) {
+  int layout = GetParam();
+  size_t size = GetLayoutBufferSize(layout, sizeof(Point), N);
+  EXPECT_GE(size, sizeof(Point) * N);
+  char *grid = new char[size];
+  CopyinPointsToLayout(layout, sizeof(Point), 3, members_, N,
+                       grid, points_, 0, N);
+  Point out[N];
+  memset(out, 0, sizeof(out));
+  CopyoutPointsFromLayout(layout, sizeof(Point), 3, members_, N,
+                          grid, out, 0, N);
+  for (int i = 0; i < N; ++i) {
+    EXPECT_EQ(points_[i].x, out[i].x);
+    EXPECT_EQ(points_[i].y, out[i].y);
+    for (int j = 0; j < 3; ++j) {
+      EXPECT_EQ(points_[i].z[j], out[i].z[j]);
+    }
+  }
+  delete[] grid;
+}
+
+TEST_P(GridLayoutTest, MemberArrays) {
+  int layout = GetParam();
+  if (layout == PS_GRID_LAYOUT_AOS) return;
+  size_t block = GetLayoutBlockSize(layout, N);
+  char *grid = new char[GetLayoutBufferSize(layout, sizeof(Point), N)];
+  CopyinPointsToLayout(layout, sizeof(Point), 3, members_, N,
+                       grid, points_, 0, N);
+  // Addressing generated for member y of point i
+  for (int i = 0; i < N; ++i) {
+    double *y = (double*)(grid + (i / block) * block * sizeof(Point)
+                          + offsetof(Point, y) * block);
+    EXPECT_EQ(points_[i].y, y[i % block]);
+  }
+  // Single-point copy as in __PSGridSet
+  Point p = points_[0];
+  CopyinPointsToLayout(layout, sizeof(Point), 3, members_, N,
+                       grid, &p, N - 1, N);
+  Point q;
+  CopyoutPointsFromLayout(layout, sizeof(Point), 3, members_, N,
+                          grid, &q, N - 1, N);
+  EXPECT_EQ(p.x, q.x);
+  EXPECT_EQ(p.y, q.y);
+  EXPECT_EQ(p.z[2], q.z[2]);
+  delete[] grid;
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Layouts, GridLayoutTest,
+    ::testing::Values(PS_GRID_LAYOUT_AOS, PS_GRID_LAYOUT_SOA, 1, 4, 8));
+
+TEST(GridStorage, BFloat16Rounding) {
+  // Exactly representable values are kept as is
+  EXPECT_EQ(1.0f, __PSBFloat16ToFloat(__PSFloatToBFloat16(1.0f)));
+  EXPECT_EQ(-0.5f, __PSBFloat16ToFloat(__PSFloatToBFloat16(-0.5f)));
+  // 1 + 2^-8 is halfway between 1 and 1 + 2^-7; rounded to even
+  EXPECT_EQ(1.0f, __PSBFloat16ToFloat(__PSFloatToBFloat16(1.00390625f)));
+  // 1 + 3 * 2^-8 is halfway; rounded up to the even neighbor
+  EXPECT_EQ(1.015625f,
+            __PSBFloat16ToFloat(__PSFloatToBFloat16(1.01171875f)));
+  float nan = __PSBFloat16ToFloat(__PSFloatToBFloat16(NAN));
+  EXPECT_NE(nan, nan);
+}
+
+TEST(GridStorage, RoundTrip) {
+  const int n = 16;
+  double src[n], dst[n];
+  for (int i = 0; i < n; ++i) src[i] = 0.1 * i - 0.7;
+  float f[n];
+  ConvertPointsToStorage(PS_DOUBLE, PS_FLOAT, src, f, n);
+  ConvertPointsFromStorage(PS_DOUBLE, PS_FLOAT, f, dst, n);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ((double)(float)src[i], dst[i]);
+  }
+  uint16_t b[n];
+  EXPECT_EQ(sizeof(b[0]), GetPrimitiveTypeSize(PS_BFLOAT16));
+  ConvertPointsToStorage(PS_DOUBLE, PS_BFLOAT16, src, b, n);
+  ConvertPointsFromStorage(PS_DOUBLE, PS_BFLOAT16, b, dst, n);
+  for (int i = 0; i < n; ++i) {
+    // bfloat16 has 8 significant bits
+    EXPECT_NEAR(src[i], dst[i], std::fabs(src[i]) / 256);
+  }
+}
+
+TEST(GridRedBlack, RoundTrip) {
+  // An odd first dimension leaves one unused point per row
+  IndexArray dim(5, 4, 3);
+  const int n = 5 * 4 * 3;
+  size_t size = GetRedBlackBufferSize(3, dim);
+  EXPECT_EQ((size_t)(2 * 3 * 4 * 3), size);
+  int src[n], dst[n];
+  for (int i = 0; i < n; ++i) src[i] = i;
+  vector<int> grid(size, -1);
+  CopyinPointsToRedBlack(sizeof(int), 3, dim, &grid[0], src);
+  for (int k = 0; k < dim[2]; ++k) {
+    for (int j = 0; j < dim[1]; ++j) {
+      for (int i = 0; i < dim[0]; ++i) {
+        int64_t offset = GetRedBlackOffset(3, dim, IndexArray(i, j, k));
+        // Red points are in the first half
+        EXPECT_EQ((i + j + k) % 2 == 0, offset < (int64_t)size / 2);
+        EXPECT_EQ(i + j * dim[0] + k * dim[0] * dim[1], grid[offset]);
+      }
+    }
+  }
+  CopyoutPointsFromRedBlack(sizeof(int), 3, dim, &grid[0], dst);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(src[i], dst[i]);
+  }
+}
+
+TEST(GridRedBlack, UnitStride) {
+  // Points of the same color in a row are adjacent
+  IndexArray dim(8, 6);
+  for (int j = 0; j < dim[1]; ++j) {
+    for (int i = 2; i < dim[0]; ++i) {
+      EXPECT_EQ(GetRedBlackOffset(2, dim, IndexArray(i - 2, j)) + 1,
+                GetRedBlackOffset(2, dim, IndexArray(i, j)));
+    }
+  }
+}
+
+TEST(GridMultigrid, Regions) {
+  IndexArray co, cs, fo, fs;
+  GetCoarseRegion(2, IndexArray(3, 0), IndexArray(4, 5), co, cs);
+  EXPECT_EQ(IndexArray(1, 0), co);
+  EXPECT_EQ(IndexArray(3, 3), cs);
+  GetFineRegion(2, co, cs, IndexArray(7, 5), fo, fs);
+  EXPECT_EQ(IndexArray(2, 0), fo);
+  // Clipped at the end of the fine grid
+  EXPECT_EQ(IndexArray(5, 5), fs);
+  GetCoarseRegion(1, IndexArray(3), IndexArray(0), co, cs);
+  EXPECT_EQ(0, cs[0]);
+}
+
+TEST(GridMultigrid, RestrictProlong) {
+  // A fine region of a 5x3 grid and the coarse points covering it
+  IndexArray fo(2, 0), fs(3, 3), co(1, 0), cs(2, 2);
+  float fine[9];
+  for (int i = 0; i < 9; ++i) fine[i] = i;
+  float coarse[4];
+  RestrictSubgrid(PS_FLOAT, 2, fine, fo, fs, coarse, co, cs);
+  EXPECT_EQ((0 + 1 + 3 + 4) / 4.0f, coarse[0]);
+  EXPECT_EQ((2 + 5) / 2.0f, coarse[1]);
+  EXPECT_EQ((6 + 7) / 2.0f, coarse[2]);
+  EXPECT_EQ(8.0f, coarse[3]);
+  double c[] = {1.0, 2.0};
+  double f[] = {1.0, 1.0, 1.0};
+  ProlongSubgrid(PS_DOUBLE, 1, c, IndexArray(0), IndexArray(2),
+                 f, IndexArray(1), IndexArray(3), true);
+  EXPECT_EQ(2.0, f[0]);
+  EXPECT_EQ(3.0, f[1]);
+  EXPECT_EQ(3.0, f[2]);
+  ProlongSubgrid(PS_DOUBLE, 1, c, IndexArray(0), IndexArray(2),
+                 f, IndexArray(1), IndexArray(3), false);
+  EXPECT_EQ(1.0, f[0]);
+  EXPECT_EQ(2.0, f[2]);
+}
+
+TEST(GridView, CopyoutStrided) {
+  IndexArray dim(6, 4, 3);
+  int grid[6 * 4 * 3];
+  for (int i = 0; i < 6 * 4 * 3; ++i) grid[i] = i;
+  // Every other point of the plane at z=2 from (1, 1)
+  int view[3 * 2];
+  CopyoutStridedSubgrid(sizeof(int), 3, grid, dim, view,
+                        IndexArray(1, 1, 2), IndexArray(3, 2, 1),
+                        IndexArray(2, 2, 1));
+  for (int j = 0; j < 2; ++j) {
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ((1 + 2 * i) + (1 + 2 * j) * 6 + 2 * 24, view[i + j * 3]);
+    }
+  }
+  // Unit stride along the first dimension
+  int row[4];
+  CopyoutStridedSubgrid(sizeof(int), 2, grid, IndexArray(6, 4), row,
+                        IndexArray(2, 3), IndexArray(4, 1),
+                        IndexArray(1, 1));
+  for (int i = 0; i < 4; ++i) EXPECT_EQ(2 + i + 18, row[i]);
+}
+
+TEST(GridView, Intersect) {
+  // Points 1, 4, 7, 10, 13 of the view
+  IndexArray vo, vs;
+  EXPECT_TRUE(IntersectGridView(1, IndexArray(1), IndexArray(5),
+                                IndexArray(3), IndexArray(4),
+                                IndexArray(6), vo, vs));
+  EXPECT_EQ(1, vo[0]);
+  EXPECT_EQ(2, vs[0]);
+  EXPECT_TRUE(IntersectGridView(1, IndexArray(1), IndexArray(5),
+                                IndexArray(3), IndexArray(0),
+                                IndexArray(100), vo, vs));
+  EXPECT_EQ(0, vo[0]);
+  EXPECT_EQ(5, vs[0]);
+  EXPECT_FALSE(IntersectGridView(1, IndexArray(1), IndexArray(5),
+                                 IndexArray(3), IndexArray(5),
+                                 IndexArray(2), vo, vs));
+  // A plane intersects only the regions containing it
+  EXPECT_FALSE(IntersectGridView(2, IndexArray(0, 5), IndexArray(8, 1),
+                                 IndexArray(1, 1), IndexArray(0, 0),
+                                 IndexArray(8, 4), vo, vs));
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/task_graph.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+static void Append(vector<int> *log, int v, int delay_us) {
+  usleep(delay_us);
+  log->push_back(v);
+}
+
+// Blocks tasks until the test opens it
+class Gate {
+ public:
+  Gate(): open_(false) {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+  }
+  ~Gate() {
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+  void Open() {
+    pthread_mutex_lock(&mutex_);
+    open_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+  }
+  void Pass() {
+    pthread_mutex_lock(&mutex_);
+    while (!open_) pthread_cond_wait(&cond_, &mutex_);
+    pthread_mutex_unlock(&mutex_);
+  }
+ private:
+  bool open_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+};
+
+static void AppendAfter(Gate *gate, vector<int> *log, int v) {
+  gate->Pass();
+  log->push_back(v);
+}
+
+static vector<const void*> Objects(const void *p) {
+  return vector<const void*>(1, p);
+}
+
+static vector<const void*> NoObjects() {
+  return vector<const void*>();
+}
+
+TEST(TaskGraph, Synchronous) {
+  TaskGraph tg(0);
+  vector<int> log;
+  int obj;
+  TaskGraph::TaskID id = tg.Submit(boost::bind(Append, &log, 1, 0),
+                                   NoObjects(), Objects(&obj));
+  EXPECT_EQ(0, id);
+  ASSERT_EQ(1U, log.size());
+}
+
+TEST(TaskGraph, ReadAfterWrite) {
+  TaskGraph tg(4);
+  vector<int> log;
+  int obj;
+  // The slow writer must complete before the reader starts
+  tg.Submit(boost::bind(Append, &log, 1, 10000),
+            NoObjects(), Objects(&obj));
+  TaskGraph::TaskID r = tg.Submit(boost::bind(Append, &log, 2, 0),
+                                  Objects(&obj), Objects(&log));
+  tg.Wait(r);
+  EXPECT_FALSE(tg.IsPending(r));
+  ASSERT_EQ(2U, log.size());
+  EXPECT_EQ(1, log[0]);
+  EXPECT_EQ(2, log[1]);
+}
+
+TEST(TaskGraph, WriteAfterRead) {
+  TaskGraph tg(4);
+  vector<int> log;
+  int obj;
+  tg.Submit(boost::bind(Append, &log, 1, 10000),
+            Objects(&obj), NoObjects());
+  tg.Submit(boost::bind(Append, &log, 2, 0),
+            NoObjects(), Objects(&obj));
+  tg.WaitAll();
+  ASSERT_EQ(2U, log.size());
+  EXPECT_EQ(1, log[0]);
+  EXPECT_EQ(2, log[1]);
+}
+
+TEST(TaskGraph, WaitObject) {
+  TaskGraph tg(2);
+  vector<int> log;
+  int obj;
+  tg.Submit(boost::bind(Append, &log, 1, 10000),
+            Objects(&obj), Objects(&log));
+  // Reading does not wait for readers
+  tg.WaitObject(&obj, false);
+  tg.WaitObject(&obj, true);
+  ASSERT_EQ(1U, log.size());
+  tg.WaitObject(&obj, true);
+}
+
+TEST(TaskGraph, Independent) {
+  TaskGraph tg(2);
+  vector<int> log1, log2;
+  int obj1, obj2;
+  Gate gate;
+  TaskGraph::TaskID t1 = tg.Submit(boost::bind(AppendAfter, &gate, &log1, 1),
+                                   Objects(&obj1), Objects(&log1));
+  TaskGraph::TaskID t2 = tg.Submit(boost::bind(Append, &log2, 2, 0),
+                                   Objects(&obj2), Objects(&log2));
+  tg.Wait(t2);
+  // The second task does not wait for the first one
+  EXPECT_TRUE(tg.IsPending(t1));
+  gate.Open();
+  tg.Wait(t1);
+  EXPECT_EQ(1U, log1.size());
+  EXPECT_EQ(1U, log2.size());
+}
+
+} // namespace runtime
+} // namespace physis
+
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
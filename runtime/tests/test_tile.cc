@@ -0,0 +1,185 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "physis/physis_tile.h"
+
+#include <omp.h>
+#include <vector>
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace {
+
+#define NUM_THREADS (4)
+
+//! Stencil struct recording the runs of each point
+struct Stencil {
+  __PSDomain dom;
+  PSIndex size[PS_MAX_DIM];
+  int *counts;
+  int *threads;
+  int *tiles;
+};
+
+static void InitStencil(Stencil *s, int num_dims, const PSIndex *min,
+                        const PSIndex *max, int *counts, int *threads) {
+  memset(s, 0, sizeof(Stencil));
+  for (int i = 0; i < num_dims; ++i) {
+    s->dom.min[i] = s->dom.local_min[i] = min[i];
+    s->dom.max[i] = s->dom.local_max[i] = max[i];
+    s->size[i] = max[i];
+  }
+  for (int i = num_dims; i < PS_MAX_DIM; ++i) {
+    s->dom.max[i] = s->dom.local_max[i] = 1;
+    s->size[i] = 1;
+  }
+  s->counts = counts;
+  s->threads = threads;
+}
+
+static void RunTile(const void *p, int rb) {
+  const Stencil *s = (const Stencil *)p;
+  const __PSDomain &d = s->dom;
+  for (PSIndex k = d.local_min[2]; k < d.local_max[2]; ++k) {
+    for (PSIndex j = d.local_min[1]; j < d.local_max[1]; ++j) {
+      for (PSIndex i = d.local_min[0]; i < d.local_max[0]; ++i) {
+        PSIndex x = i + s->size[0] * (j + s->size[1] * k);
+#pragma omp atomic
+        ++s->counts[x];
+        s->threads[x] = omp_get_thread_num();
+      }
+    }
+  }
+  if (s->tiles) {
+#pragma omp atomic
+    ++*s->tiles;
+  }
+}
+
+// Uneven domains with offsets in 1-D, 2-D and 3-D
+static const int kNumDims[] = {1, 2, 3};
+static const PSIndex kMin[][PS_MAX_DIM] = {{3, 0, 0}, {1, 2, 0}, {2, 1, 3}};
+static const PSIndex kMax[][PS_MAX_DIM] = {{1003, 1, 1}, {37, 29, 1},
+                                           {19, 23, 17}};
+
+static PSIndex GetNumPoints(int n) {
+  PSIndex num_points = 1;
+  for (int i = 0; i < kNumDims[n]; ++i) num_points *= kMax[n][i];
+  return num_points;
+}
+
+static bool IsInDomain(int n, PSIndex x) {
+  for (int i = 0; i < kNumDims[n]; ++i) {
+    PSIndex idx = x % kMax[n][i];
+    x /= kMax[n][i];
+    if (idx < kMin[n][i]) return false;
+  }
+  return true;
+}
+
+} // namespace
+
+TEST(TileSpace, CoverDomain) {
+  for (int n = 0; n < 3; ++n) {
+    vector<int> counts(GetNumPoints(n)), threads(GetNumPoints(n));
+    Stencil s;
+    InitStencil(&s, kNumDims[n], kMin[n], kMax[n], &counts[0],
+                &threads[0]);
+    __PSTileSpace ts;
+    ASSERT_TRUE(__PSTileSpaceInit(&ts, &s.dom, kNumDims[n], NUM_THREADS));
+    EXPECT_GE(ts.num_tiles, NUM_THREADS);
+    for (PSIndex t = 0; t < ts.num_tiles; ++t) {
+      Stencil tile = s;
+      __PSTileSetDomain(&ts, t, &tile.dom);
+      RunTile(&tile, 0);
+    }
+    for (size_t x = 0; x < counts.size(); ++x) {
+      EXPECT_EQ(IsInDomain(n, x) ? 1 : 0, counts[x]) << "n: " << n;
+    }
+  }
+}
+
+TEST(TileSpace, EmptyDomain) {
+  PSIndex min[] = {0, 4, 0};
+  PSIndex max[] = {8, 4, 8};
+  Stencil s;
+  InitStencil(&s, 3, min, max, NULL, NULL);
+  __PSTileSpace ts;
+  EXPECT_FALSE(__PSTileSpaceInit(&ts, &s.dom, 3, NUM_THREADS));
+}
+
+TEST(RunTiles, RunEachTileOnce) {
+  omp_set_num_threads(NUM_THREADS);
+  for (int n = 0; n < 3; ++n) {
+    vector<int> counts(GetNumPoints(n)), threads(GetNumPoints(n));
+    int num_tiles = 0;
+    Stencil s;
+    InitStencil(&s, kNumDims[n], kMin[n], kMax[n], &counts[0],
+                &threads[0]);
+    s.tiles = &num_tiles;
+    __PSRunTiles(RunTile, &s, sizeof(s), 0, kNumDims[n]);
+    __PSTileSpace ts;
+    __PSTileSpaceInit(&ts, &s.dom, kNumDims[n], NUM_THREADS);
+    EXPECT_EQ(ts.num_tiles, num_tiles) << "n: " << n;
+    for (size_t x = 0; x < counts.size(); ++x) {
+      EXPECT_EQ(IsInDomain(n, x) ? 1 : 0, counts[x]) << "n: " << n;
+    }
+  }
+}
+
+TEST(RunTiles, RunWithinDivisions) {
+  omp_set_num_threads(NUM_THREADS);
+  const int divisions[][PS_MAX_DIM] = {{1, 1, 2}, {2, 1, 3}, {1, 1, 1},
+                                       {64, 64, 64}};
+  for (int v = 0; v < 4; ++v) {
+    const int *div = divisions[v];
+    int n = 2;
+    vector<int> counts(GetNumPoints(n)), threads(GetNumPoints(n));
+    Stencil s;
+    InitStencil(&s, kNumDims[n], kMin[n], kMax[n], &counts[0],
+                &threads[0]);
+    __PSRunDivisionTiles(RunTile, &s, sizeof(s), 0, kNumDims[n],
+                         div[0], div[1], div[2]);
+    // Divisions are clipped to the extent of the domain
+    int clipped[PS_MAX_DIM], num_divs = 1;
+    for (int i = 0; i < PS_MAX_DIM; ++i) {
+      clipped[i] = min((PSIndex)div[i], kMax[n][i] - kMin[n][i]);
+      num_divs *= clipped[i];
+    }
+    int num_groups = min(num_divs, NUM_THREADS);
+    for (PSIndex k = 0; k < kMax[n][2]; ++k) {
+      for (PSIndex j = 0; j < kMax[n][1]; ++j) {
+        for (PSIndex i = 0; i < kMax[n][0]; ++i) {
+          PSIndex x = i + kMax[n][0] * (j + kMax[n][1] * k);
+          if (!IsInDomain(n, x)) {
+            EXPECT_EQ(0, counts[x]);
+            continue;
+          }
+          ASSERT_EQ(1, counts[x]) << "division: " << v;
+          // Run by a thread of the group of the division
+          PSIndex idx[] = {i, j, k};
+          int u = 0;
+          for (int d = PS_MAX_DIM - 1; d >= 0; --d) {
+            PSIndex w = kMax[n][d] - kMin[n][d];
+            int di = 0;
+            while (di < clipped[d] - 1 &&
+                   kMin[n][d] + (di + 1) * w / clipped[d] <= idx[d]) {
+              ++di;
+            }
+            u = u * clipped[d] + di;
+          }
+          EXPECT_EQ(u % num_groups, threads[x] % num_groups)
+              << "division: " << v;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
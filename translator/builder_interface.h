@@ -312,6 +312,28 @@ class BuilderInterface {
   virtual SgVariableDeclaration *BuildTypeInfo(GridType *gt,
                                                SgStatementPtrList &stmts,
                                                SgScopeStatement *scope) = 0;
+  //! Returns the layout of a user-defined point type
+  /*!
+    \param gt The grid type.
+    \return PS_GRID_LAYOUT_AOS, PS_GRID_LAYOUT_SOA, or the number of
+    points in each AoSoA block.
+   */
+  virtual int GetUserTypeLayout(const GridType *gt) = 0;
+  //! Returns true if a grid type is in the red-black layout
+  /*!
+    \param gt The grid type.
+    \return True if points of the primitive type are stored in
+    PS_GRID_LAYOUT_RED_BLACK.
+   */
+  virtual bool IsRedBlackLayout(const GridType *gt) = 0;
+  //! Returns the storage type of a reduced-precision grid
+  /*!
+    \param gt The grid type.
+    \param storage_type PS_FLOAT or PS_BFLOAT16 on return.
+    \return False if points are stored in the point type itself.
+   */
+  virtual bool GetStorageType(const GridType *gt,
+                              PSType &storage_type) = 0;
 
   // These functions build functions and types for user-defined point
   // types. They may simply return NULL if no user-type-specific
@@ -21,7 +21,15 @@ class Configuration: public pu::Configuration {
     MPI_OPENMP_DIVISION,
     MPI_OPENMP_CACHESIZE,
     TRACE_KERNEL,
-    CUDA_KERNEL_ERROR_CHECK
+    CUDA_KERNEL_ERROR_CHECK,
+    TILE_SCHEDULER,
+    REF_GRID_LAYOUT,
+    REF_GRID_STORAGE_TYPE,
+    JIT_SPECIALIZE,
+    MPI_SPMD,
+    REF_FUSE_REDUCTION,
+    REF_ACTIVITY_MASK,
+    MPI_DEEP_HALO
     };
   Configuration() {
     AddKey(CUDA_BLOCK_SIZE, "CUDA_BLOCK_SIZE");
@@ -33,6 +41,14 @@ class Configuration: public pu::Configuration {
     auto_tuning_ = false; /* set default value */
     AddKey(TRACE_KERNEL, "TRACE_KERNEL");
     AddKey(CUDA_KERNEL_ERROR_CHECK, "CUDA_KERNEL_ERROR_CHECK");    
+    AddKey(TILE_SCHEDULER, "TILE_SCHEDULER");
+    AddKey(REF_GRID_LAYOUT, "REF_GRID_LAYOUT");
+    AddKey(REF_GRID_STORAGE_TYPE, "REF_GRID_STORAGE_TYPE");
+    AddKey(JIT_SPECIALIZE, "JIT_SPECIALIZE");
+    AddKey(MPI_SPMD, "MPI_SPMD");
+    AddKey(REF_FUSE_REDUCTION, "REF_FUSE_REDUCTION");
+    AddKey(REF_ACTIVITY_MASK, "REF_ACTIVITY_MASK");
+    AddKey(MPI_DEEP_HALO, "MPI_DEEP_HALO");
   }
   virtual ~Configuration() {}
   const pu::LuaValue *Lookup(ConfigKey key) const {
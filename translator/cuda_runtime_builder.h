@@ -18,6 +18,19 @@ class CUDARuntimeBuilder: virtual public ReferenceRuntimeBuilder,
                      const Configuration &config,
                      BuilderInterface *delegator=NULL);
   virtual ~CUDARuntimeBuilder() {}
+  //! User-defined types are in the AoS layout on the host.
+  virtual int GetUserTypeLayout(const GridType *gt) {
+    return PS_GRID_LAYOUT_AOS;
+  }
+  //! Grids are always in the natural order.
+  virtual bool IsRedBlackLayout(const GridType *gt) {
+    return false;
+  }
+  //! Points are always stored in the point type.
+  virtual bool GetStorageType(const GridType *gt,
+                              PSType &storage_type) {
+    return false;
+  }
   virtual SgExpression *BuildGridRefInRunKernel(
       SgInitializedName *gv,
       SgFunctionDeclaration *run_kernel);
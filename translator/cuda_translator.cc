@@ -24,6 +24,10 @@ namespace translator {
 CUDATranslator::CUDATranslator(const Configuration &config):
     ReferenceTranslator(config) {
   target_specific_macro_ = "PHYSIS_CUDA";
+  // Device offsets are computed separately
+  flag_constant_grid_offset_optimization_ = false;
+  flag_periodic_ghost_ = false;
+  flag_jit_specialization_ = false;
 }
 
 void CUDATranslator::SetUp(SgProject *project,
@@ -123,12 +123,13 @@ class Grid {
                     SgExpressionPtrList::const_iterator size_end);
   bool _isReadWrite;
   SgExpression *attribute_;
+  bool periodic_;
   
  public:
   
   Grid(GridType *gt, SgFunctionCallExp *newCall):
       gt(gt), newCall(newCall), stencil_range_(gt->rank()),
-      _isReadWrite(false), attribute_(NULL) {
+      _isReadWrite(false), attribute_(NULL), periodic_(false) {
     SgExpressionPtrList &args = newCall->get_args()->get_expressions();
     size_t num_dims = gt->rank();
     PSAssert(args.size() == num_dims ||
@@ -212,6 +213,9 @@ class Grid {
     return member_stencil_range_;
   }
   virtual void SetMemberStencilRange(const MemberStencilRangeMap &msr);
+  //! Returns true if the grid is accessed with get_periodic.
+  bool periodic() const { return periodic_; }
+  void set_periodic(bool periodic) { periodic_ = periodic; }
 
 
   static bool IsIntrinsicCall(SgFunctionCallExp *call);
@@ -282,7 +286,7 @@ class GridOffsetAttribute: public AstAttribute {
  public:
   GridOffsetAttribute(int num_dim, bool periodic,
                       const StencilIndexList *sil): 
-    rank_(num_dim), periodic_(periodic), sil_(NULL) {
+    rank_(num_dim), periodic_(periodic), sil_(NULL), red_black_(false) {
     if (sil) {
       sil_ = new StencilIndexList();
       *sil_ = *sil;
@@ -292,11 +296,18 @@ class GridOffsetAttribute: public AstAttribute {
   GridOffsetAttribute *copy() {
     GridOffsetAttribute *a= new GridOffsetAttribute(
         rank_, periodic_, sil_);
+    a->set_red_black(red_black_);
     return a;
   }
   static const std::string name;
   bool periodic() const { return periodic_; }
   int rank() const { return rank_; }
+  //! True if the offset is in the red-black layout.
+  /*!
+    Offsets in the layout are not linear in the indices.
+   */
+  bool red_black() const { return red_black_; }
+  void set_red_black(bool red_black) { red_black_ = red_black; }
   /*  
   void SetStencilIndexList(const StencilIndexList &sil) {
     sil_ = sil;
@@ -307,6 +318,7 @@ class GridOffsetAttribute: public AstAttribute {
   int rank_;
   bool periodic_;  
   StencilIndexList *sil_;
+  bool red_black_;
 };
 
 class GridGetAnalysis {
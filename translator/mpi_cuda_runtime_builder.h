@@ -31,6 +31,19 @@ class MPICUDARuntimeBuilder: virtual public MPIRuntimeBuilder,
   virtual ~MPICUDARuntimeBuilder() {
     delete cuda_rt_builder_;
   }
+  //! User-defined types are in the AoS layout on the host.
+  virtual int GetUserTypeLayout(const GridType *gt) {
+    return PS_GRID_LAYOUT_AOS;
+  }
+  //! Grids are always in the natural order.
+  virtual bool IsRedBlackLayout(const GridType *gt) {
+    return false;
+  }
+  //! Points are always stored in the point type.
+  virtual bool GetStorageType(const GridType *gt,
+                              PSType &storage_type) {
+    return false;
+  }
 
   virtual SgExpression *BuildGridBaseAddr(
       SgExpression *gvref, SgType *point_type);
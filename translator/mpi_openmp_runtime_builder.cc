@@ -0,0 +1,66 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "translator/mpi_openmp_runtime_builder.h"
+
+#include <vector>
+
+#include "translator/mpi_openmp_translator.h"
+#include "translator/rose_util.h"
+
+namespace pu = physis::util;
+namespace sb = SageBuilder;
+namespace si = SageInterface;
+
+namespace physis {
+namespace translator {
+
+MPIOpenMPRuntimeBuilder::MPIOpenMPRuntimeBuilder(
+    SgGlobal *global_scope, const Configuration &config,
+    BuilderInterface *delegator):
+    ReferenceRuntimeBuilder(global_scope, config, delegator),
+    MPIRuntimeBuilder(global_scope, config, delegator) {
+  // Same as the division passed to PSInit by MPIOpenMPTranslator
+  division_[0] = MPI_OPENMP_DIVISION_X_DEFAULT;
+  division_[1] = MPI_OPENMP_DIVISION_Y_DEFAULT;
+  division_[2] = MPI_OPENMP_DIVISION_Z_DEFAULT;
+  const pu::LuaValue *lv = config.Lookup(Configuration::MPI_OPENMP_DIVISION);
+  if (lv) {
+    const pu::LuaTable *tbl = lv->getAsLuaTable();
+    PSAssert(tbl);
+    std::vector<double> v;
+    PSAssert(tbl->get(v));
+    for (int i = 0; i < 3; ++i) {
+      division_[i] = (int)v[i];
+    }
+  }
+}
+
+SgFunctionCallExp *MPIOpenMPRuntimeBuilder::BuildRunKernelCall(
+    StencilMap *smap, SgVariableDeclaration *stencil_decl) {
+  if (!config_.LookupFlag(Configuration::TILE_SCHEDULER)) {
+    return MPIRuntimeBuilder::BuildRunKernelCall(smap, stencil_decl);
+  }
+  // __PSRunDivisionTiles(run_tile, s, sizeof(*s), 0, num_dims,
+  //                      div_x, div_y, div_z)
+  SgFunctionDeclaration *tile_func = BuildRunTileFunc(smap);
+  int nd = smap->getNumDim();
+  SgExprListExp *args =
+      sb::buildExprListExp(
+          sb::buildFunctionRefExp(tile_func),
+          sb::buildVarRefExp(stencil_decl),
+          sb::buildSizeOfOp(
+              sb::buildPointerDerefExp(sb::buildVarRefExp(stencil_decl))),
+          sb::buildIntVal(0),
+          sb::buildIntVal(nd));
+  for (int i = 0; i < 3; ++i) {
+    si::appendExpression(args, sb::buildIntVal(i < nd ? division_[i] : 1));
+  }
+  SgFunctionSymbol *fs =
+      si::lookupFunctionSymbolInParentScopes(PS_RUN_DIVISION_TILES_NAME, gs_);
+  if (fs) return sb::buildFunctionCallExp(fs, args);
+  return sb::buildFunctionCallExp(
+      sb::buildFunctionRefExp(PS_RUN_DIVISION_TILES_NAME), args);
+}
+
+} // namespace translator
+} // namespace physis
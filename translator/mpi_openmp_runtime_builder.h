@@ -0,0 +1,40 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_TRANSLATOR_MPI_OPENMP_RUNTIME_BUILDER_H_
+#define PHYSIS_TRANSLATOR_MPI_OPENMP_RUNTIME_BUILDER_H_
+
+#include "translator/translator_common.h"
+#include "translator/mpi_runtime_builder.h"
+
+namespace physis {
+namespace translator {
+
+class MPIOpenMPRuntimeBuilder: virtual public MPIRuntimeBuilder {
+ public:
+  MPIOpenMPRuntimeBuilder(SgGlobal *global_scope,
+                          const Configuration &config,
+                          BuilderInterface *delegator=NULL);
+  virtual ~MPIOpenMPRuntimeBuilder() {}
+
+ protected:
+  //! Number of divisions of the local domain along each dimension
+  int division_[3];
+
+  using MPIRuntimeBuilder::BuildRunKernelCall;
+  //! Build a call to the run kernel of a stencil map.
+  /*!
+    With TILE_SCHEDULER, the kernel is run in tiles by
+    __PSRunDivisionTiles, which lets threads steal tiles only within
+    the divisions placed on their NUMA node.
+
+    \param smap The stencil map.
+    \param stencil_decl The pointer variable to the stencil struct.
+   */
+  virtual SgFunctionCallExp *BuildRunKernelCall(
+      StencilMap *smap, SgVariableDeclaration *stencil_decl);
+};
+
+} // namespace translator
+} // namespace physis
+
+#endif /* PHYSIS_TRANSLATOR_MPI_OPENMP_RUNTIME_BUILDER_H_ */
@@ -138,6 +138,42 @@ SgFunctionCallExp *MPIRuntimeBuilder::BuildDomainSetLocalSize(
   return fc;
 }
 
+SgFunctionCallExp *MPIRuntimeBuilder::BuildDomainExtend(
+    StencilMap *smap, SgVariableDeclaration *stencil_decl) {
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes(PS_DOMAIN_EXTEND_NAME);
+  if (!fs) return NULL;
+  SgClassDefinition *stencil_def = smap->GetStencilTypeDefinition();
+  // The first member is always the domain var of the stencil
+  SgVariableDeclaration *d =
+      isSgVariableDeclaration(*stencil_def->get_members().begin());
+  SgExpression *dom_var =
+      BuildStencilFieldRef(sb::buildVarRefExp(stencil_decl),
+                           sb::buildVarRefExp(d));
+  if (!si::isPointerType(dom_var->get_type())) {
+    dom_var = sb::buildAddressOfOp(dom_var);
+  }
+  // Grid and access mode pairs
+  vector<SgExpression*> grid_args;
+  Kernel *kernel = ru::GetASTAttribute<Kernel>(smap->getKernel());
+  BOOST_FOREACH (SgInitializedName *grid_param, smap->grid_params()) {
+    int mode = 0;
+    if (kernel->IsGridParamRead(grid_param)) mode |= PS_GRID_ACCESS_READ;
+    if (kernel->IsGridParamModified(grid_param)) mode |= PS_GRID_ACCESS_WRITE;
+    if (mode == 0) continue;
+    grid_args.push_back(
+        BuildStencilFieldRef(sb::buildVarRefExp(stencil_decl),
+                             grid_param->get_name()));
+    grid_args.push_back(sb::buildIntVal(mode));
+  }
+  SgExprListExp *args = sb::buildExprListExp(
+      dom_var, sb::buildIntVal(grid_args.size() / 2));
+  BOOST_FOREACH (SgExpression *e, grid_args) {
+    si::appendExpression(args, e);
+  }
+  return sb::buildFunctionCallExp(fs, args);
+}
+
 SgExpression *MPIRuntimeBuilder::BuildGridBaseAddr(
     SgExpression *gvref, SgType *point_type) {
   SgExpression *base_addr = sb::buildFunctionCallExp(
@@ -201,9 +237,6 @@ void MPIRuntimeBuilder::ProcessStencilMap(StencilMap *smap,
                                      init, function_body);
   si::appendStatement(sdecl, function_body);
 
-  // run kernel function
-  SgFunctionSymbol *fs = ru::getFunctionSymbol(smap->run());
-  PSAssert(fs);
   SgInitializedNamePtrList remote_grids;
   SgStatementPtrList load_statements;
   bool overlap_eligible;
@@ -214,11 +247,19 @@ void MPIRuntimeBuilder::ProcessStencilMap(StencilMap *smap,
   FOREACH (sit, load_statements.begin(), load_statements.end()) {
     si::appendStatement(*sit, loop_body);
   }
+
+  // Extend the domain into the halos loaded above
+  if (config_.LookupFlag(Configuration::MPI_DEEP_HALO)) {
+    SgFunctionCallExp *extend = BuildDomainExtend(smap, sdecl);
+    if (extend) {
+      si::appendStatement(sb::buildExprStatement(extend), loop_body);
+    } else {
+      LOG_WARNING() << "Deep halo not supported by this target\n";
+    }
+  }
     
   // Call the stencil kernel
-  SgExprListExp *args = sb::buildExprListExp(
-      sb::buildVarRefExp(sdecl));
-  SgFunctionCallExp *c = sb::buildFunctionCallExp(fs, args);
+  SgFunctionCallExp *c = BuildRunKernelCall(smap, sdecl);
   si::appendStatement(sb::buildExprStatement(c), loop_body);
   SgStatementPtrList stmt_lists;
   BuildDeactivateRemoteGrids(smap, sdecl, remote_grids, stmt_lists);
@@ -229,6 +270,15 @@ void MPIRuntimeBuilder::ProcessStencilMap(StencilMap *smap,
   BuildFixGridAddresses(smap, sdecl, function_body);
 }
 
+SgFunctionCallExp *MPIRuntimeBuilder::BuildRunKernelCall(
+    StencilMap *smap, SgVariableDeclaration *stencil_decl) {
+  SgFunctionSymbol *fs = ru::getFunctionSymbol(smap->run());
+  PSAssert(fs);
+  SgExprListExp *args = sb::buildExprListExp(
+      sb::buildVarRefExp(stencil_decl));
+  return sb::buildFunctionCallExp(fs, args);
+}
+
 void MPIRuntimeBuilder::BuildDeactivateRemoteGrids(
     StencilMap *smap,
     SgVariableDeclaration *stencil_decl,
@@ -30,9 +30,34 @@ class MPIRuntimeBuilder: virtual public ReferenceRuntimeBuilder,
   }
   
   virtual ~MPIRuntimeBuilder() {}
+  //! User-defined types are always in the AoS layout.
+  virtual int GetUserTypeLayout(const GridType *gt) {
+    return PS_GRID_LAYOUT_AOS;
+  }
+  //! Grids are always in the natural order.
+  virtual bool IsRedBlackLayout(const GridType *gt) {
+    return false;
+  }
+  //! Points are always stored in the point type.
+  virtual bool GetStorageType(const GridType *gt,
+                              PSType &storage_type) {
+    return false;
+  }
   virtual SgFunctionCallExp *BuildIsRoot();
   virtual SgFunctionCallExp *BuildGetGridByID(SgExpression *id_exp);
   virtual SgFunctionCallExp *BuildDomainSetLocalSize(SgExpression *dom);
+  //! Build a call to extend the local domain of a stencil map.
+  /*!
+    Generated before each run of the stencil kernel when MPI_DEEP_HALO
+    is enabled, so that the kernel computes the points of deep halos
+    redundantly.
+
+    \param smap The stencil map.
+    \param stencil_decl The stencil variable declaration.
+    \return NULL if not supported by the runtime.
+   */
+  virtual SgFunctionCallExp *BuildDomainExtend(
+      StencilMap *smap, SgVariableDeclaration *stencil_decl);
 
   virtual SgExpression *BuildGridBaseAddr(
       SgExpression *gvref, SgType *point_type);
@@ -69,6 +94,15 @@ class MPIRuntimeBuilder: virtual public ReferenceRuntimeBuilder,
  protected:
   bool flag_mpi_overlap_;
 
+  using ReferenceRuntimeBuilder::BuildRunKernelCall;
+  //! Build a call to the run kernel of a stencil map.
+  /*!
+    \param smap The stencil map.
+    \param stencil_decl The pointer variable to the stencil struct.
+   */
+  virtual SgFunctionCallExp *BuildRunKernelCall(
+      StencilMap *smap, SgVariableDeclaration *stencil_decl);
+
   //! Build a code sequence to load remote region necessary for a grid
   /*!
     This is a helper function for
@@ -16,13 +16,16 @@ namespace translator {
 
 MPITranslator::MPITranslator(const Configuration &config):
     ReferenceTranslator(config),
-    flag_mpi_overlap_(false) {
+    flag_mpi_overlap_(false), flag_mpi_spmd_(false) {
   grid_type_name_ = "__PSGridMPI";
   grid_create_name_ = "__PSGridNewMPI";
   target_specific_macro_ = "PHYSIS_MPI";
   get_addr_name_ = "__PSGridGetAddr";
   get_addr_no_halo_name_ = "__PSGridGetAddrNoHalo";
   emit_addr_name_ = "__PSGridEmitAddr";
+  // Offsets are computed with the size of local subgrids
+  flag_constant_grid_offset_optimization_ = false;
+  flag_periodic_ghost_ = false;
   
   const pu::LuaValue *lv
       = config.Lookup(Configuration::MPI_OVERLAP);
@@ -32,6 +35,10 @@ MPITranslator::MPITranslator(const Configuration &config):
   if (flag_mpi_overlap_) {
     LOG_INFO() << "Overlapping enabled\n";
   }
+  flag_mpi_spmd_ = config.LookupFlag(Configuration::MPI_SPMD);
+  if (flag_mpi_spmd_) {
+    LOG_INFO() << "SPMD execution enabled\n";
+  }
   
   validate_ast_ = true;
 }
@@ -164,6 +171,17 @@ void MPITranslator::TranslateInit(SgFunctionCallExp *node) {
   si::appendExpression(node->get_args(),
                        sb::buildVarRefExp(clients));
 
+  if (flag_mpi_spmd_) {
+    SgFunctionSymbol *init_spmd =
+        si::lookupFunctionSymbolInParentScopes("__PSInitSPMD",
+                                               global_scope_);
+    if (init_spmd) {
+      node->set_function(sb::buildFunctionRefExp(init_spmd));
+    } else {
+      LOG_WARNING() << "SPMD execution not supported by this target\n";
+    }
+  }
+
   si::appendStatement(
       si::copyStatement(getContainingStatement(node)),
       tmp_block);
@@ -18,6 +18,13 @@ class MPITranslator: public ReferenceTranslator {
   virtual void Translate();
  protected:
   bool flag_mpi_overlap_;
+  //! Run the host code in all processes (MPI_SPMD).
+  /*!
+    PSInit is translated to __PSInitSPMD, so that runtime calls are
+    executed in all processes without broadcasting them from the root
+    process.
+   */
+  bool flag_mpi_spmd_;
   virtual MPIRuntimeBuilder *builder() {
     return dynamic_cast<MPIRuntimeBuilder*>(rt_builder_);
   }
@@ -24,6 +24,10 @@ OpenCLTranslator::OpenCLTranslator(const Configuration &config):
   // TODO: Need check & implementation
 
   target_specific_macro_ = "PHYSIS_OPENCL";  
+  // Device offsets are computed separately
+  flag_constant_grid_offset_optimization_ = false;
+  flag_periodic_ghost_ = false;
+  flag_jit_specialization_ = false;
 
   const pu::LuaValue *lv;
 
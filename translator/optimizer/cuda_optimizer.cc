@@ -8,6 +8,9 @@ namespace translator {
 namespace optimizer {
 
 void CUDAOptimizer::DoStage1() {
+  if (config_->LookupFlag("OPT_GRID_LIVENESS")) {
+    pass::grid_liveness(proj_, tx_, builder_);
+  }
 }
 
 void CUDAOptimizer::DoStage2() {
@@ -29,6 +32,9 @@ void CUDAOptimizer::DoStage2() {
   if (config_->LookupFlag("OPT_OFFSET_SPATIAL_CSE")) {
     pass::offset_spatial_cse(proj_, tx_, builder_);
   }
+  if (config_->LookupFlag("OPT_STENCIL_FACTORING")) {
+    pass::stencil_factoring(proj_, tx_, builder_);
+  }
   if (config_->LookupFlag("OPT_LOOP_OPT")) {
     pass::loop_opt(proj_, tx_, builder_);
     pass::primitive_optimization(proj_, tx_, builder_);
@@ -0,0 +1,220 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "translator/optimizer/optimization_passes.h"
+#include "translator/optimizer/optimization_common.h"
+#include "translator/rose_util.h"
+#include "translator/physis_names.h"
+
+#include <algorithm>
+#include <set>
+
+namespace si = SageInterface;
+
+using std::set;
+using std::vector;
+
+namespace physis {
+namespace translator {
+namespace optimizer {
+namespace pass {
+
+static string GetCalleeName(SgFunctionCallExp *call) {
+  SgFunctionRefExp *fref = isSgFunctionRefExp(call->get_function());
+  return fref ? rose_util::getFuncName(fref) : "";
+}
+
+// Returns the parent of an expression skipping casts.
+static SgNode *GetParentWithoutCasts(SgExpression *exp) {
+  SgNode *parent = exp->get_parent();
+  while (isSgCastExp(parent)) parent = parent->get_parent();
+  return parent;
+}
+
+// Returns the call an expression is passed to, or NULL.
+static SgFunctionCallExp *GetCallOfArg(SgExpression *exp) {
+  SgNode *parent = GetParentWithoutCasts(exp);
+  if (!isSgExprListExp(parent)) return NULL;
+  return isSgFunctionCallExp(parent->get_parent());
+}
+
+// Returns true if var is a non-static variable declared in fdef.
+static bool IsLocalVariable(SgInitializedName *var,
+                            SgFunctionDefinition *fdef) {
+  SgVariableDeclaration *decl =
+      isSgVariableDeclaration(var->get_declaration());
+  if (decl == NULL) return false;
+  if (decl->get_declarationModifier().get_storageModifier().isStatic()) {
+    return false;
+  }
+  return si::getEnclosingFunctionDefinition(decl) == fdef;
+}
+
+// Returns the variable where the result of a stencil map call is
+// stored, or NULL if it is not simply stored.
+static SgInitializedName *GetMapDestination(SgFunctionCallExp *map) {
+  SgNode *parent = GetParentWithoutCasts(map);
+  if (isSgAssignInitializer(parent)) {
+    return isSgInitializedName(parent->get_parent());
+  }
+  SgAssignOp *asn = isSgAssignOp(parent);
+  if (asn && rose_util::removeCasts(asn->get_rhs_operand()) == map &&
+      isSgVarRefExp(asn->get_lhs_operand())) {
+    return isSgVarRefExp(asn->get_lhs_operand())->get_symbol()
+        ->get_declaration();
+  }
+  return NULL;
+}
+
+//! Checks a reference to a grid or a stencil holding grids.
+/*!
+  Grids can only be passed to the Physis API, including stencil maps,
+  or be assigned new grids. Stencils can only be run or be assigned
+  new maps. Other uses, such as copying to other variables and
+  passing to user functions, may make the grid live beyond the
+  references to the variable.
+
+  \param ref The reference to check.
+  \param tx The translation context.
+  \param aliases Variables of stencils mapped with the grid are added.
+  \return True if the grid is only accessed through the variable.
+ */
+static bool IsTrackableUse(SgVarRefExp *ref, TranslationContext *tx,
+                           vector<SgInitializedName*> &aliases) {
+  SgAssignOp *asn = isSgAssignOp(ref->get_parent());
+  if (asn && asn->get_lhs_operand() == ref) {
+    SgFunctionCallExp *rhs = isSgFunctionCallExp(
+        rose_util::removeCasts(asn->get_rhs_operand()));
+    return rhs && (tx->isNewCall(rhs) || tx->IsMap(rhs));
+  }
+  SgFunctionCallExp *call = GetCallOfArg(ref);
+  if (call == NULL) return false;
+  if (tx->IsMap(call)) {
+    // PSStencilRun(PSStencilMap(...))
+    SgFunctionCallExp *run = GetCallOfArg(call);
+    if (run && tx->isRun(run)) return true;
+    SgInitializedName *stencil = GetMapDestination(call);
+    if (stencil == NULL) return false;
+    aliases.push_back(stencil);
+    return true;
+  }
+  return tx->isRun(call) || Reduce::IsReduce(call) ||
+      startswith(GetCalleeName(call), PS_GRID_TYPE_NAME_PREFIX);
+}
+
+//! Collects the variables whose references keep a grid live.
+/*!
+  \param grid The grid variable.
+  \param fdef The function where the grid is declared.
+  \param tx The translation context.
+  \param vars The grid variable and stencil variables mapped with it.
+  \return False if the liveness of the grid cannot be determined.
+ */
+static bool CollectLiveVars(SgInitializedName *grid,
+                            SgFunctionDefinition *fdef,
+                            TranslationContext *tx,
+                            set<SgInitializedName*> &vars) {
+  vector<SgVarRefExp*> refs = si::querySubTree<SgVarRefExp>(fdef);
+  vector<SgInitializedName*> worklist(1, grid);
+  while (!worklist.empty()) {
+    SgInitializedName *var = worklist.back();
+    worklist.pop_back();
+    if (!vars.insert(var).second) continue;
+    if (!IsLocalVariable(var, fdef)) return false;
+    FOREACH (it, refs.begin(), refs.end()) {
+      if ((*it)->get_symbol()->get_declaration() != var) continue;
+      if (!IsTrackableUse(*it, tx, worklist)) {
+        LOG_DEBUG() << "Untracked use of " << var->get_name() << ": "
+                    << (*it)->get_parent()->unparseToString() << "\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Returns true if the grid may be live after stmt, or control may
+// not reach the statement following stmt.
+static bool IsLivenessBarrier(SgStatement *stmt,
+                              const set<SgInitializedName*> &vars) {
+  vector<SgInitializedName*> names =
+      si::querySubTree<SgInitializedName>(stmt);
+  FOREACH (it, names.begin(), names.end()) {
+    if (vars.count(*it)) return true;
+  }
+  vector<SgVarRefExp*> refs = si::querySubTree<SgVarRefExp>(stmt);
+  FOREACH (it, refs.begin(), refs.end()) {
+    if (vars.count((*it)->get_symbol()->get_declaration())) return true;
+  }
+  return !si::querySubTree<SgReturnStmt>(stmt).empty() ||
+      !si::querySubTree<SgBreakStmt>(stmt).empty() ||
+      !si::querySubTree<SgContinueStmt>(stmt).empty() ||
+      !si::querySubTree<SgGotoStatement>(stmt).empty() ||
+      !si::querySubTree<SgLabelStatement>(stmt).empty();
+}
+
+//! Moves a call to PSGridFree to right after the last use of the grid.
+/*!
+  \return True if moved.
+ */
+static bool HoistGridFree(SgFunctionCallExp *free_call, SgVarRefExp *grid,
+                          TranslationContext *tx) {
+  SgExprStatement *free_stmt = isSgExprStatement(free_call->get_parent());
+  if (free_stmt == NULL) return false;
+  SgBasicBlock *block = isSgBasicBlock(free_stmt->get_parent());
+  if (block == NULL) return false;
+  SgFunctionDefinition *fdef = si::getEnclosingFunctionDefinition(block);
+  set<SgInitializedName*> vars;
+  if (fdef == NULL ||
+      !CollectLiveVars(grid->get_symbol()->get_declaration(), fdef,
+                       tx, vars)) {
+    return false;
+  }
+  SgStatementPtrList &stmts = block->get_statements();
+  SgStatementPtrList::iterator free_it =
+      std::find(stmts.begin(), stmts.end(), free_stmt);
+  PSAssert(free_it != stmts.end());
+  SgStatementPtrList::iterator it = free_it;
+  while (it != stmts.begin()) {
+    --it;
+    if (IsLivenessBarrier(*it, vars)) {
+      ++it;
+      break;
+    }
+  }
+  if (it == free_it) return false;
+  LOG_DEBUG() << "Freeing " << grid->unparseToString()
+              << " right after its last use\n";
+  SgStatement *next = *it;
+  si::removeStatement(free_stmt);
+  si::insertStatementBefore(next, free_stmt);
+  return true;
+}
+
+void grid_liveness(
+    SgProject *proj,
+    TranslationContext *tx,
+    BuilderInterface *builder) {
+  pre_process(proj, tx, __FUNCTION__);
+
+  if (!rose_util::IsCLikeLanguage()) {
+    LOG_DEBUG() << "Grid liveness analysis not supported for this target\n";
+    return;
+  }
+
+  vector<SgFunctionCallExp*> calls =
+      si::querySubTree<SgFunctionCallExp>(proj);
+  int num_moved = 0;
+  FOREACH (it, calls.begin(), calls.end()) {
+    SgVarRefExp *grid = tx->IsFree(*it);
+    if (grid == NULL) continue;
+    if (HoistGridFree(*it, grid, tx)) ++num_moved;
+  }
+  LOG_DEBUG() << num_moved << " grid(s) freed earlier\n";
+
+  post_process(proj, tx, __FUNCTION__);
+}
+
+} // namespace pass
+} // namespace optimizer
+} // namespace translator
+} // namespace physis
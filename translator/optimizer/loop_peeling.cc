@@ -18,60 +18,273 @@ namespace optimizer {
 namespace pass {
 
 
-static void RemoveDeadConditional(SgForStatement *loop,
-                                  int dim, int peel_size_first,
-                                  int peel_size_last,
-                                  RunKernelLoopAttribute::Kind type);
+//! Linear form of an index expression.
+/*!
+  Represents var * i + size * N + constant, where i is a loop
+  variable and N is the size of a grid along the loop dimension.
+ */
+struct LinearForm {
+  long var;
+  long size;
+  //! Grid of N; empty if size is zero
+  string grid;
+  long constant;
+  LinearForm(): var(0), size(0), constant(0) {}
+};
+
+// Limit of variable definitions followed in the analysis
+static const int MAX_DEFINITION_DEPTH = 8;
+
+//! Returns a string identifying a grid variable.
+/*!
+  Grid variables are followed to their definitions, e.g., a local
+  copy of the grid field of the stencil.
+ */
+static string GetGridKey(SgExpression *grid, int depth=0);
+
+static string GetGridKey(SgInitializedName *grid, int depth=0) {
+  SgExpression *def = depth < MAX_DEFINITION_DEPTH ?
+      GetDeterministicDefinition(grid) : NULL;
+  if (def) return GetGridKey(def, depth + 1);
+  return grid->get_name().getString();
+}
+
+static string GetGridKey(SgExpression *grid, int depth) {
+  SgVarRefExp *vref = isSgVarRefExp(grid);
+  if (vref) {
+    return GetGridKey(vref->get_symbol()->get_declaration(), depth);
+  }
+  return grid->unparseToString();
+}
+
+static bool AddLinearForm(LinearForm &x, const LinearForm &y, long sign) {
+  if (x.size != 0 && y.size != 0 && x.grid != y.grid) return false;
+  x.var += sign * y.var;
+  x.size += sign * y.size;
+  if (y.size != 0) x.grid = y.grid;
+  x.constant += sign * y.constant;
+  if (x.size == 0) x.grid.clear();
+  return true;
+}
+
+//! Analyzes an expression as a linear form of a loop variable.
+/*!
+  Only integer constants, the loop variable, PSGridDim of the loop
+  dimension, variables with a single definition, and additive
+  operators and multiplications by constants are allowed.
+
+  \param e The expression to analyze.
+  \param loop_var The loop variable.
+  \param dim The loop dimension.
+  \param lf The linear form of the expression on return.
+  \return True if the expression is a linear form.
+ */
+static bool AnalyzeLinearForm(SgExpression *e, SgInitializedName *loop_var,
+                              int dim, LinearForm &lf, int depth=0) {
+  lf = LinearForm();
+  if (depth > MAX_DEFINITION_DEPTH) return false;
+  if (isSgValueExp(e)) {
+    if (!si::isStrictIntegerType(e->get_type())) return false;
+    lf.constant = si::getIntegerConstantValue(isSgValueExp(e));
+    return true;
+  } else if (isSgVarRefExp(e)) {
+    SgInitializedName *var =
+        isSgVarRefExp(e)->get_symbol()->get_declaration();
+    if (var == loop_var) {
+      lf.var = 1;
+      return true;
+    }
+    SgExpression *def = GetDeterministicDefinition(var);
+    return def && AnalyzeLinearForm(def, loop_var, dim, lf, depth + 1);
+  } else if (isSgCastExp(e)) {
+    if (!si::isStrictIntegerType(e->get_type())) return false;
+    return AnalyzeLinearForm(isSgCastExp(e)->get_operand(), loop_var,
+                             dim, lf, depth);
+  } else if (isSgUnaryAddOp(e)) {
+    return AnalyzeLinearForm(isSgUnaryAddOp(e)->get_operand(), loop_var,
+                             dim, lf, depth);
+  } else if (isSgMinusOp(e)) {
+    LinearForm x;
+    if (!AnalyzeLinearForm(isSgMinusOp(e)->get_operand(), loop_var,
+                           dim, x, depth)) {
+      return false;
+    }
+    return AddLinearForm(lf, x, -1);
+  } else if (isSgAddOp(e) || isSgSubtractOp(e) || isSgMultiplyOp(e)) {
+    SgBinaryOp *bop = isSgBinaryOp(e);
+    LinearForm x, y;
+    if (!AnalyzeLinearForm(bop->get_lhs_operand(), loop_var, dim, x,
+                           depth) ||
+        !AnalyzeLinearForm(bop->get_rhs_operand(), loop_var, dim, y,
+                           depth)) {
+      return false;
+    }
+    if (isSgMultiplyOp(e)) {
+      // Either side must be a constant
+      if (x.var == 0 && x.size == 0) std::swap(x, y);
+      if (y.var != 0 || y.size != 0) return false;
+      lf = x;
+      lf.var *= y.constant;
+      lf.size *= y.constant;
+      lf.constant *= y.constant;
+      if (lf.size == 0) lf.grid.clear();
+      return true;
+    }
+    lf = x;
+    return AddLinearForm(lf, y, isSgAddOp(e) ? 1 : -1);
+  } else if (isSgFunctionCallExp(e)) {
+    SgFunctionCallExp *call = isSgFunctionCallExp(e);
+    if (rose_util::getFuncName(call) != PS_GRID_DIM_NAME) return false;
+    const SgExpressionPtrList &args = call->get_args()->get_expressions();
+    if (args.size() != 2 || !isSgValueExp(args[1]) ||
+        si::getIntegerConstantValue(isSgValueExp(args[1])) != dim - 1) {
+      return false;
+    }
+    lf.size = 1;
+    lf.grid = GetGridKey(args[0]);
+    return true;
+  }
+  return false;
+}
+
+//! Comparison of a loop variable with a bound.
+struct LoopGuard {
+  //! V_SgEqualityOp, V_SgNotEqualOp, V_SgLessThanOp, V_SgLessOrEqualOp,
+  //! V_SgGreaterThanOp, or V_SgGreaterOrEqualOp
+  VariantT op;
+  //! The bound, whose var is zero
+  LinearForm bound;
+};
+
+//! Analyzes a comparison as a guard on a loop variable.
+/*!
+  \param e A comparison expression.
+  \param loop_var The loop variable.
+  \param dim The loop dimension.
+  \param guard The comparison normalized as "loop_var op bound" on
+  return.
+  \return True if the expression is a guard on the loop variable.
+ */
+static bool AnalyzeLoopGuard(SgExpression *e, SgInitializedName *loop_var,
+                             int dim, LoopGuard &guard) {
+  if (!(isSgEqualityOp(e) || isSgNotEqualOp(e) || isSgLessThanOp(e) ||
+        isSgLessOrEqualOp(e) || isSgGreaterThanOp(e) ||
+        isSgGreaterOrEqualOp(e))) {
+    return false;
+  }
+  SgBinaryOp *bop = isSgBinaryOp(e);
+  LinearForm lhs, rhs;
+  if (!AnalyzeLinearForm(bop->get_lhs_operand(), loop_var, dim, lhs) ||
+      !AnalyzeLinearForm(bop->get_rhs_operand(), loop_var, dim, rhs)) {
+    return false;
+  }
+  // lhs - rhs op 0
+  if (!AddLinearForm(lhs, rhs, -1)) return false;
+  VariantT op = e->variantT();
+  if (lhs.var == -1) {
+    // Flip the sides
+    LinearForm zero;
+    AddLinearForm(zero, lhs, -1);
+    lhs = zero;
+    if (op == V_SgLessThanOp) op = V_SgGreaterThanOp;
+    else if (op == V_SgLessOrEqualOp) op = V_SgGreaterOrEqualOp;
+    else if (op == V_SgGreaterThanOp) op = V_SgLessThanOp;
+    else if (op == V_SgGreaterOrEqualOp) op = V_SgLessOrEqualOp;
+  }
+  if (lhs.var != 1) return false;
+  // loop_var op -(size * N + constant)
+  guard.op = op;
+  guard.bound = LinearForm();
+  lhs.var = 0;
+  AddLinearForm(guard.bound, lhs, -1);
+  LOG_DEBUG() << "Guard found: " << e->unparseToString() << "\n";
+  return true;
+}
+
+//! Returns true if an expression contains a guard on a loop variable.
+static bool HasLoopGuard(SgExpression *e, SgInitializedName *loop_var,
+                         int dim) {
+  if (e == NULL) return false;
+  vector<SgExpression*> exprs = si::querySubTree<SgExpression>(e);
+  FOREACH (it, exprs.begin(), exprs.end()) {
+    LoopGuard guard;
+    if (AnalyzeLoopGuard(*it, loop_var, dim, guard)) return true;
+  }
+  return false;
+}
+
+static SgExpression *GetCondition(SgStatement *stmt) {
+  SgExprStatement *es = isSgExprStatement(stmt);
+  return es ? es->get_expression() : NULL;
+}
+
+// Gets in a condition itself are not guarded by the condition
+static bool IsInCondition(SgExpression *cond, const SgExpression *get_exp) {
+  return si::isAncestor(cond, const_cast<SgExpression*>(get_exp));
+}
 
-//! Return true if a given get MAY be guarded by a conditional node.
+//! Return true if a given get may be guarded by a conditional node.
 /*!
-  This is a conservative analysis. It is SAFE to always return true.
+  A conditional is considered to guard the get if it compares the
+  loop variable with a bound that can be statically evaluated in
+  the peeled iterations. Returning false only makes peeling less
+  aggressive.
   
   \param get_exp A GridGet expression.
   \param if_stmt An if node that is a parent of the get expression.
+  \param loop_var The loop variable.
   \param dim The dimension with off-region access.
   \return true if the conditional node may guard the get.
  */
 static bool MayGuardGridAccess(const SgExpression *get_exp,
                                const SgIfStmt *if_stmt,
+                               SgInitializedName *loop_var,
                                int dim) {
-  return true;
+  SgExpression *cond = GetCondition(if_stmt->get_conditional());
+  if (cond == NULL || IsInCondition(cond, get_exp)) return false;
+  return HasLoopGuard(cond, loop_var, dim);
 }
 
-//! Return true if a given get MAY be guarded by a conditional node.
+//! Return true if a given get may be guarded by a conditional node.
 /*!
-  This is a conservative analysis. It is SAFE to always return true.
-  
   \param get_exp A GridGet expression.
   \param cond_exp A conditional expression that is a parent of the
   get. 
+  \param loop_var The loop variable.
   \param dim The dimension with off-region access.
   \return true if the conditional node may guard the get.
  */
 static bool MayGuardGridAccess(const SgExpression *get_exp,
                                const SgConditionalExp *cond_exp,
+                               SgInitializedName *loop_var,
                                int dim) {
-  return true;
+  SgExpression *cond = cond_exp->get_conditional_exp();
+  if (IsInCondition(cond, get_exp)) return false;
+  return HasLoopGuard(cond, loop_var, dim);
 }
 
-//! Return true if a given get MAY be guarded by a conditional node.
+//! Return true if a given get may be guarded by a conditional node.
 /*!
-  This is a conservative analysis. It is SAFE to always return true.
-  
+  Switch statements are not simplified in the peeled iterations, so
+  peeling is not profitable for gets guarded by them.
+
   \param get_exp A GridGet expression.
   \param switch_stmt A switch statment that is a parent of the get. 
+  \param loop_var The loop variable.
   \param dim The dimension with off-region access.
   \return true if the conditional node may guard the get.
  */
 static bool MayGuardGridAccess(const SgExpression *get_exp,
                                const SgSwitchStatement *switch_stmt,
+                               SgInitializedName *loop_var,
                                int dim) {
-  return true;
+  return false;
 }
 
 static int FindProfitablePeelSize(const SgExpression *grid_get,
                                   const StencilIndexList &index_list,
                                   int loop_dim,
+                                  SgInitializedName *loop_var,
                                   SgStatement *loop_body) {
   if (!StencilIndexRegularOrder(index_list)) return 0;
   ssize_t offset = index_list[loop_dim-1].offset;
@@ -90,13 +303,14 @@ static int FindProfitablePeelSize(const SgExpression *grid_get,
     while (parent != loop_body) {
       PSAssert(parent);
       if ((isSgIfStmt(parent) &&
-           MayGuardGridAccess(grid_get, isSgIfStmt(parent), loop_dim)) ||
+           MayGuardGridAccess(grid_get, isSgIfStmt(parent), loop_var,
+                              loop_dim)) ||
           (isSgConditionalExp(parent) &&
            MayGuardGridAccess(grid_get, isSgConditionalExp(parent),
-                              loop_dim)) ||
+                              loop_var, loop_dim)) ||
           (isSgSwitchStatement(parent) &&
            MayGuardGridAccess(grid_get, isSgSwitchStatement(parent),
-                              loop_dim))) {
+                              loop_var, loop_dim))) {
         LOG_DEBUG() << "Profitable access found: "
                     << grid_get->unparseToString() << "\n";
         return offset;
@@ -248,6 +462,220 @@ static SgForStatement* PeelLastIterations(SgForStatement *loop,
   return peeled_iterations;
 }
 
+//! Range of a loop variable in peeled or main iterations.
+struct LoopRange {
+  LinearForm min;
+  bool has_max;
+  LinearForm max;
+  //! Grid whose size the bounds are relative to
+  string peel_grid;
+  //! Minimum size of the peel grid if the iterations are not empty
+  long min_size;
+};
+
+//! Returns the range of a loop variable.
+/*!
+  The first iterations are within [0, peel_size_first), the last
+  ones within [N - peel_size_last, N), and the main ones between
+  them, where N is the size of the peel grid. Grids are assumed to
+  contain the domain.
+ */
+static LoopRange GetLoopRange(RunKernelLoopAttribute::Kind kind,
+                              int peel_size_first, int peel_size_last,
+                              const string &peel_grid) {
+  LoopRange r;
+  r.has_max = true;
+  r.peel_grid = peel_grid;
+  r.min_size = 1;
+  LinearForm end;
+  end.size = 1;
+  end.grid = peel_grid;
+  switch (kind) {
+    case RunKernelLoopAttribute::FIRST:
+      r.max.constant = peel_size_first - 1;
+      break;
+    case RunKernelLoopAttribute::MAIN:
+      r.min.constant = peel_size_first;
+      r.has_max = peel_size_last > 0;
+      r.max = end;
+      r.max.constant = -peel_size_last - 1;
+      r.min_size = peel_size_first + peel_size_last + 1;
+      break;
+    case RunKernelLoopAttribute::LAST:
+      r.min = end;
+      r.min.constant = -peel_size_last;
+      r.max = end;
+      r.max.constant = -1;
+      r.min_size = peel_size_first + 1;
+      break;
+  }
+  return r;
+}
+
+//! Sign of the difference of two bounds.
+/*!
+  \return -1 if x < y, 0 if x == y, and 1 if x > y for all grid
+  sizes allowed in a range; 2 if not known.
+ */
+static int CompareBounds(const LinearForm &x, const LinearForm &y,
+                         const LoopRange &r) {
+  LinearForm d = x;
+  if (!AddLinearForm(d, y, -1)) return 2;
+  if (d.size == 0) return d.constant < 0 ? -1 : d.constant > 0 ? 1 : 0;
+  long min_size = d.grid == r.peel_grid ? r.min_size : 0;
+  // The difference is bounded only on one side
+  long limit = d.size * min_size + d.constant;
+  if (d.size > 0 && limit > 0) return 1;
+  if (d.size < 0 && limit < 0) return -1;
+  return 2;
+}
+
+//! Evaluates a guard statically in a range of the loop variable.
+/*!
+  \return 1 if the guard always holds, 0 if it never holds, and -1
+  if not known.
+ */
+static int EvaluateLoopGuard(const LoopGuard &guard, const LoopRange &r) {
+  int lo = CompareBounds(r.min, guard.bound, r);
+  int hi = r.has_max ? CompareBounds(r.max, guard.bound, r) : 2;
+  switch (guard.op) {
+    case V_SgEqualityOp:
+    case V_SgNotEqualOp: {
+      int eq = -1;
+      if (lo == 0 && hi == 0) eq = 1;
+      else if (lo == 1 || hi == -1) eq = 0;
+      if (eq < 0) return -1;
+      return guard.op == V_SgEqualityOp ? eq : !eq;
+    }
+    case V_SgLessThanOp:
+      if (hi == -1) return 1;
+      if (lo == 0 || lo == 1) return 0;
+      return -1;
+    case V_SgLessOrEqualOp:
+      if (hi == -1 || hi == 0) return 1;
+      if (lo == 1) return 0;
+      return -1;
+    case V_SgGreaterThanOp:
+      if (lo == 1) return 1;
+      if (hi == -1 || hi == 0) return 0;
+      return -1;
+    case V_SgGreaterOrEqualOp:
+      if (lo == 0 || lo == 1) return 1;
+      if (hi == -1) return 0;
+      return -1;
+    default:
+      return -1;
+  }
+}
+
+static bool HasSideEffect(SgExpression *e) {
+  return si::querySubTree<SgFunctionCallExp>(e).size() > 0 ||
+      si::querySubTree<SgAssignOp>(e).size() > 0 ||
+      si::querySubTree<SgCompoundAssignOp>(e).size() > 0 ||
+      si::querySubTree<SgPlusPlusOp>(e).size() > 0 ||
+      si::querySubTree<SgMinusMinusOp>(e).size() > 0;
+}
+
+static bool IsBooleanExp(SgExpression *e) {
+  return isSgEqualityOp(e) || isSgNotEqualOp(e) || isSgLessThanOp(e) ||
+      isSgLessOrEqualOp(e) || isSgGreaterThanOp(e) ||
+      isSgGreaterOrEqualOp(e) || isSgAndOp(e) || isSgOrOp(e) ||
+      isSgNotOp(e);
+}
+
+//! Replaces a guard with its value and folds the enclosing conditions.
+static void ReplaceLoopGuard(SgExpression *guard, int value) {
+  SgExpression *e = sb::buildIntVal(value);
+  si::replaceExpression(guard, e);
+  while (true) {
+    SgNode *parent = e->get_parent();
+    SgExpression *folded = NULL;
+    if (isSgNotOp(parent)) {
+      folded = sb::buildIntVal(!value);
+    } else if (isSgAndOp(parent) || isSgOrOp(parent)) {
+      SgBinaryOp *bop = isSgBinaryOp(parent);
+      bool is_lhs = bop->get_lhs_operand() == e;
+      SgExpression *other =
+          is_lhs ? bop->get_rhs_operand() : bop->get_lhs_operand();
+      // The value that determines the result by itself
+      int dominant = isSgAndOp(parent) ? 0 : 1;
+      if (value != dominant) {
+        if (IsBooleanExp(other) || isSgIntVal(other)) {
+          folded = si::copyExpression(other);
+        }
+      } else if (is_lhs || !HasSideEffect(other)) {
+        folded = sb::buildIntVal(value);
+      }
+    } else if (isSgConditionalExp(parent) &&
+               isSgConditionalExp(parent)->get_conditional_exp() == e) {
+      SgConditionalExp *ce = isSgConditionalExp(parent);
+      folded = si::copyExpression(
+          value ? ce->get_true_exp() : ce->get_false_exp());
+    } else if (isSgExprStatement(parent)) {
+      SgIfStmt *if_stmt = isSgIfStmt(parent->get_parent());
+      if (if_stmt && if_stmt->get_conditional() == parent) {
+        SgStatement *body = value ?
+            if_stmt->get_true_body() : if_stmt->get_false_body();
+        si::replaceStatement(
+            if_stmt,
+            body ? si::copyStatement(body) : sb::buildBasicBlock(),
+            true);
+      }
+      return;
+    }
+    if (folded == NULL) return;
+    si::replaceExpression(isSgExpression(parent), folded);
+    if (!isSgIntVal(folded)) return;
+    e = folded;
+    value = isSgIntVal(folded)->get_value() != 0;
+  }
+}
+
+//! Removes conditionals statically evaluated in peeled iterations.
+/*!
+  \param loop The main or peeled loop.
+  \param dim The loop dimension.
+  \param peel_size_first The number of peeled first iterations.
+  \param peel_size_last The number of peeled last iterations.
+  \param peel_grid The grid whose size the last iterations are
+  relative to.
+  \param kind The kind of iterations of the loop.
+ */
+static void RemoveDeadConditional(SgForStatement *loop,
+                                  int dim,
+                                  int peel_size_first,
+                                  int peel_size_last,
+                                  const string &peel_grid,
+                                  RunKernelLoopAttribute::Kind kind) {
+  SgInitializedName *loop_var =
+      KernelLoopAnalysis::GetLoopVar(loop)->get_symbol()->get_declaration();
+  LoopRange range = GetLoopRange(kind, peel_size_first, peel_size_last,
+                                 peel_grid);
+  // Guards are replaced one at a time since replacing a conditional
+  // statement copies its branches
+  while (true) {
+    vector<SgExpression*> exprs =
+        si::querySubTree<SgExpression>(loop->get_loop_body());
+    SgExpression *target = NULL;
+    int value = -1;
+    FOREACH (it, exprs.begin(), exprs.end()) {
+      LoopGuard guard;
+      if (!AnalyzeLoopGuard(*it, loop_var, dim, guard)) continue;
+      value = EvaluateLoopGuard(guard, range);
+      if (value >= 0) {
+        target = *it;
+        break;
+      }
+      LOG_DEBUG() << "Static evaluation not possible: "
+                  << (*it)->unparseToString() << "\n";
+    }
+    if (target == NULL) break;
+    LOG_DEBUG() << "Replacing " << target->unparseToString()
+                << " with " << value << "\n";
+    ReplaceLoopGuard(target, value);
+  }
+}
+
 static void PeelLoop(
     SgFunctionDeclaration *run_kernel_func,
     SgForStatement *loop,
@@ -256,6 +684,8 @@ static void PeelLoop(
       rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop);
   int dim = loop_attr->dim();
   SgStatement *loop_body = loop->get_loop_body();
+  SgInitializedName *loop_var =
+      KernelLoopAnalysis::GetLoopVar(loop)->get_symbol()->get_declaration();
   std::vector<SgNode*> grid_gets =
       rose_util::QuerySubTreeAttribute<GridGetAttribute>(loop);
   int peel_size_first = 0;
@@ -267,7 +697,7 @@ static void PeelLoop(
         rose_util::GetASTAttribute<GridGetAttribute>(grid_get);
     const StencilIndexList &sil =
         *grid_get_attr->GetStencilIndexList();
-    int peel_size = FindProfitablePeelSize(grid_get, sil, dim,
+    int peel_size = FindProfitablePeelSize(grid_get, sil, dim, loop_var,
                                            loop_body);
     if (peel_size == 0) continue;
     // Find target peel size for first iterations
@@ -293,12 +723,12 @@ static void PeelLoop(
       }
     }
   }
+  string peel_grid = peel_last_grid ? GetGridKey(peel_last_grid) : "";
   if (peel_size_first > 0) {
     SgForStatement *peeled_loop = PeelFirstIterations(loop, peel_size_first);
     RemoveDeadConditional(
-        peeled_loop,
-        rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->dim(),
-        peel_size_first, peel_size_last, RunKernelLoopAttribute::FIRST);
+        peeled_loop, dim, peel_size_first, peel_size_last, peel_grid,
+        RunKernelLoopAttribute::FIRST);
   } else {
     LOG_DEBUG() << "No profitable iteration found at the loop beginning.\n";
   }
@@ -306,296 +736,16 @@ static void PeelLoop(
     SgForStatement *peeled_loop = PeelLastIterations(loop, peel_size_last,
                                                      peel_last_grid, builder);
     RemoveDeadConditional(
-        peeled_loop,
-        rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->dim(),
-        peel_size_first, peel_size_last, RunKernelLoopAttribute::LAST);
-    
+        peeled_loop, dim, peel_size_first, peel_size_last, peel_grid,
+        RunKernelLoopAttribute::LAST);
   } else {
     LOG_DEBUG() << "No profitable iteration found at the loop end.\n";
   }
 
   if (peel_size_first > 0 || peel_size_last > 0) {
     RemoveDeadConditional(
-        loop,
-        rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->dim(),
-        peel_size_first, peel_size_last, RunKernelLoopAttribute::MAIN);
-  }
-  
-}
-
-// Return 0 on success
-static int FindExresssionReferencingLoopVar(SgBinaryOp *bop,
-                                            SgInitializedName *loop_var,
-                                            SgExpression *&v_expr,
-                                            SgExpression *&c_expr) {
-  SgExpression *lhs = bop->get_lhs_operand();
-  SgExpression *rhs = bop->get_rhs_operand();  
-  vector<SgVarRefExp*> vrefs = si::querySubTree<SgVarRefExp>(lhs);
-  bool ref = false;
-  FOREACH (it, vrefs.begin(), vrefs.end()) {
-    if ((*it)->get_symbol()->get_declaration() == loop_var) {
-      v_expr = lhs;
-      c_expr = rhs;
-      return 0;
-    }
-  }
-  vrefs = si::querySubTree<SgVarRefExp>(rhs);
-  ref = false;
-  FOREACH (it, vrefs.begin(), vrefs.end()) {
-    if ((*it)->get_symbol()->get_declaration() == loop_var) {
-      v_expr = rhs;
-      c_expr = lhs;
-      return 0;
-    }
-  }
-
-  LOG_DEBUG() << "No reference to " << loop_var->unparseToString() <<
-      " found in " << bop->unparseToString() << "\n";
-  return -1;
-}
-
-static bool IsRefToVar(SgVarRefExp *vref, SgInitializedName *var) {
-  return vref->get_symbol()->get_declaration() == var;
-}
-
-static SgBinaryOp *FlipComparatorOp(SgBinaryOp *bop) {
-  SgBinaryOp *flipped_op = NULL;
-  SgExpression *lhs = si::copyExpression(bop->get_lhs_operand());
-  SgExpression *rhs = si::copyExpression(bop->get_rhs_operand());
-  if (isSgGreaterThanOp(bop)) {
-    flipped_op = sb::buildLessOrEqualOp(lhs, rhs);
-  } else if (isSgGreaterOrEqualOp(bop)) {
-    flipped_op = sb::buildLessThanOp(lhs, rhs);
-  } else if (isSgLessThanOp(bop)) {
-    flipped_op = sb::buildGreaterOrEqualOp(lhs, rhs);
-  } else if (isSgLessOrEqualOp(bop)) {
-    flipped_op = sb::buildGreaterThanOp(lhs, rhs);
-  }
-  LOG_DEBUG() << bop->unparseToString() << " flipped to "
-              << flipped_op->unparseToString() << "\n";
-  return flipped_op;
-}
-
-static SgExpression *BuildTrue() {
-  return sb::buildIntVal(1);
-}
-
-static SgExpression *BuildFalse() {
-  return sb::buildIntVal(0);
-}
-
-//! Return true if expression is like "PSGridDim() - i", where i is
-//! integer constant.
-static int InvolveGridSize(SgExpression *exp, int dim) {
-  SgSubtractOp *sop = isSgSubtractOp(exp);
-  if (!sop) return -1;
-  SgFunctionCallExp *lhs = isSgFunctionCallExp(sop->get_lhs_operand());
-  SgValueExp *rhs = isSgValueExp(sop->get_rhs_operand());
-  if (lhs == NULL || rhs == NULL) return -1;
-  if (!si::isStrictIntegerType(rhs->get_type())) return -1;
-  string func_name = rose_util::getFuncName(lhs);
-  if (func_name != "PSGridDim") return -1;
-  SgValueExp *dim_arg =
-      isSgValueExp(lhs->get_args()->get_expressions()[1]);
-  PSAssert(dim_arg);
-  //LOG_DEBUG() << "Dim arg: " << dim_arg->unparseToString() << "\n";
-  if ((int)si::getIntegerConstantValue(dim_arg) != dim-1) return -1;
-  return si::getIntegerConstantValue(rhs);
-}
-
-static int Evaluate(SgBinaryOp *op,
-                    SgExpression *rhs,
-                    int peel_size_first, int peel_size_last,
-                    RunKernelLoopAttribute::Kind kind,
-                    int dim) {
-  int minus_offset = InvolveGridSize(rhs, dim);
-  if (minus_offset > 0) {
-    if (isSgEqualityOp(op)) {
-      switch (kind) {
-        case RunKernelLoopAttribute::FIRST:
-        case RunKernelLoopAttribute::MAIN:
-          if (minus_offset <= peel_size_last) {
-            return 0;
-          } else {
-            return -1;
-          }
-        case RunKernelLoopAttribute::LAST:
-          if (minus_offset > peel_size_last) {
-            return 0;
-          } else {
-            return -1;
-          }
-      }
-    }
-  } else if (isSgValueExp(rhs)) {
-    int val = si::getIntegerConstantValue(isSgValueExp(rhs));
-    if (isSgEqualityOp(op)) {
-      switch (kind) {
-        case RunKernelLoopAttribute::FIRST:
-          if (val < peel_size_first) {
-            return -1;
-          } else {
-            return 0;
-          }
-        case RunKernelLoopAttribute::MAIN:
-        case RunKernelLoopAttribute::LAST:
-          if (val < peel_size_first) {
-            return 0;
-          }
-          return -1;
-      }
-    }
-  }
-
-  
-  LOG_DEBUG() << "No static evaluation done for "
-              << rhs->unparseToString() << "\n";
-  return -1;    
-}
-
-static SgIfStmt *IsIfConditional(SgExpression *expr) {
-  SgExprStatement *cond = isSgExprStatement(expr->get_parent());
-  if (!cond) return false;
-  SgIfStmt *if_stmt = isSgIfStmt(cond->get_parent());
-  if (!if_stmt) return false;
-  if (if_stmt->get_conditional() == cond) {
-    return if_stmt;
-  } else {
-    return NULL;
-  }
-}
-
-static void RemoveDeadConditional(SgForStatement *loop,
-                                  int dim,
-                                  int peel_size_first,
-                                  int peel_size_last,
-                                  RunKernelLoopAttribute::Kind kind) {
-  vector<SgBinaryOp*> bin_ops = si::querySubTree<SgBinaryOp>(loop);
-  SgInitializedName *loop_var =
-      KernelLoopAnalysis::GetLoopVar(loop)->get_symbol()->get_declaration();
-  FOREACH (it, bin_ops.begin(), bin_ops.end()) {
-    SgBinaryOp *bin_op = isSgBinaryOp(si::copyExpression(*it));
-    if (!(isSgEqualityOp(bin_op))) continue;
-    LOG_DEBUG() << "Optimizing " << bin_op->unparseToString() << "?\n";    
-    vector<SgExpression*> nested_exprs = si::querySubTree<SgExpression>(bin_op);
-    SgVarRefExp *loop_var_ref = NULL;
-    bool safe_to_opt = true;
-    FOREACH (nested_exprs_it, nested_exprs.begin(), nested_exprs.end()) {
-      SgExpression *nested_expr = *nested_exprs_it;
-      if (nested_expr == bin_op) continue;
-      if (isSgVarRefExp(nested_expr)) {
-        SgVarRefExp *vref = isSgVarRefExp(nested_expr);
-        if (!IsRefToVar(isSgVarRefExp(nested_expr), loop_var)) {
-          // non loop var ref found; assumes non safe conditional
-          LOG_DEBUG() << "Non loop var found\n";
-          SgExpression *vdef =
-              GetDeterministicDefinition(vref->get_symbol()->get_declaration());
-          if (vdef) {
-            LOG_DEBUG() << "Deterministic def found\n";
-            si::replaceExpression(vref, si::copyExpression(vdef));
-          } else {
-            safe_to_opt = false;            
-            break;
-          }
-        } else {
-          if (loop_var_ref) {
-            // multiple references to loop var found; not assumed;
-            LOG_DEBUG() << "multiple var ref found\n";
-            safe_to_opt = false;
-            break;
-          } else {
-            loop_var_ref = isSgVarRefExp(nested_expr);
-          }
-        }
-      } else if (isSgValueExp(nested_expr) ||
-                 isSgAddOp(nested_expr) || isSgSubtractOp(nested_expr) ||
-                 isSgUnaryAddOp(nested_expr)) {
-        LOG_DEBUG() << "Valid expression: " <<
-            nested_expr->unparseToString() << "\n";
-        continue;
-      } else {
-        // not assumed expression
-        LOG_DEBUG() << "Having " << nested_expr->unparseToString()
-                    << " not assumed.\n";
-        break;
-      }
-    }
-    if (!safe_to_opt) {
-      LOG_DEBUG() << "Not possible to optimize\n";
-      continue;
-    }
-    // If no ref found, removing not possible
-    if (!loop_var_ref) {
-      LOG_DEBUG() << "No ref to loop var found; not possible to optimize\n";
-      continue;
-    }
-    SgExpression *v_expr = NULL, *c_expr = NULL;
-    PSAssert(FindExresssionReferencingLoopVar(bin_op, loop_var,
-                                              v_expr, c_expr) == 0);
-    LOG_DEBUG() << "v_expr: " << v_expr->unparseToString()
-                << ", c_expr: " << c_expr->unparseToString() << "\n";
-
-    //v_expr = si::copyExpression(v_expr);
-    //c_expr = si::copyExpression(c_expr);
-    SgBinaryOp *top_expr = bin_op;
-    // Move the terms other than loop var ref to RHS
-    while (true) {
-      if (isSgVarRefExp(v_expr) &&
-          IsRefToVar(isSgVarRefExp(v_expr), loop_var)) {
-        break;
-      } else if (isSgBinaryOp(v_expr)) {
-        SgExpression *v_expr_child = NULL;
-        SgExpression *c_expr_child = NULL;
-        PSAssert(FindExresssionReferencingLoopVar(isSgBinaryOp(v_expr), loop_var,
-                                                  v_expr_child, c_expr_child) == 0);
-        if (isSgAddOp(v_expr)) {
-          c_expr = sb::buildSubtractOp(c_expr, si::copyExpression(c_expr_child));
-        } else {
-          // subtract
-          if (v_expr_child == isSgSubtractOp(v_expr)->get_lhs_operand()) {
-            c_expr = sb::buildAddOp(c_expr, si::copyExpression(c_expr_child));
-          } else {
-            c_expr = sb::buildSubtractOp(c_expr, si::copyExpression(c_expr_child));
-            top_expr = FlipComparatorOp(top_expr);
-          }
-        }
-        v_expr = v_expr_child;
-      } else if (isSgUnaryAddOp(v_expr)) {
-        LOG_DEBUG() << "UnaryAdd: " << v_expr->unparseToString() << "\n";
-        v_expr = isSgUnaryAddOp(v_expr)->get_operand();
-        continue;
-      } else {
-        LOG_ERROR() << "Invalid AST node: " << v_expr->unparseToString() << "\n";
-        PSAbort(1);
-      }
-    }
-    si::constantFolding(c_expr);
-    LOG_DEBUG() << "RHS: " << c_expr->unparseToString() << "\n";
-    LOG_DEBUG() << "OPERATOR: " << top_expr->unparseToString() << "\n";
-    int evaluated_result = Evaluate(top_expr, c_expr,
-                                    peel_size_first, peel_size_last,
-                                    kind, dim);
-    if (evaluated_result >= 0) {
-      LOG_DEBUG() << "Static evaluation done: " << evaluated_result << "\n";
-      LOG_DEBUG() << "Replacing " << bin_op->unparseToString()
-                  << " with " << evaluated_result << "\n";
-      SgIfStmt *if_stmt = IsIfConditional(*it);
-      if (if_stmt) {
-        if (evaluated_result) {
-          si::replaceStatement(if_stmt,
-                               si::copyStatement(if_stmt->get_true_body()),
-                               true);
-        } else {
-          si::replaceStatement(if_stmt,
-                               si::copyStatement(if_stmt->get_false_body()),
-                               true);
-        }
-      } else {
-        si::replaceExpression(*it, evaluated_result? BuildTrue() : BuildFalse());
-      }
-    } else {
-      LOG_DEBUG() << "Static evaluation not possible\n";
-    }
+        loop, dim, peel_size_first, peel_size_last, peel_grid,
+        RunKernelLoopAttribute::MAIN);
   }
 }
 
@@ -605,19 +755,26 @@ void loop_peeling(
     physis::translator::BuilderInterface *builder) {
   pre_process(proj, tx, __FUNCTION__);
 
-  vector<SgForStatement*> target_loops = FindInnermostLoops(proj);
-  
-  FOREACH (it, target_loops.begin(), target_loops.end()) {
-    SgForStatement *target_loop = *it;
-    RunKernelLoopAttribute *loop_attr =
-        rose_util::GetASTAttribute<RunKernelLoopAttribute>(target_loop);
-    LOG_DEBUG() << "Loop dimension: " << loop_attr->dim() << "\n";
-    SgFunctionDeclaration *run_kernel_func =
-        si::getEnclosingFunctionDeclaration(target_loop);
-    PeelLoop(run_kernel_func, target_loop, builder);    
+  // Loops are peeled from the innermost dimension so that peeling an
+  // outer loop copies the peeled iterations of the inner loops. The
+  // iteration space is thus split into the interior, where no guard
+  // on the loop variables remains, and the face, edge, and corner
+  // regions.
+  for (int dim = 1; dim <= PS_MAX_DIM; ++dim) {
+    vector<SgNode*> loops =
+        rose_util::QuerySubTreeAttribute<RunKernelLoopAttribute>(proj);
+    FOREACH (it, loops.begin(), loops.end()) {
+      SgForStatement *target_loop = isSgForStatement(*it);
+      RunKernelLoopAttribute *loop_attr =
+          rose_util::GetASTAttribute<RunKernelLoopAttribute>(target_loop);
+      if (loop_attr->dim() != dim) continue;
+      LOG_DEBUG() << "Loop dimension: " << loop_attr->dim() << "\n";
+      SgFunctionDeclaration *run_kernel_func =
+          si::getEnclosingFunctionDeclaration(target_loop);
+      PeelLoop(run_kernel_func, target_loop, builder);
+    }
   }
   
-  
   post_process(proj, tx, __FUNCTION__);
 }
 
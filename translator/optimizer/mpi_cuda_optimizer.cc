@@ -8,6 +8,9 @@ namespace translator {
 namespace optimizer {
 
 void MPICUDAOptimizer::DoStage1() {
+  if (config_->LookupFlag("OPT_GRID_LIVENESS")) {
+    pass::grid_liveness(proj_, tx_, builder_);
+  }
 }
 
 void MPICUDAOptimizer::DoStage2() {
@@ -237,6 +237,8 @@ static GridOffsetMap find_candidates(SgForStatement *loop) {
     GridOffsetAttribute *attr =
         rose_util::GetASTAttribute<GridOffsetAttribute>(offset_expr);
     PSAssert(attr);
+    // Red-black offsets are not linear in the indices
+    if (attr->red_black()) continue;
     SgVarRefExp *gref = GridOffsetAnalysis::GetGridVar(offset_expr);
     LOG_DEBUG() << "gref: " << gref->unparseToString() << "\n";
     SgVariableSymbol *vs = gref->get_symbol();
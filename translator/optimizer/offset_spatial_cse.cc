@@ -352,6 +352,12 @@ void offset_spatial_cse(
                     << offset_expr->unparseToString() << "\n";
         continue;
       }
+      if (rose_util::GetASTAttribute<GridOffsetAttribute>(
+              offset_expr)->red_black()) {
+        LOG_DEBUG() << "Ignoring red-black offset "
+                    << offset_expr->unparseToString() << "\n";
+        continue;
+      }
       PSAssert(offset_expr);
       do_offset_spatial_cse(offset_expr, target_loop, builder);
     }
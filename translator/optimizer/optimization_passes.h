@@ -80,6 +80,15 @@ extern void kernel_inlining(
     physis::translator::TranslationContext *tx,
     physis::translator::BuilderInterface *builder);
 
+//! Peel loop iterations to remove boundary conditionals.
+/*!
+  Iterations where gets are guarded by comparisons of the loop
+  variable with constants or PSGridDim are peeled at the beginning
+  and end of each loop, and the comparisons are statically evaluated
+  in the peeled and main iterations. Loops are peeled from the
+  innermost dimension, so the run kernel is split into the interior
+  and the face, edge, and corner regions.
+ */
 extern void loop_peeling(
     SgProject *proj,
     physis::translator::TranslationContext *tx,
@@ -155,6 +164,93 @@ extern void offset_spatial_cse(
     physis::translator::TranslationContext *tx,
     physis::translator::BuilderInterface *builder);
 
+//! Factor out coefficients shared by grid gets.
+/*!
+  Linear stencils with symmetric coefficients multiply each pair of
+  points at the same distance by the same coefficient. Such sums in
+  run kernels are factored so that the points are summed before the
+  multiplication, and the change of floating-point operations per
+  grid load is reported. Note that this changes the rounding of the
+  sums.
+
+  From:
+  \code
+  c0*g[i] + c1*g[i-1] + c1*g[i+1] + c2*g[i-2] + c2*g[i+2]
+  \endcode
+
+  To:
+  \code
+  c0*g[i] + c1*(g[i-1] + g[i+1]) + c2*(g[i-2] + g[i+2])
+  \endcode
+ */
+extern void stencil_factoring(
+    SgProject *proj,
+    physis::translator::TranslationContext *tx,
+    physis::translator::BuilderInterface *builder);
+
+//! 2.5-D streaming of 3-D run kernels.
+/*!
+  Blocks rows of the middle dimension and marches along the slowest
+  dimension within each block, so that the planes accessed by the
+  stencil stay in the cache and each input point is loaded from
+  memory once per sweep.
+
+  From:
+  \code
+  for (k = kmin; k <= kmax; k++) {
+    for (j = jmin; j <= jmax; j++) {
+      for (i = ...) { ... }
+    }
+  }
+  \endcode
+
+  To:
+  \code
+  const int bs = __PSStreamingBlockSize(row_size, window_size);
+  for (jb = jmin; jb <= jmax; jb += bs) {
+    for (k = kmin; k <= kmax; k++) {
+      for (j = jb; j <= (jb + bs - 1 < jmax ? jb + bs - 1 : jmax); j++) {
+        for (i = ...) { ... }
+      }
+    }
+  }
+  \endcode
+ */
+extern void streaming(
+    SgProject *proj,
+    physis::translator::TranslationContext *tx,
+    physis::translator::BuilderInterface *builder);
+
+//! Free grids right after their last uses.
+/*!
+  Applied before translation. Calls to PSGridFree are moved up within
+  their blocks to right after the last statement referencing the
+  grid, either directly or through stencils mapped with it, so that
+  runtimes can recycle the buffers of dead grids for grids created
+  later. Grids that may be referenced through other variables or by
+  user functions are not moved.
+
+  From:
+  \code
+  PSGrid3DFloat tmp = PSGrid3DFloatNew(n, n, n);
+  PSStencilRun(PSStencilMap(kernel1, d, tmp, g1));
+  PSStencilRun(PSStencilMap(kernel2, d, g2));
+  PSGridFree(tmp);
+  \endcode
+
+  To:
+  \code
+  PSGrid3DFloat tmp = PSGrid3DFloatNew(n, n, n);
+  PSStencilRun(PSStencilMap(kernel1, d, tmp, g1));
+  PSGridFree(tmp);
+  PSStencilRun(PSStencilMap(kernel2, d, g2));
+  \endcode
+ */
+extern void grid_liveness(
+    SgProject *proj,
+    physis::translator::TranslationContext *tx,
+    physis::translator::BuilderInterface *builder);
+
 //! Miscellaneous loop optimizations
 /*!
  */
@@ -27,6 +27,7 @@ class Optimizer {
         config_->LookupFlag("OPT_REGISTER_BLOCKING") ||
         config_->LookupFlag("OPT_OFFSET_CSE") ||
         config_->LookupFlag("OPT_OFFSET_SPATIAL_CSE") ||        
+        config_->LookupFlag("OPT_STENCIL_FACTORING") ||
         config_->LookupFlag("OPT_LOOP_OPT")) {
       config_->SetFlag("OPT_KERNEL_INLINING", true);
     }
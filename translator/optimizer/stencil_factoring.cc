@@ -0,0 +1,272 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "translator/optimizer/optimization_passes.h"
+#include "translator/optimizer/optimization_common.h"
+#include "translator/rose_util.h"
+#include "translator/builder_interface.h"
+#include "translator/translation_util.h"
+
+#include <algorithm>
+
+namespace si = SageInterface;
+namespace sb = SageBuilder;
+
+using std::vector;
+
+namespace physis {
+namespace translator {
+namespace optimizer {
+namespace pass {
+
+//! A term of a sum.
+struct SumTerm {
+  SgExpression *exp;
+  bool negative;
+  //! Factors of the term other than the grid get.
+  vector<SgExpression*> coef;
+  //! Grid get multiplied by the coefficient; NULL if not a linear
+  //! term of a get.
+  SgExpression *get;
+  //! Unparsed coefficient to find terms with the same coefficient.
+  string key;
+  SumTerm(SgExpression *e, bool n): exp(e), negative(n), get(NULL) {}
+};
+
+static bool IsFloatingPoint(SgExpression *e) {
+  SgType *t = e->get_type()->stripTypedefsAndModifiers();
+  return isSgTypeFloat(t) || isSgTypeDouble(t) || isSgTypeLongDouble(t);
+}
+
+static bool IsSumOp(SgNode *node) {
+  return isSgAddOp(node) || isSgSubtractOp(node) || isSgMinusOp(node);
+}
+
+// Returns true if e is a grid get possibly wrapped by casts or a
+// conversion from the storage type.
+static bool IsGridGet(SgExpression *e) {
+  e = rose_util::removeCasts(e);
+  SgFunctionCallExp *call = isSgFunctionCallExp(e);
+  if (call && call->get_args()->get_expressions().size() == 1) {
+    e = call->get_args()->get_expressions()[0];
+  }
+  return rose_util::GetASTAttribute<GridGetAttribute>(e) != NULL;
+}
+
+static bool HasSideEffect(SgExpression *e) {
+  return si::querySubTree<SgFunctionCallExp>(e).size() > 0 ||
+      si::querySubTree<SgAssignOp>(e).size() > 0 ||
+      si::querySubTree<SgCompoundAssignOp>(e).size() > 0 ||
+      si::querySubTree<SgPlusPlusOp>(e).size() > 0 ||
+      si::querySubTree<SgMinusMinusOp>(e).size() > 0;
+}
+
+static void FlattenSum(SgExpression *e, bool negative,
+                       vector<SumTerm> &terms) {
+  if (isSgAddOp(e) || isSgSubtractOp(e)) {
+    SgBinaryOp *bop = isSgBinaryOp(e);
+    FlattenSum(bop->get_lhs_operand(), negative, terms);
+    FlattenSum(bop->get_rhs_operand(),
+               isSgSubtractOp(e) ? !negative : negative, terms);
+  } else if (isSgMinusOp(e)) {
+    FlattenSum(isSgMinusOp(e)->get_operand(), !negative, terms);
+  } else {
+    terms.push_back(SumTerm(e, negative));
+  }
+}
+
+static void FlattenProduct(SgExpression *e, vector<SgExpression*> &factors) {
+  if (isSgMultiplyOp(e)) {
+    FlattenProduct(isSgMultiplyOp(e)->get_lhs_operand(), factors);
+    FlattenProduct(isSgMultiplyOp(e)->get_rhs_operand(), factors);
+  } else {
+    factors.push_back(e);
+  }
+}
+
+// Splits a term into a coefficient and a grid get if possible.
+static void AnalyzeTerm(SumTerm &term) {
+  vector<SgExpression*> factors;
+  FlattenProduct(term.exp, factors);
+  if (factors.size() < 2) return;
+  SgExpression *get = NULL;
+  vector<string> keys;
+  FOREACH (it, factors.begin(), factors.end()) {
+    if (IsGridGet(*it)) {
+      if (get) return;
+      get = *it;
+      continue;
+    }
+    // Coefficients must evaluate to the same value in all terms
+    if (HasSideEffect(*it) ||
+        rose_util::QuerySubTreeAttribute<GridGetAttribute>(*it).size()) {
+      return;
+    }
+    term.coef.push_back(*it);
+    keys.push_back((*it)->unparseToString());
+  }
+  if (get == NULL) return;
+  term.get = get;
+  std::sort(keys.begin(), keys.end());
+  StringJoin sj("*");
+  FOREACH (it, keys.begin(), keys.end()) sj << *it;
+  term.key = sj.str();
+}
+
+static SgExpression *AddTerm(SgExpression *sum, SgExpression *e,
+                             bool negative) {
+  if (sum == NULL) {
+    return negative ? (SgExpression*)sb::buildMinusOp(e) : e;
+  }
+  return negative ? (SgExpression*)Sub(sum, e) : (SgExpression*)Add(sum, e);
+}
+
+// Counts arithmetic operations of a sum.
+static int CountFlops(const vector<SumTerm> &terms) {
+  int flops = terms.size() - 1;
+  FOREACH (it, terms.begin(), terms.end()) {
+    vector<SgExpression*> factors;
+    FlattenProduct(it->exp, factors);
+    flops += factors.size() - 1;
+  }
+  return flops;
+}
+
+//! Factors out coefficients shared by grid gets in a sum.
+/*!
+  From:
+  \code
+  c0*g[i] + c1*g[i-1] + c1*g[i+1]
+  \endcode
+  To:
+  \code
+  c0*g[i] + c1*(g[i-1] + g[i+1])
+  \endcode
+
+  \param sum The top of a floating-point sum.
+  \param saved_flops Incremented by the number of saved operations.
+  \return True if factored.
+ */
+static bool FactorSum(SgExpression *sum, int &saved_flops) {
+  vector<SumTerm> terms;
+  FlattenSum(sum, false, terms);
+  FOREACH (it, terms.begin(), terms.end()) {
+    AnalyzeTerm(*it);
+  }
+  // Group terms by the coefficient in the order of appearance
+  vector<vector<SumTerm> > groups;
+  bool factored = false;
+  FOREACH (it, terms.begin(), terms.end()) {
+    vector<vector<SumTerm> >::iterator git = groups.begin();
+    if (it->get) {
+      for (; git != groups.end(); ++git) {
+        if (git->front().get && git->front().key == it->key) break;
+      }
+    } else {
+      git = groups.end();
+    }
+    if (git == groups.end()) {
+      groups.push_back(vector<SumTerm>(1, *it));
+    } else {
+      git->push_back(*it);
+      factored = true;
+    }
+  }
+  if (!factored) return false;
+
+  SgExpression *new_sum = NULL;
+  int flops = groups.size() - 1;
+  FOREACH (git, groups.begin(), groups.end()) {
+    const SumTerm &first = git->front();
+    if (git->size() == 1) {
+      new_sum = AddTerm(new_sum, first.exp, first.negative);
+      vector<SgExpression*> factors;
+      FlattenProduct(first.exp, factors);
+      flops += factors.size() - 1;
+      continue;
+    }
+    SgExpression *gets = NULL;
+    FOREACH (it, git->begin(), git->end()) {
+      gets = AddTerm(gets, it->get, it->negative);
+    }
+    SgExpression *coef = NULL;
+    FOREACH (it, first.coef.begin(), first.coef.end()) {
+      coef = coef ? (SgExpression*)Mul(coef, *it) : *it;
+    }
+    new_sum = AddTerm(new_sum, Mul(coef, gets), false);
+    flops += git->size() - 1 + first.coef.size();
+  }
+  saved_flops += CountFlops(terms) - flops;
+  LOG_DEBUG() << "Factored: " << sum->unparseToString() << "\n";
+  // Subexpressions of the original sum are reused
+  si::replaceExpression(sum, new_sum, true);
+  LOG_DEBUG() << "Into: " << new_sum->unparseToString() << "\n";
+  return true;
+}
+
+static int CountFlops(SgNode *top) {
+  vector<SgBinaryOp*> ops = si::querySubTree<SgBinaryOp>(top);
+  int flops = 0;
+  FOREACH (it, ops.begin(), ops.end()) {
+    SgBinaryOp *op = *it;
+    if ((isSgAddOp(op) || isSgSubtractOp(op) || isSgMultiplyOp(op) ||
+         isSgDivideOp(op)) && IsFloatingPoint(op)) {
+      ++flops;
+    }
+  }
+  return flops;
+}
+
+static void FactorRunKernel(SgFunctionDeclaration *run_kernel) {
+  SgFunctionDefinition *fdef = run_kernel->get_definition();
+  if (fdef == NULL) return;
+  int flops = CountFlops(fdef);
+  int loads =
+      rose_util::QuerySubTreeAttribute<GridGetAttribute>(fdef).size();
+  vector<SgExpression*> exps = si::querySubTree<SgExpression>(fdef);
+  vector<SgExpression*> sums;
+  FOREACH (it, exps.begin(), exps.end()) {
+    SgExpression *e = *it;
+    if (!(isSgAddOp(e) || isSgSubtractOp(e)) || !IsFloatingPoint(e)) {
+      continue;
+    }
+    SgExpression *parent = isSgExpression(e->get_parent());
+    if (parent && IsSumOp(parent) && IsFloatingPoint(parent)) continue;
+    sums.push_back(e);
+  }
+  int saved_flops = 0;
+  int num_factored = 0;
+  FOREACH (it, sums.begin(), sums.end()) {
+    if (FactorSum(*it, saved_flops)) ++num_factored;
+  }
+  if (num_factored == 0) return;
+  LOG_INFO() << "Factored " << num_factored << " sum(s) in "
+             << run_kernel->get_name() << ": "
+             << flops << " -> " << flops - saved_flops
+             << " floating-point operations for " << loads
+             << " grid loads ("
+             << (loads ? (double)flops / loads : 0.0) << " -> "
+             << (loads ? (double)(flops - saved_flops) / loads : 0.0)
+             << " per load)\n";
+}
+
+void stencil_factoring(
+    SgProject *proj,
+    TranslationContext *tx,
+    BuilderInterface *builder) {
+  pre_process(proj, tx, __FUNCTION__);
+
+  vector<SgNode*> run_kernels =
+      rose_util::QuerySubTreeAttribute<RunKernelAttribute>(proj);
+  FOREACH (it, run_kernels.begin(), run_kernels.end()) {
+    SgFunctionDeclaration *run_kernel = isSgFunctionDeclaration(*it);
+    if (run_kernel == NULL) continue;
+    FactorRunKernel(run_kernel);
+  }
+
+  post_process(proj, tx, __FUNCTION__);
+}
+
+} // namespace pass
+} // namespace optimizer
+} // namespace translator
+} // namespace physis
@@ -0,0 +1,170 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "translator/optimizer/optimization_passes.h"
+#include "translator/optimizer/optimization_common.h"
+#include "translator/rose_util.h"
+#include "translator/builder_interface.h"
+#include "translator/translation_util.h"
+
+#include <algorithm>
+
+namespace si = SageInterface;
+namespace sb = SageBuilder;
+
+using std::vector;
+
+namespace physis {
+namespace translator {
+namespace optimizer {
+namespace pass {
+
+// Returns the loop for a dimension if it is the only one in a run
+// kernel.
+static SgForStatement *FindLoop(SgFunctionDeclaration *run_kernel,
+                                int dim) {
+  vector<SgNode*> loops =
+      rose_util::QuerySubTreeAttribute<RunKernelLoopAttribute>(run_kernel);
+  SgForStatement *found = NULL;
+  FOREACH (it, loops.begin(), loops.end()) {
+    RunKernelLoopAttribute *attr =
+        rose_util::GetASTAttribute<RunKernelLoopAttribute>(*it);
+    if (attr->dim() != dim) continue;
+    // Peeled loops are not expected in the outer dimensions
+    if (found) return NULL;
+    found = isSgForStatement(*it);
+  }
+  return found;
+}
+
+//! Builds the number of bytes accessed per point of a row.
+/*!
+  Each grid contributes as many planes as the extent of its stencil
+  along the slowest dimension.
+
+  \return NULL if not all grids are analyzed.
+ */
+static SgExpression *BuildWindowSize(StencilMap *sm) {
+  SgExpression *size = NULL;
+  FOREACH (it, sm->grid_params().begin(), sm->grid_params().end()) {
+    GridVarAttribute *gva =
+        rose_util::GetASTAttribute<GridVarAttribute>(*it);
+    if (gva == NULL) return NULL;
+    int depth = 1;
+    IntVector offset_min, offset_max;
+    if (gva->sr().GetNeighborAccess(offset_min, offset_max)) {
+      depth = std::max(offset_max[2] - offset_min[2] + 1, (PSIndex)1);
+    }
+    LOG_DEBUG() << "Window depth of " << (*it)->get_name()
+                << ": " << depth << "\n";
+    SgExpression *e = Mul(Int(depth),
+                          sb::buildSizeOfOp(gva->gt()->point_type()));
+    size = size ? Add(size, e) : e;
+  }
+  return size;
+}
+
+static bool ApplyStreaming(SgFunctionDeclaration *run_kernel,
+                           BuilderInterface *builder,
+                           SgFunctionSymbol *block_size_func) {
+  RunKernelAttribute *run_kernel_attr =
+      rose_util::GetASTAttribute<RunKernelAttribute>(run_kernel);
+  StencilMap *sm = run_kernel_attr->stencil_map();
+  if (sm->getNumDim() != 3) return false;
+  SgForStatement *k_loop = FindLoop(run_kernel, 3);
+  SgForStatement *j_loop = FindLoop(run_kernel, 2);
+  if (k_loop == NULL || j_loop == NULL) return false;
+  // The j loop must be perfectly nested in the k loop except for the
+  // declaration of its index variable
+  SgBasicBlock *k_body = isSgBasicBlock(k_loop->get_loop_body());
+  if (k_body == NULL || j_loop->get_parent() != k_body) return false;
+  FOREACH (it, k_body->get_statements().begin(),
+           k_body->get_statements().end()) {
+    if (*it != j_loop && !isSgVariableDeclaration(*it)) return false;
+  }
+  SgExpression *j_begin = KernelLoopAnalysis::GetLoopBegin(j_loop);
+  SgExprStatement *j_test = isSgExprStatement(j_loop->get_test());
+  if (j_begin == NULL || j_test == NULL ||
+      !isSgLessOrEqualOp(j_test->get_expression())) {
+    return false;
+  }
+  SgExpression *j_end = KernelLoopAnalysis::GetLoopEnd(j_loop);
+  SgExpression *window_size = BuildWindowSize(sm);
+  if (window_size == NULL) return false;
+
+  LOG_DEBUG() << "Streaming " << run_kernel->get_name() << "\n";
+  SgScopeStatement *scope = si::getScope(k_loop);
+  // const int bs = __PSStreamingBlockSize(row_size, window_size);
+  SgExpression *stencil = Var(run_kernel_attr->stencil_param());
+  SgExpression *row_size =
+      Sub(builder->BuildStencilDomMaxRef(stencil, 1),
+          builder->BuildStencilDomMinRef(si::copyExpression(stencil), 1));
+  SgVariableDeclaration *bs = sb::buildVariableDeclaration(
+      rose_util::generateUniqueName(scope),
+      sb::buildConstType(sb::buildIntType()),
+      sb::buildAssignInitializer(
+          sb::buildFunctionCallExp(
+              block_size_func,
+              sb::buildExprListExp(row_size, window_size))),
+      scope);
+  si::insertStatementBefore(k_loop, bs);
+  SgVariableDeclaration *jb = sb::buildVariableDeclaration(
+      rose_util::generateUniqueName(scope), sb::buildIntType(),
+      NULL, scope);
+  si::insertStatementBefore(k_loop, jb);
+
+  // for (jb = jmin; jb <= jmax; jb += bs)
+  SgBasicBlock *block_body = sb::buildBasicBlock();
+  SgForStatement *block_loop = sb::buildForStatement(
+      sb::buildExprStatement(
+          sb::buildAssignOp(Var(jb), si::copyExpression(j_begin))),
+      sb::buildExprStatement(
+          sb::buildLessOrEqualOp(Var(jb), si::copyExpression(j_end))),
+      sb::buildPlusAssignOp(Var(jb), Var(bs)),
+      block_body);
+  si::attachComment(block_loop, "Streaming along the slowest dimension");
+  si::insertStatementBefore(k_loop, block_loop);
+  si::removeStatement(k_loop);
+  si::appendStatement(k_loop, block_body);
+
+  // for (j = jb; j <= min(jb + bs - 1, jmax); j++)
+  SgExpression *block_end = Sub(Add(Var(jb), Var(bs)), Int(1));
+  SgExpression *j_block_end = sb::buildConditionalExp(
+      sb::buildLessThanOp(block_end, si::copyExpression(j_end)),
+      si::copyExpression(block_end), si::copyExpression(j_end));
+  si::replaceExpression(j_begin, Var(jb));
+  si::replaceExpression(j_end, j_block_end);
+  return true;
+}
+
+void streaming(
+    SgProject *proj,
+    TranslationContext *tx,
+    BuilderInterface *builder) {
+  pre_process(proj, tx, __FUNCTION__);
+
+  SgFunctionSymbol *block_size_func =
+      si::lookupFunctionSymbolInParentScopes(
+          PS_STREAMING_BLOCK_SIZE_NAME, si::getFirstGlobalScope(proj));
+  if (block_size_func == NULL || !rose_util::IsCLikeLanguage()) {
+    LOG_DEBUG() << "Streaming not supported for this target\n";
+    return;
+  }
+
+  vector<SgNode*> run_kernels =
+      rose_util::QuerySubTreeAttribute<RunKernelAttribute>(proj);
+  FOREACH (it, run_kernels.begin(), run_kernels.end()) {
+    SgFunctionDeclaration *run_kernel = isSgFunctionDeclaration(*it);
+    if (run_kernel == NULL) continue;
+    if (!ApplyStreaming(run_kernel, builder, block_size_func)) {
+      LOG_DEBUG() << "Streaming not applied to "
+                  << run_kernel->get_name() << "\n";
+    }
+  }
+
+  post_process(proj, tx, __FUNCTION__);
+}
+
+} // namespace pass
+} // namespace optimizer
+} // namespace translator
+} // namespace physis
@@ -29,6 +29,14 @@
 #define PS_STENCIL_MAP_INNER_SUFFIX_NAME "inner"
 #define PS_STENCIL_MAP_BOUNDARY_FW_SUFFIX_NAME "fw"
 #define PS_STENCIL_MAP_BOUNDARY_BW_SUFFIX_NAME "bw"
+#define PS_STENCIL_MAP_TILE_SUFFIX_NAME "tile"
+#define PS_RUN_TILES_NAME "__PSRunTiles"
+#define PS_RUN_TILES_ACTIVE_NAME "__PSRunTilesActive"
+#define PS_RUN_DIVISION_TILES_NAME "__PSRunDivisionTiles"
+#define PS_DOMAIN_EXTEND_NAME "__PSDomainExtend"
+#define PS_STENCIL_MAP_REDUCE_SUFFIX_NAME "reduce"
+#define PS_FUSED_REDUCE_PARAM_NAME "__ps_reduce"
+#define PS_FUSED_REDUCE_ACC_NAME "__ps_acc"
 
 #define PS_DOMAIN1D_TYPE_NAME "PSDomain1D"
 #define PS_DOMAIN2D_TYPE_NAME "PSDomain2D"
@@ -42,9 +50,19 @@
 #define PS_GRID_GET_ID_NAME "__PSGridGetID"
 #define PSF_GRID_GET_ID_NAME "PSGridGetID"
 #define PS_GRID_GET_DEV_NAME "__PSGridGetDev"
+#define PS_GRID_UPDATE_GHOST_NAME "__PSGridUpdateGhost"
+#define PS_GRID_WAIT_NAME "__PSGridWait"
+#define PS_GRID_MARK_WRITTEN_NAME "__PSGridMarkWritten"
+#define PS_REDUCE_GRID_OUTSIDE_NAME "__PSReduceGridOutside"
+#define PS_REDUCE_IDENTITY_NAME "__PSReduceIdentity"
+#define PS_STREAMING_BLOCK_SIZE_NAME "__PSStreamingBlockSize"
 
 #define PS_GRID_RAW_PTR_NAME "p"
 #define PS_GRID_GET_BASE_ADDR "__PSGridGetBaseAddr"
+#define PS_FLOAT_TO_BFLOAT16_NAME "__PSFloatToBFloat16"
+#define PS_BFLOAT16_TO_FLOAT_NAME "__PSBFloat16ToFloat"
+#define PS_JIT_GET_RUN_FUNC_NAME "__PSJITGetRunFunc"
+#define PS_JIT_SOURCE_NAME "__PSJITSource"
 #define PS_GET_LOCAL_SIZE_NAME "__PSGetLocalSize"
 #define PS_GET_LOCAL_OFFSET_NAME "__PSGetLocalOffset"
 #define PS_DOMAIN_SHRINK_NAME "__PSDomainShrink"
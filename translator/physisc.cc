@@ -1,8 +1,21 @@
 // Licensed under the BSD license. See LICENSE.txt for more details.
 
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
 #include <boost/program_options.hpp>
 #include <boost/foreach.hpp>
 
+#include "common/hash.h"
 #include "translator/config.h"
 #include "translator/reference_translator.h"
 #include "translator/cuda_translator.h"
@@ -32,12 +45,14 @@
 #endif
 #ifdef MPI_OPENMP_TRANSLATOR_ENABLED
 #include "translator/mpi_openmp_translator.h"
+#include "translator/mpi_openmp_runtime_builder.h"
 #endif
 #ifdef CUDA_HM_TRANSLATOR_ENABLED
 #include "translator/cuda_hm_translator.h"
 #include "translator/cuda_hm_runtime_builder.h"
 #endif
 #include "translator/fortran_output_fix.h"
+#include "translator/translation_cache.h"
 
 using std::string;
 namespace bpo = boost::program_options;
@@ -62,6 +77,11 @@ struct CommandLineOptions {
   bool mpi_openmp_numa_trans;
   bool cuda_hm_trans;
   std::pair<bool, string> config_file_path;
+  //! Number of processes generating auto-tuning variants; 0 means
+  //! the number of online CPUs
+  int at_jobs;
+  //! Translation cache directory; empty if not cached
+  string cache_dir;
   CommandLineOptions(): ref_trans(false), cuda_trans(false),
                         mpi_trans(false),
                         //mpi2_trans(false),
@@ -71,7 +91,11 @@ struct CommandLineOptions {
                         mpi_openmp_trans(false),
                         mpi_openmp_numa_trans(false),
                         cuda_hm_trans(false),
-                        config_file_path(std::make_pair(false, "")) {}
+                        config_file_path(std::make_pair(false, "")),
+                        at_jobs(0) {
+    const char *dir = getenv("PHYSISC_CACHE_DIR");
+    if (dir) cache_dir = dir;
+  }
 };
 
 void parseOptions(int argc, char *argv[], CommandLineOptions &opts,
@@ -81,6 +105,13 @@ void parseOptions(int argc, char *argv[], CommandLineOptions &opts,
   desc.add_options()("help", "Produce help message");
   desc.add_options()("config", bpo::value<string>(),
                      "Read configuration file");
+  desc.add_options()("at-jobs", bpo::value<int>(),
+                     "Number of processes generating auto-tuning variants");
+  desc.add_options()("cache-dir", bpo::value<string>(),
+                     "Reuse translations of unchanged inputs cached in "
+                     "the directory");
+  desc.add_options()("no-ast-check",
+                     "Skip AST validation after each optimization pass");
   desc.add_options()("ref", "Reference translation");
 #ifdef CUDA_TRANSLATOR_ENABLED  
   desc.add_options()("cuda", "CUDA translation");
@@ -133,6 +164,24 @@ void parseOptions(int argc, char *argv[], CommandLineOptions &opts,
                 << opts.config_file_path.second << ".\n";    
   }
 
+  if (vm.count("cache-dir")) {
+    opts.cache_dir = vm["cache-dir"].as<string>();
+  }
+
+  if (vm.count("no-ast-check")) {
+    // Checked by the optimization passes
+    setenv("NOASTCHECK", "1", 1);
+  }
+
+  if (vm.count("at-jobs")) {
+    opts.at_jobs = vm["at-jobs"].as<int>();
+    if (opts.at_jobs < 1) {
+      LOG_ERROR() << "Invalid number of auto-tuning jobs: "
+                  << opts.at_jobs << "\n";
+      exit(1);
+    }
+  }
+
   if (vm.count("ref")) {
     LOG_DEBUG() << "Reference translation.\n";
     opts.ref_trans = true;
@@ -264,6 +313,10 @@ static pt::BuilderInterface *GetRTBuilder(SgProject *proj,
   } else if (opts.mpi_cuda_trans) {
     builder = new pt::MPICUDARuntimeBuilder(gs, config);
 #endif    
+#ifdef MPI_OPENMP_TRANSLATOR_ENABLED
+  } else if (opts.mpi_openmp_trans || opts.mpi_openmp_numa_trans) {
+    builder = new pt::MPIOpenMPRuntimeBuilder(gs, config);
+#endif
   }
   if (builder == NULL) {
     LOG_WARNING() << "No runtime builder found for this target\n";
@@ -427,6 +480,31 @@ static void SetDynamicLinkLib(
   si::attachArbitraryText(vdecl, "#include <dlfcn.h>");
 }
 
+/** set the path of the output source file in __PSJITSource,
+ *  which is compiled again by the runtime for JIT specialization
+ * @param[in] proj
+ * @param[in] output_filename ... output file name in the current directory
+ */
+static void SetJITSource(SgProject *proj, const string &output_filename) {
+  SgScopeStatement *sc = si::getFirstGlobalScope(proj);
+  char cwd[PATH_MAX];
+  string path = output_filename;
+  if (getcwd(cwd, sizeof(cwd))) {
+    path = string(cwd) + "/" + output_filename;
+  } else {
+    LOG_WARNING() << "Cannot get the current directory; "
+                  << "JIT source path is relative\n";
+  }
+  SgVariableDeclaration *vdecl =
+      sb::buildVariableDeclaration(
+          PS_JIT_SOURCE_NAME,
+          sb::buildArrayType(sb::buildConstType(sb::buildCharType())),
+          sb::buildAssignInitializer(sb::buildStringVal(path)),
+          sc);
+  si::setStatic(vdecl);
+  si::prependStatement(vdecl, sc);
+}
+
 } // namespace translator
 } // namespace physis
 
@@ -445,6 +523,209 @@ static SgFile *GetMainSourceFile(SgProject *proj) {
   return NULL;
 }
 
+// Marks the comment listing the parameters of an auto-tuning
+// variant, which is excluded when comparing variants.
+static const char *kATParamCommentMarker = "Auto-tuning parameters:";
+
+static string GetATVariantFileName(SgFile *file, int i,
+                                   const string &suffix) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%05d.", i);
+  return pt::generate_output_filename(
+      file->get_sourceFileNameWithoutPath(), buf + suffix);
+}
+
+// Replaces the source suffix with .so
+static string GetATLibrarySuffix(const string &dl_filename_suffix) {
+  return dl_filename_suffix.substr(
+      0, dl_filename_suffix.find_last_of('.')) + ".so";
+}
+
+/** generate the source file of an auto-tuning variant.
+ * @param[in] i ... pattern index
+ * @return    backend status
+ */
+static int GenerateATVariant(
+    int i, SgProject *proj, std::vector<SgFunctionDeclaration *> &orig,
+    pt::Configuration &config, pt::TranslationContext *tx,
+    pt::BuilderInterface *rt_builder, pt::CommandLineOptions &opts,
+    pt::Translator *trans, const string &dl_filename_suffix) {
+  pt::ReplaceCloneRunKernelFunc(proj, orig);
+  config.SetPat(i);
+
+  pto::Optimizer *optimizer =
+      pt::GetOptimizer(tx, proj, rt_builder, opts, &config);
+  LOG_INFO() << i << ":Performing optimization Stage 2\n";
+  optimizer->Stage2();
+  trans->Optimize();
+  LOG_INFO() << i << ":Optimization Stage 2 done\n";
+  delete optimizer;
+
+#if 1 /* add optimize parameter as comment */
+  char buf[256];
+  string debug_comment = string("\n  ") + kATParamCommentMarker + "\n";
+  for (int ii = 0; !config.at_params_pattern[ii].empty(); ++ii) {
+    snprintf(buf, sizeof(buf), "  %s = %d\n",
+             config.at_params_pattern[ii].c_str(),
+             config.LookupFlag(config.at_params_pattern[ii]));
+    debug_comment += buf;
+  }
+  si::attachComment(si::getLastStatement(si::getFirstGlobalScope(proj)),
+                    debug_comment, PreprocessingInfo::after);
+#endif
+  snprintf(buf, sizeof(buf), "%05d.", i);
+  pt::set_output_filename(GetMainSourceFile(proj),
+                          buf + dl_filename_suffix);
+  int b = backend(proj);  /* optimized kernel function */
+  LOG_INFO() << i << ": Code generation complete.\n";
+  if (b) {
+    LOG_ERROR() << i << ": Backend failure.\n";
+  }
+  return b;
+}
+
+/** generate all auto-tuning variants.
+ *
+ * Variants are generated by forked worker processes, each of which
+ * starts from a copy of the translated AST and generates every
+ * num_jobs-th variant.
+ * @param[in] num_jobs ... number of worker processes
+ * @return    non-zero if any variant failed
+ */
+static int GenerateATVariants(
+    int num_jobs, SgProject *proj,
+    std::vector<SgFunctionDeclaration *> &orig,
+    pt::Configuration &config, pt::TranslationContext *tx,
+    pt::BuilderInterface *rt_builder, pt::CommandLineOptions &opts,
+    pt::Translator *trans, const string &dl_filename_suffix) {
+  int n = config.npattern();
+  if (num_jobs <= 1) {
+    for (int i = 0; i < n; ++i) {
+      int b = GenerateATVariant(i, proj, orig, config, tx, rt_builder,
+                                opts, trans, dl_filename_suffix);
+      if (b) return b;
+    }
+    return 0;
+  }
+  LOG_INFO() << "Generating " << n << " variants with "
+             << num_jobs << " processes\n";
+  // Do not let the children write buffered output again
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(NULL);
+  std::vector<pid_t> workers;
+  int b = 0;
+  for (int w = 0; w < num_jobs; ++w) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      LOG_ERROR() << "Cannot start a worker process.\n";
+      b = 1;
+      break;
+    }
+    if (pid == 0) {
+      int status = 0;
+      for (int i = w; i < n && status == 0; i += num_jobs) {
+        status = GenerateATVariant(i, proj, orig, config, tx, rt_builder,
+                                   opts, trans, dl_filename_suffix);
+      }
+      std::cout.flush();
+      std::cerr.flush();
+      fflush(NULL);
+      // Skip destructors of the AST shared with the parent
+      _exit(status ? 1 : 0);
+    }
+    workers.push_back(pid);
+  }
+  for (size_t w = 0; w < workers.size(); ++w) {
+    int status;
+    if (waitpid(workers[w], &status, 0) < 0 ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      LOG_ERROR() << "Worker " << w << " failed.\n";
+      b = 1;
+    }
+  }
+  return b;
+}
+
+// Reads a variant source without the parameter comment.
+static bool ReadATVariantCode(const string &path, string &code) {
+  std::ifstream ifs(path.c_str());
+  if (!ifs) return false;
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  code = ss.str();
+  size_t pos = code.find(kATParamCommentMarker);
+  if (pos != string::npos) {
+    size_t begin = code.rfind("/*", pos);
+    code.erase(begin == string::npos ? pos : begin);
+  }
+  return true;
+}
+
+/** remove auto-tuning variants identical to an earlier one.
+ *
+ * The source of a duplicate is removed so that it is not compiled,
+ * and its shared library name, which is listed in __dl_fname[], is
+ * made a symbolic link to the library of the earlier variant.
+ */
+static void DeduplicateATVariants(SgFile *file, int n,
+                                  const string &dl_filename_suffix) {
+  string so_suffix = GetATLibrarySuffix(dl_filename_suffix);
+  std::map<uint64_t, std::vector<int> > variants;
+  int num_dups = 0;
+  for (int i = 0; i < n; ++i) {
+    string src = GetATVariantFileName(file, i, dl_filename_suffix);
+    string code;
+    if (!ReadATVariantCode(src, code)) {
+      LOG_WARNING() << "Cannot read " << src << "\n";
+      continue;
+    }
+    std::vector<int> &same_hash = variants[HashFNV1a(code)];
+    int orig = -1;
+    FOREACH (it, same_hash.begin(), same_hash.end()) {
+      string other;
+      if (ReadATVariantCode(
+              GetATVariantFileName(file, *it, dl_filename_suffix), other) &&
+          other == code) {
+        orig = *it;
+        break;
+      }
+    }
+    if (orig < 0) {
+      same_hash.push_back(i);
+      continue;
+    }
+    string so = GetATVariantFileName(file, i, so_suffix);
+    string orig_so = GetATVariantFileName(file, orig, so_suffix);
+    unlink(so.c_str());
+    if (symlink(orig_so.c_str(), so.c_str()) != 0) {
+      perror("symlink");
+      LOG_WARNING() << "Cannot link " << so << " to " << orig_so << "\n";
+      continue;
+    }
+    unlink(src.c_str());
+    LOG_DEBUG() << "Variant " << i << " is identical to variant "
+                << orig << "\n";
+    ++num_dups;
+  }
+  LOG_INFO() << num_dups << " of " << n
+             << " variants are duplicates and not compiled\n";
+}
+
+// Lists the files output for auto-tuning variants, which are either
+// the sources or the links made for duplicates.
+static void GetATVariantOutputs(SgFile *file, int n,
+                                const string &dl_filename_suffix,
+                                std::vector<string> &outputs) {
+  string so_suffix = GetATLibrarySuffix(dl_filename_suffix);
+  for (int i = 0; i < n; ++i) {
+    string src = GetATVariantFileName(file, i, dl_filename_suffix);
+    outputs.push_back(access(src.c_str(), F_OK) == 0 ? src :
+                      GetATVariantFileName(file, i, so_suffix));
+  }
+}
+
 int main(int argc, char *argv[]) {
   pt::Translator *trans = NULL;
   string filename_target_suffix;
@@ -559,6 +840,22 @@ int main(int argc, char *argv[]) {
   LOG_VERBOSE() << "Rose command line: " << sj << "\n";
 #endif  
   
+  pt::TranslationCache *cache = NULL;
+  if (!opts.cache_dir.empty()) {
+    cache = new pt::TranslationCache(opts.cache_dir);
+    string config_path = opts.config_file_path.first ?
+        opts.config_file_path.second : "";
+    if (!cache->SetUp(argvec, config_path)) {
+      LOG_INFO() << "Translation not cached\n";
+      delete cache;
+      cache = NULL;
+    } else if (cache->Restore()) {
+      LOG_INFO() << "Translation restored from cache\n";
+      delete cache;
+      return 0;
+    }
+  }
+
   // Build AST
   SgProject* proj = frontend(argvec);
   proj->skipfinalCompileStep(true);
@@ -594,8 +891,6 @@ int main(int argc, char *argv[]) {
   
   LOG_INFO() << "Translating the AST\n";
   trans->Translate();
-  // TODO: optimization is disabled
-  //trans->Optimize();
   LOG_INFO() << "Translation done\n";
   
   /* auto tuning & has dynamic link libraries */
@@ -608,6 +903,8 @@ int main(int argc, char *argv[]) {
     delete optimizer;
 
     pt::set_output_filename(GetMainSourceFile(proj), filename_suffix);
+    std::vector<string> outputs;
+    outputs.push_back(GetMainSourceFile(proj)->get_unparse_output_filename());
 
     int b = backend(proj);  /* without kernel function */
     LOG_INFO() << "Base code generation complete.\n";
@@ -618,38 +915,23 @@ int main(int argc, char *argv[]) {
     }
 
     /* output dynamic link libraries */
-    for (int i = 0; i < config.npattern(); ++i) {
-      pt::ReplaceCloneRunKernelFunc(proj, orig);
-      config.SetPat(i);
-
-      optimizer = GetOptimizer(&tx, proj, rt_builder, opts, &config);
-      LOG_INFO() << i << ":Performing optimization Stage 2\n";
-      optimizer->Stage2();
-      LOG_INFO() << i << ":Optimization Stage 2 done\n";
-      delete optimizer;
-
-      char buf[32];
-#if 1 /* add optimize parameter as comment */
-      string debug_comment = "\n";
-      for (int ii = 0; !config.at_params_pattern[ii].empty(); ++ii) {
-        snprintf(buf, sizeof(buf), "  %s = %d\n",
-                 config.at_params_pattern[ii].c_str(),
-                 config.LookupFlag(config.at_params_pattern[ii]));
-        debug_comment += buf;
-      }
-      si::attachComment(si::getLastStatement(si::getFirstGlobalScope(proj)),
-                        debug_comment, PreprocessingInfo::after);
-#endif
-      snprintf(buf, sizeof(buf), "%05d.", i);
-      pt::set_output_filename(GetMainSourceFile(proj),
-                              buf + dl_filename_suffix);
-      b = backend(proj);  /* optimized kernel function */
-      LOG_INFO() << i << ": Code generation complete.\n";
-      if (b) {
-        LOG_ERROR() << i << ": Backend failure.\n";
-        trans->Finish();
-        return b;
-      }
+    int num_jobs = opts.at_jobs;
+    if (num_jobs == 0) num_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    num_jobs = std::max(1, std::min(num_jobs, config.npattern()));
+    b = GenerateATVariants(num_jobs, proj, orig, config, &tx, rt_builder,
+                           opts, trans, dl_filename_suffix);
+    if (b) {
+      LOG_ERROR() << "AT code generation failed.\n";
+      trans->Finish();
+      return b;
+    }
+    DeduplicateATVariants(GetMainSourceFile(proj), config.npattern(),
+                          dl_filename_suffix);
+    if (cache) {
+      GetATVariantOutputs(GetMainSourceFile(proj), config.npattern(),
+                          dl_filename_suffix, outputs);
+      cache->Store(outputs);
+      delete cache;
     }
     LOG_DEBUG() << "AT code generation done.\n";
     trans->Finish();
@@ -659,10 +941,15 @@ int main(int argc, char *argv[]) {
   LOG_INFO() << "Performing optimization Stage 2\n";
   if (is_fortran) {
     LOG_WARNING() << "No optimization implemented for Fortran\n";
-  } else if (optimizer) {
-    optimizer->Stage2();
   } else {
-    LOG_INFO() << "No optimizer defined\n";
+    if (optimizer) {
+      optimizer->Stage2();
+    } else {
+      LOG_INFO() << "No optimizer defined\n";
+    }
+    // Done after the optimizer as it assumes the generic grid
+    // offset functions
+    trans->Optimize();
   }
   LOG_INFO() << "Optimization Stage 2 done\n";
   
@@ -679,6 +966,11 @@ int main(int argc, char *argv[]) {
   pt::set_output_filename(
       GetMainSourceFile(proj),
       filename_target_suffix + "." + filename_suffix);
+  if (opts.ref_trans && !is_fortran &&
+      config.LookupFlag(pt::Configuration::JIT_SPECIALIZE)) {
+    pt::SetJITSource(
+        proj, GetMainSourceFile(proj)->get_unparse_output_filename());
+  }
 
   int b = backend(proj);
   LOG_INFO() << "Code generation complete.\n";
@@ -687,6 +979,14 @@ int main(int argc, char *argv[]) {
     pt::FixFortranOutput(
         GetMainSourceFile(proj)->get_unparse_output_filename());
   }
+
+  if (cache) {
+    if (b == 0) {
+      cache->Store(std::vector<string>(
+          1, GetMainSourceFile(proj)->get_unparse_output_filename()));
+    }
+    delete cache;
+  }
   
   return b;
 }
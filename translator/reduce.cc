@@ -50,11 +50,16 @@ bool Reduce::IsKernel() const {
   return kind_ == KERNEL;
 }
 
+bool Reduce::IsAsync() const {
+  SgFunctionRefExp *f = isSgFunctionRefExp(reduce_call_->get_function());
+  return f && f->get_symbol()->get_name() == REDUCE_ASYNC_NAME;
+}
+
 bool Reduce::IsReduce(SgFunctionCallExp *call) {
   SgFunctionRefExp *f = isSgFunctionRefExp(call->get_function());
   if (!f) return false;
   SgName name = f->get_symbol()->get_name();
-  return name == REDUCE_NAME;
+  return name == REDUCE_NAME || name == REDUCE_ASYNC_NAME;
 }
 
 SgVarRefExp *Reduce::GetGrid() const {
@@ -64,6 +69,13 @@ SgVarRefExp *Reduce::GetGrid() const {
   return isSgVarRefExp(ge);
 }
 
+string FusedReduce::GetName() const {
+  SgEnumVal *ev = isSgEnumVal(op);
+  PSAssert(ev);
+  return grid_param->get_name().getString() + "_" +
+      ev->get_name().getString();
+}
+
 } // namespace translator
 } // namespace physis
 
@@ -16,6 +16,7 @@
 #include "physis/physis_util.h"
 
 #define REDUCE_NAME ("PSReduce")
+#define REDUCE_ASYNC_NAME ("PSReduceAsync")
 
 namespace physis {
 namespace translator {
@@ -30,12 +31,15 @@ class Reduce: public AstAttribute {
   SgFunctionCallExp *reduce_call() const { return reduce_call_; };
   bool IsGrid() const;
   bool IsKernel() const;
+  //! Returns true if the reduction is asynchronous (PSReduceAsync).
+  bool IsAsync() const;
   //! Returns the variable referencing the grid to be reduced.
   SgVarRefExp *GetGrid() const;
   //! Returns true if a call is to the reduce intrinsic.
   /*!
     \param call A function call.
-    \return True if the call is to the reduce intrinsic.
+    \return True if the call is to the reduce intrinsic or its
+    asynchronous variant.
    */
   static bool IsReduce(SgFunctionCallExp *call);
  protected:
@@ -43,6 +47,31 @@ class Reduce: public AstAttribute {
   KIND kind_;
 };
 
+class StencilMap;
+
+//! A grid reduction fused into the last iteration of a stencil run.
+/*!
+  The run kernel of the map emitting the reduced grid accumulates the
+  points of its domain as they are computed, and the remaining points
+  of the grid are reduced by the runtime afterwards.
+ */
+struct FusedReduce {
+  //! The map emitting the reduced grid.
+  StencilMap *map;
+  //! The kernel parameter of the reduced grid.
+  SgInitializedName *grid_param;
+  //! Point type of the grid.
+  SgType *type;
+  //! Suffix of the runtime functions for the point type, e.g., Float.
+  string type_name;
+  //! The reduction operator.
+  SgExpression *op;
+  //! Pointer to the result.
+  SgExpression *buf;
+  //! Returns a name unique to the grid and operator.
+  string GetName() const;
+};
+
 
 } // namespace translator
 } // namespace physis
@@ -4,6 +4,8 @@
 #include "translator/translation_util.h"
 #include "translator/rose_fortran.h"
 #include "translator/map.h"
+#include "translator/kernel.h"
+#include "translator/grid.h"
 
 #include <boost/foreach.hpp>
 
@@ -90,12 +92,23 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridGet(
   SgExpression *offset =
       BuildGridOffset(gvref, gt->rank(), offset_exprs,
                       sil, is_kernel, is_periodic);
+  PSType storage_type;
+  bool is_reduced = GetStorageType(gt, storage_type);
   SgExpression *p = BuildGridBaseAddr(
-      si::copyExpression(gvref), gt->point_type());
+      si::copyExpression(gvref),
+      is_reduced ? BuildStorageType(storage_type) : gt->point_type());
   p = ArrayRef(p, offset);
   GridGetAttribute *gga = new GridGetAttribute(
       gt, NULL, gva, is_kernel, is_periodic, sil);
   ru::AddASTAttribute<GridGetAttribute>(p, gga);
+  // Float storage is promoted implicitly. The attribute is kept on
+  // the array reference so that the get can still be analyzed.
+  if (is_reduced && storage_type == PS_BFLOAT16) {
+    SgFunctionSymbol *fs = si::lookupFunctionSymbolInParentScopes(
+        PS_BFLOAT16_TO_FLOAT_NAME, gs_);
+    PSAssert(fs);
+    p = sb::buildFunctionCallExp(fs, sb::buildExprListExp(p));
+  }
   return p;
 }
 
@@ -108,6 +121,17 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridGet(
     bool is_kernel,
     bool is_periodic,
     const string &member_name) {
+  if (GetUserTypeLayout(gt) != PS_GRID_LAYOUT_AOS) {
+    SgExpression *offset =
+        BuildGridOffset(gvref, gt->rank(), offset_exprs,
+                        sil, is_kernel, is_periodic);
+    SgExpression *xm = BuildGridMemberRef(
+        si::copyExpression(gvref), gt, offset, member_name);
+    GridGetAttribute *gga = new GridGetAttribute(
+        gt, NULL, gva, is_kernel, is_periodic, sil, member_name);
+    ru::AddASTAttribute<GridGetAttribute>(xm, gga);
+    return xm;
+  }
   SgExpression *x = BuildGridGet(gvref, gva, gt, offset_exprs,
                                  sil, is_kernel, is_periodic);
   SgExpression *xm = Dot(x, Var(member_name));
@@ -152,17 +176,36 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridEmit(
   int nd = attr->gt()->rank();
   StencilIndexList sil;
   StencilIndexListInitSelf(sil, nd);
-  SgExpression *p1 = BuildGridBaseAddr(grid_exp, attr->gt()->point_type());
   SgExpression *offset = BuildGridOffset(
       si::copyExpression(grid_exp),
       nd, offset_exprs, &sil, true, false);
-  SgExpression *lhs = ArrayRef(p1, offset);
+  SgExpression *lhs = NULL;
+
+  if (GetUserTypeLayout(attr->gt()) != PS_GRID_LAYOUT_AOS) {
+    // ((type *)(g->p + member array offset))[offset]
+    if (!attr->is_member_access()) {
+      LOG_ERROR() << "Emitting a whole point is not supported "
+                  << "with the SoA/AoSoA layout of "
+                  << attr->gt()->type_name() << "\n";
+      PSAbort(1);
+    }
+    lhs = BuildGridMemberRef(grid_exp, attr->gt(), offset,
+                             attr->member_name());
+  } else {
+    PSType storage_type;
+    SgExpression *p1 = BuildGridBaseAddr(
+        grid_exp, GetStorageType(attr->gt(), storage_type) ?
+        BuildStorageType(storage_type) : attr->gt()->point_type());
+    lhs = ArrayRef(p1, offset);
+    if (attr->is_member_access()) {
+      SgClassDefinition *user_type_def = ru::getDefinition(isSgClassType(attr->gt()->point_type()));
+      PSAssert(user_type_def);
+      SgVarRefExp *mv = Var(attr->member_name(), user_type_def);
+      lhs = Dot(lhs, mv);
+    }
+  }
   
   if (attr->is_member_access()) {
-    SgClassDefinition *user_type_def = ru::getDefinition(isSgClassType(attr->gt()->point_type()));
-    PSAssert(user_type_def);
-    SgVarRefExp *mv = Var(attr->member_name(), user_type_def);
-    lhs = Dot(lhs, mv);
     const vector<string> &array_offsets = attr->array_offsets();
     FOREACH (it, array_offsets.begin(), array_offsets.end()) {
       SgExpression *e = ru::ParseString(*it, scope);
@@ -171,6 +214,18 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridEmit(
   }
   LOG_DEBUG() << "emit lhs: " << lhs->unparseToString() << "\n";
 
+  PSType storage_type;
+  if (GetStorageType(attr->gt(), storage_type)) {
+    if (storage_type == PS_BFLOAT16) {
+      SgFunctionSymbol *fs = si::lookupFunctionSymbolInParentScopes(
+          PS_FLOAT_TO_BFLOAT16_NAME, gs_);
+      PSAssert(fs);
+      emit_val = sb::buildFunctionCallExp(fs, sb::buildExprListExp(emit_val));
+    } else {
+      emit_val = sb::buildCastExp(emit_val, BuildStorageType(storage_type));
+    }
+  }
+
   SgExpression *emit = sb::buildAssignOp(lhs, emit_val);
   LOG_DEBUG() << "emit: " << emit->unparseToString() << "\n";
   return emit;
@@ -217,6 +272,15 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridRefInRunKernel(
   return grid_ref;
 }
 
+// Returns the grid type of a grid reference or its address; NULL if
+// not known.
+static GridType *GetGridTypeOfRef(SgExpression *gvref) {
+  if (isSgAddressOfOp(gvref)) {
+    gvref = isSgAddressOfOp(gvref)->get_operand();
+  }
+  return ru::GetASTAttribute<GridType>(gvref->get_type());
+}
+
 SgExpression *ReferenceRuntimeBuilder::BuildGridOffset(
     SgExpression *gvref,
     int num_dim,
@@ -229,6 +293,9 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridOffset(
   */
   std::string func_name = "__PSGridGetOffset";
   if (is_periodic) func_name += "Periodic";
+  GridType *gt = GetGridTypeOfRef(gvref);
+  bool is_red_black = gt && IsRedBlackLayout(gt);
+  if (is_red_black) func_name += "RB";
   func_name += toString(num_dim) + "D";
   if (!si::isPointerType(gvref->get_type())) {
     gvref = sb::buildAddressOfOp(gvref);
@@ -241,11 +308,156 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridOffset(
       = si::lookupFunctionSymbolInParentScopes(func_name);
   SgFunctionCallExp *offset_fc =
       sb::buildFunctionCallExp(fs, offset_params);
-  ru::AddASTAttribute<GridOffsetAttribute>(
-      offset_fc, new GridOffsetAttribute(num_dim, is_periodic, sil));
+  GridOffsetAttribute *attr =
+      new GridOffsetAttribute(num_dim, is_periodic, sil);
+  attr->set_red_black(is_red_black);
+  ru::AddASTAttribute<GridOffsetAttribute>(offset_fc, attr);
   return offset_fc;
 }
 
+SgExpression *ReferenceRuntimeBuilder::BuildMemberOffset(
+    SgType *point_type, SgVariableSymbol *member) {
+  // (char *)&((type *)0)->member - (char *)0
+  SgType *char_ptr = sb::buildPointerType(sb::buildCharType());
+  SgExpression *null_point =
+      sb::buildCastExp(Int(0), sb::buildPointerType(point_type));
+  SgExpression *member_addr =
+      sb::buildAddressOfOp(Arrow(null_point, Var(member)));
+  return sb::buildSubtractOp(sb::buildCastExp(member_addr, char_ptr),
+                             sb::buildCastExp(Int(0), char_ptr));
+}
+
+SgExpression *ReferenceRuntimeBuilder::BuildGridMemberRef(
+    SgExpression *gvref, const GridType *gt, SgExpression *offset,
+    const string &member_name) {
+  int layout = GetUserTypeLayout(gt);
+  PSAssert(layout != PS_GRID_LAYOUT_AOS);
+  SgVariableSymbol *member =
+      si::lookupVariableSymbolInParentScopes(member_name,
+                                             gt->point_def());
+  if (member == NULL) {
+    LOG_ERROR() << "Member not found: " << member_name << "\n";
+    PSAbort(1);
+  }
+  SgExpression *member_offset =
+      BuildMemberOffset(gt->point_type(), member);
+  SgExpression *base =
+      sb::buildCastExp(BuildGridBaseAddr(si::copyExpression(gvref), NULL),
+                       sb::buildPointerType(sb::buildCharType()));
+  SgExpression *index = NULL;
+  if (layout == PS_GRID_LAYOUT_SOA) {
+    // (type *)((char *)g->p + offsetof(point, member) * g->num_elms)
+    SgExpression *num_elms =
+        si::isPointerType(gvref->get_type()) ?
+        isSgExpression(Arrow(gvref, sb::buildOpaqueVarRefExp("num_elms"))) :
+        isSgExpression(Dot(gvref, sb::buildOpaqueVarRefExp("num_elms")));
+    base = Add(base, Mul(member_offset, num_elms));
+    index = offset;
+  } else {
+    // (type *)((char *)g->p + offset / B * B * sizeof(point)
+    //          + offsetof(point, member) * B)[offset % B]
+    base = Add(base,
+               Mul(sb::buildDivideOp(offset, Int(layout)),
+                   Int(layout), sb::buildSizeOfOp(gt->point_type())),
+               Mul(member_offset, Int(layout)));
+    index = sb::buildModOp(si::copyExpression(offset), Int(layout));
+  }
+  SgExpression *member_array =
+      sb::buildCastExp(base, sb::buildPointerType(member->get_type()));
+  return ArrayRef(member_array, index);
+}
+
+// Returns the REF_GRID_LAYOUT entry of a grid type; NULL if not given.
+static const pu::LuaValue *FindGridLayout(const Configuration &config,
+                                          const GridType *gt) {
+  const pu::LuaValue *lv = config.Lookup(Configuration::REF_GRID_LAYOUT);
+  if (lv == NULL) return NULL;
+  const pu::LuaTable *tbl = lv->getAsLuaTable();
+  if (tbl == NULL) {
+    LOG_ERROR() << "REF_GRID_LAYOUT must be a table\n";
+    PSAbort(1);
+  }
+  pu::LuaTable::KeyMapType::const_iterator it =
+      tbl->Find(gt->type_name());
+  if (it == tbl->tbl().end()) return NULL;
+  return it->second;
+}
+
+int ReferenceRuntimeBuilder::GetUserTypeLayout(const GridType *gt) {
+  if (!gt->IsUserDefinedPointType()) return PS_GRID_LAYOUT_AOS;
+  const pu::LuaValue *lv = FindGridLayout(config_, gt);
+  if (lv == NULL) return PS_GRID_LAYOUT_AOS;
+  string name;
+  double block;
+  if (lv->get(name)) {
+    if (name == "soa") return PS_GRID_LAYOUT_SOA;
+    if (name == "aos") return PS_GRID_LAYOUT_AOS;
+  } else if (lv->get(block) && block >= 1) {
+    return (int)block;
+  }
+  LOG_ERROR() << "Invalid layout for " << gt->type_name()
+              << "; must be \"aos\", \"soa\", or a positive block size\n";
+  PSAbort(1);
+  return PS_GRID_LAYOUT_AOS;
+}
+
+bool ReferenceRuntimeBuilder::IsRedBlackLayout(const GridType *gt) {
+  if (!gt->IsPrimitivePointType()) return false;
+  const pu::LuaValue *lv = FindGridLayout(config_, gt);
+  string name;
+  if (lv == NULL || !lv->get(name) || name != "redblack") return false;
+  // The runtime converts points as a whole
+  PSType storage_type;
+  if (GetStorageType(gt, storage_type)) {
+    LOG_ERROR() << "The red-black layout of " << gt->type_name()
+                << " cannot be combined with a storage type\n";
+    PSAbort(1);
+  }
+  return true;
+}
+
+bool ReferenceRuntimeBuilder::GetStorageType(const GridType *gt,
+                                             PSType &storage_type) {
+  const pu::LuaValue *lv =
+      config_.Lookup(Configuration::REF_GRID_STORAGE_TYPE);
+  if (lv == NULL) return false;
+  const pu::LuaTable *tbl = lv->getAsLuaTable();
+  if (tbl == NULL) {
+    LOG_ERROR() << "REF_GRID_STORAGE_TYPE must be a table\n";
+    PSAbort(1);
+  }
+  pu::LuaTable::KeyMapType::const_iterator it =
+      tbl->Find(gt->type_name());
+  if (it == tbl->tbl().end()) return false;
+  SgType *ty = gt->point_type();
+  string name;
+  if (it->second->get(name)) {
+    if ((name == "double" && isSgTypeDouble(ty)) ||
+        (name == "float" && isSgTypeFloat(ty))) {
+      return false;
+    }
+    if (name == "float" && isSgTypeDouble(ty)) {
+      storage_type = PS_FLOAT;
+      return true;
+    }
+    if (name == "bfloat16" && (isSgTypeDouble(ty) || isSgTypeFloat(ty))) {
+      storage_type = PS_BFLOAT16;
+      return true;
+    }
+  }
+  LOG_ERROR() << "Invalid storage type for " << gt->type_name()
+              << "; must be \"float\" or \"bfloat16\" narrower than "
+              << "the point type\n";
+  PSAbort(1);
+  return false;
+}
+
+SgType *ReferenceRuntimeBuilder::BuildStorageType(PSType storage_type) {
+  if (storage_type == PS_FLOAT) return sb::buildFloatType();
+  PSAssert(storage_type == PS_BFLOAT16);
+  return sb::buildUnsignedShortType();
+}
+
 SgClassDeclaration *ReferenceRuntimeBuilder::GetGridDecl() {
   LOG_DEBUG() << "grid type name: " << grid_type_name_ << "\n";
   SgTypedefType *grid_type = isSgTypedefType(
@@ -855,6 +1067,45 @@ void ReferenceRuntimeBuilder::BuildRunFuncBody(
           sb::buildPlusPlusOp(sb::buildVarRefExp(lv)),
           loopBody);
 
+  // Asynchronous copies and reductions of the grids modified by this
+  // run must be completed first
+  ENUMERATE(i, it, run->stencils().begin(), run->stencils().end()) {
+    string stencil_name = PS_STENCIL_MAP_STENCIL_PARAM_NAME + toString(i);
+    AppendTaskWait(it->second,
+                   sb::buildVarRefExp(stencil_name,
+                                      run_func->get_definition()),
+                   block);
+  }
+
+  // The fused reduction is not computed without any iteration
+  FusedReduce *fr = run->fused_reduce();
+  if (fr) {
+    ENUMERATE(i, it, run->stencils().begin(), run->stencils().end()) {
+      if (it->second != fr->map) continue;
+      // if (iter <= 0) __PSReduceGridT(buf, op, s.g)
+      SgFunctionSymbol *fs =
+          si::lookupFunctionSymbolInParentScopes(
+              "__PSReduceGrid" + fr->type_name, gs_);
+      PSAssert(fs);
+      SgExpression *stencil = sb::buildVarRefExp(
+          PS_STENCIL_MAP_STENCIL_PARAM_NAME + toString(i),
+          run_func->get_definition());
+      SgExprListExp *args = sb::buildExprListExp(
+          sb::buildVarRefExp(PS_FUSED_REDUCE_PARAM_NAME,
+                             run_func->get_definition()),
+          si::copyExpression(fr->op),
+          BuildStencilFieldRef(stencil,
+                               fr->grid_param->get_name().getString()));
+      si::appendStatement(
+          sb::buildIfStmt(
+              sb::buildLessOrEqualOp(sb::buildVarRefExp("iter", block),
+                                     Int(0)),
+              sb::buildExprStatement(sb::buildFunctionCallExp(fs, args)),
+              NULL),
+          block);
+      break;
+    }
+  }
 
   TraceStencilRun(run, loop, block);
   return;
@@ -865,32 +1116,372 @@ SgBasicBlock *ReferenceRuntimeBuilder::BuildRunFuncLoopBody(
   SgBasicBlock *loop_body = sb::buildBasicBlock();  
   ENUMERATE(i, it, run->stencils().begin(), run->stencils().end()) {
     StencilMap *s = it->second;
-    SgFunctionSymbol *fs = ru::getFunctionSymbol(s->run());
-    assert(fs);
     string stencilName = PS_STENCIL_MAP_STENCIL_PARAM_NAME + toString(i);
     SgExpression *stencil = sb::buildVarRefExp(stencilName,
                                                run_func->get_definition());
-    SgExprListExp *args =
-        sb::buildExprListExp(sb::buildAddressOfOp(stencil));
-    if (s->IsRedBlackVariant()) {
-      si::appendExpression(
-          args,
-          sb::buildIntVal(s->IsBlack() ? 1 : 0));
+    AppendGhostUpdate(s, stencil, loop_body);
+    SgFunctionCallExp *c =
+        BuildRunKernelCall(s, stencil, s->IsBlack() ? 1 : 0);
+    FusedReduce *fr = run->fused_reduce();
+    if (fr && fr->map == s) {
+      si::appendStatement(BuildFusedReduce(s, fr, stencil, c, run_func),
+                          loop_body);
+    } else {
+      si::appendStatement(sb::buildExprStatement(c), loop_body);
     }
-    SgFunctionCallExp *c = sb::buildFunctionCallExp(fs, args);
-    si::appendStatement(sb::buildExprStatement(c), loop_body);
+    AppendWriteMark(s, stencil, c, loop_body);
     // Call both Red and Black versions for MapRedBlack
     if (s->IsRedBlack()) {
-      args =
-          sb::buildExprListExp(
-              sb::buildAddressOfOp(si::copyExpression(stencil)),
-              sb::buildIntVal(1));
-      c = sb::buildFunctionCallExp(fs, args);
+      // Red points may be read through the ghost layers
+      AppendGhostUpdate(s, stencil, loop_body);
+      c = BuildRunKernelCall(s, si::copyExpression(stencil), 1);
       si::appendStatement(sb::buildExprStatement(c), loop_body);
+      AppendWriteMark(s, stencil, c, loop_body);
     }
   }
   return loop_body;
 }
+
+void ReferenceRuntimeBuilder::AppendGhostUpdate(
+    StencilMap *s, SgExpression *stencil, SgBasicBlock *block) {
+  // Only declared by the reference runtime
+  SgFunctionSymbol *fs =
+      si::lookupFunctionSymbolInParentScopes(PS_GRID_UPDATE_GHOST_NAME, gs_);
+  if (fs == NULL || !ru::IsCLikeLanguage()) return;
+  SgClassDefinition *stencil_def = s->GetStencilTypeDefinition();
+  FOREACH (it, s->grid_params().begin(), s->grid_params().end()) {
+    SgInitializedName *gv = *it;
+    if (!s->IsGridPeriodic(gv)) continue;
+    SgVariableSymbol *field =
+        si::lookupVariableSymbolInParentScopes(gv->get_name(), stencil_def);
+    PSAssert(field);
+    // __PSGridUpdateGhost(s.g), which does nothing unless the grid
+    // has ghost layers
+    SgExpression *g = ru::BuildFieldRef(si::copyExpression(stencil),
+                                        Var(field));
+    si::appendStatement(
+        sb::buildExprStatement(
+            sb::buildFunctionCallExp(fs, sb::buildExprListExp(g))),
+        block);
+  }
+}
+
+void ReferenceRuntimeBuilder::AppendTaskWait(
+    StencilMap *s, SgExpression *stencil, SgBasicBlock *block) {
+  // Only declared by the reference runtime
+  SgFunctionSymbol *fs =
+      si::lookupFunctionSymbolInParentScopes(PS_GRID_WAIT_NAME, gs_);
+  if (fs == NULL || !ru::IsCLikeLanguage()) return;
+  Kernel *kernel = ru::GetASTAttribute<Kernel>(s->getKernel());
+  PSAssert(kernel);
+  SgClassDefinition *stencil_def = s->GetStencilTypeDefinition();
+  FOREACH (it, s->grid_params().begin(), s->grid_params().end()) {
+    SgInitializedName *gv = *it;
+    if (!kernel->IsGridParamModified(gv)) continue;
+    SgVariableSymbol *field =
+        si::lookupVariableSymbolInParentScopes(gv->get_name(), stencil_def);
+    PSAssert(field);
+    // __PSGridWait(s.g)
+    SgExpression *g = ru::BuildFieldRef(si::copyExpression(stencil),
+                                        Var(field));
+    si::appendStatement(
+        sb::buildExprStatement(
+            sb::buildFunctionCallExp(fs, sb::buildExprListExp(g))),
+        block);
+  }
+}
+
+void ReferenceRuntimeBuilder::AppendWriteMark(
+    StencilMap *s, SgExpression *stencil, SgFunctionCallExp *call,
+    SgBasicBlock *block) {
+  // Only declared by the reference runtime
+  SgFunctionSymbol *fs =
+      si::lookupFunctionSymbolInParentScopes(PS_GRID_MARK_WRITTEN_NAME, gs_);
+  if (fs == NULL || !ru::IsCLikeLanguage()) return;
+  // __PSRunTilesActive records the changes by itself
+  SgFunctionSymbol *callee = call->getAssociatedFunctionSymbol();
+  if (callee && callee->get_name().getString() == PS_RUN_TILES_ACTIVE_NAME) {
+    return;
+  }
+  Kernel *kernel = ru::GetASTAttribute<Kernel>(s->getKernel());
+  PSAssert(kernel);
+  SgClassDefinition *stencil_def = s->GetStencilTypeDefinition();
+  FOREACH (it, s->grid_params().begin(), s->grid_params().end()) {
+    SgInitializedName *gv = *it;
+    if (!kernel->IsGridParamModified(gv)) continue;
+    SgVariableSymbol *field =
+        si::lookupVariableSymbolInParentScopes(gv->get_name(), stencil_def);
+    PSAssert(field);
+    // __PSGridMarkWritten(s.g)
+    SgExpression *g = ru::BuildFieldRef(si::copyExpression(stencil),
+                                        Var(field));
+    si::appendStatement(
+        sb::buildExprStatement(
+            sb::buildFunctionCallExp(fs, sb::buildExprListExp(g))),
+        block);
+  }
+}
+
+SgFunctionCallExp *ReferenceRuntimeBuilder::BuildRunActiveTilesCall(
+    StencilMap *s, SgExpression *stencil, int rb) {
+  // Only declared by the reference runtime
+  SgFunctionSymbol *fs =
+      si::lookupFunctionSymbolInParentScopes(PS_RUN_TILES_ACTIVE_NAME, gs_);
+  if (fs == NULL) return NULL;
+  const SgInitializedNamePtrList &gparams = s->grid_params();
+  // Grids are given as bit masks
+  if (gparams.size() > sizeof(int) * 8) {
+    LOG_WARNING() << "Activity not tracked for stencils with more than "
+                  << sizeof(int) * 8 << " grids\n";
+    return NULL;
+  }
+  Kernel *kernel = ru::GetASTAttribute<Kernel>(s->getKernel());
+  PSAssert(kernel);
+  SgClassDefinition *stencil_def = s->GetStencilTypeDefinition();
+  int width = 0;
+  int read = 0, written = 0;
+  vector<SgExpression*> grids;
+  for (unsigned i = 0; i < gparams.size(); ++i) {
+    SgInitializedName *gv = gparams[i];
+    GridVarAttribute *gva = ru::GetASTAttribute<GridVarAttribute>(gv);
+    PSAssert(gva);
+    StencilRange &sr = gva->sr();
+    // Tiles depending on unknown or wrapped points are always computed
+    if (width >= 0 && sr.IsNeighborAccess() && !s->IsGridPeriodic(gv)) {
+      width = std::max(width, sr.GetMaxWidth());
+    } else if (kernel->IsGridParamRead(gv)) {
+      width = -1;
+    }
+    if (kernel->IsGridParamRead(gv)) read |= 1 << i;
+    if (kernel->IsGridParamModified(gv)) written |= 1 << i;
+    SgVariableSymbol *field =
+        si::lookupVariableSymbolInParentScopes(gv->get_name(), stencil_def);
+    PSAssert(field);
+    grids.push_back(ru::BuildFieldRef(si::copyExpression(stencil),
+                                      Var(field)));
+  }
+  // __PSRunTilesActive(run_tile, &s, sizeof(s), rb, num_dims, width,
+  //                    read, written, num_grids, s.g0, s.g1, ...)
+  SgFunctionDeclaration *tile_func = BuildRunTileFunc(s);
+  SgExprListExp *args =
+      sb::buildExprListExp(
+          sb::buildFunctionRefExp(tile_func),
+          sb::buildAddressOfOp(stencil),
+          sb::buildSizeOfOp(si::copyExpression(stencil)),
+          sb::buildIntVal(rb),
+          sb::buildIntVal(s->getNumDim()),
+          sb::buildIntVal(width),
+          sb::buildIntVal(read),
+          sb::buildIntVal(written));
+  si::appendExpression(args, sb::buildIntVal(gparams.size()));
+  FOREACH (it, grids.begin(), grids.end()) {
+    si::appendExpression(args, *it);
+  }
+  return sb::buildFunctionCallExp(fs, args);
+}
+
+SgFunctionCallExp *ReferenceRuntimeBuilder::BuildRunKernelCall(
+    StencilMap *s, SgExpression *stencil, int rb) {
+  if (config_.LookupFlag(Configuration::REF_ACTIVITY_MASK) &&
+      ru::IsCLikeLanguage()) {
+    SgFunctionCallExp *call = BuildRunActiveTilesCall(s, stencil, rb);
+    if (call) return call;
+  }
+  if (config_.LookupFlag(Configuration::TILE_SCHEDULER) &&
+      ru::IsCLikeLanguage()) {
+    // __PSRunTiles(run_tile, &s, sizeof(s), rb, num_dims)
+    SgFunctionDeclaration *tile_func = BuildRunTileFunc(s);
+    SgExprListExp *args =
+        sb::buildExprListExp(
+            sb::buildFunctionRefExp(tile_func),
+            sb::buildAddressOfOp(stencil),
+            sb::buildSizeOfOp(si::copyExpression(stencil)),
+            sb::buildIntVal(rb),
+            sb::buildIntVal(s->getNumDim()));
+    SgFunctionSymbol *fs =
+        si::lookupFunctionSymbolInParentScopes(PS_RUN_TILES_NAME, gs_);
+    if (fs) return sb::buildFunctionCallExp(fs, args);
+    return sb::buildFunctionCallExp(
+        sb::buildFunctionRefExp(PS_RUN_TILES_NAME), args);
+  }
+  SgFunctionSymbol *fs = ru::getFunctionSymbol(s->run());
+  assert(fs);
+  SgExprListExp *args =
+      sb::buildExprListExp(sb::buildAddressOfOp(stencil));
+  if (s->IsRedBlackVariant()) {
+    si::appendExpression(args, sb::buildIntVal(rb));
+  }
+  return sb::buildFunctionCallExp(fs, args);
+}
+
+SgFunctionDeclaration *ReferenceRuntimeBuilder::BuildRunTileFunc(
+    StencilMap *s) {
+  string name = s->GetRunName() + "_" +
+      string(PS_STENCIL_MAP_TILE_SUFFIX_NAME);
+  // Multiple runs may use the same stencil map type
+  SgFunctionSymbol *tile_symbol =
+      si::lookupFunctionSymbolInParentScopes(name, gs_);
+  if (tile_symbol) return tile_symbol->get_declaration();
+
+  SgFunctionParameterList *parlist = sb::buildFunctionParameterList();
+  SgInitializedName *stencil_param =
+      sb::buildInitializedName(
+          PS_STENCIL_MAP_STENCIL_PARAM_NAME,
+          sb::buildPointerType(sb::buildConstType(sb::buildVoidType())));
+  si::appendArg(parlist, stencil_param);
+  SgInitializedName *rb_param =
+      sb::buildInitializedName(PS_STENCIL_MAP_RB_PARAM_NAME,
+                               sb::buildIntType());
+  si::appendArg(parlist, rb_param);
+
+  SgFunctionDeclaration *tile_func = ru::BuildFunctionDeclaration(
+      name, sb::buildVoidType(), parlist, gs_);
+  ru::SetFunctionStatic(tile_func);
+  si::attachComment(tile_func, "Generated by " + string(__FUNCTION__));
+
+  // run(s, rb) with the stencil struct type recovered
+  SgExprListExp *args =
+      sb::buildExprListExp(
+          sb::buildCastExp(
+              Var(stencil_param),
+              sb::buildPointerType(
+                  sb::buildConstType(s->stencil_type()))));
+  if (s->IsRedBlackVariant()) {
+    si::appendExpression(args, Var(rb_param));
+  }
+  SgFunctionSymbol *run_symbol = ru::getFunctionSymbol(s->run());
+  PSAssert(run_symbol);
+  si::appendStatement(
+      sb::buildExprStatement(sb::buildFunctionCallExp(run_symbol, args)),
+      tile_func->get_definition()->get_body());
+  si::insertStatementAfter(s->run(), tile_func);
+  return tile_func;
+}
+
+SgFunctionDeclaration *ReferenceRuntimeBuilder::BuildRunKernelReduceFunc(
+    StencilMap *s, FusedReduce *fr) {
+  string name = s->GetRunName() + "_" +
+      string(PS_STENCIL_MAP_REDUCE_SUFFIX_NAME) + "_" + fr->GetName();
+  // Multiple runs may use the same stencil map type
+  SgFunctionSymbol *reduce_symbol =
+      si::lookupFunctionSymbolInParentScopes(name, gs_);
+  if (reduce_symbol) return reduce_symbol->get_declaration();
+
+  SgFunctionParameterList *parlist = BuildRunKernelFuncParameterList(s);
+  SgInitializedName *stencil_param = parlist->get_args()[0];
+  si::appendArg(parlist,
+                sb::buildInitializedName(PS_FUSED_REDUCE_PARAM_NAME,
+                                         sb::buildPointerType(fr->type)));
+  SgFunctionDeclaration *reduce_func = ru::BuildFunctionDeclaration(
+      name, sb::buildVoidType(), parlist, gs_);
+  ru::SetFunctionStatic(reduce_func);
+  si::attachComment(reduce_func, "Generated by " + string(__FUNCTION__));
+  SgBasicBlock *body = reduce_func->get_definition()->get_body();
+
+  // T acc = __PSReduceIdentityT(op);
+  SgFunctionSymbol *identity =
+      si::lookupFunctionSymbolInParentScopes(
+          PS_REDUCE_IDENTITY_NAME + fr->type_name, gs_);
+  PSAssert(identity);
+  SgVariableDeclaration *acc = sb::buildVariableDeclaration(
+      PS_FUSED_REDUCE_ACC_NAME, fr->type,
+      sb::buildAssignInitializer(
+          sb::buildFunctionCallExp(
+              identity, sb::buildExprListExp(si::copyExpression(fr->op)))),
+      body);
+  si::appendStatement(acc, body);
+
+  vector<SgVariableDeclaration*> indices;
+  BuildRunKernelFuncBody(s, parlist, indices, body);
+
+  // Accumulate each point right after the kernel call
+  SgBasicBlock *inner_block = NULL;
+  vector<SgNode*> loops =
+      ru::QuerySubTreeAttribute<RunKernelLoopAttribute>(body);
+  FOREACH (it, loops.begin(), loops.end()) {
+    if (ru::GetASTAttribute<RunKernelLoopAttribute>(*it)->dim() == 1) {
+      inner_block = isSgBasicBlock(isSgForStatement(*it)->get_loop_body());
+    }
+  }
+  PSAssert(inner_block);
+  SgExpression *g = BuildGridRefInRunKernel(fr->grid_param, reduce_func);
+  SgExpressionPtrList offset_exprs;
+  FOREACH (it, indices.begin(), indices.end()) {
+    offset_exprs.push_back(Var(*it));
+  }
+  SgExpression *offset = BuildGridOffset(g, s->getNumDim(), &offset_exprs,
+                                         NULL, true, false);
+  // Not an access by the kernel
+  ru::RemoveASTAttribute<GridOffsetAttribute>(offset);
+  SgExpression *x = ArrayRef(BuildGridBaseAddr(si::copyExpression(g),
+                                               fr->type), offset);
+  string op_name = isSgEnumVal(fr->op)->get_name().getString();
+  SgExpression *accum = NULL;
+  if (op_name == "PS_SUM") {
+    accum = sb::buildPlusAssignOp(Var(acc), x);
+  } else if (op_name == "PS_PROD") {
+    accum = sb::buildMultAssignOp(Var(acc), x);
+  } else {
+    // acc = x > acc ? x : acc
+    SgExpression *cmp = op_name == "PS_MAX" ?
+        isSgExpression(sb::buildGreaterThanOp(x, Var(acc))) :
+        isSgExpression(sb::buildLessThanOp(x, Var(acc)));
+    accum = sb::buildAssignOp(
+        Var(acc),
+        sb::buildConditionalExp(cmp, si::copyExpression(x), Var(acc)));
+  }
+  si::appendStatement(sb::buildExprStatement(accum), inner_block);
+
+  // *buf = acc;
+  si::appendStatement(
+      sb::buildAssignStatement(
+          sb::buildPointerDerefExp(Var(parlist->get_args().back())),
+          Var(acc)),
+      body);
+  ru::AddASTAttribute(
+      reduce_func, new RunKernelAttribute(s, stencil_param));
+  si::insertStatementAfter(s->run(), reduce_func);
+  return reduce_func;
+}
+
+SgStatement *ReferenceRuntimeBuilder::BuildFusedReduce(
+    StencilMap *s, FusedReduce *fr, SgExpression *stencil,
+    SgFunctionCallExp *kernel_call, SgFunctionDeclaration *run_func) {
+  SgScopeStatement *scope = run_func->get_definition()->get_body();
+  SgBasicBlock *last = sb::buildBasicBlock();
+  // run_reduce(&s, buf);
+  SgFunctionDeclaration *reduce_func = BuildRunKernelReduceFunc(s, fr);
+  SgExpression *buf = sb::buildVarRefExp(PS_FUSED_REDUCE_PARAM_NAME, scope);
+  si::appendStatement(
+      sb::buildExprStatement(
+          sb::buildFunctionCallExp(
+              ru::getFunctionSymbol(reduce_func),
+              sb::buildExprListExp(
+                  sb::buildAddressOfOp(si::copyExpression(stencil)),
+                  buf))),
+      last);
+  // __PSReduceGridOutsideT(buf, op, s.g, &s.dom);
+  SgFunctionSymbol *fs =
+      si::lookupFunctionSymbolInParentScopes(
+          PS_REDUCE_GRID_OUTSIDE_NAME + fr->type_name, gs_);
+  PSAssert(fs);
+  SgExprListExp *args = sb::buildExprListExp(
+      si::copyExpression(buf), si::copyExpression(fr->op),
+      BuildStencilFieldRef(si::copyExpression(stencil),
+                           fr->grid_param->get_name().getString()),
+      sb::buildAddressOfOp(
+          BuildStencilFieldRef(si::copyExpression(stencil),
+                               PS_STENCIL_MAP_DOM_NAME)));
+  si::appendStatement(
+      sb::buildExprStatement(sb::buildFunctionCallExp(fs, args)), last);
+  // if (i == iter - 1) {...} else run(&s);
+  SgExpression *cond = sb::buildEqualityOp(
+      sb::buildVarRefExp("i", scope),
+      Sub(sb::buildVarRefExp("iter", scope), Int(1)));
+  return sb::buildIfStmt(
+      cond, last,
+      sb::buildBasicBlock(sb::buildExprStatement(kernel_call)));
+}
   
 
 void ReferenceRuntimeBuilder::TraceStencilRun(Run *run,
@@ -977,6 +1568,23 @@ SgVariableDeclaration *ReferenceRuntimeBuilder::BuildTypeInfo(
   if (gt->IsPrimitivePointType()) {
     si::appendExpression(type_info_init_args, Int(0));
     //si::appendExpression(type_info_init_args, sb::buildNullExpression());
+    PSType storage_type;
+    bool is_reduced = GetStorageType(gt, storage_type);
+    bool is_red_black = IsRedBlackLayout(gt);
+    if (is_reduced || is_red_black) {
+      // members, layout
+      si::appendExpression(type_info_init_args, Int(0));
+      si::appendExpression(
+          type_info_init_args,
+          Int(is_red_black ? PS_GRID_LAYOUT_RED_BLACK : PS_GRID_LAYOUT_AOS));
+    }
+    if (is_reduced) {
+      // storage_size, storage_type
+      si::appendExpression(
+          type_info_init_args,
+          sb::buildSizeOfOp(BuildStorageType(storage_type)));
+      si::appendExpression(type_info_init_args, Int(storage_type));
+    }
   } else {
     // MemberInfo
     SgTypedefType *member_info_type =
@@ -1000,6 +1608,9 @@ SgVariableDeclaration *ReferenceRuntimeBuilder::BuildTypeInfo(
     SgVariableSymbol *member_dim_field =
         si::lookupVariableSymbolInParentScopes("dim", member_info_def);
     PSAssert(member_dim_field);
+    SgVariableSymbol *member_offset_field =
+        si::lookupVariableSymbolInParentScopes("offset", member_info_def);
+    PSAssert(member_offset_field);
 
     SgClassDefinition *utype = gt->point_def();
     // MemberInfo variable declaration
@@ -1012,6 +1623,7 @@ SgVariableDeclaration *ReferenceRuntimeBuilder::BuildTypeInfo(
 
     si::appendExpression(type_info_init_args, Int(members.size()));
     si::appendExpression(type_info_init_args, Var(member_info));
+    si::appendExpression(type_info_init_args, Int(GetUserTypeLayout(gt)));
     
     for (int i = 0; i < (int)members.size(); ++i) {
       SgVariableDeclaration *member_decl = isSgVariableDeclaration(members[i]);
@@ -1056,6 +1668,14 @@ SgVariableDeclaration *ReferenceRuntimeBuilder::BuildTypeInfo(
       stmts.push_back(sb::buildAssignStatement(rank_lhs, rank_rhs));
       // Reorder the rank and dim field assignment
       std::swap(stmts[stmts.size()-1], stmts[stmts.size()-2]);
+      // offset
+      SgExpression *offset_lhs = Dot(ArrayRef(Var(member_info), Int(i)), Var(member_offset_field));
+      SgVariableSymbol *member_symbol =
+          isSgVariableSymbol(member_in->search_for_symbol_from_symbol_table());
+      PSAssert(member_symbol);
+      SgExpression *offset_rhs =
+          BuildMemberOffset(gt->point_type(), member_symbol);
+      stmts.push_back(sb::buildAssignStatement(offset_lhs, offset_rhs));
     
     }
   }
@@ -1084,6 +1704,13 @@ SgFunctionParameterList *ReferenceRuntimeBuilder::BuildRunFuncParameterList(Run
   SgFunctionParameterList *parlist = sb::buildFunctionParameterList();  
   si::appendArg(parlist, sb::buildInitializedName("iter",
                                                   sb::buildIntType()));
+  // Pointer to the result of the fused reduction
+  FusedReduce *fr = run->fused_reduce();
+  if (fr) {
+    si::appendArg(parlist,
+                  sb::buildInitializedName(PS_FUSED_REDUCE_PARAM_NAME,
+                                           sb::buildPointerType(fr->type)));
+  }
   /* auto tuning & has dynamic arguments */
   if (config_.auto_tuning() && config_.ndynamic() > 1) {
     AddDynamicParameter(parlist);
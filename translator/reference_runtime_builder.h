@@ -173,6 +173,44 @@ class ReferenceRuntimeBuilder: virtual public BuilderInterface {
       Run *run, SgFunctionDeclaration *run_func);
   virtual SgBasicBlock *BuildRunFuncLoopBody(
       Run *run, SgFunctionDeclaration *run_func);
+  //! Build a run-tile callback for the tile scheduler.
+  /*!
+    The callback has the __PSRunTileFunc signature and just calls the
+    run kernel of the stencil map with the given stencil struct.
+
+    \param s The stencil map object.
+    
+    \return The callback declaration, inserted after the run kernel.
+   */
+  virtual SgFunctionDeclaration *BuildRunTileFunc(StencilMap *s);
+  //! Build a run kernel that also reduces the emitted grid.
+  /*!
+    The kernel takes a pointer to the result after the parameters of
+    the run kernel, and accumulates the points of the domain in a
+    local variable, which is stored to the result at the end.
+
+    \param s The stencil map object.
+    \param fr The fused reduction.
+    \return The kernel declaration, inserted after the run kernel.
+   */
+  virtual SgFunctionDeclaration *BuildRunKernelReduceFunc(
+      StencilMap *s, FusedReduce *fr);
+  //! Build the statement of the fused reduction in the run loop.
+  /*!
+    The fused run kernel and the reduction of the points outside the
+    domain are called in the last iteration; the original run kernel
+    call is used otherwise.
+
+    \param s The stencil map object.
+    \param fr The fused reduction.
+    \param stencil The stencil struct variable.
+    \param kernel_call The original run kernel call.
+    \param run_func The run function.
+   */
+  virtual SgStatement *BuildFusedReduce(StencilMap *s, FusedReduce *fr,
+                                        SgExpression *stencil,
+                                        SgFunctionCallExp *kernel_call,
+                                        SgFunctionDeclaration *run_func);
 
   virtual void TraceStencilRun(Run *run, SgScopeStatement *loop,
                                SgScopeStatement *cur_scope);
@@ -181,6 +219,29 @@ class ReferenceRuntimeBuilder: virtual public BuilderInterface {
   virtual SgVariableDeclaration *BuildTypeInfo(GridType *gt,
                                                SgStatementPtrList &stmts,
                                                SgScopeStatement *scope);
+  //! Returns the layout of a user-defined point type
+  /*!
+    The layout is selected per grid type with REF_GRID_LAYOUT, e.g.,
+    REF_GRID_LAYOUT = {PSGrid3DPoint = "soa", PSGrid2DPoint = 8},
+    where a number designates the AoSoA block size.
+   */
+  virtual int GetUserTypeLayout(const GridType *gt);
+  //! Returns true if a grid type is in the red-black layout
+  /*!
+    Grids of primitive types are stored with red and black points
+    separated with REF_GRID_LAYOUT, e.g.,
+    REF_GRID_LAYOUT = {PSGrid3DFloat = "redblack"}.
+   */
+  virtual bool IsRedBlackLayout(const GridType *gt);
+  //! Returns the storage type of a reduced-precision grid
+  /*!
+    The storage type is selected per grid type with
+    REF_GRID_STORAGE_TYPE, e.g.,
+    REF_GRID_STORAGE_TYPE = {PSGrid3DDouble = "float",
+                             PSGrid3DFloat = "bfloat16"}.
+    Only float and double grids can be stored in a narrower type.
+   */
+  virtual bool GetStorageType(const GridType *gt, PSType &storage_type);
 
   // REFERENCE backend uses the given user-type as is, so the below
   // functions for user-given types just return NULL.
@@ -221,6 +282,70 @@ class ReferenceRuntimeBuilder: virtual public BuilderInterface {
   BuilderInterface *delegator_;
   SgTypedefType *dom_type_;
   SgClassDeclaration *GetGridDecl();
+  //! Build a call to the run kernel of a stencil map.
+  /*!
+    The call goes through the tile scheduler when TILE_SCHEDULER is
+    enabled, and only over the tiles affected by changed inputs when
+    REF_ACTIVITY_MASK is enabled.
+
+    \param s The stencil map object.
+    \param stencil The stencil struct variable.
+    \param rb The red-black color.
+   */
+  virtual SgFunctionCallExp *BuildRunKernelCall(
+      StencilMap *s, SgExpression *stencil, int rb);
+  //! Build a call to run a stencil map over the active tiles.
+  /*!
+    \return NULL if not supported.
+   */
+  virtual SgFunctionCallExp *BuildRunActiveTilesCall(
+      StencilMap *s, SgExpression *stencil, int rb);
+  //! Append calls to fill the ghost layers of periodic grids.
+  /*!
+    \param s The stencil map object.
+    \param stencil The stencil struct variable.
+    \param block The block to append the calls to.
+   */
+  virtual void AppendGhostUpdate(StencilMap *s, SgExpression *stencil,
+                                 SgBasicBlock *block);
+  //! Append calls to wait for asynchronous tasks reading modified grids.
+  /*!
+    \param s The stencil map object.
+    \param stencil The stencil struct variable.
+    \param block The block to append the calls to.
+   */
+  virtual void AppendTaskWait(StencilMap *s, SgExpression *stencil,
+                              SgBasicBlock *block);
+  //! Append calls to record the grids modified by a kernel call.
+  /*!
+    Activity masks of the grids are only updated by
+    __PSRunTilesActive, so kernel calls not going through it must
+    mark the grids they modify as changed.
+
+    \param s The stencil map object.
+    \param stencil The stencil struct variable.
+    \param call The kernel call.
+    \param block The block to append the calls to.
+   */
+  virtual void AppendWriteMark(StencilMap *s, SgExpression *stencil,
+                               SgFunctionCallExp *call,
+                               SgBasicBlock *block);
+  //! Build a reference to a point member in the SoA or AoSoA layout.
+  /*!
+    \param gvref The grid reference.
+    \param gt The grid type.
+    \param offset The linear offset of the point.
+    \param member_name The name of the member.
+   */
+  virtual SgExpression *BuildGridMemberRef(SgExpression *gvref,
+                                           const GridType *gt,
+                                           SgExpression *offset,
+                                           const string &member_name);
+  //! Build the type of the grid buffer of a reduced-precision grid.
+  virtual SgType *BuildStorageType(PSType storage_type);
+  //! Build the byte offset of a member in a point type.
+  virtual SgExpression *BuildMemberOffset(SgType *point_type,
+                                          SgVariableSymbol *member);
   virtual SgExpression *BuildDomFieldRef(SgExpression *domain,
                                          string fname);
   
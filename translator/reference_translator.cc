@@ -12,6 +12,8 @@
 #include "translator/builder_interface.h"
 #include "translator/physis_names.h"
 #include "translator/rose_fortran.h"
+#include "translator/stencil_analysis.h"
+#include "translator/kernel.h"
 
 namespace si = SageInterface;
 namespace sb = SageBuilder;
@@ -25,7 +27,12 @@ ReferenceTranslator::ReferenceTranslator(const Configuration &config):
     Translator(config),
     flag_constant_grid_size_optimization_(true),
     validate_ast_(true),
+    flag_constant_grid_offset_optimization_(true),
+    flag_jit_specialization_(false),
+    flag_periodic_ghost_(true),
     grid_create_name_("__PSGridNew") {
+  flag_jit_specialization_ =
+      config.LookupFlag(Configuration::JIT_SPECIALIZE);
   target_specific_macro_ = "PHYSIS_REF";
   if (getenv("PHYSISC_NO_VALIDATION")) {
     validate_ast_ = false;
@@ -70,6 +77,8 @@ void ReferenceTranslator::Translate() {
 
   ProcessUserDefinedPointType();
 
+  FuseReductions();
+
   DefineMapSpecificTypesAndFunctions();
   
   traverseBottomUp(project_);
@@ -85,6 +94,98 @@ void ReferenceTranslator::Translate() {
   ValidateASTConsistency();
 }
 
+// Returns the suffix of the runtime reduction functions for a point
+// type; empty if not supported.
+static string GetReduceTypeName(SgType *type) {
+  if (isSgTypeFloat(type)) {
+    return "Float";
+  } else if (isSgTypeDouble(type)) {
+    return "Double";
+  } else if (isSgTypeInt(type)) {
+    return "Int";
+  } else if (isSgTypeLong(type)) {
+    return "Long";
+  }
+  return "";
+}
+
+// Returns the reduction that immediately follows a run statement,
+// skipping the grids freed after the run.
+static Reduce *FindReduceAfter(SgStatement *run_stmt,
+                               TranslationContext *tx) {
+  for (SgStatement *stmt = si::getNextStatement(run_stmt); stmt;
+       stmt = si::getNextStatement(stmt)) {
+    SgExprStatement *es = isSgExprStatement(stmt);
+    if (es == NULL) return NULL;
+    SgFunctionCallExp *call = isSgFunctionCallExp(es->get_expression());
+    if (call == NULL) return NULL;
+    Reduce *rd = ru::GetASTAttribute<Reduce>(call);
+    if (rd) return rd;
+    if (tx->IsFree(call) == NULL) return NULL;
+  }
+  return NULL;
+}
+
+void ReferenceTranslator::FuseReductions() {
+  if (!config_.LookupFlag(Configuration::REF_FUSE_REDUCTION) ||
+      !ru::IsCLikeLanguage()) return;
+  if (config_.auto_tuning() ||
+      config_.LookupFlag(Configuration::TILE_SCHEDULER) ||
+      config_.LookupFlag(Configuration::REF_ACTIVITY_MASK)) {
+    LOG_WARNING() << "Reductions not fused with auto tuning, the tile scheduler or activity masks\n";
+    return;
+  }
+  FOREACH (it, tx_->run_map().begin(), tx_->run_map().end()) {
+    Run *run = it->second;
+    SgExprStatement *run_stmt = isSgExprStatement(it->first->get_parent());
+    if (run_stmt == NULL) continue;
+    Reduce *rd = FindReduceAfter(run_stmt, tx_);
+    if (rd == NULL || !rd->IsGrid() || rd->IsAsync()) continue;
+    SgExpressionPtrList &args =
+        rd->reduce_call()->get_args()->get_expressions();
+    // The operator must be known to select the accumulation
+    SgEnumVal *op = isSgEnumVal(args[1]);
+    if (op == NULL) continue;
+    SgInitializedName *gv = rd->GetGrid()->get_symbol()->get_declaration();
+    GridType *gt = ru::GetASTAttribute<GridType>(gv->get_type());
+    PSType storage_type;
+    string type_name = GetReduceTypeName(gt->point_type());
+    if (type_name.empty() || builder()->IsRedBlackLayout(gt) ||
+        builder()->GetStorageType(gt, storage_type)) continue;
+    // Only supported by the reference runtime
+    if (si::lookupFunctionSymbolInParentScopes(
+            PS_REDUCE_GRID_OUTSIDE_NAME + type_name, global_scope_) == NULL) {
+      continue;
+    }
+    // Fused into the last map emitting the grid
+    StencilMap *map = NULL;
+    SgInitializedName *param = NULL;
+    FOREACH (sit, run->stencils().begin(), run->stencils().end()) {
+      StencilMap *s = sit->second;
+      Kernel *kernel = ru::GetASTAttribute<Kernel>(s->getKernel());
+      for (unsigned i = 0; i < s->grid_args().size(); ++i) {
+        if (s->grid_args()[i] == gv &&
+            kernel->IsGridParamModified(s->grid_params()[i])) {
+          map = s;
+          param = s->grid_params()[i];
+        }
+      }
+    }
+    if (map == NULL || map->IsRedBlackVariant()) continue;
+    LOG_INFO() << "Fusing reduction of " << gv->get_name().getString()
+               << " into " << run->GetName() << "\n";
+    FusedReduce *fr = new FusedReduce();
+    fr->map = map;
+    fr->grid_param = param;
+    fr->type = gt->point_type();
+    fr->type_name = type_name;
+    fr->op = si::copyExpression(op);
+    fr->buf = si::copyExpression(args[0]);
+    run->set_fused_reduce(fr);
+    si::removeStatement(isSgStatement(rd->reduce_call()->get_parent()));
+  }
+}
+
 void ReferenceTranslator::FixAST() {
   if (!rose_util::IsFortranLikeLanguage()) {
     FixGridType();
@@ -124,41 +225,113 @@ void ReferenceTranslator::Optimize() {
   }
 }
 
+bool ReferenceTranslator::GetPeriodicGhostWidth(const Grid *g,
+                                                IntVector &width) {
+  width.assign(g->getNumDim(), 0);
+  if (!flag_periodic_ghost_ || !g->periodic()) return false;
+  // The runtime copies points as a whole in the natural order
+  PSType storage_type;
+  if (!g->getType()->IsPrimitivePointType() ||
+      builder()->GetStorageType(g->getType(), storage_type) ||
+      builder()->IsRedBlackLayout(g->getType())) {
+    return false;
+  }
+  IntVector offset_min, offset_max;
+  if (!g->stencil_range().GetNeighborAccess(offset_min, offset_max)) {
+    return false;
+  }
+  bool has_ghost = false;
+  for (int i = 0; i < g->getNumDim(); ++i) {
+    width[i] = std::max(std::max(-offset_min[i], offset_max[i]), (PSIndex)0);
+    if (width[i] > 0) has_ghost = true;
+  }
+  return has_ghost;
+}
+
+bool ReferenceTranslator::HasPeriodicGhost(SgInitializedName *gv) {
+  const GridSet *gs = tx_->findGrid(gv);
+  if (gs == NULL || gs->empty()) return false;
+  FOREACH (it, gs->begin(), gs->end()) {
+    IntVector width;
+    if (*it == NULL || !GetPeriodicGhostWidth(*it, width)) return false;
+  }
+  return true;
+}
+
+// Returns the static size shared by all grids a grid expression may
+// refer to. Grids of unknown or different sizes are left to the
+// generic code. The ghost layers are included if with_ghost is given.
+static bool GetStaticGridSize(SgExpression *gexp, TranslationContext *tx,
+                              SizeVector &size,
+                              ReferenceTranslator *with_ghost=NULL) {
+  while (isSgAddressOfOp(gexp) || isSgCastExp(gexp)) {
+    gexp = isSgUnaryOp(gexp)->get_operand();
+  }
+  SgVarRefExp *gvref = isSgVarRefExp(gexp);
+  if (gvref == NULL) return false;
+  const GridSet *gs = tx->findGrid(si::convertRefToInitializedName(gvref));
+  if (gs == NULL || gs->empty()) return false;
+  size.clear();
+  FOREACH (it, gs->begin(), gs->end()) {
+    const Grid *g = *it;
+    if (g == NULL || !g->has_static_size()) return false;
+    SizeVector s = g->static_size();
+    IntVector width;
+    if (with_ghost && with_ghost->GetPeriodicGhostWidth(g, width)) {
+      for (size_t i = 0; i < width.size(); ++i) s[i] += width[i] * 2;
+    }
+    if (size.empty()) {
+      size = s;
+    } else if (size != s) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void ReferenceTranslator::optimizeConstantSizedGrids() {
-#if NOT_SUPPORTED_YET
   SgNodePtrList func_calls =
       NodeQuery::querySubTree(project_, V_SgFunctionCallExp);
-  FOREACH(it, func_calls.begin(), func_calls.end()) {
+  int num_folded = 0;
+  FOREACH (it, func_calls.begin(), func_calls.end()) {
     SgFunctionCallExp *func_call = isSgFunctionCallExp(*it);
-    ROSE_ASSERT(func_call);
-    LOG_DEBUG() << "func call: " << func_call->unparseToString() << "\n";
+    PSAssert(func_call);
     SgFunctionSymbol *func_symbol = func_call->getAssociatedFunctionSymbol();
-    ROSE_ASSERT(func_symbol);
-
-    if (func_symbol != grid_dim_get_func_) continue;
-    SgExpression *grid_arg_exp =
-        func_call->get_args()->get_expressions()[0];
-    ROSE_ASSERT(grid_arg_exp);
-    SgInitializedName* grid_var =
-        si::convertRefToInitializedName(grid_arg_exp);
-    ROSE_ASSERT(grid_var);
-    const GridSet *grid_set = tx_->findGrid(grid_var);
-
-    // TODO (tatsuo): grid_set shouldn't be NULL, namely grid_var must always
-    // associated with Grids.
-    if (grid_set) {
-      break;
-    }
-
-    const Grid *grid = *(grid_set->begin());
-
-    if (grid->hasStaticSize()) {
-      unsigned int size = grid->getStaticSize()[i];
-      SgExpression *size_exp = sb::buildIntVal(size);
-      si::replaceExpression(func_call, size_exp);
+    if (func_symbol == NULL) continue;
+    const string name = func_symbol->get_name().getString();
+    const SgExpressionPtrList &args =
+        func_call->get_args()->get_expressions();
+    SizeVector size;
+    if (name == PS_GRID_DIM_NAME) {
+      // PSGridDim(g, d) -> size of dimension d
+      SgIntVal *dim = args.size() == 2 ? isSgIntVal(args[1]) : NULL;
+      if (dim == NULL || !GetStaticGridSize(args[0], tx_, size)) continue;
+      PSAssert(dim->get_value() >= 0 &&
+               dim->get_value() < (int)size.size());
+      si::replaceExpression(func_call,
+                            Int((PSIndex)size[dim->get_value()]));
+      ++num_folded;
+    } else if (flag_constant_grid_offset_optimization_ &&
+               name.find("__PSGridGetOffset") == 0 &&
+               name.find("Periodic") == string::npos &&
+               args.size() >= 2 && args.size() <= PS_MAX_DIM + 1) {
+      // __PSGridGetOffsetND(g, i, j, k) -> i + j * nx + k * (nx * ny)
+      // Strides of grids with ghost layers include the layers
+      if (name != "__PSGridGetOffset" + toString(args.size() - 1) + "D" ||
+          !GetStaticGridSize(args[0], tx_, size, this)) continue;
+      SgExpression *offset = si::copyExpression(args[1]);
+      PSIndex stride = 1;
+      for (size_t i = 2; i < args.size(); ++i) {
+        stride *= (PSIndex)size[i-2];
+        offset = Add(offset, Mul(si::copyExpression(args[i]),
+                                 Int(stride)));
+      }
+      si::replaceExpression(func_call, offset);
+      ++num_folded;
     }
   }
-#endif  
+  LOG_INFO() << num_folded
+             << " grid dimension and offset expressions folded\n";
 }
 
 void ReferenceTranslator::TranslateKernelDeclaration(
@@ -183,6 +356,23 @@ SgExprListExp *ReferenceTranslator::BuildNewArg(GridType *gt, Grid *g,
 void ReferenceTranslator::appendNewArgExtra(SgExprListExp *args,
                                             Grid *g,
                                             SgVariableDeclaration *dim_decl) {
+  if (!flag_periodic_ghost_) return;
+  IntVector width;
+  if (GetPeriodicGhostWidth(g, width)) {
+    LOG_DEBUG() << "Ghost layers of " << *g << ": " << width << "\n";
+  }
+  SgExprListExp *ghost_val = sb::buildExprListExp();
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    si::appendExpression(
+        ghost_val, Int(i < (int)width.size() ? width[i] : 0));
+  }
+  SgVariableDeclaration *ghost_var
+      = sb::buildVariableDeclaration(
+          "ghost", ivec_type_,
+          sb::buildAggregateInitializer(ghost_val, ivec_type_),
+          si::getScope(dim_decl));
+  si::insertStatementAfter(dim_decl, ghost_var);
+  si::appendExpression(args, sb::buildVarRefExp(ghost_var));
   return;
 }
 
@@ -249,6 +439,11 @@ void ReferenceTranslator::TranslateGet(SgFunctionCallExp *node,
   GridType *gt = ru::GetASTAttribute<GridType>(gv->get_type());
   const StencilIndexList *sil =
       rose_util::GetASTAttribute<GridGetAttribute>(node)->GetStencilIndexList();
+  // The ghost layers of all grids gv may refer to cover the stencil
+  // range of gv, so no wrap around is needed
+  if (is_periodic && is_kernel && HasPeriodicGhost(gv)) {
+    is_periodic = false;
+  }
   SgExpressionPtrList args;
   rose_util::CopyExpressionPtrList(
       node->get_args()->get_expressions(), args);
@@ -257,8 +452,65 @@ void ReferenceTranslator::TranslateGet(SgFunctionCallExp *node,
       rose_util::GetASTAttribute<GridVarAttribute>(gv),
       gt,
       &args, sil, is_kernel, is_periodic);
-  rose_util::GetASTAttribute<GridGetAttribute>(p0)->gv() = gv;  
+  // Gets of bfloat16 grids are wrapped with a conversion call
+  SgExpression *get = p0;
+  if (isSgFunctionCallExp(p0)) {
+    get = isSgFunctionCallExp(p0)->get_args()->get_expressions()[0];
+  }
+  rose_util::GetASTAttribute<GridGetAttribute>(get)->gv() = gv;
   si::replaceExpression(node, p0);
+  // Points in the SoA/AoSoA layouts can only be accessed by members,
+  // which are translated by TranslateGetForUserDefinedType
+  if (builder()->GetUserTypeLayout(gt) != PS_GRID_LAYOUT_AOS &&
+      !isSgDotExp(p0->get_parent())) {
+    LOG_ERROR() << "Getting a whole point is not supported "
+                << "with the SoA/AoSoA layout of "
+                << gt->type_name() << "\n";
+    PSAbort(1);
+  }
+}
+
+void ReferenceTranslator::TranslateGetForUserDefinedType(
+    SgDotExp *node, SgPntrArrRefExp *array_top) {
+  SgExpression *get_exp = node->get_lhs_operand();
+  SgInitializedName *gv = GridGetAnalysis::GetGridVar(get_exp);
+  GridType *gt = rose_util::GetASTAttribute<GridType>(gv->get_type());
+  PSAssert(gt);
+  if (builder()->GetUserTypeLayout(gt) == PS_GRID_LAYOUT_AOS) return;
+  GridGetAttribute *gga =
+      rose_util::GetASTAttribute<GridGetAttribute>(get_exp);
+  SgVarRefExp *member_ref = isSgVarRefExp(node->get_rhs_operand());
+  PSAssert(member_ref);
+  const string &mem_name = rose_util::GetName(member_ref);
+  SgExpressionPtrList indices =
+      GridOffsetAnalysis::GetIndices(
+          GridGetAnalysis::GetOffset(get_exp));
+  SgExpressionPtrList args;
+  rose_util::CopyExpressionPtrList(indices, args);
+  SgExpression *original = node;
+  SgExpression *new_get = NULL;
+  if (array_top == NULL) {
+    new_get = builder()->BuildGridGet(
+        sb::buildVarRefExp(gv->get_name(), si::getScope(node)),
+        rose_util::GetASTAttribute<GridVarAttribute>(gv),
+        gt, &args, gga->GetStencilIndexList(),
+        gga->in_kernel(), gga->is_periodic(), mem_name);
+  } else {
+    // Member is an array
+    SgExpressionVector array_indices;
+    SgExpression *parent;
+    PSAssert(AnalyzeGetArrayMember(node, array_indices, parent));
+    rose_util::ReplaceWithCopy(array_indices);
+    PSAssert(array_top == parent);
+    original = parent;
+    new_get = builder()->BuildGridGet(
+        sb::buildVarRefExp(gv->get_name(), si::getScope(node)),
+        rose_util::GetASTAttribute<GridVarAttribute>(gv),
+        gt, &args, gga->GetStencilIndexList(),
+        gga->in_kernel(), gga->is_periodic(), mem_name,
+        array_indices);
+  }
+  si::replaceExpression(original, new_get);
 }
 
 void ReferenceTranslator::RemoveEmitDummyExp(SgExpression *emit) {
@@ -950,6 +1202,13 @@ void ReferenceTranslator::TranslateRun(SgFunctionCallExp *node,
     SgFunctionDeclaration *trialFunc = GenerateTrial(run, ref);
     si::insertStatementBefore(getContainingFunction(node), trialFunc);
     ref = rose_util::getFunctionRefExp(trialFunc);
+  } else if (flag_jit_specialization_) {
+    // Looked up by name in the code compiled at runtime
+    runFunc->get_declarationModifier().get_storageModifier().setDefault();
+    if (si::is_Cxx_language()) runFunc->set_linkage("C");
+    SgFunctionDeclaration *jitFunc = GenerateJITDispatch(run, runFunc);
+    si::insertStatementBefore(getContainingFunction(node), jitFunc);
+    ref = rose_util::getFunctionRefExp(jitFunc);
   }
 
   SgExprListExp *args = sb::buildExprListExp();
@@ -963,6 +1222,10 @@ void ReferenceTranslator::TranslateRun(SgFunctionCallExp *node,
     si::appendExpression(args, si::copyExpression(original_args.back()));
     --num_remaining_args;
   }
+  if (run->fused_reduce()) {
+    si::appendExpression(args,
+                         si::copyExpression(run->fused_reduce()->buf));
+  }
   for (int i = 0; i < num_remaining_args; ++i) {
     si::appendExpression(args, si::copyExpression(original_args.at(i)));
   }
@@ -975,6 +1238,68 @@ void ReferenceTranslator::TranslateRun(SgFunctionCallExp *node,
 // }
 
 
+/** generate JIT dispatch function
+ * @param[in] run
+ * @param[in] run_func ... generic run function
+ * @return    function declaration
+ *
+ *  static float __PSStencilRun_0_jit(int iter, ...) {
+ *    void *f = __PSJITGetRunFunc(__PSJITSource, "__PSStencilRun_0");
+ *    if (f) return ((float (*)(int, ...))f)(iter, ...);
+ *    return __PSStencilRun_0(iter, ...);
+ *  }
+ */
+SgFunctionDeclaration *ReferenceTranslator::GenerateJITDispatch(
+    Run *run, SgFunctionDeclaration *run_func) {
+  SgFunctionParameterList *parlist = sb::buildFunctionParameterList();
+  const SgInitializedNamePtrList &params = run_func->get_args();
+  FOREACH (it, params.begin(), params.end()) {
+    si::appendArg(parlist, sb::buildInitializedName((*it)->get_name(),
+                                                    (*it)->get_type()));
+  }
+  SgFunctionDeclaration *jit_func =
+      sb::buildDefiningFunctionDeclaration(
+          run->GetName() + "_jit", run_func->get_orig_return_type(),
+          parlist);
+  rose_util::SetFunctionStatic(jit_func);
+  SgBasicBlock *body = jit_func->get_definition()->get_body();
+
+  SgExprListExp *args = sb::buildExprListExp();
+  FOREACH (it, parlist->get_args().begin(), parlist->get_args().end()) {
+    si::appendExpression(args, sb::buildVarRefExp(*it, body));
+  }
+  /* void *f = __PSJITGetRunFunc(__PSJITSource, "__PSStencilRun_0"); */
+  SgVariableDeclaration *f =
+      sb::buildVariableDeclaration(
+          "f", sb::buildPointerType(sb::buildVoidType()),
+          sb::buildAssignInitializer(
+              sb::buildFunctionCallExp(
+                  sb::buildFunctionRefExp(PS_JIT_GET_RUN_FUNC_NAME),
+                  sb::buildExprListExp(
+                      sb::buildOpaqueVarRefExp(PS_JIT_SOURCE_NAME),
+                      sb::buildStringVal(run->GetName())))),
+          body);
+  si::appendStatement(f, body);
+  /* if (f) return ((float (*)(int, ...))f)(iter, ...); */
+  SgExpression *fp = sb::buildCastExp(
+      Var(f), sb::buildPointerType(run_func->get_type()));
+  si::appendStatement(
+      sb::buildIfStmt(
+          Var(f),
+          sb::buildReturnStmt(sb::buildFunctionCallExp(fp, args)),
+          NULL),
+      body);
+  /* return __PSStencilRun_0(iter, ...); */
+  si::appendStatement(
+      sb::buildReturnStmt(
+          sb::buildFunctionCallExp(
+              rose_util::getFunctionRefExp(run_func),
+              isSgExprListExp(si::copyExpression(args)))),
+      body);
+  si::attachComment(jit_func, "Generated by " + string(__FUNCTION__));
+  return jit_func;
+}
+
 void ReferenceTranslator::TranslateSet(SgFunctionCallExp *node,
                                        SgInitializedName *gv) {
   GridType *gt = ru::GetASTAttribute<GridType>(gv->get_type());
@@ -1006,32 +1331,24 @@ void ReferenceTranslator::TranslateReduceGrid(Reduce *rd) {
   GridType *gt = ru::GetASTAttribute<GridType>(gv->get_type());
   SgType *elm_type = gt->point_type();
   
-  SgFunctionSymbol *reduce_grid_func;
-
-  if (isSgTypeFloat(elm_type)) {
-    PSAssert(reduce_grid_func = 
-             si::lookupFunctionSymbolInParentScopes(
-                 "__PSReduceGridFloat",
-                 global_scope_));
-  } else if (isSgTypeDouble(elm_type)) {
-    PSAssert(reduce_grid_func = 
-             si::lookupFunctionSymbolInParentScopes(
-                 "__PSReduceGridDouble",
-                 global_scope_));
-  } else if (isSgTypeInt(elm_type)) {
-    PSAssert(reduce_grid_func = 
-             si::lookupFunctionSymbolInParentScopes(
-                 "__PSReduceGridInt",
-                 global_scope_));
-  } else if (isSgTypeLong(elm_type)) {
-    PSAssert(reduce_grid_func = 
-             si::lookupFunctionSymbolInParentScopes(
-                 "__PSReduceGridLong",
-                 global_scope_));
-  } else {
+  string type_name = GetReduceTypeName(elm_type);
+  if (type_name.empty()) {
     LOG_ERROR() << "Unsupported element type.";
     PSAbort(1);
   }
+  string reduce_grid_func_name = "__PSReduceGrid" + type_name;
+  // Asynchronous reductions return the handle of the task
+  if (rd->IsAsync()) reduce_grid_func_name += "Async";
+
+  SgFunctionSymbol *reduce_grid_func =
+      si::lookupFunctionSymbolInParentScopes(reduce_grid_func_name,
+                                             global_scope_);
+  if (reduce_grid_func == NULL) {
+    LOG_ERROR() << (rd->IsAsync() ?
+                    "Asynchronous reduction not supported by this target.\n" :
+                    "Reduction function not found.\n");
+    PSAbort(1);
+  }
 
   SgFunctionCallExp *original_rdcall = rd->reduce_call();
   SgFunctionCallExp *new_call =
@@ -35,9 +35,40 @@ class ReferenceTranslator : public Translator {
   void set_flag_constant_grid_size_optimization(bool flag) {
     flag_constant_grid_size_optimization_ = flag;
   }
+  //! Returns the ghost-layer width of a grid.
+  /*!
+    \param g The grid.
+    \param width The width of each dimension.
+    \return True if the grid has ghost layers.
+   */
+  virtual bool GetPeriodicGhostWidth(const Grid *g, IntVector &width);
+  //! Returns true if all grids of a variable have ghost layers.
+  virtual bool HasPeriodicGhost(SgInitializedName *gv);
 
  protected:
   bool validate_ast_;
+  //! Fold offsets of statically sized grids into constant strides.
+  /*!
+    Only valid when __PSGridGetOffsetND is computed with the global
+    grid size. Disabled by the targets whose grids are local or
+    device subgrids.
+   */
+  bool flag_constant_grid_offset_optimization_;
+  //! Run stencils with code specialized at runtime when available.
+  /*!
+    Enabled with JIT_SPECIALIZE. Each run is called through a
+    dispatch function that looks up the run function compiled by the
+    runtime for the grid size, and calls the generic one otherwise.
+   */
+  bool flag_jit_specialization_;
+  //! Give periodic grids ghost layers instead of wrapping offsets.
+  /*!
+    Grids accessed with get_periodic are allocated with ghost layers
+    as wide as their stencil range, which are filled before each
+    stencil run, so that periodic gets can use the plain offsets.
+    Only valid with __PSGridNew of the reference runtime.
+   */
+  bool flag_periodic_ghost_;
   //! Fixes inconsistency in AST.
   virtual void FixAST();
   //! Validates AST consistency.
@@ -60,6 +91,12 @@ class ReferenceTranslator : public Translator {
                             SgInitializedName *gv,
                             bool is_kernel,
                             bool is_periodic);
+  //! Translates member accesses of grids in the SoA/AoSoA layouts.
+  /*!
+    Member accesses of grids in the AoS layout are left as is.
+   */
+  virtual void TranslateGetForUserDefinedType(
+      SgDotExp *node, SgPntrArrRefExp *array_top);
   virtual void TranslateEmit(SgFunctionCallExp *node,
                              GridEmitAttribute *attr);
   virtual void RemoveEmitDummyExp(SgExpression *emit);
@@ -75,6 +112,14 @@ class ReferenceTranslator : public Translator {
     return v;
   }
 
+  //! Fuses grid reductions into the stencil runs emitting the grids.
+  /*!
+    A call to PSReduce over a grid that immediately follows a run
+    emitting the grid is removed, and the reduction is instead
+    computed by the run kernel during the last iteration of the run.
+    Enabled by REF_FUSE_REDUCTION.
+   */
+  virtual void FuseReductions();
   virtual void DefineMapSpecificTypesAndFunctions();
   virtual void InsertStencilSpecificType(StencilMap *s,
                                          SgClassDeclaration *type_decl);
@@ -99,6 +144,14 @@ class ReferenceTranslator : public Translator {
    */
   virtual SgFunctionDeclaration *GenerateTrial(
       Run *run, SgFunctionRefExp *ref);
+  //! Generate a function to call a run function specialized at runtime.
+  /*!
+    \param run The stencil run.
+    \param run_func The generic run function.
+    \return A function with the same signature as run_func.
+   */
+  virtual SgFunctionDeclaration *GenerateJITDispatch(
+      Run *run, SgFunctionDeclaration *run_func);
 
   virtual void TranslateReduceGrid(Reduce *rd);
   virtual void TranslateReduceKernel(Reduce *rd);
@@ -109,6 +162,14 @@ class ReferenceTranslator : public Translator {
    */
   virtual SgFunctionDeclaration *BuildReduceGrid(Reduce *rd);
 
+  //! Specializes grid accesses with static grid sizes.
+  /*!
+    PSGridDim and __PSGridGetOffsetND of grids whose sizes are known
+    at compile time are replaced with literal sizes and strides. A
+    grid variable is specialized only when all of the grids it may
+    refer to have the same static size; otherwise the generic code
+    is kept.
+   */
   virtual void optimizeConstantSizedGrids();
   string grid_create_name_;
 #if 0  
@@ -14,7 +14,7 @@ namespace translator {
 Counter Run::c;
 
 Run::Run(SgFunctionCallExp *call, TranslationContext *tx)
-    : call(call), id_(Run::c.next()) {
+    : call(call), fused_reduce_(NULL), id_(Run::c.next()) {
   count_ = Run::findCountArg(call);
   SgExpressionPtrList::iterator begin, end;
   if (ru::IsCLikeLanguage()) {
@@ -8,6 +8,7 @@
 #include "translator/translator_common.h"
 #include "physis/physis_util.h"
 #include "translator/map.h"
+#include "translator/reduce.h"
 
 namespace physis {
 namespace translator {
@@ -20,9 +21,10 @@ class Run {
   typedef std::vector<std::pair<SgExpression*, StencilMap*> >
   StencilMapArgVector;
   StencilMapArgVector stencils_;
+  FusedReduce *fused_reduce_;
  public:
   Run(SgFunctionCallExp *call, TranslationContext *tx);
-  virtual ~Run() {}
+  virtual ~Run() { delete fused_reduce_; }
 
   string GetName() const {
     return "__" + string(PS_STENCIL_RUN_NAME) + "_" + toString(id_);
@@ -31,6 +33,9 @@ class Run {
   const StencilMapArgVector &stencils() const { return stencils_; }
   bool HasCount() const;
   SgExpression *BuildCount() const;
+  //! The reduction fused into this run; NULL if not fused.
+  FusedReduce *fused_reduce() const { return fused_reduce_; }
+  void set_fused_reduce(FusedReduce *fr) { fused_reduce_ = fr; }
 
   static bool isRun(SgFunctionCallExp *call);
   static SgExpression *findCountArg(SgFunctionCallExp *call);
@@ -165,6 +165,7 @@ static void PropagateStencilRangeToGrid(StencilMap &sm, TranslationContext &tx)
       } 
       g->SetStencilRange(gva->sr());
       g->SetMemberStencilRange(gva->member_sr());      
+      if (sm.IsGridPeriodic(gn)) g->set_periodic(true);
       LOG_DEBUG() << "Grid stencil range: "
                   << *g << ", " << g->stencil_range() << "\n";
     }
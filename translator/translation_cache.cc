@@ -0,0 +1,238 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#include "translator/translation_cache.h"
+#include "common/hash.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace physis {
+namespace translator {
+
+namespace {
+
+const char *kManifestName = "MANIFEST";
+
+// Two 64-bit FNV-1a hashes with different offset bases
+class Hasher {
+ public:
+  Hasher(): h1_(kFNVOffsetBasis), h2_(0x84222325cbf29ce4ULL) {}
+  void Update(const string &s) {
+    // Separated from consecutive strings by a null character
+    h1_ = HashFNV1a(s.c_str(), s.size() + 1, h1_);
+    h2_ = HashFNV1a(s.c_str(), s.size() + 1, h2_);
+  }
+  string Digest() const {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%016llx%016llx",
+             (unsigned long long)h1_, (unsigned long long)h2_);
+    return string(buf);
+  }
+ private:
+  uint64_t h1_;
+  uint64_t h2_;
+};
+
+bool ReadFile(const string &path, string &contents) {
+  std::ifstream ifs(path.c_str(), std::ios::binary);
+  if (!ifs) return false;
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  contents = ss.str();
+  return true;
+}
+
+bool WriteFile(const string &path, const string &contents) {
+  std::ofstream ofs(path.c_str(), std::ios::binary);
+  if (!ofs) return false;
+  ofs << contents;
+  return ofs.good();
+}
+
+// Copies a regular file or a symbolic link.
+bool CopyFile(const string &src, const string &dst) {
+  struct stat st;
+  if (lstat(src.c_str(), &st) != 0) return false;
+  if (S_ISLNK(st.st_mode)) {
+    char target[PATH_MAX];
+    ssize_t len = readlink(src.c_str(), target, sizeof(target) - 1);
+    if (len < 0) return false;
+    target[len] = '\0';
+    unlink(dst.c_str());
+    return symlink(target, dst.c_str()) == 0;
+  }
+  string contents;
+  if (!ReadFile(src, contents)) return false;
+  // Written to a temporary file and renamed so that concurrent
+  // processes never see a partial file
+  string tmp = dst + "." + toString(getpid()) + ".tmp";
+  if (!WriteFile(tmp, contents) || rename(tmp.c_str(), dst.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MakeDirectories(const string &path) {
+  for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+    string d = path.substr(0, pos);
+    if (mkdir(d.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    if (pos == string::npos) return true;
+  }
+}
+
+string ShellQuote(const string &s) {
+  string q = "'";
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '\'') q += "'\\''";
+    else q += s[i];
+  }
+  return q + "'";
+}
+
+bool IsCSource(const string &arg) {
+  return endswith(arg, ".c") || endswith(arg, ".cc") ||
+      endswith(arg, ".cpp") || endswith(arg, ".cxx") ||
+      endswith(arg, ".C");
+}
+
+bool IsFortranSource(const string &arg) {
+  return endswith(arg, ".f") || endswith(arg, ".F") ||
+      endswith(arg, ".f90") || endswith(arg, ".F90");
+}
+
+} // namespace
+
+TranslationCache::TranslationCache(const string &dir): dir_(dir) {}
+
+bool TranslationCache::SetUp(const vector<string> &argvec,
+                             const string &config_path) {
+  Hasher h;
+  vector<string> cpp_opts, inputs;
+  // The first argument is the program name
+  for (size_t i = 1; i < argvec.size(); ++i) {
+    const string &arg = argvec[i];
+    h.Update(arg);
+    if (startswith(arg, "-I") || startswith(arg, "-D") ||
+        startswith(arg, "-U")) {
+      cpp_opts.push_back(arg);
+    } else if (IsFortranSource(arg)) {
+      // Module files read by the frontend are not tracked
+      LOG_DEBUG() << "Fortran input is not cached\n";
+      return false;
+    } else if (arg[0] != '-' && IsCSource(arg)) {
+      inputs.push_back(arg);
+    }
+  }
+  if (inputs.size() == 0) return false;
+
+  const char *cpp = getenv("PHYSISC_CACHE_CPP");
+  StringJoin cmd_opts(" ");
+  FOREACH (it, cpp_opts.begin(), cpp_opts.end()) {
+    cmd_opts << ShellQuote(*it);
+  }
+  FOREACH (it, inputs.begin(), inputs.end()) {
+    string cmd = string(cpp && *cpp ? cpp : "cpp") + " " +
+        cmd_opts.str() + " " + ShellQuote(*it);
+    LOG_DEBUG() << "Preprocessing for the cache key: " << cmd << "\n";
+    FILE *fp = popen(cmd.c_str(), "r");
+    if (fp == NULL) return false;
+    string out;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) out.append(buf, n);
+    if (pclose(fp) != 0) {
+      LOG_WARNING() << "Preprocessing failed; translation not cached\n";
+      return false;
+    }
+    // Line markers contain the input path, which is already hashed
+    h.Update(out);
+  }
+
+  if (!config_path.empty()) {
+    string config;
+    if (!ReadFile(config_path, config)) return false;
+    h.Update(config);
+  }
+  // Generated code may refer to files by absolute paths
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == NULL) return false;
+  h.Update(cwd);
+  string exe;
+  if (ReadFile("/proc/self/exe", exe)) {
+    h.Update(exe);
+  } else {
+    h.Update(__DATE__ " " __TIME__);
+  }
+  key_ = h.Digest();
+
+  if (!MakeDirectories(dir_)) {
+    LOG_WARNING() << "Cannot create the translation cache directory "
+                  << dir_ << "\n";
+    return false;
+  }
+  LOG_DEBUG() << "Translation cache key: " << key_ << "\n";
+  return true;
+}
+
+bool TranslationCache::Restore() {
+  string entry = GetEntryPath();
+  string manifest;
+  if (!ReadFile(entry + "/" + kManifestName, manifest)) return false;
+  std::istringstream iss(manifest);
+  string name;
+  while (std::getline(iss, name)) {
+    if (name.empty()) continue;
+    if (!CopyFile(entry + "/" + name, name)) {
+      LOG_WARNING() << "Cannot restore " << name
+                    << " from the translation cache\n";
+      return false;
+    }
+    LOG_INFO() << "Output file restored from cache: " << name << "\n";
+  }
+  return true;
+}
+
+void TranslationCache::Store(const vector<string> &outputs) {
+  string entry = GetEntryPath();
+  string tmp = entry + "." + toString(getpid()) + ".tmp";
+  if (mkdir(tmp.c_str(), 0755) != 0) {
+    LOG_WARNING() << "Cannot create " << tmp << "\n";
+    return;
+  }
+  string manifest;
+  bool ok = true;
+  FOREACH (it, outputs.begin(), outputs.end()) {
+    if (it->find('/') != string::npos ||
+        !CopyFile(*it, tmp + "/" + *it)) {
+      LOG_WARNING() << "Cannot cache " << *it << "\n";
+      ok = false;
+      break;
+    }
+    manifest += *it + "\n";
+  }
+  // The manifest is written last as it marks a complete entry
+  ok = ok && WriteFile(tmp + "/" + kManifestName, manifest);
+  if (ok && rename(tmp.c_str(), entry.c_str()) == 0) {
+    LOG_DEBUG() << "Translation cached in " << entry << "\n";
+    return;
+  }
+  // Not an error if another process has stored the same entry
+  FOREACH (it, outputs.begin(), outputs.end()) {
+    unlink((tmp + "/" + *it).c_str());
+  }
+  unlink((tmp + "/" + kManifestName).c_str());
+  rmdir(tmp.c_str());
+}
+
+} // namespace translator
+} // namespace physis
@@ -0,0 +1,53 @@
+// Licensed under the BSD license. See LICENSE.txt for more details.
+
+#ifndef PHYSIS_TRANSLATOR_TRANSLATION_CACHE_H_
+#define PHYSIS_TRANSLATOR_TRANSLATION_CACHE_H_
+
+#include "translator/translator_common.h"
+
+namespace physis {
+namespace translator {
+
+//! Caches translated files to skip the frontend on unchanged inputs.
+/*!
+  The key is a hash of the preprocessed input sources, the frontend
+  command line, which includes the target macro, the configuration
+  file contents, the current directory, and the physisc executable
+  itself. The input is preprocessed with the command given by
+  PHYSISC_CACHE_CPP ("cpp" by default) using only the -I, -D and -U
+  options of the command line.
+
+  Each entry is a directory holding the output files, including the
+  auto-tuning variant sources and the links to shared libraries of
+  duplicate variants, and a manifest listing them.
+ */
+class TranslationCache {
+ public:
+  explicit TranslationCache(const string &dir);
+  virtual ~TranslationCache() {}
+  //! Computes the cache key.
+  /*!
+    \param argvec Frontend command line.
+    \param config_path Configuration file path; empty if not given.
+    \return False if the inputs cannot be cached.
+   */
+  bool SetUp(const vector<string> &argvec, const string &config_path);
+  //! Copies the cached output files to the current directory.
+  /*!
+    \return True on a cache hit.
+   */
+  bool Restore();
+  //! Stores output files in the current directory.
+  void Store(const vector<string> &outputs);
+  const string &key() const { return key_; }
+
+ protected:
+  string dir_;
+  string key_;
+  string GetEntryPath() const { return dir_ + "/" + key_; }
+};
+
+} // namespace translator
+} // namespace physis
+
+#endif /* PHYSIS_TRANSLATOR_TRANSLATION_CACHE_H_ */